@@ -0,0 +1,80 @@
+#include <vector>
+
+#include "bench_common.h"
+#include "frame_accumulator.h"
+#include "frame_provider.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+// Steps through the sequence with a window of `window` frames as the viewer does (fetch the frame, then advance
+// the window), and against reloading every frame of the window at each step.
+void bench_window(const FrameSourcePtr &source, size_t points, int window, const BenchOptions &options)
+{
+    AccumulationConfig config;
+    config.frames = window;
+    config.use_pose = true;
+
+    DurationHistogram step, merge;
+    size_t fetched = 0, merged_points = 0;
+    int steps = 0, without_pose = 0;
+    double reload_ms = 0.0;
+    {
+        QuietStdout quiet;
+        FrameProvider provider(source);
+        FrameAccumulator accumulator(provider, config);
+
+        accumulator.advance(provider.get(0));
+        for (int index = 1; index < source->size(); ++index)
+        {
+            auto start = std::chrono::steady_clock::now();
+            FramePtr frame = provider.get(index);
+            fetched += accumulator.advance(frame);
+            step.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            merge.add(accumulator.merge_ms());
+            ++steps;
+        }
+        merged_points = accumulator.cloud()->size();
+        without_pose = accumulator.frames_without_pose();
+
+        // Without the ring : every frame of the window is decoded again at each step.
+        int last = source->size() - 1;
+        reload_ms = 1e3 * time_best_of(options.repeat, [&] {
+            for (int index = std::max(0, last - window + 1); index <= last; ++index)
+            {
+                load_frame(*source, index);
+            }
+        });
+    }
+
+    BenchRecord("accumulate")
+        .field("points", points)
+        .field("window", window)
+        .field("steps", steps)
+        .field("fetched_per_step", steps > 0 ? double(fetched) / steps : 0.0)
+        .field("merged_points", merged_points)
+        .field("frames_without_pose", without_pose)
+        .field("step_p50_ms", step.percentile(0.5))
+        .field("step_p95_ms", step.percentile(0.95))
+        .field("merge_p50_ms", merge.percentile(0.5))
+        .field("reload_window_ms", reload_ms)
+        .print();
+}
+
+} // namespace
+
+
+void bench_accumulate(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        SyntheticSequence sequence(n, 0, std::max(options.frames, 2));
+        FrameSourcePtr source(new PcdFileSource(sequence.pcd_files, sequence.annot_dir));
+        for (int window : {5, 10})
+        {
+            bench_window(source, n, window, options);
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <boost/foreach.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "bbox3d.h"
+#include "bench_common.h"
+
+
+namespace
+{
+
+// load_annot as it was before the streaming parser (boost::property_tree), kept as the reference for output and speed.
+bool load_annot_reference(const std::string &annot_file, std::vector<BBox3D> &bboxes)
+{
+    namespace bpt = boost::property_tree;
+
+    bpt::ptree pt;
+    try
+    {
+        bpt::read_json(annot_file, pt);
+    }
+    catch (const bpt::ptree_error &e)
+    {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+
+    bpt::ptree lidar_0 = pt.get_child("Lidar").begin()->second;
+    Eigen::Vector3f lidar_0_trans(
+        lidar_0.get<float>("Location.x"), lidar_0.get<float>("Location.y"), lidar_0.get<float>("Location.z"));
+    Eigen::Quaternionf lidar_0_quat(
+        lidar_0.get<float>("Rotation.w"), lidar_0.get<float>("Rotation.x"), lidar_0.get<float>("Rotation.y"), lidar_0.get<float>("Rotation.z"));
+
+    int count = 0;
+    BOOST_FOREACH (const bpt::ptree::value_type &child, pt.get_child("BoundingBox3D"))
+    {
+        const bpt::ptree &info = child.second;
+
+        Eigen::Vector3f bbox_center(info.get<float>("Origin.x"), info.get<float>("Origin.y"), info.get<float>("Origin.z"));
+        Eigen::Vector3f bbox_center_lidar_coord = lidar_0_quat.inverse() * (bbox_center - lidar_0_trans);
+        Eigen::Quaternionf bbox_rot(
+            info.get<float>("Rotation.w"), info.get<float>("Rotation.x"), info.get<float>("Rotation.y"), info.get<float>("Rotation.z"));
+        Eigen::Quaternionf bbox_rot_lidar_coord = lidar_0_quat.inverse() * bbox_rot;
+
+        float width = info.get<float>("Extent.x");
+        float height = info.get<float>("Extent.z");
+        float depth = info.get<float>("Extent.y");
+
+        std::string id = info.get<std::string>("Label") + "_";
+        id += std::to_string(count);
+
+        bboxes.push_back(BBox3D{bbox_center_lidar_coord, bbox_rot_lidar_coord, width, height, depth, id});
+        ++count;
+    }
+    return true;
+}
+
+bool same_bboxes(const std::vector<BBox3D> &a, const std::vector<BBox3D> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].translation != b[i].translation || a[i].rotation.coeffs() != b[i].rotation.coeffs() ||
+            a[i].width != b[i].width || a[i].height != b[i].height || a[i].depth != b[i].depth || a[i].id != b[i].id)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+// Annotation file in the recorder's layout, with the extra members it writes for each box.
+void write_synthetic_annot(const std::string &file, int num_boxes, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> yaw(-3.14159265f, 3.14159265f);
+    const char *labels[] = {"Car", "Pedestrian", "Cyclist", "Truck"};
+
+    std::ofstream os(file);
+    os.precision(9);
+    os << "{\n    \"Lidar\": {\n        \"lidar_0\": {\n"
+       << "            \"Location\": {\"x\": 12.5, \"y\": -3.25, \"z\": 1.8},\n"
+       << "            \"Rotation\": {\"w\": 0.99875, \"x\": 0.0, \"y\": 0.0, \"z\": 0.049979}\n"
+       << "        }\n    },\n    \"BoundingBox3D\": [";
+    for (int i = 0; i < num_boxes; ++i)
+    {
+        float half_yaw = 0.5f * yaw(rng);
+        os << (i ? ",\n" : "\n")
+           << "        {\n"
+           << "            \"Label\": \"" << labels[i % 4] << "\",\n"
+           << "            \"Occluded\": false,\n"
+           << "            \"Attributes\": {\"moving\": \"true\", \"track\": " << i << "},\n"
+           << "            \"Origin\": {\"x\": " << position(rng) << ", \"y\": " << position(rng) << ", \"z\": " << 0.1f * position(rng) << "},\n"
+           << "            \"Rotation\": {\"w\": " << std::cos(half_yaw) << ", \"x\": 0.0, \"y\": 0.0, \"z\": " << std::sin(half_yaw) << "},\n"
+           << "            \"Extent\": {\"x\": " << size(rng) << ", \"y\": " << size(rng) << ", \"z\": " << size(rng) << "}\n"
+           << "        }";
+    }
+    os << "\n    ]\n}\n";
+}
+
+void bench_annot(const BenchOptions &options)
+{
+    TempDirectory dir;
+    for (int num_boxes : options.boxes_or({10, 100, 1000}))
+    {
+        std::string file = (dir.path / "annot.json").string();
+        write_synthetic_annot(file, num_boxes, num_boxes);
+
+        std::vector<BBox3D> reference, parsed;
+        bool identical = load_annot_reference(file, reference) && load_annot(file, parsed) && same_bboxes(reference, parsed);
+
+        // The viewer reloads into the frame's vector, cleared beforehand.
+        double t_reference = time_best_of(options.repeat, [&] {
+            reference.clear();
+            load_annot_reference(file, reference);
+        });
+        double t_parsed = time_best_of(options.repeat, [&] {
+            parsed.clear();
+            load_annot(file, parsed);
+        });
+
+        BenchRecord("annot_load")
+            .field("boxes", num_boxes)
+            .field("reference_ms", t_reference * 1e3)
+            .field("parser_ms", t_parsed * 1e3)
+            .field("speedup", t_reference / t_parsed)
+            .check("identical", identical)
+            .print();
+    }
+}
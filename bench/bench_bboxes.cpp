@@ -0,0 +1,166 @@
+#include <cmath>
+#include <random>
+
+#include "bbox3d.h"
+#include "bbox_slots.h"
+#include "bench_common.h"
+
+
+namespace
+{
+
+std::vector<BBox3D> make_synthetic_bboxes(int n, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> yaw(-3.14159265f, 3.14159265f);
+
+    std::vector<BBox3D> bboxes;
+    for (int i = 0; i < n; ++i)
+    {
+        Eigen::Vector3f translation(position(rng), position(rng), 0.05f * position(rng));
+        Eigen::Quaternionf rotation(Eigen::AngleAxisf(yaw(rng), Eigen::Vector3f::UnitZ()));
+        float width = size(rng), height = size(rng), depth = size(rng);
+        bboxes.push_back(BBox3D{translation, rotation, width, height, depth, "Car_" + std::to_string(i)});
+    }
+    return bboxes;
+}
+
+// Largest distance between the wireframe corners and those of the cube addCube(translation, rotation, width, depth, height)
+// draws : a unit cube scaled, rotated then translated.
+float max_corner_error(const std::vector<BBox3D> &bboxes, const BBoxWireframe &wireframe)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < bboxes.size(); ++i)
+    {
+        const BBox3D &bbox = bboxes[i];
+        Eigen::Affine3f pose = Eigen::Translation3f(bbox.translation) * bbox.rotation;
+        for (int k = 0; k < 8; ++k)
+        {
+            Eigen::Vector3f local(
+                ((k & 1) ? 0.5f : -0.5f) * bbox.width, ((k & 2) ? 0.5f : -0.5f) * bbox.depth, ((k & 4) ? 0.5f : -0.5f) * bbox.height);
+            Eigen::Vector3f expected = pose * local;
+            Eigen::Vector3f corner(wireframe.vertices.data() + (i * 8 + k) * 3);
+            error = std::max(error, (corner - expected).norm());
+        }
+    }
+    return error;
+}
+
+// Next frame of `bboxes` : 10 % of the boxes moved a little, 5 % gone and as many new ids.
+std::vector<BBox3D> next_synthetic_bboxes(const std::vector<BBox3D> &bboxes, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> step(-0.2f, 0.2f);
+    std::vector<BBox3D> next;
+    int n = int(bboxes.size());
+    for (int i = 0; i < n; ++i)
+    {
+        if (i % 20 == 7)
+        {
+            continue;
+        }
+        next.push_back(bboxes[i]);
+        if (i % 10 == 3)
+        {
+            next.back().translation += Eigen::Vector3f(step(rng), step(rng), 0.0f);
+        }
+    }
+    std::vector<BBox3D> fresh = make_synthetic_bboxes(n / 20, seed);
+    for (size_t j = 0; j < fresh.size(); ++j)
+    {
+        fresh[j].id = "Pedestrian_" + std::to_string(j);
+        next.push_back(fresh[j]);
+    }
+    return next;
+}
+
+// Corners rewritten for the changed slots only, as the overlay does, against every slot recomputed.
+bool incremental_corners_match(const BBoxSlots &slots, const BBoxChanges &changes, std::vector<float> &vertices)
+{
+    vertices.resize(slots.size() * 8 * 3);
+    for (const std::vector<uint32_t> *rewritten : {&changes.added, &changes.updated, &changes.relocated})
+    {
+        for (uint32_t slot : *rewritten)
+        {
+            bbox_corners(slots.box(slot), vertices.data() + slot * 8 * 3);
+        }
+    }
+    float expected[8 * 3];
+    for (uint32_t slot = 0; slot < slots.size(); ++slot)
+    {
+        bbox_corners(slots.box(slot), expected);
+        if (!std::equal(expected, expected + 8 * 3, vertices.data() + slot * 8 * 3))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void bench_diff_bboxes(int num_boxes, const BenchOptions &options)
+{
+    std::vector<BBox3D> frame = make_synthetic_bboxes(num_boxes, num_boxes);
+    std::vector<BBox3D> next = next_synthetic_bboxes(frame, num_boxes + 1);
+
+    BBoxSlots slots;
+    std::vector<float> vertices;
+    slots.update(frame);
+    bool identical = incremental_corners_match(slots, slots.changes(), vertices);
+    BBoxChanges changes = slots.update(next);
+    identical = identical && incremental_corners_match(slots, changes, vertices) && slots.size() == next.size();
+    // Back and forth between the two frames.
+    double t_update = time_best_of(options.repeat, [&] {
+        slots.update(frame);
+        slots.update(next);
+    }) / 2.0;
+
+    size_t touched = changes.added.size() + changes.updated.size() + changes.removed.size();
+    BenchRecord("bbox_diff")
+        .field("boxes", num_boxes)
+        .field("next_boxes", next.size())
+        .field("added", changes.added.size())
+        .field("updated", changes.updated.size())
+        .field("removed", changes.removed.size())
+        .field("unchanged", changes.unchanged + changes.relocated.size())
+        .field("corners_rewritten", changes.added.size() + changes.updated.size() + changes.relocated.size())
+        .field("update_us", t_update * 1e6)
+        .check("identical", identical)
+        // Label actors added, moved or removed per step : formerly every label removed and added again.
+        .field("label_ops_before", frame.size() + next.size())
+        .field("label_ops_after", touched)
+        .print();
+}
+
+} // namespace
+
+
+void bench_bboxes(const BenchOptions &options)
+{
+    for (int num_boxes : options.boxes_or({10, 200, 1000}))
+    {
+        std::vector<BBox3D> bboxes = make_synthetic_bboxes(num_boxes, num_boxes);
+        BBoxWireframe wireframe;
+        build_bbox_wireframe(bboxes, wireframe);
+        float error = max_corner_error(bboxes, wireframe);
+
+        // Frame to frame with the same number of boxes, as the overlay does : buffers and edges are reused.
+        double t_build = time_best_of(options.repeat, [&] { build_bbox_wireframe(bboxes, wireframe); });
+
+        BenchRecord("bbox_wireframe")
+            .field("boxes", num_boxes)
+            .field("build_us", t_build * 1e6)
+            .field("ns_per_box", t_build * 1e9 / std::max(num_boxes, 1))
+            .field("vertices", wireframe.vertices.size() / 3)
+            .field("edges", wireframe.indices.size() / 2)
+            .field("max_corner_error", error)
+            // Formerly a cube and a 3D text actor per box, now one line actor (+ one text per box with labels).
+            .field("actors_before", 2 * num_boxes)
+            .field("actors_after", 1)
+            .field("actors_after_with_labels", 1 + num_boxes)
+            .print();
+
+        bench_diff_bboxes(num_boxes, options);
+    }
+}
@@ -0,0 +1,194 @@
+#include <cmath>
+#include <cstring>
+
+#include "bench_common.h"
+
+
+namespace
+{
+
+// apply_color as it was before the LUT/AVX2 rewrite, kept as the reference for output and speed.
+void apply_color_reference(PointCloudT::Ptr cloud, int filtering_axis_, int color_mode_)
+{
+    double min, max;
+    switch (filtering_axis_)
+    {
+    case 0:
+        min = (*cloud)[0].x;
+        max = (*cloud)[0].x;
+        break;
+    case 1:
+        min = (*cloud)[0].y;
+        max = (*cloud)[0].y;
+        break;
+    default:
+        min = (*cloud)[0].z;
+        max = (*cloud)[0].z;
+        break;
+    }
+
+    for (PointCloudT::iterator cloud_it = cloud->begin(); cloud_it != cloud->end(); ++cloud_it)
+    {
+        switch (filtering_axis_)
+        {
+        case 0:
+            if (min > cloud_it->x)
+                min = cloud_it->x;
+            if (max < cloud_it->x)
+                max = cloud_it->x;
+            break;
+        case 1:
+            if (min > cloud_it->y)
+                min = cloud_it->y;
+            if (max < cloud_it->y)
+                max = cloud_it->y;
+            break;
+        default:
+            if (min > cloud_it->z)
+                min = cloud_it->z;
+            if (max < cloud_it->z)
+                max = cloud_it->z;
+            break;
+        }
+    }
+
+    double lut_scale = 255.0 / (max - min);
+    if (min == max)
+        lut_scale = 1.0;
+
+    for (PointCloudT::iterator cloud_it = cloud->begin(); cloud_it != cloud->end(); ++cloud_it)
+    {
+        int value;
+        switch (filtering_axis_)
+        {
+        case 0:
+            value = std::lround((cloud_it->x - min) * lut_scale);
+            break;
+        case 1:
+            value = std::lround((cloud_it->y - min) * lut_scale);
+            break;
+        default:
+            value = std::lround((cloud_it->z - min) * lut_scale);
+            break;
+        }
+
+        switch (color_mode_)
+        {
+        case 0:
+            cloud_it->r = value;
+            cloud_it->g = 0;
+            cloud_it->b = 255 - value;
+            break;
+        case 1:
+            cloud_it->r = value;
+            cloud_it->g = 255 - value;
+            cloud_it->b = value;
+            break;
+        case 2:
+            cloud_it->r = 255;
+            cloud_it->g = 255 - value;
+            cloud_it->b = 255 - value;
+            break;
+        case 3:
+            if (value > 128)
+            {
+                cloud_it->r = 255;
+                cloud_it->g = 0;
+                cloud_it->b = 0;
+            }
+            else
+            {
+                cloud_it->r = 128;
+                cloud_it->g = 128;
+                cloud_it->b = 128;
+            }
+            break;
+        default:
+            cloud_it->r = value > 128 ? (value - 128) * 2 : 0;
+            cloud_it->g = value < 128 ? 2 * value : 255 - ((value - 128) * 2);
+            cloud_it->b = value < 128 ? 255 - (2 * value) : 0;
+        }
+    }
+}
+
+bool same_colors(const PointCloudT &a, const PointCloudT &b)
+{
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].rgba != b[i].rgba)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+void bench_color(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        PointCloudT::Ptr cloud = make_synthetic_cloud(n, 1);
+        // Flat and degenerate values exercise the rounding / NaN paths of the kernels.
+        if (n > 2)
+        {
+            (*cloud)[1].z = std::nanf("");
+            (*cloud)[2].x = (*cloud)[0].x;
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int mode = 0; mode < 5; ++mode)
+            {
+                PointCloudT::Ptr reference(new PointCloudT(*cloud));
+                PointCloudT::Ptr colored(new PointCloudT(*cloud));
+                apply_color_reference(reference, axis, mode);
+                apply_color(colored, axis, mode);
+                bool identical = same_colors(*reference, *colored);
+
+                double t_reference = time_best_of(options.repeat, [&] { apply_color_reference(reference, axis, mode); });
+                double t_colored = time_best_of(options.repeat, [&] { apply_color(colored, axis, mode); });
+
+                BenchRecord("apply_color")
+                    .field("points", n)
+                    .field("axis", axis)
+                    .field("mode", mode)
+                    .field("reference_points_per_sec", n / t_reference)
+                    .field("points_per_sec", n / t_colored)
+                    .field("speedup", t_reference / t_colored)
+                    .check("identical", identical)
+                    .print();
+            }
+        }
+
+        // Sources without a reference implementation : range and per-point values, per-frame and fixed range.
+        std::vector<float> intensity(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            intensity[i] = float(i % 256);
+        }
+        for (int source : {COLOR_SOURCE_RANGE, COLOR_SOURCE_INTENSITY})
+        {
+            for (bool fixed_range : {false, true})
+            {
+                ColorConfig config;
+                config.source = source;
+                config.fixed_range = fixed_range;
+                config.range_min = 0.0f;
+                config.range_max = 100.0f;
+                PointCloudT::Ptr colored(new PointCloudT(*cloud));
+                double t_colored = time_best_of(options.repeat, [&] { apply_color(colored, config, &intensity); });
+
+                BenchRecord("apply_color")
+                    .field("points", n)
+                    .field("source", source == COLOR_SOURCE_RANGE ? "range" : "intensity")
+                    .field("range", fixed_range ? "fixed" : "frame")
+                    .field("points_per_sec", n / t_colored)
+                    .field("ms", t_colored * 1e3)
+                    .print();
+            }
+        }
+    }
+}
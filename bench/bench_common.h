@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "bbox3d.h"
+#include "pointcloud_processing.h"
+
+
+struct BenchOptions
+{
+    std::vector<size_t> points = {300000};
+    std::vector<int> boxes;  // box counts of the annotation benchmarks, empty for their own defaults
+    int repeat = 5;
+    int frames = 10;         // frames of the synthetic sequences of the pipeline, playback and accumulate benchmarks
+    std::vector<double> fps = {10.0, 30.0, 100.0};  // target rates of the playback benchmark
+    // Real sequence for the pipeline benchmark instead of synthetic ones.
+    std::string pcd_path;
+    std::string annotation_path;
+
+    std::vector<int> boxes_or(const std::vector<int> &defaults) const
+    {
+        return this->boxes.empty() ? defaults : this->boxes;
+    }
+};
+
+// Checks of the records printed so far that failed (see BenchRecord::check), main exits non-zero when there is any.
+inline int &bench_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+// One measurement, printed as a single JSON line so that runs can be diffed / parsed by scripts.
+class BenchRecord
+{
+public:
+    explicit BenchRecord(const std::string &bench)
+    {
+        this->os << "{\"bench\":\"" << bench << "\"";
+    }
+
+    BenchRecord &field(const std::string &key, const std::string &value)
+    {
+        this->os << ",\"" << key << "\":\"" << value << "\"";
+        return *this;
+    }
+
+    BenchRecord &field(const std::string &key, const char *value)
+    {
+        return this->field(key, std::string(value));
+    }
+
+    BenchRecord &field(const std::string &key, bool value)
+    {
+        this->os << ",\"" << key << "\":" << (value ? "true" : "false");
+        return *this;
+    }
+
+    // Field holding the result of a correctness check of the measurement, counted in bench_failures() when false.
+    BenchRecord &check(const std::string &key, bool passed)
+    {
+        if (!passed)
+        {
+            ++bench_failures();
+            std::cerr << "check '" << key << "' failed : " << this->os.str() << "}" << std::endl;
+        }
+        return this->field(key, passed);
+    }
+
+    template <typename T>
+    BenchRecord &field(const std::string &key, T value)
+    {
+        this->os << ",\"" << key << "\":" << value;
+        return *this;
+    }
+
+    void print() const
+    {
+        std::cout << this->os.str() << "}" << std::endl;
+    }
+
+private:
+    std::ostringstream os;
+};
+
+// Discards what the code under test prints to std::cout (detected files, loaded annotations) while it lives, so that
+// stdout only carries the JSON lines. Has to outlive the threads that may print.
+class QuietStdout
+{
+public:
+    QuietStdout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietStdout() { std::cout.rdbuf(this->saved); }
+
+private:
+    std::streambuf *saved;
+};
+
+// Temporary directory for generated input files, removed on destruction.
+struct TempDirectory
+{
+    boost::filesystem::path path;
+
+    TempDirectory()
+    {
+        namespace bfs = boost::filesystem;
+        this->path = bfs::temp_directory_path() / bfs::unique_path("cloud_viewer_bench_%%%%%%%%");
+        bfs::create_directories(this->path);
+    }
+
+    ~TempDirectory()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(this->path, ec);
+    }
+};
+
+// Best (minimum) wall time in seconds of `repeat` runs of f(), after one warm-up run.
+template <typename F>
+double time_best_of(int repeat, F &&f)
+{
+    f();
+    double best = 1e30;
+    for (int r = 0; r < std::max(repeat, 1); ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Rotating-LiDAR-like cloud : rings of points around the origin with some height variation.
+inline PointCloudT::Ptr make_synthetic_cloud(size_t n, unsigned seed = 0)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> range(2.0f, 80.0f);
+    std::uniform_real_distribution<float> azimuth(-3.14159265f, 3.14159265f);
+    std::uniform_real_distribution<float> height(-2.0f, 6.0f);
+
+    PointCloudT::Ptr cloud(new PointCloudT);
+    cloud->resize(n);
+    for (PointT &p : cloud->points)
+    {
+        float r = range(rng), a = azimuth(rng);
+        p.x = r * std::cos(a);
+        p.y = r * std::sin(a);
+        p.z = height(rng);
+        p.r = p.g = p.b = 0;
+    }
+    return cloud;
+}
+
+// `n` boxes spread over the area of make_synthetic_cloud, turned around z, labelled car, pedestrian and truck in turn.
+std::vector<BBox3D> make_synthetic_boxes(int n, unsigned seed);
+
+// Annotation file in the recorder's layout with `num_boxes` random boxes.
+void write_synthetic_annot(const std::string &file, int num_boxes, unsigned seed);
+
+// Sequence of synthetic binary pcd files, with an annotation file of `boxes` boxes per frame.
+struct SyntheticSequence
+{
+    TempDirectory dir;
+    std::string pcd_dir;
+    std::string annot_dir;
+    std::vector<std::string> pcd_files;  // in frame order
+
+    SyntheticSequence(size_t points, int boxes, int frames);
+};
+
+void bench_accumulate(const BenchOptions &options);
+void bench_annot(const BenchOptions &options);
+void bench_bboxes(const BenchOptions &options);
+void bench_color(const BenchOptions &options);
+void bench_compress(const BenchOptions &options);
+void bench_convert(const BenchOptions &options);
+void bench_decimate(const BenchOptions &options);
+void bench_diff(const BenchOptions &options);
+void bench_filter(const BenchOptions &options);
+void bench_frames(const BenchOptions &options);
+void bench_index(const BenchOptions &options);
+void bench_live(const BenchOptions &options);
+void bench_pcd(const BenchOptions &options);
+void bench_pipeline(const BenchOptions &options);
+void bench_playback(const BenchOptions &options);
+void bench_spatial(const BenchOptions &options);
+void bench_summary(const BenchOptions &options);
@@ -0,0 +1,79 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "bench_common.h"
+#include "frame.h"
+
+
+void bench_compress(const BenchOptions &options)
+{
+    const int drive_frames = 2000;
+
+    for (size_t n : options.points)
+    {
+        Frame frame;
+        frame.index = 0;
+        frame.cloud = make_synthetic_cloud(n);
+        frame.intensity.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            frame.intensity[i] = float(i % 256);
+        }
+        frame.color_version = 0;
+        frame.full_colored = false;
+        frame.full_color_version = 0;
+        frame.load_ms = frame.filter_ms = frame.decimate_ms = frame.color_ms = 0.0;
+        size_t raw_bytes = frame_size_bytes(frame);
+
+        for (PointCodec codec : {POINT_CODEC_FLOAT, POINT_CODEC_QUANT16})
+        {
+            CompressedFramePtr compressed;
+            double t_encode = time_best_of(options.repeat, [&] { compressed = compress_frame(frame, codec); });
+            size_t bytes = compressed_frame_size_bytes(*compressed);
+
+            // Decoded into recycled clouds as the cache does in steady state, then coloured as before display.
+            CloudPool pool(2);
+            FramePipelineConfig pipeline;
+            FramePtr decoded;
+            double t_decode = time_best_of(options.repeat, [&] {
+                decoded.reset();
+                decoded = decompress_frame(*compressed, &pool);
+            });
+            double t_decode_color = time_best_of(options.repeat, [&] {
+                decoded.reset();
+                decoded = decompress_frame(*compressed, &pool);
+                update_frame_color(*decoded, pipeline);
+            });
+
+            float max_error = 0.0f, max_intensity_error = 0.0f, max_coordinate = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                const PointT &a = frame.cloud->points[i], &b = decoded->cloud->points[i];
+                max_error = std::max({max_error, std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z)});
+                max_coordinate = std::max({max_coordinate, std::abs(a.x), std::abs(a.y), std::abs(a.z)});
+                max_intensity_error = std::max(max_intensity_error, std::abs(frame.intensity[i] - decoded->intensity[i]));
+            }
+            // Bound of the codec, plus float rounding of the decoded coordinates.
+            float bound = compressed->cloud.max_error().maxCoeff() + 4.0f * std::numeric_limits<float>::epsilon() * max_coordinate;
+
+            BenchRecord("compress")
+                .field("points", n)
+                .field("codec", point_codec_name(codec))
+                .field("raw_bytes_per_point", double(raw_bytes) / n)
+                .field("bytes_per_point", double(bytes) / n)
+                .field("ratio", double(raw_bytes) / bytes)
+                .field("drive_raw_gb", double(raw_bytes) * drive_frames / (1024.0 * 1024.0 * 1024.0))
+                .field("drive_gb", double(bytes) * drive_frames / (1024.0 * 1024.0 * 1024.0))
+                .field("encode_ms", t_encode * 1e3)
+                .field("decode_ms", t_decode * 1e3)
+                .field("decode_mpoints_per_sec", n / t_decode / 1e6)
+                .field("decode_mb_per_sec", double(raw_bytes) / t_decode / (1024.0 * 1024.0))
+                .field("decode_color_ms", t_decode_color * 1e3)
+                .field("max_error_m", max_error)
+                .field("max_intensity_error", max_intensity_error)
+                .check("within_bound", max_error <= bound && (codec != POINT_CODEC_FLOAT || max_intensity_error == 0.0f))
+                .print();
+        }
+    }
+}
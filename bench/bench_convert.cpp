@@ -0,0 +1,148 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "batch_convert.h"
+#include "bench_common.h"
+#include "pcd_reader.h"
+
+
+namespace
+{
+
+// FNV-1a of every file of `dir`, in name order : equal for identical outputs.
+uint64_t directory_hash(const boost::filesystem::path &dir)
+{
+    namespace bfs = boost::filesystem;
+    std::vector<bfs::path> files(bfs::directory_iterator(dir), bfs::directory_iterator{});
+    std::sort(files.begin(), files.end());
+    uint64_t hash = 1469598103934665603ull;
+    for (const bfs::path &file : files)
+    {
+        std::ifstream is(file.string(), std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        for (char c : file.filename().string() + data)
+        {
+            hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// The first frame read back from the output against the pipeline run in memory : points, colours and boxes.
+bool check_round_trip(const FrameSource &source, const ConvertOptions &options)
+{
+    FramePtr frame = load_frame(source, 0, options.pipeline);
+    PointCloudT cloud;
+    std::vector<float> intensity;
+    std::vector<BBox3D> bboxes;
+    if (!frame || !read_pcd_mmap(convert_output_path(options.output_dir, source.name(0), ".pcd"), cloud, intensity)
+        || !load_annot(convert_output_path(options.output_dir, source.name(0), ".json"), bboxes)
+        || cloud.size() != frame->cloud->size() || bboxes.size() != frame->bboxes.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < cloud.size(); ++i)
+    {
+        const PointT &p = cloud.points[i], &q = frame->cloud->points[i];
+        if (std::memcmp(p.data, q.data, 3 * sizeof(float)) != 0 || p.rgba != q.rgba)
+        {
+            return false;
+        }
+    }
+    for (size_t b = 0; b < bboxes.size(); ++b)
+    {
+        const BBox3D &a = bboxes[b], &e = frame->bboxes[b];
+        if (a.translation != e.translation || a.rotation.coeffs() != e.rotation.coeffs()
+            || a.width != e.width || a.height != e.height || a.depth != e.depth || a.id != e.id)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The whole sequence converted on 1, 2, 4... threads up to the cores, in each format : throughput, scaling against
+// one thread, and the outputs checked to be identical whatever the number of threads.
+void bench_sequence(size_t n, int boxes, int frames)
+{
+    SyntheticSequence sequence(n, boxes, frames);
+    PcdFileSource source(sequence.pcd_files, sequence.annot_dir);
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> thread_counts;
+    for (int t = 1; t < cores; t *= 2)
+    {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(cores);
+
+    for (int format = 0; format < PCD_DATA_FORMAT_COUNT; ++format)
+    {
+        double single_thread_fps = 0.0;
+        uint64_t single_thread_hash = 0;
+        for (int threads : thread_counts)
+        {
+            TempDirectory output;
+            ConvertOptions options;
+            options.output_dir = output.path.string();
+            options.format = static_cast<PcdDataFormat>(format);
+            options.threads = threads;
+            // Filters and decimation on, as a typical preprocessing run.
+            options.pipeline.filter.max_range = 60.0f;
+            options.pipeline.decimation.max_points = n / 2;
+
+            ConvertStats stats;
+            {
+                QuietStdout quiet;
+                stats = convert_frames(source, options);
+            }
+            double fps = stats.frames / stats.elapsed_s;
+            uint64_t hash = directory_hash(output.path);
+            if (threads == 1)
+            {
+                single_thread_fps = fps;
+                single_thread_hash = hash;
+            }
+            bool round_trip = true;
+            if (format == PCD_DATA_BINARY)
+            {
+                QuietStdout quiet;
+                round_trip = check_round_trip(source, options);
+            }
+
+            BenchRecord("convert")
+                .field("points", n)
+                .field("boxes", boxes)
+                .field("frames", stats.frames)
+                .field("format", pcd_data_format_name(format))
+                .field("threads", threads)
+                .field("elapsed_s", stats.elapsed_s)
+                .field("frames_per_sec", fps)
+                .field("mb_per_sec_loaded", stats.bytes_in / stats.elapsed_s / 1e6)
+                .field("mb_per_sec_written", stats.bytes_out / stats.elapsed_s / 1e6)
+                .field("bytes_per_point_written", double(stats.bytes_out) / std::max<uint64_t>(stats.points_out, 1))
+                .field("speedup", fps / single_thread_fps)
+                .field("efficiency", fps / single_thread_fps / threads)
+                .field("writer_wait_s", stats.write_wait_ms / 1e3)
+                .field("peak_pending_mb", stats.peak_pending_bytes / 1e6)
+                .check("identical_to_1_thread", hash == single_thread_hash)
+                .check("round_trip_ok", round_trip)
+                .print();
+        }
+    }
+}
+
+} // namespace
+
+
+void bench_convert(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        for (int boxes : options.boxes_or({20}))
+        {
+            bench_sequence(n, boxes, std::max(options.frames, 8));
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include <vector>
+
+#include "bench_common.h"
+#include "decimation.h"
+
+
+void bench_decimate(const BenchOptions &options)
+{
+    const char *method_names[DECIMATION_METHOD_COUNT] = {"voxel", "random"};
+
+    for (size_t n : options.points)
+    {
+        PointCloudT::Ptr input = make_synthetic_cloud(n);
+        std::vector<float> intensity(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            intensity[i] = float(i % 256);
+        }
+
+        PointCloudT::Ptr full(new PointCloudT(*input));
+        double t_color_full = time_best_of(options.repeat, [&] { apply_color(full); });
+
+        for (size_t budget : {n / 20, n / 4})
+        {
+            for (int method = 0; method < DECIMATION_METHOD_COUNT; ++method)
+            {
+                DecimationConfig config;
+                config.max_points = budget;
+                config.method = method;
+
+                PointCloudT::Ptr output(new PointCloudT);
+                std::vector<float> output_intensity;
+                float voxel_size = 0.0f;
+                double t_decimate = time_best_of(options.repeat, [&] {
+                    voxel_size = decimate_cloud(*input, intensity, config, *output, output_intensity);
+                });
+                double t_color = time_best_of(options.repeat, [&] { apply_color(output); });
+
+                BenchRecord("decimate")
+                    .field("points", n)
+                    .field("method", method_names[method])
+                    .field("max_points", budget)
+                    .field("output_points", output->size())
+                    .check("within_budget", output->size() <= budget && output_intensity.size() == output->size())
+                    .field("ratio", double(output->size()) / n)
+                    .field("voxel_size", voxel_size)
+                    .field("decimate_ms", t_decimate * 1e3)
+                    .field("mpoints_per_sec", n / t_decimate / 1e6)
+                    // The colour stage runs on the decimated cloud instead of the full one.
+                    .field("color_full_ms", t_color_full * 1e3)
+                    .field("color_decimated_ms", t_color * 1e3)
+                    .print();
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "bench_common.h"
+#include "frame_provider.h"
+#include "parallel.h"
+#include "stage_profiler.h"
+#include "temporal_diff.h"
+
+
+namespace
+{
+
+const float kMaxDistance = 0.5f;
+const float kThreshold = 0.2f;
+
+// Distance to the nearest point of `cloud` within max_distance, every point tested : the reference.
+float nearest_reference(const PointCloudT &cloud, const Eigen::Vector3f &p, float max_distance)
+{
+    float best2 = max_distance * max_distance;
+    for (const PointT &q : cloud.points)
+    {
+        best2 = std::min(best2, (Eigen::Vector3f(q.getVector3fMap()) - p).squaredNorm());
+    }
+    return std::sqrt(best2);
+}
+
+// Grid build and queries on a pair of frames : the second one is the first with 2 cm of noise, and 5 % of its
+// points moved 2 m away as a moving object would.
+void bench_kernel(size_t n, const BenchOptions &options)
+{
+    PointCloudT::Ptr previous = make_synthetic_cloud(n, 1);
+    PointCloudT::Ptr current(new PointCloudT(*previous));
+    std::mt19937 rng(2);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    size_t moved = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        PointT &p = current->points[i];
+        p.x += noise(rng);
+        p.y += noise(rng);
+        p.z += noise(rng);
+        if (i % 20 == 0)
+        {
+            p.x += 2.0f;
+            ++moved;
+        }
+    }
+
+    NeighborGrid grid;
+    double t_build = time_best_of(options.repeat, [&] { grid = NeighborGrid(*previous, kMaxDistance); });
+
+    std::vector<float> distance(n);
+    double t_query = time_best_of(options.repeat, [&] {
+        parallel_for(n, 16384, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                distance[i] = grid.nearest_distance(current->points[i].getVector3fMap());
+            }
+        });
+    });
+    size_t dynamic = std::count_if(distance.begin(), distance.end(), [](float d) { return d > kThreshold; });
+
+    // Brute force is O(n) per query : checked on an even sample of 1000 points.
+    size_t samples = std::min<size_t>(n, 1000);
+    bool identical = true;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < samples; ++s)
+    {
+        size_t i = s * n / samples;
+        identical = identical && nearest_reference(*previous, current->points[i].getVector3fMap(), kMaxDistance) == distance[i];
+    }
+    double t_reference = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / samples * n;
+
+    BenchRecord("diff")
+        .field("mode", "kernel")
+        .field("points", n)
+        .field("max_distance", kMaxDistance)
+        .field("build_ms", t_build * 1e3)
+        .field("grid_kb", grid.size_bytes() / 1024)
+        .field("query_ms", t_query * 1e3)
+        .field("query_mpoints_per_sec", n / t_query / 1e6)
+        .field("moved", moved)
+        .field("dynamic", dynamic)
+        .field("reference_ms", t_reference * 1e3)
+        .check("identical", identical)
+        .print();
+}
+
+// Steps forward through a synthetic sequence as the viewer does with --diff : fetch the frame, then compare it with
+// the one before it and colour it.
+void bench_steps(size_t n, const BenchOptions &options)
+{
+    SyntheticSequence sequence(n, 0, std::max(options.frames, 2));
+    FrameSourcePtr source(new PcdFileSource(sequence.pcd_files, sequence.annot_dir));
+
+    TemporalDiffConfig config;
+    config.enabled = true;
+    config.max_distance = kMaxDistance;
+
+    DurationHistogram step, build, query;
+    size_t built = 0, fetched = 0;
+    {
+        QuietStdout quiet;
+        FrameProvider provider(source);
+        TemporalDiff diff(provider, config);
+
+        diff.advance(provider.get(0));
+        for (int index = 1; index < source->size(); ++index)
+        {
+            auto start = std::chrono::steady_clock::now();
+            FramePtr frame = provider.get(index);
+            diff.advance(frame);
+            step.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            build.add(diff.build_ms());
+            query.add(diff.query_ms());
+        }
+        built = diff.grids_built();
+        fetched = diff.fetched();
+    }
+
+    BenchRecord("diff")
+        .field("mode", "step")
+        .field("points", n)
+        .field("steps", step.count())
+        .field("grids_built", built)
+        .field("previous_fetched", fetched)
+        .field("step_p50_ms", step.percentile(0.5))
+        .field("step_p95_ms", step.percentile(0.95))
+        .field("build_p50_ms", build.percentile(0.5))
+        .field("query_color_p50_ms", query.percentile(0.5))
+        .field("steps_per_sec", step.percentile(0.5) > 0.0 ? 1e3 / step.percentile(0.5) : 0.0)
+        .print();
+}
+
+} // namespace
+
+
+void bench_diff(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        bench_kernel(n, options);
+        bench_steps(n, options);
+    }
+}
@@ -0,0 +1,150 @@
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#include "point_filter.h"
+
+
+namespace
+{
+
+struct FilterCase
+{
+    const char *name;
+    FilterConfig config;
+};
+
+std::vector<FilterCase> filter_cases()
+{
+    FilterCase range{"range", FilterConfig()};
+    range.config.min_range = 5.0f;
+    range.config.max_range = 40.0f;
+
+    FilterCase height{"height", FilterConfig()};
+    height.config.height_crop = true;
+    height.config.min_z = -1.0f;
+    height.config.max_z = 3.0f;
+
+    FilterCase boxes{"boxes", FilterConfig()};
+    boxes.config.crop_to_boxes = true;
+    boxes.config.box_padding = 0.5f;
+
+    FilterCase all{"range+height+boxes(car,truck)", FilterConfig()};
+    all.config = range.config;
+    all.config.height_crop = true;
+    all.config.min_z = height.config.min_z;
+    all.config.max_z = height.config.max_z;
+    all.config.crop_to_boxes = true;
+    all.config.box_padding = 0.5f;
+    all.config.allow_labels = {"car", "truck"};
+
+    return {range, height, boxes, all};
+}
+
+// Point by point, every box tested, kept points appended one by one : the reference the filter is checked against.
+bool keep_reference(const PointT &p, const std::vector<BBox3D> &bboxes, const FilterConfig &config)
+{
+    if (config.min_range > 0.0f || config.max_range > 0.0f)
+    {
+        float range2 = p.x * p.x + p.y * p.y + p.z * p.z;
+        float max_range2 = config.max_range > 0.0f ? config.max_range * config.max_range : 1e30f;
+        if (!(range2 >= config.min_range * config.min_range && range2 <= max_range2))
+        {
+            return false;
+        }
+    }
+    if (config.height_crop && !(p.z >= config.min_z && p.z <= config.max_z))
+    {
+        return false;
+    }
+    if (!config.crop_to_boxes)
+    {
+        return true;
+    }
+    for (const BBox3D &bbox : bboxes)
+    {
+        Eigen::Vector3f local = bbox.rotation.toRotationMatrix().transpose() * (p.getVector3fMap() - bbox.translation);
+        Eigen::Vector3f half(0.5f * bbox.width + config.box_padding, 0.5f * bbox.depth + config.box_padding,
+                             0.5f * bbox.height + config.box_padding);
+        if ((local.cwiseAbs().array() <= half.array()).all())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+
+void bench_filter(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        PointCloudT::Ptr input = make_synthetic_cloud(n);
+        std::vector<float> intensity(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            intensity[i] = float(i % 256);
+        }
+        PointCloudT::Ptr colored(new PointCloudT(*input));
+        double t_color_full = time_best_of(options.repeat, [&] { apply_color(colored); });
+
+        for (int num_boxes : options.boxes_or({10, 100}))
+        {
+            for (const FilterCase &filter_case : filter_cases())
+            {
+                std::vector<BBox3D> bboxes = make_synthetic_boxes(num_boxes, num_boxes);
+                size_t bboxes_dropped = filter_bboxes(bboxes, filter_case.config);
+
+                PointCloudT::Ptr output(new PointCloudT);
+                std::vector<float> output_intensity;
+                FilterStats stats;
+                double t_filter = time_best_of(options.repeat, [&] {
+                    stats = filter_cloud(*input, intensity, bboxes, filter_case.config, *output, output_intensity);
+                });
+
+                PointCloudT reference;
+                std::vector<float> reference_intensity;
+                double t_reference = time_best_of(std::min(options.repeat, 2), [&] {
+                    reference.clear();
+                    reference_intensity.clear();
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        if (keep_reference(input->points[i], bboxes, filter_case.config))
+                        {
+                            reference.push_back(input->points[i]);
+                            reference_intensity.push_back(intensity[i]);
+                        }
+                    }
+                });
+                bool identical = reference.size() == output->size() && reference_intensity == output_intensity;
+                for (size_t j = 0; j < reference.size() && identical; ++j)
+                {
+                    identical = output->points[j].x == reference.points[j].x && output->points[j].y == reference.points[j].y
+                        && output->points[j].z == reference.points[j].z;
+                }
+
+                double t_color = time_best_of(options.repeat, [&] { apply_color(output); });
+
+                BenchRecord("filter")
+                    .field("points", n)
+                    .field("boxes", num_boxes)
+                    .field("filter", filter_case.name)
+                    .field("bboxes_dropped", bboxes_dropped)
+                    .field("kept", stats.kept())
+                    .field("dropped_range", stats.dropped[FILTER_RANGE])
+                    .field("dropped_height", stats.dropped[FILTER_HEIGHT])
+                    .field("dropped_boxes", stats.dropped[FILTER_BOXES])
+                    .field("filter_ms", t_filter * 1e3)
+                    .field("mpoints_per_sec", n / t_filter / 1e6)
+                    .field("reference_ms", t_reference * 1e3)
+                    .check("identical", identical)
+                    // The colour stage (and the upload) only see the kept points.
+                    .field("color_full_ms", t_color_full * 1e3)
+                    .field("color_filtered_ms", t_color * 1e3)
+                    .print();
+            }
+        }
+    }
+}
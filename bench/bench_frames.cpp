@@ -0,0 +1,83 @@
+#include <pcl/io/pcd_io.h>
+
+#include "bench_common.h"
+#include "cloud_pool.h"
+#include "frame.h"
+#include "frame_cache.h"
+#include "frame_prefetcher.h"
+
+
+namespace
+{
+
+const int kSequenceFrames = 24;
+const int kCachedFrames = 8;
+const int kLaps = 8;
+const int kWarmupLaps = 3;
+
+} // namespace
+
+
+void bench_frames(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        SyntheticSequence sequence(n, 0, kSequenceFrames);
+
+        // Steps forward through the sequence as the viewer does : cache, prefetcher and pool, the shown frame
+        // holding its cloud until the next one replaces it. The cache holds less than the sequence, so every
+        // lap evicts and reloads frames. Allocations after the warm-up laps are the steady-state ones.
+        CloudPool pool(2 * 2 + 2 + 2);
+        FrameCache cache(kCachedFrames * (n * sizeof(PointT) + sizeof(Frame)));
+        FrameSourcePtr source(new PcdFileSource(sequence.pcd_files, ""));
+        FramePrefetcher prefetcher(source, 2, 2, 2, &cache, &pool);
+
+        FramePtr shown;
+        PointCloudT::Ptr copy_target(new PointCloudT);
+        size_t warmup_allocations = 0, warmup_reallocations = 0;
+        double copy_seconds = 0.0;
+        int steps = 0;
+        for (int lap = 0; lap < kLaps; ++lap)
+        {
+            for (int i = 0; i < kSequenceFrames; ++i)
+            {
+                FramePtr frame = cache.get(i);
+                if (!frame)
+                {
+                    frame = prefetcher.get(i);
+                }
+                if (!frame)
+                {
+                    frame = load_frame(*source, i, FramePipelineConfig(), &pool);
+                }
+                cache.put(frame);
+                prefetcher.recenter(i);
+
+                // What every frame change cost before : a deep copy into the viewer's cloud.
+                auto start = std::chrono::steady_clock::now();
+                pcl::copyPointCloud(*(frame->cloud), *copy_target);
+                copy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                ++steps;
+
+                shown = frame;
+            }
+            if (lap + 1 == kWarmupLaps)
+            {
+                warmup_allocations = pool.allocations();
+                warmup_reallocations = pool.reallocations();
+            }
+        }
+
+        BenchRecord("frame_swap")
+            .field("points", n)
+            .field("frames", kSequenceFrames)
+            .field("laps", kLaps)
+            .field("warmup_cloud_allocations", warmup_allocations)
+            .field("steady_cloud_allocations", pool.allocations() - warmup_allocations)
+            .field("steady_buffer_reallocations", pool.reallocations() - warmup_reallocations)
+            .field("loads", pool.allocations() + pool.recycled())
+            .field("recycled", pool.recycled())
+            .field("copy_ms_per_frame_saved", copy_seconds * 1e3 / std::max(steps, 1))
+            .print();
+    }
+}
@@ -0,0 +1,85 @@
+#include <fstream>
+#include <boost/format.hpp>
+
+#include "bench_common.h"
+#include "frame_source.h"
+#include "sequence_index.h"
+
+
+namespace
+{
+
+// The former directory scan : one stat per entry, then a plain string sort.
+std::vector<std::string> scan_reference(const std::string &dir)
+{
+    namespace bfs = boost::filesystem;
+    std::vector<std::string> files;
+    for (bfs::directory_iterator itr(dir), end_itr; itr != end_itr; ++itr)
+    {
+        if (bfs::is_regular_file(itr->path()) && bfs::extension(itr->path()) == ".pcd")
+        {
+            files.push_back(itr->path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace
+
+
+void bench_index(const BenchOptions &options)
+{
+    namespace bfs = boost::filesystem;
+
+    for (int frames : {1000, 10000, 50000})
+    {
+        // Empty files : only the directory entries matter. Names without zero padding, so that name order and
+        // frame order differ.
+        TempDirectory dir;
+        std::string pcd_dir = (dir.path / "pcd").string();
+        std::string annot_dir = (dir.path / "annotation").string();
+        bfs::create_directories(pcd_dir);
+        bfs::create_directories(annot_dir);
+        for (int i = 0; i < frames; ++i)
+        {
+            std::string name = (boost::format("frame_%d") % i).str();
+            std::ofstream((bfs::path(pcd_dir) / (name + ".pcd")).string());
+            if (i % 2 == 0)
+            {
+                std::ofstream((bfs::path(annot_dir) / (name + ".json")).string());
+            }
+        }
+
+        double t_reference = time_best_of(options.repeat, [&] { scan_reference(pcd_dir); });
+        std::vector<std::string> pcd_files;
+        double t_list = time_best_of(options.repeat, [&] { pcd_files = find_pcd_files(pcd_dir); });
+        SequenceIndex index;
+        double t_pair = time_best_of(options.repeat, [&] { index.annot_files = pair_annot_files(pcd_files, annot_dir); });
+        index.pcd_files = pcd_files;
+
+        int64_t mtime = path_mtime_ns(pcd_dir);
+        bool saved = save_sequence_index(pcd_dir, annot_dir, index, mtime);
+        SequenceIndex cached;
+        bool loaded = false;
+        double t_cache = time_best_of(options.repeat, [&] { loaded = load_sequence_index(pcd_dir, annot_dir, cached); });
+
+        bool natural_order = true;
+        for (int i = 0; i < frames && natural_order; ++i)
+        {
+            natural_order = bfs::path(pcd_files[i]).stem().string() == (boost::format("frame_%d") % i).str();
+        }
+        size_t paired = std::count_if(index.annot_files.begin(), index.annot_files.end(), [](const std::string &f) { return !f.empty(); });
+
+        BenchRecord("index")
+            .field("frames", frames)
+            .field("scan_reference_ms", t_reference * 1e3)
+            .field("list_ms", t_list * 1e3)
+            .field("pair_ms", t_pair * 1e3)
+            .field("cache_read_ms", t_cache * 1e3)
+            .check("natural_order", natural_order)
+            .field("paired", paired)
+            .check("cache_reused", saved && loaded && cached.pcd_files == index.pcd_files && cached.annot_files == index.annot_files)
+            .print();
+    }
+}
@@ -0,0 +1,108 @@
+#include <atomic>
+#include <thread>
+
+#include "bench_common.h"
+#include "frame_provider.h"
+#include "live_feed.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+// Live ingest end to end through a real shared memory ring : a producer thread publishes `frames` synthetic frames
+// at `fps`, while the consumer polls every 2 ms as the viewer's run loop does, takes the newest frame and runs the
+// frame pipeline on it. Latency is from the producer's stamp to the frame taken, then to the frame ready to upload
+// (rendering isn't included).
+void bench_rate(const std::string &ring_name, const std::vector<PointCloudT::Ptr> &clouds, const std::vector<BBox3D> &bboxes,
+                int frames, double fps)
+{
+    size_t n = clouds[0]->size();
+    LiveFrameWriter writer(ring_name, live_frame_bytes(n, false, bboxes, "frame_000000.pcd"));
+    std::atomic<bool> done(false);
+    DurationHistogram publish_ms;
+
+    std::thread producer([&] {
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+        auto due = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+        {
+            std::this_thread::sleep_until(due);
+            due += period;
+            auto start = std::chrono::steady_clock::now();
+            writer.publish(*clouds[i % clouds.size()], {}, bboxes, LidarPose(), "frame_000000.pcd", live_clock_ns());
+            publish_ms.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        done = true;
+    });
+
+    size_t taken = 0, skipped = 0;
+    DurationHistogram take_latency, ready_latency;
+    {
+        QuietStdout quiet;
+        std::shared_ptr<LiveFrameSource> source(new LiveFrameSource(ring_name));
+        FrameProviderOptions provider_options;
+        provider_options.prefetch_ahead = 0;
+        provider_options.prefetch_behind = 0;
+        provider_options.cache_bytes = 0;
+        FrameProvider provider(source, provider_options);
+        while (true)
+        {
+            // Read before take() : the last frame is still taken once the producer is done.
+            bool finished = done;
+            if (source->take())
+            {
+                FramePtr frame = provider.get(0);
+                source->record_shown();
+            }
+            else if (finished)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        taken = source->taken();
+        skipped = source->skipped();
+        take_latency = source->take_latency();
+        ready_latency = source->shown_latency();
+    }
+    producer.join();
+
+    BenchRecord("live")
+        .field("points", n)
+        .field("bboxes", bboxes.size())
+        .field("target_fps", fps)
+        .field("published", writer.published())
+        .field("taken", taken)
+        .field("skipped", skipped)
+        .field("overwritten", writer.overwritten())
+        .field("publish_p50_ms", publish_ms.percentile(0.5))
+        .field("take_p50_ms", take_latency.percentile(0.5))
+        .field("take_p95_ms", take_latency.percentile(0.95))
+        .field("ready_p50_ms", ready_latency.percentile(0.5))
+        .field("ready_p95_ms", ready_latency.percentile(0.95))
+        .field("ready_max_ms", ready_latency.max())
+        .print();
+}
+
+} // namespace
+
+
+void bench_live(const BenchOptions &options)
+{
+    std::string ring_name = "cloud_viewer_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    std::vector<BBox3D> bboxes = make_synthetic_boxes(options.boxes_or({50})[0], 1);
+    for (size_t n : options.points)
+    {
+        std::vector<PointCloudT::Ptr> clouds;
+        for (unsigned seed = 0; seed < 4; ++seed)
+        {
+            clouds.push_back(make_synthetic_cloud(n, seed));
+        }
+        for (double fps : options.fps)
+        {
+            // At least a second of frames per rate.
+            bench_rate(ring_name, clouds, bboxes, std::max(options.frames, int(fps)), fps);
+        }
+    }
+}
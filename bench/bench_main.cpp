@@ -0,0 +1,166 @@
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "bench_common.h"
+
+
+int main(int argc, char *argv[])
+{
+    namespace bops = boost::program_options;
+
+    bops::options_description description("options");
+    description.add_options()
+        ("help,h", "show help")
+        ("bench,",
+        bops::value<std::vector<std::string>>()->multitoken(),
+        "benchmarks to run : accumulate, annot, bboxes, color, compress, convert, decimate, diff, filter, frames, index, live, pcd, pipeline, playback, spatial, summary (default : all)")
+        ("points,",
+        bops::value<std::vector<size_t>>()->multitoken(),
+        "cloud sizes of the synthetic clouds, default : 300000")
+        ("boxes,",
+        bops::value<std::vector<int>>()->multitoken(),
+        "box counts of the annot, bboxes, convert, pipeline, spatial and summary benchmarks, default : their own")
+        ("frames,",
+        bops::value<int>()->default_value(10),
+        "frames of the synthetic sequences of the pipeline, playback, accumulate, convert, diff and summary benchmarks")
+        ("fps,",
+        bops::value<std::vector<double>>()->multitoken(),
+        "target rates of the playback and live benchmarks, default : 10 30 100")
+        ("pcd_path,",
+        bops::value<std::string>(),
+        "run the pipeline benchmark on this directory of pcd files instead of synthetic sequences")
+        ("annotation_path,",
+        bops::value<std::string>()->default_value(""),
+        "annotation directory (or file) of --pcd_path")
+        ("repeat,",
+        bops::value<int>()->default_value(5),
+        "timed runs per measurement, the best one is reported");
+
+    bops::variables_map vm;
+    try
+    {
+        bops::store(bops::parse_command_line(argc, argv, description), vm);
+        bops::notify(vm);
+    }
+    catch (const bops::error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help"))
+    {
+        std::cout << description << std::endl;
+        return 0;
+    }
+
+    BenchOptions options;
+    if (vm.count("points"))
+    {
+        options.points = vm["points"].as<std::vector<size_t>>();
+    }
+    if (vm.count("boxes"))
+    {
+        options.boxes = vm["boxes"].as<std::vector<int>>();
+    }
+    options.repeat = vm["repeat"].as<int>();
+    options.frames = vm["frames"].as<int>();
+    if (vm.count("fps"))
+    {
+        options.fps = vm["fps"].as<std::vector<double>>();
+    }
+    if (vm.count("pcd_path"))
+    {
+        options.pcd_path = vm["pcd_path"].as<std::string>();
+    }
+    options.annotation_path = vm["annotation_path"].as<std::string>();
+
+    std::vector<std::string> benches = {"accumulate", "annot", "bboxes", "color", "compress", "convert", "decimate", "diff", "filter", "frames", "index", "live", "pcd", "pipeline", "playback", "spatial", "summary"};
+    if (vm.count("bench"))
+    {
+        benches = vm["bench"].as<std::vector<std::string>>();
+    }
+
+    for (const std::string &bench : benches)
+    {
+        if (bench == "accumulate")
+        {
+            bench_accumulate(options);
+        }
+        else if (bench == "annot")
+        {
+            bench_annot(options);
+        }
+        else if (bench == "bboxes")
+        {
+            bench_bboxes(options);
+        }
+        else if (bench == "color")
+        {
+            bench_color(options);
+        }
+        else if (bench == "compress")
+        {
+            bench_compress(options);
+        }
+        else if (bench == "convert")
+        {
+            bench_convert(options);
+        }
+        else if (bench == "decimate")
+        {
+            bench_decimate(options);
+        }
+        else if (bench == "diff")
+        {
+            bench_diff(options);
+        }
+        else if (bench == "filter")
+        {
+            bench_filter(options);
+        }
+        else if (bench == "frames")
+        {
+            bench_frames(options);
+        }
+        else if (bench == "index")
+        {
+            bench_index(options);
+        }
+        else if (bench == "live")
+        {
+            bench_live(options);
+        }
+        else if (bench == "pcd")
+        {
+            bench_pcd(options);
+        }
+        else if (bench == "pipeline")
+        {
+            bench_pipeline(options);
+        }
+        else if (bench == "playback")
+        {
+            bench_playback(options);
+        }
+        else if (bench == "spatial")
+        {
+            bench_spatial(options);
+        }
+        else if (bench == "summary")
+        {
+            bench_summary(options);
+        }
+        else
+        {
+            std::cerr << "unknown benchmark '" << bench << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (bench_failures() > 0)
+    {
+        std::cerr << bench_failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
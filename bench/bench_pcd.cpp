@@ -0,0 +1,158 @@
+#include <cstring>
+#include <fstream>
+#include <pcl/io/pcd_io.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define CLOUD_VIEWER_BENCH_HAVE_FORK 1
+#endif
+
+#include "bench_common.h"
+#include "frame.h"
+#include "pcd_reader.h"
+
+
+namespace
+{
+
+// Binary pcd with the layout of the recorder : x y z intensity, float32 each.
+void write_recorder_pcd(const std::string &file, const PointCloudT &cloud, const std::vector<float> &intensity)
+{
+    std::ofstream os(file, std::ios::binary);
+    os << "# .PCD v0.7 - Point Cloud Data file format\n"
+       << "VERSION 0.7\n"
+       << "FIELDS x y z intensity\n"
+       << "SIZE 4 4 4 4\n"
+       << "TYPE F F F F\n"
+       << "COUNT 1 1 1 1\n"
+       << "WIDTH " << cloud.size() << "\n"
+       << "HEIGHT 1\n"
+       << "VIEWPOINT 0 0 0 1 0 0 0\n"
+       << "POINTS " << cloud.size() << "\n"
+       << "DATA binary\n";
+    std::vector<float> record(4 * cloud.size());
+    for (size_t i = 0; i < cloud.size(); ++i)
+    {
+        record[4 * i] = cloud[i].x;
+        record[4 * i + 1] = cloud[i].y;
+        record[4 * i + 2] = cloud[i].z;
+        record[4 * i + 3] = intensity[i];
+    }
+    os.write(reinterpret_cast<const char *>(record.data()), record.size() * sizeof(float));
+}
+
+// Peak RSS increase, in KB, of running f() once in a forked child. -1 when not available.
+template <typename F>
+long peak_rss_increase_kb(F &&f)
+{
+#ifdef CLOUD_VIEWER_BENCH_HAVE_FORK
+    int fds[2];
+    if (::pipe(fds) != 0)
+    {
+        return -1;
+    }
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        struct rusage before, after;
+        ::getrusage(RUSAGE_SELF, &before);
+        f();
+        ::getrusage(RUSAGE_SELF, &after);
+        long increase = after.ru_maxrss - before.ru_maxrss;
+#ifdef __APPLE__
+        increase /= 1024;  // bytes on macOS
+#endif
+        ssize_t written = ::write(fds[1], &increase, sizeof(increase));
+        ::_exit(written == sizeof(increase) ? 0 : 1);
+    }
+    ::close(fds[1]);
+    long increase = -1;
+    if (pid < 0 || ::read(fds[0], &increase, sizeof(increase)) != sizeof(increase))
+    {
+        increase = -1;
+    }
+    ::close(fds[0]);
+    if (pid > 0)
+    {
+        ::waitpid(pid, nullptr, 0);
+    }
+    return increase;
+#else
+    return -1;
+#endif
+}
+
+bool same_points(const PointCloudT &a, const PointCloudT &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (std::memcmp(a[i].data, b[i].data, 3 * sizeof(float)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+void bench_pcd(const BenchOptions &options)
+{
+    TempDirectory dir;
+    for (size_t n : options.points)
+    {
+        PointCloudT::Ptr source = make_synthetic_cloud(n, 2);
+        std::vector<float> source_intensity(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            source_intensity[i] = float(i % 256);
+        }
+        std::string file = (dir.path / "recorder.pcd").string();
+        write_recorder_pcd(file, *source, source_intensity);
+        source.reset();
+
+        PointCloudT pcl_cloud, mmap_cloud;
+        std::vector<float> intensity;
+        bool pcl_ok = pcl::io::loadPCDFile(file, pcl_cloud) == 0;
+        bool mmap_ok = read_pcd_mmap(file, mmap_cloud, intensity);
+        bool identical = pcl_ok && mmap_ok && same_points(pcl_cloud, mmap_cloud) && intensity == source_intensity;
+
+        // Fresh clouds each run : the cost of a first load, as for a frame that isn't cached.
+        double t_pcl = time_best_of(options.repeat, [&] {
+            PointCloudT cloud;
+            pcl::io::loadPCDFile(file, cloud);
+        });
+        double t_mmap = time_best_of(options.repeat, [&] {
+            PointCloudT cloud;
+            std::vector<float> values;
+            read_pcd_mmap(file, cloud, values);
+        });
+        long rss_pcl = peak_rss_increase_kb([&] {
+            PointCloudT cloud;
+            pcl::io::loadPCDFile(file, cloud);
+        });
+        long rss_mmap = peak_rss_increase_kb([&] {
+            PointCloudT cloud;
+            std::vector<float> values;
+            read_pcd_mmap(file, cloud, values);
+        });
+
+        BenchRecord("pcd_load")
+            .field("points", n)
+            .field("format", "binary x y z intensity")
+            .field("pcl_ms", t_pcl * 1e3)
+            .field("mmap_ms", t_mmap * 1e3)
+            .field("speedup", t_pcl / t_mmap)
+            .field("pcl_peak_rss_kb", rss_pcl)
+            .field("mmap_peak_rss_kb", rss_mmap)
+            .check("identical", identical)
+            .print();
+    }
+}
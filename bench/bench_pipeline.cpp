@@ -0,0 +1,199 @@
+#include <random>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <pcl/io/pcd_io.h>
+
+#include "bbox3d.h"
+#include "bench_common.h"
+#include "frame.h"
+#include "frame_provider.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+void print_histogram(BenchRecord &record, const DurationHistogram &h)
+{
+    record.field("count", h.count())
+        .field("mean_ms", h.mean())
+        .field("p50_ms", h.percentile(0.5))
+        .field("p95_ms", h.percentile(0.95))
+        .field("max_ms", h.max())
+        .print();
+}
+
+// Steps through `order` as the viewer does, through a FrameProvider with the viewer defaults (--prefetch 2,
+// --prefetch_threads 2, --cache_mb 512), without any pause between steps : the prefetcher only gets ahead by the
+// time a step takes.
+void bench_stepping(const char *source_name, size_t points, int boxes, const std::string &order_name,
+                    const std::vector<int> &order, const FrameSourcePtr &source)
+{
+    DurationHistogram steps;
+    size_t cache_hits = 0, prefetch_hits = 0;
+    {
+        QuietStdout quiet;
+        FrameProvider provider(source);
+
+        FramePtr shown;
+        for (int index : order)
+        {
+            auto start = std::chrono::steady_clock::now();
+            shown = provider.get(index);
+            steps.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        cache_hits = provider.frame_cache() ? provider.frame_cache()->hits() : 0;
+        prefetch_hits = provider.frame_prefetcher() ? provider.frame_prefetcher()->hits() : 0;
+    }
+
+    BenchRecord record("pipeline_step");
+    record.field("source", source_name)
+        .field("points", points)
+        .field("boxes", boxes)
+        .field("order", order_name)
+        .field("cache_hits", cache_hits)
+        .field("prefetch_hits", prefetch_hits);
+    print_histogram(record, steps);
+}
+
+// Stages of loading a frame, one histogram each over `repeat` passes on the sequence after a warm-up pass,
+// then sequential and random-access stepping.
+void bench_sequence(const char *source_name, size_t points, int boxes, const std::string &pcd_path,
+                    const std::string &annot_path, const BenchOptions &options)
+{
+    std::vector<std::string> pcd_files;
+    try
+    {
+        QuietStdout quiet;
+        pcd_files = find_pcd_files(pcd_path);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+    double t_scan = time_best_of(options.repeat, [&] {
+        QuietStdout quiet;
+        pcd_files = find_pcd_files(pcd_path);
+    });
+    BenchRecord("pipeline_scan")
+        .field("source", source_name)
+        .field("frames", pcd_files.size())
+        .field("scan_ms", t_scan * 1e3)
+        .print();
+    if (pcd_files.empty())
+    {
+        return;
+    }
+
+    const char *stage_names[] = {"pcd_load", "color", "annot_load", "bbox_geometry"};
+    DurationHistogram stages[4];
+    PointCloudT::Ptr cloud(new PointCloudT);
+    std::vector<float> intensity;
+    std::vector<BBox3D> bboxes;
+    BBoxWireframe wireframe;
+    size_t total_points = 0, total_boxes = 0;
+    {
+        QuietStdout quiet;
+        for (int pass = 0; pass <= std::max(options.repeat, 1); ++pass)
+        {
+            for (const std::string &pcd_file : pcd_files)
+            {
+                double t[4];
+                auto start = std::chrono::steady_clock::now();
+                auto lap = [&start]() {
+                    auto now = std::chrono::steady_clock::now();
+                    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+                    start = now;
+                    return ms;
+                };
+                load_frame_cloud(pcd_file, *cloud, intensity);
+                t[0] = lap();
+                apply_color(cloud, ColorConfig(), &intensity);
+                t[1] = lap();
+                load_frame_annot(annot_path, pcd_file, bboxes);
+                t[2] = lap();
+                build_bbox_wireframe(bboxes, wireframe);
+                t[3] = lap();
+
+                // The first pass warms the page cache and the buffers.
+                if (pass == 0)
+                {
+                    total_points += cloud->size();
+                    total_boxes += bboxes.size();
+                    continue;
+                }
+                for (int s = 0; s < 4; ++s)
+                {
+                    stages[s].add(t[s]);
+                }
+            }
+        }
+    }
+
+    // Real sequences report their mean frame size.
+    if (points == 0)
+    {
+        points = total_points / pcd_files.size();
+        boxes = int(total_boxes / pcd_files.size());
+    }
+    for (int s = 0; s < 4; ++s)
+    {
+        BenchRecord record("pipeline_stage");
+        record.field("source", source_name).field("points", points).field("boxes", boxes).field("stage", stage_names[s]);
+        print_histogram(record, stages[s]);
+    }
+
+    FrameSourcePtr source(new PcdFileSource(pcd_files, annot_path));
+    std::vector<int> sequential(pcd_files.size());
+    for (size_t i = 0; i < sequential.size(); ++i)
+    {
+        sequential[i] = int(i);
+    }
+    // Uniform jumps over the sequence, the same for every run.
+    std::vector<int> random_access(pcd_files.size());
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> frame(0, int(pcd_files.size()) - 1);
+    for (int &index : random_access)
+    {
+        index = frame(rng);
+    }
+    bench_stepping(source_name, points, boxes, "sequential", sequential, source);
+    bench_stepping(source_name, points, boxes, "random", random_access, source);
+}
+
+} // namespace
+
+
+SyntheticSequence::SyntheticSequence(size_t points, int boxes, int frames)
+{
+    namespace bfs = boost::filesystem;
+    this->pcd_dir = (this->dir.path / "pcd").string();
+    this->annot_dir = (this->dir.path / "annotation").string();
+    bfs::create_directories(this->pcd_dir);
+    bfs::create_directories(this->annot_dir);
+    for (int i = 0; i < frames; ++i)
+    {
+        std::string name = (boost::format("%08d") % i).str();
+        this->pcd_files.push_back((bfs::path(this->pcd_dir) / (name + ".pcd")).string());
+        pcl::io::savePCDFileBinary(this->pcd_files.back(), *make_synthetic_cloud(points, i));
+        write_synthetic_annot((bfs::path(this->annot_dir) / (name + ".json")).string(), boxes, i);
+    }
+}
+
+void bench_pipeline(const BenchOptions &options)
+{
+    if (!options.pcd_path.empty())
+    {
+        bench_sequence("directory", 0, 0, options.pcd_path, options.annotation_path, options);
+        return;
+    }
+    for (size_t n : options.points)
+    {
+        for (int boxes : options.boxes_or({0, 100}))
+        {
+            SyntheticSequence sequence(n, boxes, std::max(options.frames, 1));
+            bench_sequence("synthetic", n, boxes, sequence.pcd_dir, sequence.annot_dir, options);
+        }
+    }
+}
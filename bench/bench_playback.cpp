@@ -0,0 +1,85 @@
+#include <thread>
+
+#include "bench_common.h"
+#include "frame_provider.h"
+#include "playback.h"
+
+
+namespace
+{
+
+// Plays `frames` frames of the sequence at `fps` as the viewer's run loop does : wait for the next due frame (or
+// 1 ms when it is due but not decoded yet), then tick. Rendering isn't included, frames are dropped only when
+// decoding falls behind.
+void bench_rate(const FrameSourcePtr &source, size_t points, int frames, double fps)
+{
+    using Clock = PlaybackScheduler::Clock;
+    size_t cache_hits = 0, prefetch_hits = 0;
+    double achieved_fps = 0;
+    size_t shown = 0, dropped = 0, stalls = 0;
+    DurationHistogram lateness;
+    {
+        QuietStdout quiet;
+        FrameProvider provider(source);
+        PlaybackScheduler playback(provider, fps);
+
+        FramePtr frame = provider.get(0);
+        Clock::time_point start = Clock::now();
+        Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frames / fps));
+        playback.play(0, start);
+        while (Clock::now() < end)
+        {
+            std::this_thread::sleep_until(std::min(playback.next_due(), end));
+            int index;
+            FramePtr next = playback.tick(Clock::now(), index);
+            if (next)
+            {
+                frame = next;
+            }
+            else if (Clock::now() >= playback.next_due())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        achieved_fps = playback.achieved_fps(Clock::now());
+        shown = playback.shown();
+        dropped = playback.dropped();
+        stalls = playback.stalls();
+        lateness = playback.lateness();
+        cache_hits = provider.frame_cache() ? provider.frame_cache()->hits() : 0;
+        prefetch_hits = provider.frame_prefetcher() ? provider.frame_prefetcher()->hits() : 0;
+    }
+
+    BenchRecord("playback")
+        .field("points", points)
+        .field("frames", frames)
+        .field("target_fps", fps)
+        .field("achieved_fps", achieved_fps)
+        .field("shown", shown)
+        .field("dropped", dropped)
+        .field("stalls", stalls)
+        .field("late_p50_ms", lateness.percentile(0.5))
+        .field("late_p95_ms", lateness.percentile(0.95))
+        .field("late_max_ms", lateness.max())
+        .field("cache_hits", cache_hits)
+        .field("prefetch_hits", prefetch_hits)
+        .print();
+}
+
+} // namespace
+
+
+void bench_playback(const BenchOptions &options)
+{
+    int frames = std::max(options.frames, 2);
+    for (size_t n : options.points)
+    {
+        SyntheticSequence sequence(n, 0, frames);
+        FrameSourcePtr source(new PcdFileSource(sequence.pcd_files, sequence.annot_dir));
+        for (double fps : options.fps)
+        {
+            // Twice through the sequence : the second pass plays from the cache.
+            bench_rate(source, n, 2 * frames, fps);
+        }
+    }
+}
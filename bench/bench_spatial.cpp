@@ -0,0 +1,145 @@
+#include <random>
+#include <vector>
+
+#include "bench_common.h"
+#include "spatial_index.h"
+
+
+std::vector<BBox3D> make_synthetic_boxes(int n, unsigned seed)
+{
+    const char *labels[] = {"car", "pedestrian", "truck"};
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> height(-1.0f, 3.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> yaw(-3.14159265f, 3.14159265f);
+
+    std::vector<BBox3D> bboxes(n);
+    for (int i = 0; i < n; ++i)
+    {
+        BBox3D &bbox = bboxes[i];
+        bbox.translation = Eigen::Vector3f(position(rng), position(rng), height(rng));
+        bbox.rotation = Eigen::Quaternionf(Eigen::AngleAxisf(yaw(rng), Eigen::Vector3f::UnitZ()));
+        bbox.width = size(rng);
+        bbox.depth = size(rng);
+        bbox.height = size(rng);
+        bbox.id = std::string(labels[i % 3]) + "_" + std::to_string(i);
+    }
+    return bboxes;
+}
+
+
+namespace
+{
+
+bool inside(const BBox3D &bbox, const PointT &p)
+{
+    Eigen::Vector3f local = bbox.rotation.toRotationMatrix().transpose() * (Eigen::Vector3f(p.x, p.y, p.z) - bbox.translation);
+    return std::abs(local.x()) <= 0.5f * bbox.width && std::abs(local.y()) <= 0.5f * bbox.depth && std::abs(local.z()) <= 0.5f * bbox.height;
+}
+
+} // namespace
+
+
+void bench_spatial(const BenchOptions &options)
+{
+    const int picks = 1000;
+    const size_t k = 10;
+
+    for (size_t n : options.points)
+    {
+        PointCloudT::Ptr cloud = make_synthetic_cloud(n);
+        for (int num_boxes : options.boxes_or({10, 100, 1000}))
+        {
+            std::vector<BBox3D> bboxes = make_synthetic_boxes(num_boxes, num_boxes);
+
+            double build_ms = 1e3 * time_best_of(options.repeat, [&] { FrameSpatialIndex index(*cloud, bboxes); });
+            FrameSpatialIndex index(*cloud, bboxes);
+
+            std::vector<size_t> counts, reference(bboxes.size());
+            double t_count = time_best_of(options.repeat, [&] { counts = index.count_points_in_boxes(); });
+            double t_count_brute = time_best_of(std::min(options.repeat, 2), [&] {
+                for (size_t b = 0; b < bboxes.size(); ++b)
+                {
+                    reference[b] = 0;
+                    for (const PointT &p : cloud->points)
+                    {
+                        reference[b] += inside(bboxes[b], p);
+                    }
+                }
+            });
+
+            // Picks on points of the cloud, as a click does.
+            std::vector<Eigen::Vector3f> targets(picks);
+            for (int i = 0; i < picks; ++i)
+            {
+                const PointT &p = cloud->points[(size_t(i) * 7919) % n];
+                targets[i] = Eigen::Vector3f(p.x, p.y, p.z);
+            }
+            std::vector<int> found(picks), found_brute(picks);
+            double t_pick = time_best_of(options.repeat, [&] {
+                for (int i = 0; i < picks; ++i)
+                {
+                    found[i] = index.find_box(targets[i]);
+                }
+            });
+            double t_pick_brute = time_best_of(options.repeat, [&] {
+                for (int i = 0; i < picks; ++i)
+                {
+                    PointT p(targets[i].x(), targets[i].y(), targets[i].z(), 0, 0, 0);
+                    int best = -1;
+                    for (size_t b = 0; b < bboxes.size(); ++b)
+                    {
+                        float volume = float(bboxes[b].width * bboxes[b].depth * bboxes[b].height);
+                        if (inside(bboxes[b], p) && (best < 0 || volume < float(bboxes[best].width * bboxes[best].depth * bboxes[best].height)))
+                        {
+                            best = int(b);
+                        }
+                    }
+                    found_brute[i] = best;
+                }
+            });
+
+            std::vector<std::pair<uint32_t, float>> nearest;
+            double t_nearest = time_best_of(options.repeat, [&] {
+                for (int i = 0; i < picks; ++i)
+                {
+                    nearest = index.nearest_points(targets[i], k, 5.0f);
+                }
+            });
+            // k-th nearest distance of the last pick, against a full scan.
+            std::vector<float> distances;
+            double t_nearest_brute = time_best_of(std::min(options.repeat, 2), [&] {
+                distances.clear();
+                for (const PointT &p : cloud->points)
+                {
+                    float d = (Eigen::Vector3f(p.x, p.y, p.z) - targets[picks - 1]).norm();
+                    if (d <= 5.0f)
+                    {
+                        distances.push_back(d);
+                    }
+                }
+                std::sort(distances.begin(), distances.end());
+            }) * picks;
+            bool nearest_identical = nearest.size() == std::min(k, distances.size())
+                && (nearest.empty() || std::abs(nearest.back().second - distances[nearest.size() - 1]) < 1e-4f);
+
+            BenchRecord("spatial")
+                .field("points", n)
+                .field("boxes", num_boxes)
+                .field("build_ms", build_ms)
+                .field("index_mb", index.size_bytes() / (1024.0 * 1024.0))
+                .field("count_ms", t_count * 1e3)
+                .field("count_brute_ms", t_count_brute * 1e3)
+                .check("counts_identical", counts == reference)
+                .field("pick_us", t_pick / picks * 1e6)
+                .field("pick_brute_us", t_pick_brute / picks * 1e6)
+                .check("picks_identical", found == found_brute)
+                .field("nearest_us", t_nearest / picks * 1e6)
+                .field("nearest_brute_us", t_nearest_brute / picks * 1e6)
+                .check("nearest_identical", nearest_identical)
+                .print();
+        }
+    }
+}
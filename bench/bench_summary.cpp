@@ -0,0 +1,168 @@
+#include <thread>
+
+#include "bench_common.h"
+#include "frame_provider.h"
+#include "sequence_summary.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+int summary_threads()
+{
+    return std::max(1, int(std::thread::hardware_concurrency()) - 1);
+}
+
+void wait_complete(const SequenceSummary &summary)
+{
+    while (!summary.complete())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Exact percentile of the z values of every frame, for the histogram estimate.
+float z_percentile(const FrameSource &source, double fraction)
+{
+    std::vector<float> z;
+    PointCloudT cloud;
+    std::vector<float> intensity;
+    for (int i = 0; i < source.size(); ++i)
+    {
+        source.load_cloud(i, cloud, intensity);
+        for (const PointT &p : cloud.points)
+        {
+            z.push_back(p.z);
+        }
+    }
+    size_t k = std::min(z.size() - 1, size_t(fraction * z.size()));
+    std::nth_element(z.begin(), z.begin() + k, z.end());
+    return z[k];
+}
+
+// Steps through the sequence loading every frame (no cache, no prefetch), as the viewer does on a cold sequence.
+DurationHistogram step_latency(const FrameSourcePtr &source)
+{
+    FrameProviderOptions provider_options;
+    provider_options.prefetch_ahead = 0;
+    provider_options.prefetch_behind = 0;
+    provider_options.cache_bytes = 0;
+    FrameProvider provider(source, provider_options);
+    DurationHistogram latency;
+    for (int i = 0; i < source->size(); ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        provider.get(i);
+        latency.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return latency;
+}
+
+void bench_sequence(size_t n, int boxes, int frames)
+{
+    namespace bfs = boost::filesystem;
+    SyntheticSequence sequence(n, boxes, frames);
+    FrameSourcePtr source(new PcdFileSource(sequence.pcd_files, sequence.annot_dir));
+    std::string sidecar = SequenceSummary::default_sidecar_path(sequence.pcd_dir);
+    int threads = summary_threads();
+
+    // Cold pass, then a run that finds everything in the sidecar.
+    double pass_s = 0.0, mb_per_s = 0.0;
+    {
+        QuietStdout quiet;
+        SequenceSummary summary(source, sidecar);
+        auto start = std::chrono::steady_clock::now();
+        summary.start(threads);
+        wait_complete(summary);
+        pass_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mb_per_s = double(n) * frames * sizeof(PointT) / pass_s / 1e6;
+    }
+    uint64_t sidecar_bytes = bfs::file_size(sidecar);
+    auto start = std::chrono::steady_clock::now();
+    SequenceSummary resumed(source, sidecar);
+    double reopen_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Queries and the robust colour range against the exact percentiles.
+    SummaryQuery query("boxes>=10,Car>1,zmax<100");
+    double query_ms = time_best_of(5, [&] { resumed.find(query); }) * 1e3;
+    size_t matches = resumed.find(query).size();
+    size_t max_points = resumed.find(SummaryQuery("max:points")).size();
+    float robust_min = 0.0f, robust_max = 0.0f;
+    resumed.color_range(COLOR_SOURCE_Z, 0.01, 0.99, robust_min, robust_max);
+    float exact_min = z_percentile(*source, 0.01), exact_max = z_percentile(*source, 0.99);
+    float range_min = 0.0f, range_max = 0.0f;
+    resumed.color_range(COLOR_SOURCE_Z, 0.0, 1.0, range_min, range_max);
+    double robust_error = std::max(std::abs(robust_min - exact_min), std::abs(robust_max - exact_max)) / (range_max - range_min);
+
+    // Interrupted half way : the next run resumes, and a record cut short is dropped.
+    bfs::remove(sidecar);
+    int done_at_stop = 0, resumed_after_stop = 0, resumed_after_tear = 0;
+    {
+        QuietStdout quiet;
+        SequenceSummary summary(source, sidecar);
+        summary.start(1);
+        while (summary.done() < frames / 2)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        summary.stop();
+        done_at_stop = summary.done();
+    }
+    resumed_after_stop = SequenceSummary(source, sidecar).resumed();
+    bfs::resize_file(sidecar, bfs::file_size(sidecar) - 10);
+    resumed_after_tear = SequenceSummary(source, sidecar).resumed();
+
+    // Step latency alone, then with the pass running on a fresh sidecar.
+    DurationHistogram idle, busy;
+    bfs::remove(sidecar);
+    {
+        QuietStdout quiet;
+        idle = step_latency(source);
+        SequenceSummary summary(source, sidecar);
+        summary.start(threads);
+        busy = step_latency(source);
+    }
+
+    BenchRecord("summary")
+        .field("points", n)
+        .field("boxes", boxes)
+        .field("frames", frames)
+        .field("threads", threads)
+        .field("pass_s", pass_s)
+        .field("frames_per_sec", frames / pass_s)
+        .field("mb_per_sec", mb_per_s)
+        .field("sidecar_bytes_per_frame", double(sidecar_bytes) / frames)
+        .field("reopen_ms", reopen_ms)
+        .field("resumed", resumed.resumed())
+        .field("query_ms", query_ms)
+        .field("matches", matches)
+        .field("max_points_frames", max_points)
+        .field("robust_z_min", robust_min)
+        .field("robust_z_max", robust_max)
+        .field("exact_z_min", exact_min)
+        .field("exact_z_max", exact_max)
+        .field("robust_error_of_range", robust_error)
+        .field("done_at_stop", done_at_stop)
+        .field("resumed_after_stop", resumed_after_stop)
+        .field("resumed_after_torn_record", resumed_after_tear)
+        .field("step_idle_p50_ms", idle.percentile(0.5))
+        .field("step_idle_p95_ms", idle.percentile(0.95))
+        .field("step_during_pass_p50_ms", busy.percentile(0.5))
+        .field("step_during_pass_p95_ms", busy.percentile(0.95))
+        .print();
+}
+
+} // namespace
+
+
+void bench_summary(const BenchOptions &options)
+{
+    for (size_t n : options.points)
+    {
+        for (int boxes : options.boxes_or({20}))
+        {
+            bench_sequence(n, boxes, std::max(options.frames, 4));
+        }
+    }
+}
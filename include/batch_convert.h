@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "frame.h"
+#include "frame_source.h"
+#include "pcd_writer.h"
+
+
+struct ConvertOptions
+{
+    // Run on every frame as by the viewer : boxes in the lidar frame, label lists and crops, decimation, colours.
+    FramePipelineConfig pipeline;
+    std::string output_dir;
+    PcdDataFormat format = PCD_DATA_BINARY;
+    int threads = 0;                       // worker threads, 0 : one per core
+    // Converted frames waiting to be written in order, beyond which the workers wait. Each worker holds one more
+    // frame on top of this while it converts it.
+    size_t max_pending_bytes = size_t(512) << 20;
+    int max_pending_frames = 0;            // 0 : 4 per worker thread
+    bool write_annotations = true;         // <stem>.json next to the frames that have an annotation
+};
+
+struct ConvertStats
+{
+    int frames = 0;                // written
+    int failed = 0;                // couldn't be loaded, skipped
+    uint64_t points_in = 0;        // as loaded
+    uint64_t points_out = 0;       // as written
+    uint64_t bytes_in = 0;         // points (and intensities) as loaded
+    uint64_t bytes_out = 0;        // written, annotations included
+    int threads = 0;
+    double elapsed_s = 0.0;
+    // Summed over the frames, in ms.
+    double load_ms = 0.0;
+    double filter_ms = 0.0;
+    double decimate_ms = 0.0;
+    double color_ms = 0.0;
+    double encode_ms = 0.0;
+    double write_ms = 0.0;         // on the writer thread
+    double write_wait_ms = 0.0;    // writer waiting for the next frame in order
+    size_t peak_pending_bytes = 0;
+
+    void print(std::ostream &os) const;
+};
+
+// Output file of frame `name` of a sequence in `output_dir` : its stem with `extension`.
+std::string convert_output_path(const std::string &output_dir, const std::string &name, const std::string &extension);
+
+// Run the frame pipeline over every frame of `source` and write them as pcd files (with the boxes of the frame, in
+// the lidar frame, as annotation files) to options.output_dir, which is created when missing.
+//
+// Frames are handed out in index order to a pool of worker threads, each taking the next frame as soon as it is
+// done with one, so that uneven frames keep every thread busy. The workers load, convert and encode whole frames on
+// their own thread (the per-frame stages don't split over threads of their own), while the calling thread writes
+// the encoded frames in index order : disk writes overlap loading and compute, and the files and the progress
+// appear in the same order whatever the number of threads. At most max_pending_frames / max_pending_bytes of
+// converted frames wait for the writer, workers stop taking frames beyond. Progress goes to `progress` when given.
+//
+// Throws std::runtime_error when a file can't be written, frames that can't be loaded (or throw while converted) are
+// skipped and counted.
+ConvertStats convert_frames(const FrameSource &source, const ConvertOptions &options, std::ostream *progress = nullptr);
@@ -1,11 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <iostream>
 #include <vector>
 #include <string>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/foreach.hpp>
-// #include <boost/optional.hpp>
 #include <Eigen/Dense>
 
 
@@ -19,59 +17,39 @@ struct BBox3D
     std::string id;
 };
 
-
-inline bool load_annot(std::string annot_file, std::vector<BBox3D> &bboxes)
+// Pose of the lidar in the world frame of the annotation file : p_world = rotation * p_lidar + translation.
+struct LidarPose
 {
-    namespace bpt = boost::property_tree;
-
-    bool ret = true;
-    bpt::ptree pt;
-    bpt:read_json(annot_file, pt);
-
-    try {
-        bpt::ptree lidar_0 = pt.get_child("Lidar").begin()->second;
-        Eigen::Vector3f lidar_0_trans(
-            lidar_0.get<float>("Location.x"), lidar_0.get<float>("Location.y"), lidar_0.get<float>("Location.z")
-        );
-        Eigen::Quaternionf lidar_0_quat(
-            lidar_0.get<float>("Rotation.w"), lidar_0.get<float>("Rotation.x"), lidar_0.get<float>("Rotation.y"), lidar_0.get<float>("Rotation.z")
-        );
+    bool valid = false;  // false when the frame has no annotation file
+    Eigen::Vector3f translation = Eigen::Vector3f::Zero();
+    Eigen::Quaternionf rotation = Eigen::Quaternionf::Identity();
+};
 
-        int count = 0;
-        BOOST_FOREACH (const bpt::ptree::value_type& child, pt.get_child("BoundingBox3D")) 
-        {
-            const bpt::ptree& info = child.second;
 
-            Eigen::Vector3f bbox_center(
-                info.get<float>("Origin.x"), info.get<float>("Origin.y"), info.get<float>("Origin.z")
-            );
-            Eigen::Vector3f bbox_center_lidar_coord = lidar_0_quat.inverse() * (bbox_center - lidar_0_trans);
-            // Eigen::Quaternionf p;
-            // p.w() = 0;
-            // p.vec() = (bbox_center - lidar_0_trans);
-            // Eigen::Quaternionf rotatedP = lidar_0_quat.inverse() * p * lidar_0_quat; 
-            // Eigen::Vector3f bbox_center_lidar_coord = rotatedP.vec();
+// Append the 3D bboxes of an annotation file (Lidar pose + BoundingBox3D array), in the lidar frame.
+// The Lidar pose itself goes to `pose` when given.
+// Malformed files are reported on std::cout as "file(line): message" and leave `bboxes` and `pose` unchanged.
+bool load_annot(const std::string &annot_file, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr);
 
-            Eigen::Quaternionf bbox_rot(
-                info.get<float>("Rotation.w"), info.get<float>("Rotation.x"), info.get<float>("Rotation.y"), info.get<float>("Rotation.z")
-            );
-            Eigen::Quaternionf bbox_rot_lidar_coord = lidar_0_quat.inverse() * bbox_rot;
+// Label of a bbox id : the id without the trailing "_<number>" load_annot appends ("car_12" -> "car").
+std::string bbox_label(const std::string &id);
 
-            float width, height, depth;
-            width = info.get<float>("Extent.x");
-            height = info.get<float>("Extent.z");
-            depth = info.get<float>("Extent.y");
+// Annotation file of `bboxes` in the layout load_annot reads, with an identity Lidar pose : the boxes stay in the
+// lidar frame, and load_annot gives them back as they are (labels from bbox_label).
+void write_annot(std::ostream &os, const std::vector<BBox3D> &bboxes);
 
-            std::string id = info.get<std::string>("Label") + "_";
-            id += std::to_string(count);
+// Wireframes of a set of boxes as one line set : 8 corners and 12 edges per box.
+struct BBoxWireframe
+{
+    std::vector<float> vertices;    // x y z of each corner, 8 corners per box
+    std::vector<uint32_t> indices;  // corner pair of each edge, 12 edges per box
+};
 
-            bboxes.push_back(BBox3D{bbox_center_lidar_coord, bbox_rot_lidar_coord, width, height, depth, id});
-            ++count;
-        }
-    } catch (bpt::json_parser_error &e) {
-        ret = false;
-        std::cout << e.what() << std::endl;
-    }
+// The 8 corners of `bbox` (x y z each) into `vertex`, and the 12 edges of the i-th box of a wireframe (corner
+// pairs) into `index`, laid out as by build_bbox_wireframe.
+void bbox_corners(const BBox3D &bbox, float *vertex);
+void bbox_edges(size_t i, uint32_t *index);
 
-    return ret;
-}
\ No newline at end of file
+// Fill `wireframe` with the edges of `bboxes`, sized as drawn by addCube(translation, rotation, width, depth, height).
+// The buffers keep their capacity from one call to the next.
+void build_bbox_wireframe(const std::vector<BBox3D> &bboxes, BBoxWireframe &wireframe);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <pcl/visualization/pcl_visualizer.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkProp3D.h>
+#include <vtkSmartPointer.h>
+
+#include "bbox3d.h"
+#include "bbox_slots.h"
+
+
+// The bboxes of the shown frame, drawn as a single line actor whose polydata is updated in place from one frame
+// to the next (instead of one cube actor per box). Labels are optional 3D texts, one per box.
+// Boxes are matched by id with those already drawn (see BBoxSlots) : only the corners of the boxes that appeared,
+// moved or vanished are rewritten, their labels added, moved in place or removed, the others are left alone.
+class BBoxOverlay
+{
+public:
+    BBoxOverlay(pcl::visualization::PCLVisualizer &viewer, bool show_labels = true, const std::string &id = "bboxes");
+
+    // Replace the boxes drawn by those of `bboxes`, returns what changed.
+    const BBoxChanges &update(const std::vector<BBox3D> &bboxes);
+
+private:
+    void add_label(uint32_t slot);
+    void move_label(uint32_t slot);
+
+    pcl::visualization::PCLVisualizer &viewer;
+    std::string id;
+    bool show_labels;
+    BBoxSlots slots;
+    vtkSmartPointer<vtkPolyData> polydata;
+    vtkSmartPointer<vtkPoints> points;
+    vtkSmartPointer<vtkFloatArray> point_data;
+    vtkSmartPointer<vtkCellArray> lines;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bbox3d.h"
+
+
+// What changed between the boxes of two frames (see BBoxSlots::update).
+struct BBoxChanges
+{
+    std::vector<uint32_t> added;       // slots of the boxes whose id wasn't shown
+    std::vector<uint32_t> updated;     // slots of the boxes shown under the same id, moved or resized
+    std::vector<uint32_t> relocated;   // slots an unchanged box was moved to, to fill the slot of a removed one
+    std::vector<std::string> removed;  // keys of the boxes no longer shown
+    size_t unchanged = 0;
+
+    void clear();
+};
+
+// Boxes drawn by an overlay, matched by id from one frame to the next. The shown boxes occupy slots [0, size()),
+// a box keeps its slot as long as its id is shown, so that a new frame only touches the boxes that appeared, moved
+// or vanished : the overlay rewrites the corners of these slots and adds, moves or removes their labels, instead of
+// redrawing everything. A removed box leaves its slot to the last one, which keeps the slots contiguous.
+// Boxes sharing an id within a frame are told apart by their rank ("car_3", "car_3#2"...).
+class BBoxSlots
+{
+public:
+    // Match `bboxes` with the boxes of the previous call.
+    const BBoxChanges &update(const std::vector<BBox3D> &bboxes);
+
+    size_t size() const { return this->slots.size(); }
+    const BBox3D &box(uint32_t slot) const { return this->slots[slot].box; }
+    // Unique id of the box of a slot.
+    const std::string &key(uint32_t slot) const { return this->slots[slot].key; }
+    const BBoxChanges &changes() const { return this->last_changes; }
+
+private:
+    struct Slot
+    {
+        BBox3D box;
+        std::string key;
+        uint32_t seen = 0;  // epoch of the last update the id was in
+        bool added = false;
+        bool updated = false;
+        bool relocated = false;
+    };
+
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, uint32_t> slot_of;
+    uint32_t epoch = 0;
+    BBoxChanges last_changes;
+};
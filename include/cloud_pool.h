@@ -0,0 +1,61 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "pointcloud_processing.h"
+
+
+// Recycles the point clouds of decoded frames, so that steady-state frame loading reuses the
+// point storage of frames that were dropped instead of allocating it again.
+//
+// acquire() hands out a cloud whose deleter gives it back to the pool : when the last FramePtr
+// holding it goes away (cache eviction, prefetch slot dropped, frame replaced on screen), its buffer
+// becomes available to the next load. At most `max_free` buffers are kept, extra ones are freed.
+// The pool can be destroyed before the clouds it handed out, they are then simply deleted.
+class CloudPool
+{
+public:
+    explicit CloudPool(size_t max_free = 8);
+    ~CloudPool();
+
+    CloudPool(const CloudPool &) = delete;
+    CloudPool &operator=(const CloudPool &) = delete;
+
+    // Empty cloud, with the largest recycled capacity available. Thread-safe.
+    PointCloudT::Ptr acquire();
+
+    // Clouds allocated because no buffer was free, and buffers whose point storage had to grow
+    // while they were handed out. Both stop increasing once the sequence reaches steady state.
+    size_t allocations() const;
+    size_t reallocations() const;
+    // Clouds handed out from a recycled buffer.
+    size_t recycled() const;
+    size_t free_buffers() const;
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Buffer
+    {
+        PointCloudT *cloud;
+        size_t capacity;  // points capacity when handed out
+    };
+
+    struct Shared
+    {
+        std::mutex mtx;
+        size_t max_free;
+        std::vector<Buffer> free_list;
+        size_t n_allocations = 0;
+        size_t n_reallocations = 0;
+        size_t n_recycled = 0;
+        bool alive = true;
+
+        void release(PointCloudT *cloud, size_t capacity);
+    };
+
+    // Shared with the deleters of the clouds handed out, which may outlive the pool.
+    std::shared_ptr<Shared> shared;
+};
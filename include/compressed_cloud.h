@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+
+#include "pointcloud_processing.h"
+
+
+// Storage of the points of a compressed cloud. Colours are never stored : they only depend on the colour config,
+// apply_color regenerates them after decoding.
+enum PointCodec
+{
+    POINT_CODEC_NONE = 0,     // not compressed (stored as POINT_CODEC_FLOAT when a CompressedCloud is built anyway)
+    POINT_CODEC_FLOAT = 1,    // lossless : float xyz and intensity, 12 (16 with intensity) bytes per point
+    POINT_CODEC_QUANT16 = 2,  // lossy : xyz and intensity as 16 bit steps of the frame bounds, 6 (8) bytes per point
+    POINT_CODEC_COUNT
+};
+
+const char *point_codec_name(int codec);
+bool parse_point_codec(const std::string &name, PointCodec &codec);
+
+// Points and intensities of a cloud in compressed form. Encoding and decoding split large clouds over threads.
+class CompressedCloud
+{
+public:
+    CompressedCloud() = default;
+    // `intensity` is only kept when it holds one value per point.
+    CompressedCloud(const PointCloudT &cloud, const std::vector<float> &intensity, PointCodec codec);
+
+    PointCodec codec() const { return this->point_codec; }
+    size_t size() const { return this->num_points; }
+    bool empty() const { return this->num_points == 0; }
+    size_t size_bytes() const;
+
+    // Largest difference per axis between an input point and its decoded position (0 when lossless).
+    Eigen::Vector3f max_error() const;
+
+    // Points into `cloud` (resized, colours reset to the default of PointT) and intensities into `intensity`
+    // (cleared when there were none). Non-finite input points decode as NaN.
+    void decode(PointCloudT &cloud, std::vector<float> &intensity) const;
+
+private:
+    PointCodec point_codec = POINT_CODEC_FLOAT;
+    size_t num_points = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool dense = true;
+    bool has_intensity = false;
+
+    // POINT_CODEC_QUANT16 : value = origin + level * step.
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+    Eigen::Vector3f step = Eigen::Vector3f::Zero();
+    float intensity_origin = 0.0f;
+    float intensity_step = 0.0f;
+
+    std::vector<float> xyz;                // POINT_CODEC_FLOAT, 3 per point
+    std::vector<float> values;             // POINT_CODEC_FLOAT intensities
+    std::vector<uint16_t> xyz_levels;      // POINT_CODEC_QUANT16, 3 per point
+    std::vector<uint16_t> value_levels;    // POINT_CODEC_QUANT16 intensities
+};
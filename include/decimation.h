@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "pointcloud_processing.h"
+
+
+enum DecimationMethod
+{
+    DECIMATION_VOXEL = 0,   // centroid of each occupied voxel
+    DECIMATION_RANDOM = 1,  // random subset of the points
+    DECIMATION_METHOD_COUNT
+};
+
+// Level-of-detail stage run between loading and colouring : frames with more than `max_points` points
+// are reduced to at most `max_points` points for display.
+struct DecimationConfig
+{
+    size_t max_points = 0;  // point budget of a frame, 0 disables the stage
+    int method = DECIMATION_VOXEL;
+    // Edge of the voxels in metres. 0 derives it from the xy extent of the cloud and the budget.
+    float voxel_size = 0.0f;
+};
+
+inline bool decimation_needed(size_t points, const DecimationConfig &config)
+{
+    return config.max_points > 0 && points > config.max_points;
+}
+
+// Reduce `input` to at most config.max_points points into `output`, `intensity` (ignored unless it has one value
+// per point) follows the points into `output_intensity`.
+//
+// voxel : the points are hashed into a voxel grid on all cores, each occupied voxel gives the centroid (and mean
+// intensity) of its finite points. When the voxels still exceed the budget, a random subset of them is kept.
+// random : exactly max_points points, one drawn at random in each of max_points equal slices of the cloud,
+// so that the scan structure is thinned evenly. Both are deterministic for a given cloud, whatever the number of cores.
+//
+// Returns the voxel size used (0 for random). The input is copied as is when it is within budget.
+float decimate_cloud(const PointCloudT &input, const std::vector<float> &intensity, const DecimationConfig &config,
+                     PointCloudT &output, std::vector<float> &output_intensity);
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bbox3d.h"
+#include "cloud_pool.h"
+#include "compressed_cloud.h"
+#include "decimation.h"
+#include "frame_source.h"
+#include "point_filter.h"
+#include "pointcloud_processing.h"
+
+class FrameSpatialIndex;
+
+// A decoded frame of the sequence : coloured point cloud + its annotations.
+struct Frame
+{
+    int index;
+    std::string pcd_file;
+    PointCloudT::Ptr cloud;
+    std::vector<float> intensity;  // empty when the pcd file has no intensity field
+    std::vector<BBox3D> bboxes;
+    LidarPose pose;                // pose.valid is false when the frame has no annotation file
+    unsigned color_version;        // FramePipelineConfig::color_version the cloud was coloured with
+
+    // Full-resolution points kept in reserve when `cloud` was decimated (nullptr otherwise), coloured on demand.
+    PointCloudT::Ptr full_cloud;
+    std::vector<float> full_intensity;
+    bool full_colored;
+    unsigned full_color_version;
+
+    // Points kept / dropped by the filter stage, input 0 when no stage drops points.
+    FilterStats filter;
+
+    // Time spent in each stage of load_frame, in ms. filter_ms / decimate_ms are 0 when the frame wasn't
+    // filtered / decimated.
+    double load_ms;
+    double filter_ms;
+    double decimate_ms;
+    double color_ms;
+
+    // Built on the first spatial query (see frame_spatial_index), nullptr until then.
+    std::shared_ptr<const FrameSpatialIndex> spatial_index;
+};
+
+// Processing applied to every frame after loading.
+struct FramePipelineConfig
+{
+    ColorConfig color;
+    // Bumped whenever `color` changes, frames coloured with an older version have to be recoloured.
+    unsigned color_version = 0;
+    // Crops and bbox label lists applied right after loading.
+    FilterConfig filter;
+    // Level of detail applied between filtering and colouring.
+    DecimationConfig decimation;
+};
+
+using FramePtr = std::shared_ptr<Frame>;
+
+// color_version of a frame whose cloud hasn't been coloured yet (decoded from a CompressedFrame).
+const unsigned kColorVersionNone = ~0u;
+
+// Frame held in compressed form (see FrameCache) : boxes, pose and timings as is, the clouds compressed and
+// without colours. The spatial index isn't part of it, FrameCache keeps it next to the compressed frame.
+struct CompressedFrame
+{
+    int index;
+    std::string pcd_file;
+    std::vector<BBox3D> bboxes;
+    LidarPose pose;
+    FilterStats filter;
+    double load_ms;
+    double filter_ms;
+    double decimate_ms;
+    double color_ms;
+
+    CompressedCloud cloud;
+    CompressedCloud full_cloud;  // empty when the frame wasn't decimated
+    size_t frame_bytes;          // frame_size_bytes() of the frame it was compressed from
+};
+
+using CompressedFramePtr = std::shared_ptr<const CompressedFrame>;
+
+CompressedFramePtr compress_frame(const Frame &frame, PointCodec codec);
+// Decode `frame` into clouds of `pool` (when given). The clouds are left uncoloured (color_version is
+// kColorVersionNone), update_frame_color / update_full_color colour them.
+FramePtr decompress_frame(const CompressedFrame &frame, CloudPool *pool = nullptr);
+size_t compressed_frame_size_bytes(const CompressedFrame &frame);
+
+// Heap memory held by the frame (point storage, boxes and strings), used for cache accounting.
+size_t frame_size_bytes(const Frame &frame);
+
+// Resolve the annotation file of `pcd_file_path` under `annot_path` (directory or single .json file).
+// Returns an empty string when no annotation is configured or the path doesn't exist.
+std::string find_annot_file(const std::string &annot_path, const std::string &pcd_file_path);
+
+bool load_frame_annot(const std::string &annot_path, const std::string &pcd_file_path, std::vector<BBox3D> &bboxes,
+                      LidarPose *pose = nullptr);
+
+// Load the points of a pcd file, plus its intensity field when there is one.
+// Binary files are read through read_pcd_mmap(), other formats through PCL.
+bool load_frame_cloud(const std::string &pcd_file, PointCloudT &cloud, std::vector<float> &intensity);
+
+// Load, annotate, filter, decimate and colour frame `index` of `source`. Doesn't touch any viewer state, so it is safe to call
+// from worker threads. The points are loaded into buffers of `pool` when given. Returns nullptr when the point cloud
+// cannot be loaded.
+FramePtr load_frame(const FrameSource &source, int index,
+                    const FramePipelineConfig &pipeline = FramePipelineConfig(), CloudPool *pool = nullptr);
+
+// Recolour the frame if it was coloured with another version of the pipeline colour config.
+void update_frame_color(Frame &frame, const FramePipelineConfig &pipeline);
+// Same for the full-resolution cloud of a decimated frame, which is only coloured once it is about to be shown.
+void update_full_color(Frame &frame, const FramePipelineConfig &pipeline);
+
+// Min/max of the colour source of `config` over the whole sequence, loading the frames on all cores.
+// Over the points kept by `filter` when given. Frames that can't be loaded (or throw) are left out.
+bool compute_sequence_color_range(const FrameSource &source, const ColorConfig &config, float &min, float &max,
+                                  const FilterConfig *filter = nullptr);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "frame.h"
+#include "frame_provider.h"
+
+
+struct AccumulationConfig
+{
+    int frames = 1;               // sweeps overlaid, the shown one and the K - 1 before it. <= 1 disables accumulation
+    size_t max_points = 2000000;  // cap on the points of the merged cloud, 0 : no cap
+    // Express the older sweeps in the lidar frame of the shown one through the Lidar poses of their annotation
+    // files. Sweeps without a pose are overlaid as they are.
+    bool use_pose = false;
+    // Colour of the oldest sweep blended this much towards white (the background), linearly with age.
+    float fade = 0.7f;
+};
+
+inline bool accumulation_enabled(const AccumulationConfig &config)
+{
+    return config.frames > 1;
+}
+
+// Sliding window of the last K frames of a sequence, merged into a single cloud for display.
+//
+// The window holds the decoded frames themselves (shared with the cache, nothing is copied) keyed by index.
+// advance() slides it to end on a new frame : frames still in the window are kept, only the missing ones are
+// fetched from the provider, so stepping to the next frame costs one decode. The merged cloud is rebuilt on all
+// cores in the same pass that transforms each sweep into the lidar frame of the newest one and tints it by age.
+// Frames are downsampled evenly to fit config.max_points.
+class FrameAccumulator
+{
+public:
+    FrameAccumulator(FrameProvider &provider, const AccumulationConfig &config);
+
+    FrameAccumulator(const FrameAccumulator &) = delete;
+    FrameAccumulator &operator=(const FrameAccumulator &) = delete;
+
+    // Slide the window to end on `frame` (frames [index - K + 1, index], clipped at 0) and rebuild the merged cloud.
+    // Returns the number of frames that had to be fetched. Frames that can't be loaded are left out.
+    int advance(const FramePtr &frame);
+    // Recolour the frames of the window for the current colour config of the provider and rebuild the merged cloud.
+    void recolor();
+
+    // Merged cloud of the window, the same buffer is refilled by every advance().
+    const PointCloudT::Ptr &cloud() const { return this->merged; }
+    int frames() const { return this->window.size(); }
+    // Frames of the window overlaid without transformation because they (or the newest frame) have no pose.
+    int frames_without_pose() const { return this->n_without_pose; }
+    const AccumulationConfig &config() const { return this->settings; }
+
+    size_t fetched() const { return this->n_fetched; }
+    size_t reused() const { return this->n_reused; }
+    double merge_ms() const { return this->last_merge_ms; }
+    void print_stats(std::ostream &os) const;
+
+private:
+    void merge();
+
+    FrameProvider &provider;
+    AccumulationConfig settings;
+    std::vector<FramePtr> window;  // newest first
+    PointCloudT::Ptr merged;
+    int n_without_pose = 0;
+    size_t n_fetched = 0;
+    size_t n_reused = 0;
+    double last_merge_ms = 0.0;
+};
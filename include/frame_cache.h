@@ -0,0 +1,71 @@
+#pragma once
+
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "frame.h"
+
+
+// Decoded frames keyed by index into pcd_files, bounded by the memory they hold
+// (see frame_size_bytes) and evicted in least-recently-used order.
+//
+// With a codec other than POINT_CODEC_NONE, frames are kept compressed (see compress_frame) so that many more of
+// them fit in the budget : put() compresses, get() decodes into clouds of `pool` and returns a new, uncoloured
+// frame on every hit. A spatial index built on a returned frame is kept alongside the compressed entry and attached
+// to the frames decoded from it afterwards.
+class FrameCache
+{
+public:
+    explicit FrameCache(size_t budget_bytes, PointCodec codec = POINT_CODEC_NONE, CloudPool *pool = nullptr);
+
+    FrameCache(const FrameCache &) = delete;
+    FrameCache &operator=(const FrameCache &) = delete;
+
+    // Returns the cached frame and marks it as most recently used, nullptr on a miss.
+    FramePtr get(int pcd_id);
+    bool contains(int pcd_id) const;
+    void put(const FramePtr &frame);
+    // Charge the entry of `frame` for what was attached to the frame after put() (its spatial index), evicting
+    // other frames as needed. Does nothing when the frame isn't cached.
+    void update_size(const FramePtr &frame);
+    void clear();
+
+    size_t budget() const { return budget_bytes; }
+    PointCodec codec() const { return point_codec; }
+    size_t size_bytes() const;
+    // frame_size_bytes() of the cached frames, the same as size_bytes() without compression.
+    size_t frame_bytes() const;
+    size_t hits() const;
+    size_t misses() const;
+    size_t evictions() const;
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Entry
+    {
+        int pcd_id;
+        FramePtr frame;                 // without compression
+        CompressedFramePtr compressed;  // with compression
+        std::shared_ptr<const FrameSpatialIndex> spatial_index;  // with compression, once built on a decoded frame
+        size_t bytes;
+        size_t frame_bytes;
+    };
+
+    void evict_to(size_t target_bytes);
+
+    size_t budget_bytes;
+    PointCodec point_codec;
+    CloudPool *pool;
+    size_t used_bytes;
+    size_t used_frame_bytes;
+    std::list<Entry> lru;  // most recently used first
+    std::unordered_map<int, std::list<Entry>::iterator> entries;
+
+    size_t n_hits;
+    size_t n_misses;
+    size_t n_evictions;
+
+    mutable std::mutex mtx;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+#include "frame_cache.h"
+
+
+// Loads the frames around the currently shown one on a pool of worker threads,
+// so that stepping to a neighbouring frame swaps in an already decoded frame.
+//
+// The ready frames are kept in a bounded ring of (1 + ahead + behind) slots.
+// Each recenter() re-targets the ring on a new frame : slots falling out of the window
+// are dropped (queued loads are cancelled, in-flight results are discarded) and the
+// missing neighbours are queued nearest first. Frames already held by `cache` (optional) are not loaded again,
+// frames are loaded into buffers of `pool` (optional).
+class FramePrefetcher
+{
+public:
+    FramePrefetcher(
+        FrameSourcePtr source,
+        int ahead, int behind, int num_workers, const FrameCache *cache = nullptr, CloudPool *pool = nullptr);
+    ~FramePrefetcher();
+
+    FramePrefetcher(const FramePrefetcher &) = delete;
+    FramePrefetcher &operator=(const FramePrefetcher &) = delete;
+
+    // Returns the decoded frame `pcd_id` if it is ready (or waits for it when it is being loaded),
+    // nullptr otherwise. A nullptr result counts as a miss : the caller is expected to load the frame itself.
+    FramePtr get(int pcd_id);
+    // The decoded frame `pcd_id` if it is ready, nullptr otherwise without waiting for it or cancelling its load.
+    // Only a ready frame counts (as a hit).
+    FramePtr peek(int pcd_id);
+    void recenter(int pcd_id);
+    void cancel();
+    // Processing applied to frames loaded from now on. Frames already decoded keep their colour version.
+    void set_pipeline(const FramePipelineConfig &pipeline);
+
+    size_t hits() const { return n_hits; }
+    size_t misses() const { return n_misses; }
+    size_t cancelled() const { return n_cancelled; }
+    void print_stats(std::ostream &os) const;
+
+private:
+    enum SlotState
+    {
+        SLOT_EMPTY,
+        SLOT_QUEUED,
+        SLOT_LOADING,
+        SLOT_READY,
+        SLOT_FAILED
+    };
+
+    struct Slot
+    {
+        int index;
+        SlotState state;
+        unsigned long ticket;
+        FramePtr frame;
+    };
+
+    void worker_loop();
+    Slot *find_slot(int pcd_id);
+    void release_slot(Slot &slot);
+
+    FrameSourcePtr source;
+    int ahead;
+    int behind;
+    const FrameCache *cache;
+    CloudPool *pool;
+    FramePipelineConfig pipeline;
+
+    std::vector<Slot> ring;
+    std::deque<int> queue;
+    unsigned long next_ticket;
+    bool stopping;
+
+    mutable std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable ready_cv;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> n_hits;
+    std::atomic<size_t> n_misses;
+    std::atomic<size_t> n_cancelled;
+};
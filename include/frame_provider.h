@@ -0,0 +1,84 @@
+#pragma once
+
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "cloud_pool.h"
+#include "frame.h"
+#include "frame_cache.h"
+#include "frame_prefetcher.h"
+#include "frame_source.h"
+
+
+struct FrameProviderOptions
+{
+    // Frames decoded in background ahead of / behind the last one requested, both 0 disable prefetching.
+    int prefetch_ahead = 2;
+    int prefetch_behind = 2;
+    int threads = 2;
+    size_t cache_bytes = size_t(512) * 1024 * 1024;  // memory budget of the decoded frame cache, 0 disables it
+    PointCodec cache_codec = POINT_CODEC_NONE;        // frames kept compressed in the cache (see FrameCache)
+    FramePipelineConfig pipeline;
+};
+
+// Walking a sequence once in order (export, batch tools) : every worker decodes ahead, nothing is cached.
+FrameProviderOptions sequential_provider_options(int threads, const FramePipelineConfig &pipeline = FramePipelineConfig());
+
+// Ready frames of a sequence by index : the frame pipeline (decode, decimation, colouring, annotations) behind a
+// cache and a prefetch ring, without any GUI dependency. The viewer, the benchmarks and batch tools all go
+// through it.
+class FrameProvider
+{
+public:
+    explicit FrameProvider(FrameSourcePtr source, const FrameProviderOptions &options = FrameProviderOptions());
+
+    FrameProvider(const FrameProvider &) = delete;
+    FrameProvider &operator=(const FrameProvider &) = delete;
+
+    int size() const { return this->source->size(); }
+    std::string name(int index) const { return this->source->name(index); }
+    const FrameSourcePtr &frame_source() const { return this->source; }
+
+    // Frame `index`, coloured with the current colour config. Taken from the cache or the prefetch ring when it is
+    // there, loaded on the calling thread otherwise, and prefetching is re-targeted around it.
+    // nullptr when the point cloud can't be loaded. Thread-safe.
+    FramePtr get(int index);
+    // get() without waiting : the frame when it is already decoded (cache or ready prefetch slot), nullptr when it
+    // is still being loaded or not even queued.
+    FramePtr try_get(int index);
+    // Re-target prefetching around `index` without fetching it.
+    void recenter(int index);
+    bool prefetching() const { return this->prefetcher != nullptr; }
+    // get() on a background thread. The provider has to outlive the future.
+    std::shared_future<FramePtr> get_async(int index);
+
+    FramePipelineConfig pipeline() const;
+    // Colour config of the frames returned from now on. Frames decoded earlier are recoloured when returned again.
+    void set_color(const ColorConfig &color);
+    // Recolour the cloud of `frame` / its full-resolution cloud if it was coloured with another colour config.
+    void update_color(Frame &frame);
+    void update_full_color(Frame &frame);
+    // Spatial index of `frame` (see frame_spatial_index), charged to the cache entry of the frame once built.
+    std::shared_ptr<const FrameSpatialIndex> spatial_index(const FramePtr &frame);
+
+    // Min/max of the colour source of `color` over the points of the whole sequence kept by the filter of the
+    // pipeline, loading the frames on all cores.
+    bool compute_color_range(const ColorConfig &color, float &min, float &max) const;
+
+    const CloudPool &cloud_pool() const { return *(this->pool); }
+    const FrameCache *frame_cache() const { return this->cache.get(); }
+    const FramePrefetcher *frame_prefetcher() const { return this->prefetcher.get(); }
+    void print_stats(std::ostream &os) const;
+
+private:
+    FrameSourcePtr source;
+    mutable std::mutex mtx;         // guards current_pipeline
+    std::mutex color_mtx;           // serialises recolouring, frames can be shared by several callers
+    FramePipelineConfig current_pipeline;
+    std::unique_ptr<CloudPool> pool;
+    std::unique_ptr<FrameCache> cache;
+    std::unique_ptr<FramePrefetcher> prefetcher;
+};
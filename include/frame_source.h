@@ -0,0 +1,84 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bbox3d.h"
+#include "pointcloud_processing.h"
+#include "seq_file.h"
+#include "sequence_index.h"
+
+
+// Where the frames of a sequence come from. Loading must be safe to call from several threads at once
+// (the prefetch workers share the source).
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    virtual int size() const = 0;
+    // Name shown for the frame (pcd file path).
+    virtual std::string name(int index) const = 0;
+    virtual bool load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const = 0;
+    // Annotations of the frame, empty when it has none. false when they exist but couldn't be read.
+    // The Lidar pose of the annotation file goes to `pose` when given, it is left invalid when the source has none.
+    virtual bool load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr) const = 0;
+};
+
+using FrameSourcePtr = std::shared_ptr<const FrameSource>;
+
+// The .pcd files of a directory in natural name order (see natural_less), or the single file `pcd_path`.
+// Throws std::runtime_error when `pcd_path` is empty or doesn't exist.
+std::vector<std::string> find_pcd_files(const std::string &pcd_path);
+
+// One pcd file per frame, with annotations under `annot_path`. Until the annotation files are paired with the
+// frames (given by a SequenceIndex, or by index_in_background), they are looked up by stem at each load
+// (see find_annot_file).
+class PcdFileSource : public FrameSource
+{
+public:
+    PcdFileSource(const std::vector<std::string> &pcd_files, const std::string &annot_path);
+    PcdFileSource(const SequenceIndex &index, const std::string &annot_path);
+    ~PcdFileSource() override;
+
+    int size() const override { return this->pcd_files.size(); }
+    std::string name(int index) const override { return this->pcd_files[index]; }
+    bool load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const override;
+    bool load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr) const override;
+
+    // Pair the annotation files with the frames on a background thread, then write the index cache of `pcd_dir`
+    // (see save_sequence_index), listed when it had the modification time `listed_mtime_ns`.
+    void index_in_background(const std::string &pcd_dir, int64_t listed_mtime_ns);
+    bool annotations_paired() const;
+
+private:
+    std::vector<std::string> pcd_files;
+    std::string annot_path;
+    // Annotation file of each frame once paired, accessed with std::atomic_load / std::atomic_store.
+    std::shared_ptr<const std::vector<std::string>> annot_files;
+    std::thread indexer;
+};
+
+// Frames of a packed .seq file (see seq_file.h).
+class SeqFileSource : public FrameSource
+{
+public:
+    explicit SeqFileSource(const std::string &seq_path) : file(seq_path) {}
+
+    int size() const override { return this->file.size(); }
+    std::string name(int index) const override { return this->file.name(index); }
+    bool load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const override;
+    // `pose` is left invalid for the frames packed without one, and for version 1 files.
+    bool load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr) const override;
+
+private:
+    SeqFile file;
+};
+
+// The packed sequence `pcd_path` when it is a .seq file (annotations come from the file, `annot_path` is ignored),
+// its pcd files with the annotations under `annot_path` otherwise. The index of a directory is read from its cache
+// when it is up to date, else the directory is listed and the annotations are paired in background.
+// Throws std::runtime_error when there is no frame to read.
+FrameSourcePtr open_frame_source(const std::string &pcd_path, const std::string &annot_path);
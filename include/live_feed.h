@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bbox3d.h"
+#include "frame_source.h"
+#include "pointcloud_processing.h"
+#include "stage_profiler.h"
+
+
+// Live frames handed from one producer process (a sensor driver, tools/live_replay.cpp) to one viewer through a
+// POSIX shared memory object, both on the same machine.
+//
+// Layout of the object (/dev/shm/<name>, native byte order) :
+//   LiveRingHeader              64 bytes
+//   kLiveSlots slots            slot_bytes each :
+//     LiveFrameHeader           96 bytes
+//     points                    num_points PointXYZRGB, in memory layout (32 bytes each)
+//     intensity                 num_points float32, when the frame has an intensity field
+//     bboxes                    num_bboxes SeqBBoxRecord, each followed by its id, as in .seq files
+//     name                      name_length chars
+//
+// The slots form a triple buffer : the producer fills the slot it owns then exchanges it with the middle one, the
+// consumer exchanges the slot it owns with the middle one when that holds a frame it hasn't taken. Each exchange is
+// a single atomic operation and neither side ever waits for the other : a frame the consumer didn't take in time is
+// replaced by the next one (latest frame wins), so the viewer never lags behind the producer.
+const char kLiveMagic[8] = {'P', 'C', 'L', 'I', 'V', 'E', '\0', '\0'};
+const uint32_t kLiveVersion = 1;
+const uint32_t kLiveSlots = 3;
+// LiveRingHeader::middle : the middle slot holds a frame the consumer hasn't taken yet.
+const uint32_t kLiveFresh = 0x80000000u;
+
+struct LiveRingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_slots;
+    uint64_t slot_bytes;
+    uint64_t session;                   // different for every producer that created the object
+    std::atomic<uint32_t> middle;       // slot index | kLiveFresh
+    std::atomic<uint32_t> front;        // slot owned by the consumer, kept here for a consumer that reconnects
+    std::atomic<uint32_t> closed;       // the producer exited
+    uint32_t reserved;
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> overwritten;  // frames replaced before the consumer took them
+};
+
+struct LiveFrameHeader
+{
+    uint64_t sequence;     // 1 for the first frame published in the session
+    int64_t stamp_ns;      // steady clock (CLOCK_MONOTONIC) when the producer got the frame, for latency
+    uint64_t num_points;
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;        // kLiveFrame*
+    uint32_t num_bboxes;
+    uint32_t bboxes_bytes;
+    uint32_t name_length;
+    float pose[7];         // translation x y z, rotation w x y z, when kLiveFramePose
+    uint8_t reserved[20];
+};
+
+const uint32_t kLiveFrameDense = 1;
+const uint32_t kLiveFrameIntensity = 2;
+const uint32_t kLiveFramePose = 4;
+
+static_assert(sizeof(LiveRingHeader) == 64, "unexpected LiveRingHeader padding");
+static_assert(sizeof(LiveFrameHeader) == 96, "unexpected LiveFrameHeader padding");
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "the live ring needs address-free atomics");
+
+// Mapping of a live ring object. The producer creates it (and unlinks it on destruction), the consumer opens it.
+class LiveRing
+{
+public:
+    // Create the object `name` ("cloud_viewer" : /dev/shm/cloud_viewer), replacing any previous one.
+    // Throws std::runtime_error when it can't be created.
+    static std::unique_ptr<LiveRing> create(const std::string &name, size_t slot_bytes);
+    // Map the object `name`, nullptr when there is none or it isn't a live ring.
+    static std::unique_ptr<LiveRing> open(const std::string &name);
+    ~LiveRing();
+
+    LiveRing(const LiveRing &) = delete;
+    LiveRing &operator=(const LiveRing &) = delete;
+
+    LiveRingHeader &header() { return *reinterpret_cast<LiveRingHeader *>(this->addr); }
+    uint8_t *slot(uint32_t index) { return this->addr + sizeof(LiveRingHeader) + size_t(index) * this->header().slot_bytes; }
+    const std::string &name() const { return this->object_name; }
+
+private:
+    LiveRing(const std::string &object_name, uint8_t *addr, size_t length, bool owner);
+
+    std::string object_name;
+    uint8_t *addr;
+    size_t length;
+    bool owner;
+};
+
+// Bytes a frame takes in a slot.
+size_t live_frame_bytes(size_t num_points, bool intensity, const std::vector<BBox3D> &bboxes, const std::string &name);
+
+// Producer end : packs frames into its slot and publishes them.
+class LiveFrameWriter
+{
+public:
+    // Creates the ring `name` with slots of `slot_bytes`, see LiveRing::create.
+    LiveFrameWriter(const std::string &name, size_t slot_bytes);
+    // Marks the ring closed, so that the viewer waits for the next producer.
+    ~LiveFrameWriter();
+
+    // Copy the frame into the producer's slot and make it the newest one. `intensity` is ignored unless it has one
+    // value per point, `pose` when it isn't valid. false when the frame doesn't fit in a slot.
+    bool publish(const PointCloudT &cloud, const std::vector<float> &intensity, const std::vector<BBox3D> &bboxes,
+                 const LidarPose &pose, const std::string &name, int64_t stamp_ns);
+
+    size_t slot_bytes() const { return this->capacity; }
+    uint64_t published() const { return this->sequence; }
+    uint64_t overwritten();
+
+private:
+    std::unique_ptr<LiveRing> ring;
+    size_t capacity;
+    uint32_t back = 0;
+    uint64_t sequence = 0;
+};
+
+// Steady clock time in ns as stamped in LiveFrameHeader::stamp_ns.
+int64_t live_clock_ns();
+
+// Consumer end, as a single-frame source : frame 0 is the frame taken last by take(), loaded straight out of the
+// consumer's slot, which the producer never writes. take() must not run while a frame is being loaded : the viewer
+// does both on its own thread (the provider of a live source neither caches nor prefetches).
+class LiveFrameSource : public FrameSource
+{
+public:
+    // Doesn't wait for the producer : the ring is mapped by take() once it exists.
+    explicit LiveFrameSource(const std::string &name);
+
+    int size() const override { return 1; }
+    std::string name(int index) const override;
+    bool load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const override;
+    bool load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr) const override;
+
+    // Make the newest published frame frame 0. false when there is none newer than the current one. Maps the ring
+    // when the producer creates it, and maps it again when a new producer replaces it.
+    bool take();
+    bool connected() const { return this->ring != nullptr; }
+    bool has_frame() const { return this->current != nullptr; }
+    uint64_t sequence() const { return this->current_header.sequence; }
+    // Record that the frame taken last is on screen, for the end-to-end latency.
+    void record_shown();
+
+    uint64_t taken() const { return this->n_taken; }
+    // Frames published but never taken, counted from the gaps in the sequence numbers.
+    uint64_t skipped() const { return this->n_skipped; }
+    const DurationHistogram &take_latency() const { return this->taken_ms; }
+    const DurationHistogram &shown_latency() const { return this->shown_ms; }
+    void print_stats(std::ostream &os) const;
+
+private:
+    bool reconnect();
+    // Offset of the name of the current frame in its slot, the bboxes end there.
+    size_t name_offset() const;
+
+    std::string ring_name;
+    std::unique_ptr<LiveRing> ring;
+    uint64_t session = 0;
+    const uint8_t *current = nullptr;  // consumer's slot once a frame was taken
+    LiveFrameHeader current_header{};
+    int64_t last_take_ns = 0;
+    int64_t last_reconnect_ns = 0;
+    uint64_t n_taken = 0;
+    uint64_t n_skipped = 0;
+    DurationHistogram taken_ms;
+    DurationHistogram shown_ms;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CLOUD_VIEWER_HAVE_MMAP 1
+#endif
+
+
+// Read-only mapping of a whole file, unmapped on destruction. data() is nullptr when the file can't be
+// mapped (missing, empty, or a platform without mmap). `populate` faults the whole file in at once,
+// for files that are about to be read entirely ; large files read piecewise should use will_need().
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path, bool populate = true)
+    {
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= populate ? MAP_POPULATE : 0;
+#endif
+            void *addr = ::mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                this->addr = static_cast<const uint8_t *>(addr);
+                this->length = st.st_size;
+#ifndef MAP_POPULATE
+                if (populate)
+                {
+                    this->will_need(0, this->length);
+                }
+#endif
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+        if (this->addr != nullptr)
+        {
+            ::munmap(const_cast<uint8_t *>(this->addr), this->length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Hint that [offset, offset + length) is about to be read, so that it is read ahead in one go.
+    void will_need(size_t offset, size_t length) const
+    {
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+        // madvise wants a page-aligned start.
+        size_t page = size_t(::sysconf(_SC_PAGESIZE));
+        size_t begin = offset / page * page;
+        if (this->addr != nullptr && begin < this->length)
+        {
+            ::madvise(const_cast<uint8_t *>(this->addr) + begin, std::min(offset + length, this->length) - begin, MADV_WILLNEED);
+        }
+#endif
+    }
+
+    const uint8_t *data() const { return this->addr; }
+    size_t size() const { return this->length; }
+
+private:
+    const uint8_t *addr = nullptr;
+    size_t length = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+// Set on the threads of a pool that already keeps every core busy with a task each (e.g. one frame per thread of a
+// batch conversion) : parallel_for() then runs inline on them instead of spawning threads of its own.
+inline bool &parallel_for_inline()
+{
+    thread_local bool inline_only = false;
+    return inline_only;
+}
+
+// Number of chunks parallel_for() splits `n` items into, at least `min_chunk` items per chunk.
+inline size_t parallel_num_chunks(size_t n, size_t min_chunk)
+{
+    static const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (parallel_for_inline())
+    {
+        return 1;
+    }
+    size_t chunks = (min_chunk > 0) ? n / min_chunk : n;
+    return std::max<size_t>(1, std::min(chunks, max_threads));
+}
+
+// Process [0, n) as contiguous chunks, f(begin, end, chunk_id), on parallel_num_chunks(n, min_chunk) threads.
+// The calling thread takes the first chunk. Small inputs run inline without spawning any thread.
+template <typename F>
+void parallel_for(size_t n, size_t min_chunk, F &&f)
+{
+    size_t num_chunks = parallel_num_chunks(n, min_chunk);
+    if (num_chunks <= 1)
+    {
+        f(size_t(0), n, size_t(0));
+        return;
+    }
+
+    size_t chunk = (n + num_chunks - 1) / num_chunks;
+    std::vector<std::thread> threads;
+    threads.reserve(num_chunks - 1);
+    for (size_t c = 1; c < num_chunks; ++c)
+    {
+        size_t begin = std::min(n, c * chunk);
+        size_t end = std::min(n, begin + chunk);
+        threads.emplace_back([&f, begin, end, c] { f(begin, end, c); });
+    }
+    f(size_t(0), std::min(n, chunk), size_t(0));
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+}
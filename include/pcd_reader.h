@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pointcloud_processing.h"
+
+
+// Reads a binary pcd file by memory-mapping it : the header is parsed once and the points are
+// copied straight out of the mapping, in parallel for large clouds, with no intermediate blob.
+// The intensity field, when there is one, is read in the same pass.
+//
+// Returns false when the file can't be read this way (DATA ascii / binary_compressed, x/y/z not
+// float32, malformed or truncated file, platform without mmap) : the caller then falls back to PCL,
+// which also reports the actual error.
+bool read_pcd_mmap(const std::string &pcd_file, PointCloudT &cloud, std::vector<float> &intensity);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "pointcloud_processing.h"
+
+
+// DATA section of a written pcd file.
+enum PcdDataFormat
+{
+    PCD_DATA_BINARY = 0,             // points one after the other, as read_pcd_mmap reads them
+    PCD_DATA_BINARY_COMPRESSED = 1,  // fields one after the other, LZF compressed (PCL's binary_compressed)
+    PCD_DATA_FORMAT_COUNT
+};
+
+const char *pcd_data_format_name(int format);
+bool parse_pcd_data_format(const std::string &name, PcdDataFormat &format);
+
+// Whole pcd file of `cloud` into `data` : fields x y z rgb, plus intensity when `intensity` has one value per point,
+// with the width / height of the cloud when it is organized and its sensor pose as VIEWPOINT. `data` keeps its
+// capacity from one call to the next, the field buffer of binary_compressed is kept per thread.
+void encode_pcd(const PointCloudT &cloud, const std::vector<float> &intensity, PcdDataFormat format, std::string &data);
+
+// encode_pcd() to `pcd_file`, false when it can't be written.
+bool write_pcd(const std::string &pcd_file, const PointCloudT &cloud, const std::vector<float> &intensity,
+               PcdDataFormat format);
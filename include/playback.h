@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+
+#include "frame.h"
+#include "frame_provider.h"
+#include "stage_profiler.h"
+
+
+// Timed playback of the frames of `provider`, looping over the sequence.
+//
+// Frame k of the playback is due at start + k / fps. Each tick() shows the newest due frame that is already decoded,
+// so that display follows the wall clock : when decoding falls behind, the frames it couldn't deliver in time are
+// skipped (counted as dropped) instead of stalling playback, and prefetching is re-targeted on the due frame.
+// Without prefetching there is nothing to skip to, the due frame is loaded on the calling thread.
+class PlaybackScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PlaybackScheduler(FrameProvider &provider, double fps);
+
+    bool playing() const { return this->is_playing; }
+    double fps() const { return this->target_fps; }
+    // Changes the rate from the frame last shown on, playback statistics are kept.
+    void set_fps(double fps, Clock::time_point now);
+
+    // Starts playing from frame `index`, shown at `now`, and resets the statistics.
+    void play(int index, Clock::time_point now);
+    void pause();
+    // Frame `index` was shown by other means (stepping) : playback carries on from it.
+    void seek(int index, Clock::time_point now);
+
+    // Frame to show at `now`, nullptr when the next frame isn't due yet or none of the due frames is decoded.
+    // `index` is set to the index of the returned frame.
+    FramePtr tick(Clock::time_point now, int &index);
+    // When the frame after the last shown one is due.
+    Clock::time_point next_due() const;
+
+    size_t shown() const { return this->n_shown; }
+    size_t dropped() const { return this->n_dropped; }
+    // Frames that came due while none of the due frames was decoded.
+    size_t stalls() const { return this->n_stalls; }
+    double achieved_fps(Clock::time_point now) const;
+    // Delay between when shown frames were due and when they were shown (ms).
+    const DurationHistogram &lateness() const { return this->lateness_ms; }
+    void print_stats(std::ostream &os, Clock::time_point now) const;
+
+private:
+    Clock::time_point due(long position) const;
+    void show(long position, Clock::time_point now);
+    int frame_index(long position) const;
+
+    FrameProvider &provider;
+    double target_fps;
+    bool is_playing = false;
+
+    // Playback positions count frames since play() without wrapping, frame_index() maps them to the sequence.
+    Clock::time_point start_time;
+    long start_position = 0;
+    long last_position = 0;
+    long stalled_position = -1;
+
+    Clock::time_point play_time;
+    size_t n_shown = 0;
+    size_t n_dropped = 0;
+    size_t n_stalls = 0;
+    DurationHistogram lateness_ms;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "bbox3d.h"
+#include "pointcloud_processing.h"
+
+
+// Stages of the point filter, in the order they are applied. A dropped point is counted by the first stage it fails.
+enum FilterStage
+{
+    FILTER_RANGE = 0,   // distance from the sensor origin
+    FILTER_HEIGHT = 1,  // z
+    FILTER_BOXES = 2,   // inside a (padded) bbox
+    FILTER_STAGE_COUNT
+};
+
+const char *filter_stage_name(int stage);
+
+// Crops run on every frame right after loading, before decimation and colouring : dropped points are never
+// coloured, copied or uploaded.
+struct FilterConfig
+{
+    // Points kept at a distance from the sensor origin in [min_range, max_range], max_range 0 : no upper bound.
+    float min_range = 0.0f;
+    float max_range = 0.0f;
+    // Points kept with z in [min_z, max_z] when height_crop is set.
+    bool height_crop = false;
+    float min_z = 0.0f;
+    float max_z = 0.0f;
+    // Keep only the points inside a bbox grown by box_padding metres on every side.
+    bool crop_to_boxes = false;
+    float box_padding = 0.0f;
+    // Bboxes kept by label, as bbox_label gives it ("car" keeps car_0, car_1... but not cart_0) : all of them
+    // when allow_labels is empty, minus the denied ones. Applied to the bboxes of the frame, so that the others
+    // are neither drawn nor used by crop_to_boxes.
+    std::vector<std::string> allow_labels;
+    std::vector<std::string> deny_labels;
+};
+
+// Whether any stage drops points / any label list drops bboxes.
+bool point_filter_enabled(const FilterConfig &config);
+bool label_filter_enabled(const FilterConfig &config);
+
+bool bbox_label_allowed(const std::string &id, const FilterConfig &config);
+// Remove the bboxes whose label isn't allowed, returns how many were removed.
+size_t filter_bboxes(std::vector<BBox3D> &bboxes, const FilterConfig &config);
+
+struct FilterStats
+{
+    size_t input = 0;
+    size_t dropped[FILTER_STAGE_COUNT] = {};
+    size_t bboxes_dropped = 0;  // by the label lists
+
+    size_t kept() const;
+};
+
+// Copy the points of `input` that pass every stage of `config` into `output`, in their order. `intensity` (ignored
+// unless it has one value per point) follows the points into `output_intensity`. Range and height are tested 4
+// points at a time (AVX2 when the CPU supports it), bbox membership through a BVH of the padded `bboxes`, and large
+// clouds are split over threads ; the result doesn't depend on either.
+FilterStats filter_cloud(const PointCloudT &input, const std::vector<float> &intensity, const std::vector<BBox3D> &bboxes,
+                         const FilterConfig &config, PointCloudT &output, std::vector<float> &output_intensity);
@@ -1,9 +1,45 @@
 #pragma once
 
+#include <vector>
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 
 using PointT = pcl::PointXYZRGB;
 using PointCloudT = pcl::PointCloud<PointT>;
 
-void apply_color(PointCloudT::Ptr cloud);
\ No newline at end of file
+// Per-point quantity the colormap is applied to.
+enum ColorSource
+{
+    COLOR_SOURCE_X = 0,
+    COLOR_SOURCE_Y = 1,
+    COLOR_SOURCE_Z = 2,
+    COLOR_SOURCE_RANGE = 3,     // distance from the sensor origin
+    COLOR_SOURCE_INTENSITY = 4, // per-point values given to apply_color (intensity field of the pcd file)
+    COLOR_SOURCE_COUNT
+};
+
+struct ColorConfig
+{
+    int source = COLOR_SOURCE_Z;
+    // 0 : blue -> red, 1 : green -> magenta, 2 : white -> red, 3 : grey / red threshold, 4 : rainbow.
+    int color_mode = 4;
+    // Map [range_min, range_max] on the colormap instead of the min/max of each frame,
+    // so that colours don't flicker between frames. Values outside are clamped.
+    bool fixed_range = false;
+    float range_min = 0.0f;
+    float range_max = 0.0f;
+};
+
+const int kColorModeCount = 5;
+
+// Colour the cloud according to `config`. `values` holds the per-point values of COLOR_SOURCE_INTENSITY,
+// the source falls back to z when they are missing. Uses AVX2 when the CPU supports it and
+// splits large clouds over threads ; the result doesn't depend on either.
+void apply_color(PointCloudT::Ptr cloud, const ColorConfig &config, const std::vector<float> *values = nullptr);
+// Shorthands : colormap `color_mode` along `filtering_axis` (0 : x, 1 : y, 2 : z, anything else : z), and
+// z / rainbow.
+void apply_color(PointCloudT::Ptr cloud, int filtering_axis, int color_mode);
+void apply_color(PointCloudT::Ptr cloud);
+
+// Min/max of the colour source of `config` over the cloud, false for an empty cloud.
+bool color_value_range(const PointCloudT &cloud, const ColorConfig &config, const std::vector<float> *values, float &min, float &max);
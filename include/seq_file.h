@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bbox3d.h"
+#include "mapped_file.h"
+#include "pointcloud_processing.h"
+
+class FrameSource;
+
+
+// Packed sequence file (.seq) : every frame of a sequence, points and parsed annotations, in a single
+// file that is memory-mapped once. Frames are found through an index, so seeking is O(1) and showing
+// a frame doesn't open any file.
+//
+// Layout (little-endian) :
+//   SeqFileHeader                 64 bytes at offset 0
+//   frame blocks                  each starting on a kSeqBlockAlignment boundary :
+//     points                      num_points PointXYZRGB, in memory layout (32 bytes each)
+//     intensity                   num_points float32, when the frame has an intensity field
+//     bboxes                      num_bboxes SeqBBoxRecord, each followed by its id (id_length chars)
+//     name                        name_length chars, file name of the source pcd file
+//   SeqFrameEntry[num_frames]     the index, at header.index_offset
+//
+// Version 1 files, without the Lidar poses, are still read : their index entries are the first
+// kSeqFrameEntryV1Size bytes of a SeqFrameEntry.
+const char kSeqMagic[8] = {'P', 'C', 'S', 'E', 'Q', '\0', '\0', '\0'};
+const uint32_t kSeqVersion = 2;
+const uint32_t kSeqVersionNoPose = 1;
+const uint32_t kSeqByteOrder = 0x01020304;
+const size_t kSeqBlockAlignment = 64;
+
+struct SeqFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;  // kSeqByteOrder as written by the packing machine
+    uint64_t num_frames;
+    uint64_t index_offset;
+    uint8_t reserved[32];
+};
+
+struct SeqFrameEntry
+{
+    uint64_t points_offset;
+    uint64_t num_points;
+    uint64_t intensity_offset;  // 0 when the frame has no intensity
+    uint64_t bboxes_offset;
+    uint64_t name_offset;
+    uint32_t num_bboxes;
+    uint32_t name_length;
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;  // kSeqFrame*
+    uint32_t reserved;
+    float pose[7];   // Lidar pose of the annotation file, translation x y z, rotation w x y z, when kSeqFramePose
+    uint32_t reserved_pose;
+};
+
+// SeqFrameEntry::flags : no NaN / Inf coordinates (PointCloud::is_dense), and a valid `pose`.
+const uint32_t kSeqFrameDense = 1;
+const uint32_t kSeqFramePose = 2;
+const size_t kSeqFrameEntryV1Size = 64;
+
+struct SeqBBoxRecord
+{
+    float translation[3];
+    float rotation[4];  // w, x, y, z
+    uint32_t id_length;
+    double width;
+    double height;
+    double depth;
+};
+
+static_assert(sizeof(SeqFileHeader) == 64, "unexpected SeqFileHeader padding");
+static_assert(sizeof(SeqFrameEntry) == 96, "unexpected SeqFrameEntry padding");
+static_assert(sizeof(SeqBBoxRecord) == 56, "unexpected SeqBBoxRecord padding");
+
+// Bboxes as SeqBBoxRecord followed by the id, one after the other (the bbox block of a frame, also used by the
+// live ring, see live_feed.h). write_seq_bboxes writes seq_bboxes_bytes(bboxes) bytes at `data`, read_seq_bboxes
+// reads `count` bboxes back out of [data, data + size), false when they don't fit.
+size_t seq_bboxes_bytes(const std::vector<BBox3D> &bboxes);
+void write_seq_bboxes(const std::vector<BBox3D> &bboxes, uint8_t *data);
+bool read_seq_bboxes(const uint8_t *data, size_t size, uint32_t count, std::vector<BBox3D> &bboxes);
+
+// Read-only view of a .seq file. All methods are const and safe to call from several threads.
+class SeqFile
+{
+public:
+    // Maps and validates the file (header and index), throws std::runtime_error when it isn't a valid .seq file.
+    explicit SeqFile(const std::string &path);
+
+    SeqFile(const SeqFile &) = delete;
+    SeqFile &operator=(const SeqFile &) = delete;
+
+    int size() const { return this->frames.size(); }
+    std::string name(int index) const;
+    // Single bulk copy of the frame's points (and intensity) out of the mapping.
+    bool read_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const;
+    // The Lidar pose goes to `pose` when given, left invalid when the frame has none (or the file is version 1).
+    bool read_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose = nullptr) const;
+
+private:
+    std::string path;
+    MappedFile file;
+    std::vector<SeqFrameEntry> frames;  // copy of the index
+};
+
+// Packs every frame of `source` into a .seq file at `path`. Frames that fail to load are skipped with a warning.
+// Returns the number of frames written, throws std::runtime_error when the output can't be written.
+int write_seq_file(const std::string &path, const FrameSource &source);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Frames of a pcd directory : the .pcd files in natural order of their names, and the annotation file of each.
+struct SequenceIndex
+{
+    std::vector<std::string> pcd_files;
+    // Annotation file of each frame, empty for frames without one. Empty vector until the annotations are paired.
+    std::vector<std::string> annot_files;
+};
+
+// Name order with runs of digits compared by value : "frame_9.pcd" < "frame_10.pcd". Equal values fall back to
+// the shorter run (fewer leading zeros) first, so the order stays total.
+bool natural_less(const std::string &a, const std::string &b);
+
+// Paths of the entries of `dir` whose name ends with `extension`, in directory order. Entries are matched on their
+// name only (plus the entry type when the file system reports it), nothing is stat'ed.
+// Throws std::runtime_error when `dir` can't be read.
+std::vector<std::string> list_directory(const std::string &dir, const std::string &extension);
+
+// Annotation file of each of `pcd_files` under `annot_path` : the .json file of the same stem in a directory
+// (listed once), or the single .json file `annot_path`. Empty strings for frames without one.
+std::vector<std::string> pair_annot_files(const std::vector<std::string> &pcd_files, const std::string &annot_path);
+
+// Modification time of `path` in ns, 0 when it doesn't exist. Changes whenever entries are added, removed or
+// renamed in a directory.
+int64_t path_mtime_ns(const std::string &path);
+
+// Sidecar cache of the index of `pcd_dir`, kept in the directory itself.
+std::string sequence_index_cache_path(const std::string &pcd_dir);
+
+// The cached index of `pcd_dir`, when its cache file exists and neither `pcd_dir` nor the annotation directory
+// changed since it was written (for the same `annot_path`). false otherwise.
+bool load_sequence_index(const std::string &pcd_dir, const std::string &annot_path, SequenceIndex &index);
+
+// Write the cache of `index`, listed when `pcd_dir` had the modification time `listed_mtime_ns`.
+// false when the cache can't be written (read-only directory) or the directory changed while it was listed.
+bool save_sequence_index(const std::string &pcd_dir, const std::string &annot_path, const SequenceIndex &index,
+                         int64_t listed_mtime_ns);
+
+// Carry the cache of `pcd_dir` over a sidecar file that was just created in the directory (see SequenceSummary),
+// which changes its mtime without touching the frames : when the cache was valid for `created_after_mtime_ns`, the
+// directory mtime read right before creating it, the current mtime is patched in. false when there is no valid
+// cache to keep.
+bool keep_sequence_index(const std::string &pcd_dir, int64_t created_after_mtime_ns);
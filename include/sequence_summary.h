@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "frame_source.h"
+#include "pointcloud_processing.h"
+
+
+// Bins of the per-frame histograms, over the frame's own min/max of each colour source.
+const int kSummaryBins = 32;
+
+// What the background pass knows about a frame without loading it again.
+struct FrameSummary
+{
+    bool done = false;           // summarised (loaded or not)
+    bool loaded = false;         // false when the frame couldn't be loaded
+    bool has_intensity = false;
+    uint64_t points = 0;
+    uint64_t finite_points = 0;
+    // Min / max of the finite values of each colour source (ColorSource : x, y, z, range, intensity). Without
+    // intensity, the intensity source holds z, as apply_color falls back to it.
+    float min[COLOR_SOURCE_COUNT] = {};
+    float max[COLOR_SOURCE_COUNT] = {};
+    // Share of the finite points in each of kSummaryBins even bins of [min, max], in 1 / 65535.
+    uint16_t histogram[COLOR_SOURCE_COUNT][kSummaryBins] = {};
+    uint32_t boxes = 0;
+    std::vector<std::pair<uint16_t, uint16_t>> labels;  // (label id, box count), see SequenceSummary::label
+    float load_ms = 0.0f;        // pcd load
+    float annot_ms = 0.0f;       // annotation load
+};
+
+// Jump-to-frame query over the summaries, conditions separated by ',' and all required :
+//   <field> <op> <value>   op among < <= > >= = !=, field among points, boxes, xmin, xmax, ymin, ymax, zmin, zmax,
+//                          range_min, range (nearest / farthest point), imin, imax (intensity), load_ms, or a bbox
+//                          label (its box count)
+//   max:<field> min:<field> the frames where the field reaches its extreme over the summarised frames
+// e.g. "boxes>=20", "car>5,zmax<10", "max:points". Throws std::runtime_error when it can't be parsed.
+class SummaryQuery
+{
+public:
+    explicit SummaryQuery(const std::string &text);
+
+    const std::string &text() const { return this->query_text; }
+
+private:
+    friend class SequenceSummary;
+
+    struct Condition
+    {
+        std::string field;
+        int op;          // kQuery* in sequence_summary.cpp
+        double value;
+    };
+
+    std::string query_text;
+    std::vector<Condition> conditions;
+};
+
+// Per-frame summaries of a whole sequence, computed by a background pass and kept in a sidecar file.
+//
+// The pass loads every frame with the source's own loaders on worker threads of low priority, so that stepping and
+// prefetching always go first, and only holds the summary lock to store a result. Results are appended to the
+// sidecar in batches as self-checked records, so that an interrupted pass resumes where it stopped : frames found
+// in the sidecar aren't loaded again, and a record cut short by a crash is dropped. The sidecar is keyed on the
+// frame names, a sequence whose frames changed starts over. A frame whose loaders throw is recorded as not loaded.
+class SequenceSummary
+{
+public:
+    // Summaries of `source`, with the ones already in `sidecar_path` (none when empty : kept in memory only).
+    SequenceSummary(FrameSourcePtr source, const std::string &sidecar_path);
+    // Stops the pass, after writing what it summarised.
+    ~SequenceSummary();
+
+    SequenceSummary(const SequenceSummary &) = delete;
+    SequenceSummary &operator=(const SequenceSummary &) = delete;
+
+    // Summarise the remaining frames on `threads` worker threads. Returns at once.
+    void start(int threads);
+    // Stop the workers after the frames they are on and write their results.
+    void stop();
+
+    int size() const { return this->frames.size(); }
+    int done() const { return this->n_done.load(); }
+    bool complete() const { return this->done() == this->size(); }
+    int resumed() const { return this->n_resumed; }
+    // Copy of the summary of a frame, done == false until the pass reached it.
+    FrameSummary summary(int index) const;
+    std::string label(uint16_t id) const;
+    const std::string &sidecar_path() const { return this->path; }
+
+    // Summarised frames matching `query`, in index order.
+    std::vector<int> find(const SummaryQuery &query) const;
+    // Fields of `query` that are neither built-in nor a label of the summarised frames : typos once the pass is
+    // complete, possibly labels of frames not summarised yet before.
+    std::vector<std::string> unknown_fields(const SummaryQuery &query) const;
+    // Labels of the bboxes of the summarised frames, in the order they were first met.
+    std::vector<std::string> seen_labels() const;
+    // Values of the colour source `source` between the `lower` and `upper` fractions of the points of all the
+    // summarised frames, from their histograms (exact min / max for 0 and 1). false when no frame is summarised.
+    bool color_range(int source, double lower, double upper, float &min, float &max) const;
+
+    // Key of the frames of a sequence in its sidecar.
+    static uint64_t sequence_key(const FrameSource &source);
+    // Sidecar of the sequence at `pcd_path` : .cloud_viewer_summary in a pcd directory, next to its index cache
+    // (which stays valid when the sidecar is created), or next to a single file.
+    static std::string default_sidecar_path(const std::string &pcd_path);
+
+    double elapsed_s() const;
+    void print_stats(std::ostream &os) const;
+
+private:
+    void load_sidecar();
+    void work();
+    void summarise(int index, FrameSummary &summary, PointCloudT &cloud, std::vector<float> &intensity,
+                   std::vector<BBox3D> &bboxes);
+    // Append the serialised `records` to the sidecar and clear them, under the lock.
+    void write_records(std::string &records);
+    uint16_t label_id(const std::string &label);
+    double value(const FrameSummary &summary, const std::string &field) const;
+
+    FrameSourcePtr source;
+    std::string path;
+    uint64_t key;
+
+    mutable std::mutex mtx;                      // frames, labels, the sidecar and its stream
+    std::vector<FrameSummary> frames;
+    std::vector<std::string> labels;
+    std::ofstream sidecar;
+    bool sidecar_failed = false;
+    uint64_t sidecar_bytes = 0;
+
+    std::vector<int> pending;                    // frames left for the pass, in order
+    std::atomic<size_t> next{0};
+    std::atomic<int> n_done{0};
+    std::atomic<bool> stopping{false};
+    std::vector<std::thread> workers;
+    int n_resumed = 0;
+    int64_t start_ns = 0;
+    std::atomic<int64_t> end_ns{0};
+    std::atomic<uint64_t> bytes_loaded{0};
+};
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <Eigen/Dense>
 #include <boost/filesystem.hpp>
@@ -14,13 +18,51 @@
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
 #include <pcl/visualization/pcl_visualizer.h>
+#include <vtkErrorCode.h>
+#include <vtkImageData.h>
+#include <vtkPNGWriter.h>
+#include <vtkRenderWindow.h>
+#include <vtkWindowToImageFilter.h>
 
 #include "bbox3d.h"
+#include "bbox_overlay.h"
+#include "frame.h"
+#include "frame_accumulator.h"
+#include "frame_provider.h"
+#include "live_feed.h"
+#include "playback.h"
+#include "sequence_summary.h"
+#include "spatial_index.h"
+#include "temporal_diff.h"
 
 using PointT = pcl::PointXYZRGB;
 using PointCloudT = pcl::PointCloud<PointT>;
 
 
+struct ViewerOptions
+{
+    int prefetch_window = 2;  // number of frames decoded ahead/behind the shown one, 0 disables prefetching
+    int prefetch_threads = 2;
+    int cache_mb = 512;       // memory budget of the decoded frame cache, 0 disables caching
+    PointCodec cache_codec = POINT_CODEC_NONE;  // frames kept compressed in the cache
+    bool offscreen = false;   // render without a window (export mode)
+    ColorConfig color;
+    bool global_color_range = false;  // fix the colour range to the min/max over the whole sequence
+    bool bbox_labels = true;          // draw the id of each bbox as a 3D text
+    FilterConfig filter;              // crops and bbox label lists, disabled by default
+    DecimationConfig decimation;      // point budget of the frames shown while stepping
+    int refine_delay_ms = 500;        // show the full-resolution cloud after this long without stepping, < 0 never
+    double play_fps = 10.0;           // target rate of timed playback
+    bool autoplay = false;            // start playing on startup
+    AccumulationConfig accumulation;  // overlay of the last K sweeps, disabled by default
+    TemporalDiffConfig diff;          // colour by distance to the previous frame, disabled by default
+    std::string live;                 // shared memory ring of a live producer (see live_feed.h), empty : pcd_path
+    bool summary = true;              // summarise every frame in background into a sidecar (see sequence_summary.h)
+    int summary_threads = 0;          // workers of the summary pass, 0 : one less than the cores
+    std::string find;                 // query of the frames v / V jump to (see SummaryQuery)
+    bool robust_color_range = false;  // fix the colour range to the 1st - 99th percentile of the sequence's points
+};
+
 class SequenceViewer
 {
 public:
@@ -28,26 +70,71 @@ public:
     int pcd_len;
     int current_pcd_id;
 
-    SequenceViewer(std::string pcd_path, std::string annot_path, std::string cameraparam_path, std::string cameraparam_save_path);
+    SequenceViewer(std::string pcd_path, std::string annot_path, std::string cameraparam_path, std::string cameraparam_save_path,
+                   const ViewerOptions &options = ViewerOptions());
 
-    void load_pcd_files(const std::string pcd_path);
-    void load_point_cloud(const std::string pcd_file_path);
-    void load_annot_json(std::string pcd_file_path);
+    void open_source(const std::string pcd_path);
     void update_cloud(int pcd_id);
+    FramePtr fetch_frame(int pcd_id);
+    void show_frame(const FramePtr &frame);
+    void show_full_resolution();
+    void refine_if_idle();
+    void toggle_playback();
+    void change_playback_rate(double factor);
+    void play_if_due();
+    void show_live_if_new();
+    void report_summary_if_complete();
     void save_camerapose();
     void load_camerapose(std::string cameraparam_path);
     void save_screenshot();
+    void print_stats();
 
-    void showBBox3D(const BBox3D &bbox);
+    void set_color_config(const ColorConfig &color);
+    void cycle_color_source();
+    void cycle_color_mode();
+    void toggle_fixed_color_range();
+    void toggle_diff();
+    void jump_to_match(int direction);
+
+    void show_bboxes();
+    void show_pick(float x, float y, float z);
+    void print_box_counts();
 
     int run();
+    int export_frames(const std::string &output_dir, const std::string &format);
 
 protected:
+    void compute_global_color_range();
+    void print_filter(const Frame &frame);
+    void print_decimation(const Frame &frame);
+    void print_accumulation(int fetched);
+    void print_diff();
+    bool refine_pending() const;
+    int spin_timeout_ms() const;
+    void open_live_source();
+    bool summary_color_range(const ColorConfig &color, double lower, double upper, float &min, float &max);
+
     std::string annot_path;
-    std::vector<std::string> pcd_files;
+    std::unique_ptr<FrameProvider> provider;
     PointCloudT::Ptr cloud;
     std::vector<BBox3D> bboxes;
     pcl::visualization::PCLVisualizer::Ptr viewer;
+    std::unique_ptr<BBoxOverlay> bbox_overlay;
+    ViewerOptions options;
+    FramePtr current_frame;
+    bool showing_full = false;  // the full-resolution cloud of a decimated frame is shown
+    std::chrono::steady_clock::time_point last_step;
+    std::unique_ptr<PlaybackScheduler> playback;
+    std::unique_ptr<FrameAccumulator> accumulator;  // nullptr unless accumulation is enabled
+    std::unique_ptr<TemporalDiff> diff;             // nullptr unless the temporal diff is shown
+    std::shared_ptr<LiveFrameSource> live;          // source of the provider in live mode, nullptr otherwise
+    bool live_drawn_pending = false;                // a live frame was uploaded, its latency is taken once drawn
+    std::unique_ptr<SequenceSummary> summary;       // nullptr when the summary pass is disabled
+    bool summary_reported = false;
+    bool global_color_range_valid = false;
+    int global_color_range_source = COLOR_SOURCE_Z;
+    float global_color_min = 0.0f;
+    float global_color_max = 0.0f;
 };
 
 void keyboardEventOccurred(const pcl::visualization::KeyboardEvent &event, void *viewer_void);
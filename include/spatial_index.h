@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <Eigen/Dense>
+
+#include "bbox3d.h"
+#include "pointcloud_processing.h"
+
+struct Frame;
+
+
+// Points of a cloud hashed into a uniform voxel grid : the finite points are sorted by voxel, each occupied voxel
+// maps to its run of points. Coordinates are copied in voxel order, so the index doesn't refer to the cloud
+// after it is built.
+class PointGrid
+{
+public:
+    PointGrid(const PointCloudT &cloud, float cell_size);
+
+    size_t size() const { return this->order.size(); }
+    float cell_size() const { return this->cell; }
+    size_t cells() const { return this->runs.size(); }
+    size_t size_bytes() const;
+
+    // f(cloud_index, xyz) for every point of the voxels overlapping [min, max] (a superset of the points inside).
+    template <typename F>
+    void for_each_candidate(const Eigen::Vector3f &min, const Eigen::Vector3f &max, F &&f) const;
+
+    // Index in the cloud and squared distance of the k points nearest to `point` within `max_distance`,
+    // nearest first.
+    void nearest(const Eigen::Vector3f &point, size_t k, float max_distance,
+                 std::vector<std::pair<uint32_t, float>> &result) const;
+
+private:
+    struct Run
+    {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    static uint64_t key(int64_t x, int64_t y, int64_t z);
+    Eigen::Array3i cell_of(const Eigen::Vector3f &p) const;
+
+    float cell;
+    std::vector<uint32_t> order;  // cloud index of each point, in voxel order
+    std::vector<float> xyz;       // coordinates in voxel order
+    std::unordered_map<uint64_t, Run> runs;
+    Eigen::Array3i min_cell;
+    Eigen::Array3i max_cell;
+};
+
+// Oriented boxes in a bounding volume hierarchy over their axis-aligned bounds, for point -> box lookups.
+class BoxBVH
+{
+public:
+    explicit BoxBVH(const std::vector<BBox3D> &bboxes);
+
+    size_t size() const { return this->boxes.size(); }
+    size_t size_bytes() const;
+
+    // Indices of the boxes containing `point`.
+    void boxes_containing(const Eigen::Vector3f &point, std::vector<int> &result) const;
+    // Whether any box contains `point`, stops at the first one.
+    bool any_contains(const Eigen::Vector3f &point) const;
+    bool contains(int box, const Eigen::Vector3f &point) const;
+    // Axis-aligned bounds of box `box`.
+    void bounds(int box, Eigen::Vector3f &min, Eigen::Vector3f &max) const;
+    float volume(int box) const;
+
+private:
+    struct Box
+    {
+        Eigen::Matrix3f rotation;  // columns : box axes in the lidar frame
+        Eigen::Vector3f center;
+        Eigen::Vector3f half;      // half width, depth, height as drawn by build_bbox_wireframe
+        Eigen::Vector3f min;
+        Eigen::Vector3f max;
+    };
+
+    struct Node
+    {
+        Eigen::Vector3f min;
+        Eigen::Vector3f max;
+        int left;   // child nodes, -1 for a leaf
+        int right;
+        int begin;  // leaf : range of `box_order`
+        int end;
+    };
+
+    int build(int begin, int end);
+    // f(box) for the boxes containing `point` until f returns true, true when it did.
+    template <typename F>
+    bool visit_containing(const Eigen::Vector3f &point, F &&f) const;
+
+    std::vector<Box> boxes;
+    std::vector<int> box_order;
+    std::vector<Node> nodes;
+};
+
+// Spatial queries on a frame : points in boxes, box under a picked point and nearest points.
+// Built from the full-resolution points of the frame and its boxes (in the lidar frame), read-only afterwards
+// so that queries are safe from several threads.
+class FrameSpatialIndex
+{
+public:
+    static constexpr float kDefaultCellSize = 0.5f;
+
+    FrameSpatialIndex(const PointCloudT &cloud, const std::vector<BBox3D> &bboxes, float cell_size = kDefaultCellSize);
+
+    size_t points() const { return this->grid.size(); }
+    size_t boxes() const { return this->bvh.size(); }
+    size_t size_bytes() const { return sizeof(FrameSpatialIndex) + this->grid.size_bytes() + this->bvh.size_bytes(); }
+    double build_ms() const { return this->build_time_ms; }
+
+    // Number of points inside box `box`.
+    size_t count_points_in_box(int box) const;
+    // Number of points inside each box, boxes split over threads.
+    std::vector<size_t> count_points_in_boxes() const;
+    // Box containing `point`, the smallest one when boxes overlap. -1 when the point is in no box.
+    int find_box(const Eigen::Vector3f &point) const;
+    // Cloud index and distance of the k points nearest to `point` within `max_distance`, nearest first.
+    std::vector<std::pair<uint32_t, float>> nearest_points(const Eigen::Vector3f &point, size_t k, float max_distance) const;
+
+private:
+    friend std::shared_ptr<const FrameSpatialIndex> frame_spatial_index(Frame &frame);
+
+    PointGrid grid;
+    BoxBVH bvh;
+    double build_time_ms = 0.0;
+};
+
+// Spatial index of `frame`, built on first use and kept with the frame (full-resolution cloud when the frame was
+// decimated). Thread-safe.
+std::shared_ptr<const FrameSpatialIndex> frame_spatial_index(Frame &frame);
+
+
+template <typename F>
+void PointGrid::for_each_candidate(const Eigen::Vector3f &min, const Eigen::Vector3f &max, F &&f) const
+{
+    if (this->order.empty())
+    {
+        return;
+    }
+    Eigen::Array3i lo = this->cell_of(min).max(this->min_cell);
+    Eigen::Array3i hi = this->cell_of(max).min(this->max_cell);
+    if ((lo > hi).any())
+    {
+        return;
+    }
+    auto visit = [&](const Run &run) {
+        for (uint32_t i = run.begin; i < run.end; ++i)
+        {
+            f(this->order[i], Eigen::Map<const Eigen::Vector3f>(this->xyz.data() + 3 * size_t(i)));
+        }
+    };
+
+    Eigen::Array3i extent = hi - lo + 1;
+    if (double(extent(0)) * extent(1) * extent(2) > double(this->runs.size()))
+    {
+        // Wide query : cheaper to walk the occupied voxels than to probe every voxel of the range.
+        for (const auto &entry : this->runs)
+        {
+            const Run &run = entry.second;
+            Eigen::Array3i c = this->cell_of(Eigen::Map<const Eigen::Vector3f>(this->xyz.data() + 3 * size_t(run.begin)));
+            if ((c >= lo).all() && (c <= hi).all())
+            {
+                visit(run);
+            }
+        }
+        return;
+    }
+    for (int x = lo(0); x <= hi(0); ++x)
+    {
+        for (int y = lo(1); y <= hi(1); ++y)
+        {
+            for (int z = lo(2); z <= hi(2); ++z)
+            {
+                auto it = this->runs.find(key(x, y, z));
+                if (it != this->runs.end())
+                {
+                    visit(it->second);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+// Log-scale histogram of durations in ms : 8 buckets per power of two from 1 us (about 9 % resolution) up to
+// about 4 min. Count, total and max are exact, percentiles are the upper edge of their bucket.
+class DurationHistogram
+{
+public:
+    void add(double ms);
+
+    size_t count() const { return n; }
+    double total() const { return sum; }
+    double max() const { return maximum; }
+    double mean() const { return n > 0 ? sum / n : 0.0; }
+    // Smallest bucket edge under which a fraction `p` of the samples fall, clamped to max().
+    double percentile(double p) const;
+
+private:
+    static const int kBucketsPerOctave = 8;
+    static const int kBuckets = 28 * kBucketsPerOctave;
+
+    std::array<uint32_t, kBuckets> buckets{};
+    size_t n = 0;
+    double sum = 0.0;
+    double maximum = 0.0;
+};
+
+// Process-wide per-stage duration histograms. Recording is off until set_enabled(true) (--profile) and is
+// thread-safe, so stages run by the prefetch workers are collected too.
+class StageProfiler
+{
+public:
+    void set_enabled(bool enabled) { this->active.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return this->active.load(std::memory_order_relaxed); }
+
+    void record(const char *stage, double ms);
+    void clear();
+
+    // One line / object per stage : count, mean, p50, p95, max and total in ms, stages in name order.
+    void write_json(std::ostream &os) const;
+    void write_csv(std::ostream &os) const;
+    // CSV when `path` ends with .csv, JSON otherwise. false when the file can't be written.
+    bool write(const std::string &path) const;
+
+private:
+    std::atomic<bool> active{false};
+    mutable std::mutex mtx;
+    std::map<std::string, DurationHistogram, std::less<>> stages;
+};
+
+StageProfiler &stage_profiler();
+
+// Times the enclosing scope as `stage` (a string literal, it isn't copied). The time is always measured, so that
+// callers can use it, and only recorded when the profiler is enabled.
+class ScopedStageTimer
+{
+public:
+    explicit ScopedStageTimer(const char *stage) : stage(stage), running(true), start(std::chrono::steady_clock::now()) {}
+    ~ScopedStageTimer() { this->stop(); }
+
+    ScopedStageTimer(const ScopedStageTimer &) = delete;
+    ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+
+    // Ends the stage early, returns its duration in ms. Later calls return the same duration.
+    double stop()
+    {
+        if (this->running)
+        {
+            this->running = false;
+            this->elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+            StageProfiler &profiler = stage_profiler();
+            if (profiler.enabled())
+            {
+                profiler.record(this->stage, this->elapsed);
+            }
+        }
+        return this->elapsed;
+    }
+
+private:
+    const char *stage;
+    bool running;
+    double elapsed = 0.0;
+    std::chrono::steady_clock::time_point start;
+};
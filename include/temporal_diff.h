@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "frame.h"
+#include "frame_provider.h"
+
+
+struct TemporalDiffConfig
+{
+    bool enabled = false;
+    // Nearest neighbours are searched up to this distance (metres), points farther from the previous frame
+    // saturate at it.
+    float max_distance = 0.5f;
+    // > 0 : points split into static (grey, nearest neighbour within threshold) and dynamic (red) instead of
+    // coloured by distance with the current colormap.
+    float threshold = 0.0f;
+    // Express the previous frame in the lidar frame of the new one through the Lidar poses of their annotation
+    // files, so that ego-motion isn't reported as change. Frames without a pose are compared as they are.
+    bool use_pose = false;
+};
+
+// Nearest-neighbour search in a cloud within a fixed distance. The points are counting-sorted into the buckets of
+// a hashed voxel grid whose cells are `max_distance` wide : the neighbours of a query within that distance lie in
+// its own cell or one of the 26 around it, and only the non-empty cells closer than the best match so far are
+// visited.
+// Built in O(n) without sorting, so that it can be rebuilt for every frame.
+class NeighborGrid
+{
+public:
+    NeighborGrid() = default;
+    NeighborGrid(const PointCloudT &cloud, float max_distance);
+
+    // Distance from `p` to the nearest point of the cloud, max_distance when there is none that close.
+    float nearest_distance(const Eigen::Vector3f &p) const;
+
+    float max_distance() const { return this->radius; }
+    size_t size() const { return this->xyz.size(); }
+    bool empty() const { return this->xyz.empty(); }
+    size_t size_bytes() const;
+
+private:
+    uint32_t bucket(int64_t ix, int64_t iy, int64_t iz) const;
+
+    float radius = 0.0f;
+    float inv_cell = 0.0f;
+    uint32_t mask = 0;
+    std::vector<uint32_t> bucket_start;  // mask + 2 entries, points of bucket b in [bucket_start[b], bucket_start[b + 1])
+    std::vector<uint64_t> occupied;      // one bit per bucket : most neighbour cells are empty, and this fits in cache
+    std::vector<Eigen::Vector3f> xyz;    // finite points, grouped by bucket
+};
+
+// Change detection between consecutive frames : every point of the shown frame is coloured by its distance to the
+// nearest point of the frame before it in the sequence, or thresholded into static / dynamic.
+//
+// The grid of the previous frame is kept, and the shown frame is kept to build the next one, so that stepping
+// forward costs one grid build and one query pass, both linear, the queries on all cores. Stepping backward or
+// jumping fetches the previous frame from the provider (usually from the cache). The previous frame is searched at
+// full resolution when it was decimated. The coloured copy of the shown cloud is owned here, the frames themselves
+// are left untouched.
+class TemporalDiff
+{
+public:
+    TemporalDiff(FrameProvider &provider, const TemporalDiffConfig &config);
+
+    TemporalDiff(const TemporalDiff &) = delete;
+    TemporalDiff &operator=(const TemporalDiff &) = delete;
+
+    // Compare `frame` with the frame before it and rebuild the coloured cloud. Returns false when there is no
+    // previous frame (first frame, or it can't be loaded) : the cloud is then a copy of the frame's own.
+    bool advance(const FramePtr &frame);
+    // Recolour the last result for the current colour config of the provider.
+    void recolor();
+
+    // Coloured copy of the shown frame's cloud, the same buffer is refilled by every advance().
+    const PointCloudT::Ptr &cloud() const { return this->diffed; }
+    // Per-point distance to the previous frame, in the order of cloud().
+    const std::vector<float> &distances() const { return this->distance; }
+    const TemporalDiffConfig &config() const { return this->settings; }
+
+    bool compared() const { return this->has_previous; }
+    int previous_index() const { return this->grid_index; }
+    bool posed() const { return this->pose_applied; }
+    // Points of the last result farther than the threshold (or than max_distance without threshold).
+    size_t dynamic_points() const { return this->n_dynamic; }
+    float mean_distance() const { return this->mean; }
+    double build_ms() const { return this->last_build_ms; }
+    double query_ms() const { return this->last_query_ms; }
+
+    size_t grids_built() const { return this->n_built; }
+    size_t grids_reused() const { return this->n_reused; }
+    size_t fetched() const { return this->n_fetched; }
+    void print_stats(std::ostream &os) const;
+
+private:
+    void colorize();
+
+    FrameProvider &provider;
+    TemporalDiffConfig settings;
+    NeighborGrid grid;        // of the frame grid_index
+    int grid_index = -1;
+    LidarPose grid_pose;
+    FramePtr last;            // frame of the last advance(), source of the next grid when stepping forward
+    PointCloudT::Ptr diffed;
+    std::vector<float> distance;
+    std::vector<float> classes;  // 0 static / 1 dynamic, when thresholded
+    bool has_previous = false;
+    bool pose_applied = false;
+    size_t n_dynamic = 0;
+    float mean = 0.0f;
+    double last_build_ms = 0.0;
+    double last_query_ms = 0.0;
+    size_t n_built = 0;
+    size_t n_reused = 0;
+    size_t n_fetched = 0;
+};
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "batch_convert.h"
+#include "cloud_pool.h"
+#include "parallel.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+// A frame between the next one to write and the last one handed out. Owned by the worker converting it until
+// `ready`, then by the writer until it is written.
+struct ConvertSlot
+{
+    bool ready = false;
+    bool loaded = false;
+    std::string pcd;
+    std::string annot;  // empty when the frame has no annotation to write
+};
+
+bool write_file(const std::string &path, const std::string &data)
+{
+    std::ofstream os(path, std::ios::binary);
+    os.write(data.data(), data.size());
+    return bool(os);
+}
+
+} // namespace
+
+
+void ConvertStats::print(std::ostream &os) const
+{
+    double s = std::max(this->elapsed_s, 1e-9);
+    os << "converted " << this->frames << " frames (" << this->failed << " skipped) on " << this->threads
+       << " threads in " << this->elapsed_s << " s : " << this->frames / s << " frames/s, " << this->bytes_in / s / 1e6
+       << " MB/s loaded, " << this->bytes_out / s / 1e6 << " MB/s written (" << this->points_in << " -> "
+       << this->points_out << " points, " << this->bytes_out / 1e6 << " MB)" << std::endl;
+    os << "time per frame (ms) : load " << this->load_ms / std::max(this->frames, 1) << ", filter "
+       << this->filter_ms / std::max(this->frames, 1) << ", decimate " << this->decimate_ms / std::max(this->frames, 1)
+       << ", colour " << this->color_ms / std::max(this->frames, 1) << ", encode "
+       << this->encode_ms / std::max(this->frames, 1) << ", write " << this->write_ms / std::max(this->frames, 1)
+       << " ; writer waited " << this->write_wait_ms / 1e3 << " s for frames, at most "
+       << this->peak_pending_bytes / 1e6 << " MB waited to be written" << std::endl;
+}
+
+std::string convert_output_path(const std::string &output_dir, const std::string &name, const std::string &extension)
+{
+    namespace bfs = boost::filesystem;
+    return (bfs::path(output_dir) / (bfs::path(name).stem().string() + extension)).string();
+}
+
+ConvertStats convert_frames(const FrameSource &source, const ConvertOptions &options, std::ostream *progress)
+{
+    namespace bfs = boost::filesystem;
+
+    boost::system::error_code error;
+    bfs::create_directories(options.output_dir, error);
+    if (!bfs::is_directory(options.output_dir))
+    {
+        throw std::runtime_error((boost::format("Cannot create output directory '%1%'.") % options.output_dir).str());
+    }
+
+    int n = source.size();
+    // The frames would be overwritten while they are read.
+    if (n > 0)
+    {
+        std::string first = convert_output_path(options.output_dir, source.name(0), ".pcd");
+        if (bfs::exists(first) && bfs::exists(source.name(0)) && bfs::equivalent(first, source.name(0)))
+        {
+            throw std::runtime_error((boost::format("Output directory '%1%' holds the frames to convert.") % options.output_dir).str());
+        }
+    }
+    ConvertStats stats;
+    stats.threads = options.threads > 0 ? options.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+    // Frames handed out and not written yet : converting, or waiting for the writer.
+    int window = stats.threads + (options.max_pending_frames > 0 ? options.max_pending_frames : 4 * stats.threads);
+    std::vector<ConvertSlot> slots(window);
+    // Up to a loaded, a filtered and a decimated cloud per frame being converted.
+    CloudPool pool(3 * stats.threads);
+
+    std::mutex mtx;
+    std::condition_variable claimable, converted;
+    int next_claim = 0;       // next frame handed out
+    int next_write = 0;       // next frame written
+    size_t pending_bytes = 0; // of the frames converted and not written yet
+    bool aborted = false;
+    // Written pcd buffers kept for the next frames, a few so that idle slots don't hold any.
+    std::vector<std::string> free_buffers;
+
+    auto work = [&]() {
+        // A frame per thread keeps the cores busy : the stages of a frame run inline.
+        parallel_for_inline() = true;
+        while (true)
+        {
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                claimable.wait(lock, [&] {
+                    return aborted || next_claim >= n
+                        || (next_claim < next_write + window && pending_bytes < options.max_pending_bytes);
+                });
+                if (aborted || next_claim >= n)
+                {
+                    return;
+                }
+                index = next_claim++;
+                if (!free_buffers.empty())
+                {
+                    slots[index % window].pcd.swap(free_buffers.back());
+                    free_buffers.pop_back();
+                }
+            }
+
+            ConvertSlot &slot = slots[index % window];
+            FramePtr frame;
+            double encode_ms = 0.0;
+            try
+            {
+                frame = load_frame(source, index, options.pipeline, &pool);
+                if (frame)
+                {
+                    ScopedStageTimer timer("convert.encode");
+                    encode_pcd(*(frame->cloud), frame->intensity, options.format, slot.pcd);
+                    slot.annot.clear();
+                    if (options.write_annotations && (frame->pose.valid || !frame->bboxes.empty()))
+                    {
+                        std::ostringstream os;
+                        write_annot(os, frame->bboxes);
+                        slot.annot = os.str();
+                    }
+                    encode_ms = timer.stop();
+                }
+            }
+            catch (const std::exception &e)
+            {
+                // Left to the writer as a frame that couldn't be loaded : skipped and counted.
+                std::cerr << "Error : converting " << source.name(index) << " failed : " << e.what() << std::endl;
+                frame = nullptr;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                slot.loaded = frame != nullptr;
+                slot.ready = true;
+                if (frame)
+                {
+                    // Before filtering and decimation.
+                    const PointCloudT &loaded = frame->full_cloud ? *(frame->full_cloud) : *(frame->cloud);
+                    bool has_intensity = !(frame->full_cloud ? frame->full_intensity : frame->intensity).empty();
+                    size_t points_in = frame->filter.input > 0 ? frame->filter.input : loaded.size();
+                    stats.points_in += points_in;
+                    stats.points_out += frame->cloud->size();
+                    stats.bytes_in += points_in * (3 + (has_intensity ? 1 : 0)) * sizeof(float);
+                    stats.load_ms += frame->load_ms;
+                    stats.filter_ms += frame->filter_ms;
+                    stats.decimate_ms += frame->decimate_ms;
+                    stats.color_ms += frame->color_ms;
+                    stats.encode_ms += encode_ms;
+                    pending_bytes += slot.pcd.size() + slot.annot.size();
+                    stats.peak_pending_bytes = std::max(stats.peak_pending_bytes, pending_bytes);
+                }
+            }
+            converted.notify_one();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < stats.threads; ++t)
+    {
+        workers.emplace_back(work);
+    }
+
+    // Writer : the frames in index order, as they are converted.
+    std::string write_error;
+    for (int i = 0; i < n && write_error.empty(); ++i)
+    {
+        ConvertSlot &slot = slots[i % window];
+        {
+            ScopedStageTimer wait_timer("convert.wait");
+            std::unique_lock<std::mutex> lock(mtx);
+            converted.wait(lock, [&] { return slot.ready; });
+            stats.write_wait_ms += wait_timer.stop();
+        }
+
+        size_t bytes = 0;
+        if (slot.loaded)
+        {
+            ScopedStageTimer timer("convert.write");
+            std::string pcd_path = convert_output_path(options.output_dir, source.name(i), ".pcd");
+            std::string annot_path = convert_output_path(options.output_dir, source.name(i), ".json");
+            if (!write_file(pcd_path, slot.pcd))
+            {
+                write_error = pcd_path;
+            }
+            else if (!slot.annot.empty() && !write_file(annot_path, slot.annot))
+            {
+                write_error = annot_path;
+            }
+            bytes = slot.pcd.size() + slot.annot.size();
+            stats.bytes_out += bytes;
+            ++stats.frames;
+            stats.write_ms += timer.stop();
+        }
+        else
+        {
+            std::cerr << "Warning : cannot load point cloud " << source.name(i) << ", skipped." << std::endl;
+            ++stats.failed;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            slot.ready = false;
+            pending_bytes -= bytes;
+            if (free_buffers.size() < size_t(stats.threads))
+            {
+                free_buffers.push_back(std::move(slot.pcd));
+            }
+            std::string().swap(slot.pcd);
+            next_write = i + 1;
+        }
+        claimable.notify_all();
+
+        auto now = std::chrono::steady_clock::now();
+        if (progress != nullptr && (now - last_report > std::chrono::seconds(1) || i + 1 == n))
+        {
+            last_report = now;
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            std::lock_guard<std::mutex> lock(mtx);
+            *progress << "converted " << i + 1 << " / " << n << " frames, " << (i + 1) / elapsed << " frames/s, "
+                      << stats.bytes_in / elapsed / 1e6 << " MB/s loaded" << std::endl;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        aborted = true;
+    }
+    claimable.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    stats.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!write_error.empty())
+    {
+        throw std::runtime_error((boost::format("Cannot write '%1%'.") % write_error).str());
+    }
+    return stats;
+}
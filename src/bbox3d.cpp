@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "bbox3d.h"
+
+
+namespace
+{
+
+// Raised by the parser, reported as "file(line): message" like boost::property_tree's json_parser_error.
+struct AnnotError
+{
+    const char *position;
+    std::string message;
+};
+
+// A box as written in the file, before the transformation to the lidar frame
+// (the Lidar pose may come after the boxes).
+struct RawBBox
+{
+    float origin[3];
+    float rotation[4];  // w, x, y, z
+    float extent[3];
+    std::string label;
+};
+
+// Streaming parser for the annotation schema : only the members the viewer uses are decoded,
+// the others are skipped without being stored.
+class AnnotParser
+{
+public:
+    AnnotParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+    // Root object : the first "Lidar" and "BoundingBox3D" members, anything else is ignored.
+    void parse(float lidar_location[3], float lidar_rotation[4], std::vector<RawBBox> &boxes)
+    {
+        bool has_lidar = false, has_boxes = false;
+        const char *root = this->p;
+        this->parse_object([&] {
+            if (!has_lidar && this->key == "Lidar")
+            {
+                has_lidar = this->parse_lidar(lidar_location, lidar_rotation);
+            }
+            else if (!has_boxes && this->key == "BoundingBox3D")
+            {
+                has_boxes = true;
+                this->parse_boxes(boxes);
+            }
+            else
+            {
+                this->skip_value();
+            }
+        });
+        this->skip_ws();
+        if (this->p != this->end)
+        {
+            throw AnnotError{this->p, "garbage after data"};
+        }
+        if (!has_lidar)
+        {
+            throw AnnotError{root, "No such node (Lidar)"};
+        }
+        if (!has_boxes)
+        {
+            throw AnnotError{root, "No such node (BoundingBox3D)"};
+        }
+    }
+
+private:
+    void skip_ws()
+    {
+        while (this->p != this->end && (*this->p == ' ' || *this->p == '\t' || *this->p == '\n' || *this->p == '\r'))
+        {
+            ++this->p;
+        }
+    }
+
+    bool peek(char c)
+    {
+        this->skip_ws();
+        return this->p != this->end && *this->p == c;
+    }
+
+    void expect(char c, const char *message)
+    {
+        if (!this->peek(c))
+        {
+            throw AnnotError{this->p, message};
+        }
+        ++this->p;
+    }
+
+    // { "key" : value, ... } with f() parsing each value, this->key holding its name.
+    template <typename F>
+    void parse_object(F &&f)
+    {
+        this->expect('{', "expected value");
+        if (this->peek('}'))
+        {
+            ++this->p;
+            return;
+        }
+        while (true)
+        {
+            if (!this->peek('"'))
+            {
+                throw AnnotError{this->p, "expected key string"};
+            }
+            this->parse_string(this->key);
+            this->expect(':', "expected ':'");
+            f();
+            if (this->peek(','))
+            {
+                ++this->p;
+                continue;
+            }
+            this->expect('}', "expected ',' or '}'");
+            return;
+        }
+    }
+
+    // [ value, ... ] with f() parsing each value.
+    template <typename F>
+    void parse_array(F &&f)
+    {
+        this->expect('[', "expected value");
+        if (this->peek(']'))
+        {
+            ++this->p;
+            return;
+        }
+        while (true)
+        {
+            f();
+            if (this->peek(','))
+            {
+                ++this->p;
+                continue;
+            }
+            this->expect(']', "expected ',' or ']'");
+            return;
+        }
+    }
+
+    // Children of an object or an array, like the children of a ptree node. Scalars have none.
+    template <typename F>
+    void parse_children(F &&f)
+    {
+        if (this->peek('{'))
+        {
+            this->parse_object(f);
+        }
+        else if (this->peek('['))
+        {
+            this->parse_array(f);
+        }
+        else
+        {
+            this->skip_value();
+        }
+    }
+
+    void append_utf8(std::string &out, unsigned codepoint)
+    {
+        if (codepoint < 0x80)
+        {
+            out += char(codepoint);
+        }
+        else if (codepoint < 0x800)
+        {
+            out += char(0xc0 | (codepoint >> 6));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+        else if (codepoint < 0x10000)
+        {
+            out += char(0xe0 | (codepoint >> 12));
+            out += char(0x80 | ((codepoint >> 6) & 0x3f));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+        else
+        {
+            out += char(0xf0 | (codepoint >> 18));
+            out += char(0x80 | ((codepoint >> 12) & 0x3f));
+            out += char(0x80 | ((codepoint >> 6) & 0x3f));
+            out += char(0x80 | (codepoint & 0x3f));
+        }
+    }
+
+    unsigned parse_hex4()
+    {
+        if (this->end - this->p < 4)
+        {
+            throw AnnotError{this->p, "invalid escape sequence"};
+        }
+        unsigned value = 0;
+        for (int i = 0; i < 4; ++i, ++this->p)
+        {
+            char c = *this->p;
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                throw AnnotError{this->p, "invalid escape sequence"};
+        }
+        return value;
+    }
+
+    // "..." with escapes decoded into `out` (whose capacity is reused).
+    void parse_string(std::string &out)
+    {
+        this->expect('"', "expected value");
+        out.clear();
+        while (true)
+        {
+            const char *run = this->p;
+            while (this->p != this->end && *this->p != '"' && *this->p != '\\' && static_cast<unsigned char>(*this->p) >= 0x20)
+            {
+                ++this->p;
+            }
+            out.append(run, this->p);
+            if (this->p == this->end || static_cast<unsigned char>(*this->p) < 0x20)
+            {
+                throw AnnotError{this->p, "unterminated string"};
+            }
+            if (*this->p++ == '"')
+            {
+                return;
+            }
+            if (this->p == this->end)
+            {
+                throw AnnotError{this->p, "invalid escape sequence"};
+            }
+            switch (*this->p++)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                unsigned codepoint = this->parse_hex4();
+                if (codepoint >= 0xd800 && codepoint < 0xdc00 && this->end - this->p >= 6 && this->p[0] == '\\' && this->p[1] == 'u')
+                {
+                    this->p += 2;
+                    unsigned low = this->parse_hex4();
+                    codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                }
+                this->append_utf8(out, codepoint);
+                break;
+            }
+            default:
+                throw AnnotError{this->p - 1, "invalid escape sequence"};
+            }
+        }
+    }
+
+    // Number, true / false / null : the raw text, as property_tree stores it.
+    void parse_literal(std::string &out)
+    {
+        this->skip_ws();
+        const char *start = this->p;
+        while (this->p != this->end && (std::isalnum(static_cast<unsigned char>(*this->p)) || *this->p == '-' || *this->p == '+' || *this->p == '.'))
+        {
+            ++this->p;
+        }
+        if (this->p == start)
+        {
+            throw AnnotError{this->p, "expected value"};
+        }
+        out.assign(start, this->p);
+    }
+
+    void parse_text(std::string &out)
+    {
+        if (this->peek('"'))
+        {
+            this->parse_string(out);
+        }
+        else
+        {
+            this->parse_literal(out);
+        }
+    }
+
+    void skip_value()
+    {
+        if (this->peek('{'))
+        {
+            this->parse_object([this] { this->skip_value(); });
+        }
+        else if (this->peek('['))
+        {
+            this->parse_array([this] { this->skip_value(); });
+        }
+        else
+        {
+            this->parse_text(this->text);
+        }
+    }
+
+    // A number, or a string holding one : property_tree's get<float> converts the text of either.
+    float parse_float(const std::string &path)
+    {
+        this->skip_ws();
+        const char *start = this->p;
+        this->parse_text(this->text);
+        // Decimal spellings only : strtof also takes hex floats, inf and nan, which property_tree rejected.
+        bool decimal = this->text.find_first_not_of("0123456789+-.eE") == std::string::npos
+                       && this->text.find_first_of("0123456789") != std::string::npos;
+        const char *text_end = nullptr;
+        errno = 0;
+        float value = decimal ? std::strtof(this->text.c_str(), const_cast<char **>(&text_end)) : 0.0f;
+        if (!decimal || text_end != this->text.c_str() + this->text.size() || errno == ERANGE || !std::isfinite(value))
+        {
+            throw AnnotError{start, "conversion of data to type \"float\" failed (" + path + ")"};
+        }
+        return value;
+    }
+
+    // { "x": .., "y": .., "z": .. } (or "w", "x", "y", "z") into values, in the order of `names`.
+    void parse_components(const char *names, float *values, const std::string &path)
+    {
+        const char *start = this->p;
+        int n = std::strlen(names);
+        bool found[4] = {false, false, false, false};
+        this->parse_children([&] {
+            const char *name = this->key.size() == 1 ? std::strchr(names, this->key[0]) : nullptr;
+            if (name != nullptr && !found[name - names])
+            {
+                found[name - names] = true;
+                values[name - names] = this->parse_float(path + "." + this->key);
+            }
+            else
+            {
+                this->skip_value();
+            }
+        });
+        for (int i = 0; i < n; ++i)
+        {
+            if (!found[i])
+            {
+                throw AnnotError{start, "No such node (" + path + "." + names[i] + ")"};
+            }
+        }
+    }
+
+    // Pose of the first child of "Lidar".
+    bool parse_lidar(float location[3], float rotation[4])
+    {
+        bool first = true;
+        this->parse_children([&] {
+            if (!first)
+            {
+                this->skip_value();
+                return;
+            }
+            first = false;
+            bool has_location = false, has_rotation = false;
+            const char *start = this->p;
+            this->parse_children([&] {
+                if (!has_location && this->key == "Location")
+                {
+                    has_location = true;
+                    this->parse_components("xyz", location, "Location");
+                }
+                else if (!has_rotation && this->key == "Rotation")
+                {
+                    has_rotation = true;
+                    this->parse_components("wxyz", rotation, "Rotation");
+                }
+                else
+                {
+                    this->skip_value();
+                }
+            });
+            if (!has_location)
+            {
+                throw AnnotError{start, "No such node (Location.x)"};
+            }
+            if (!has_rotation)
+            {
+                throw AnnotError{start, "No such node (Rotation.w)"};
+            }
+        });
+        return !first;
+    }
+
+    void parse_boxes(std::vector<RawBBox> &boxes)
+    {
+        this->parse_children([&] {
+            boxes.emplace_back();
+            RawBBox &box = boxes.back();
+            bool has_origin = false, has_rotation = false, has_extent = false, has_label = false;
+            const char *start = this->p;
+            this->parse_children([&] {
+                if (!has_origin && this->key == "Origin")
+                {
+                    has_origin = true;
+                    this->parse_components("xyz", box.origin, "Origin");
+                }
+                else if (!has_rotation && this->key == "Rotation")
+                {
+                    has_rotation = true;
+                    this->parse_components("wxyz", box.rotation, "Rotation");
+                }
+                else if (!has_extent && this->key == "Extent")
+                {
+                    has_extent = true;
+                    this->parse_components("xyz", box.extent, "Extent");
+                }
+                else if (!has_label && this->key == "Label")
+                {
+                    has_label = true;
+                    this->parse_text(box.label);
+                }
+                else
+                {
+                    this->skip_value();
+                }
+            });
+            const char *missing = !has_origin ? "Origin.x" : !has_rotation ? "Rotation.w" : !has_extent ? "Extent.x" : !has_label ? "Label" : nullptr;
+            if (missing != nullptr)
+            {
+                throw AnnotError{start, std::string("No such node (") + missing + ")"};
+            }
+        });
+    }
+
+    const char *p;
+    const char *end;
+    std::string key;
+    std::string text;
+};
+
+} // namespace
+
+
+bool load_annot(const std::string &annot_file, std::vector<BBox3D> &bboxes, LidarPose *pose)
+{
+    // Reused from one file to the next on each thread.
+    thread_local std::string buffer;
+    thread_local std::vector<RawBBox> boxes;
+
+    std::ifstream is(annot_file, std::ios::binary);
+    if (!is)
+    {
+        std::cout << annot_file << ": cannot open file" << std::endl;
+        return false;
+    }
+    is.seekg(0, std::ios::end);
+    buffer.resize(size_t(is.tellg()));
+    is.seekg(0, std::ios::beg);
+    is.read(&buffer[0], buffer.size());
+
+    float lidar_location[3], lidar_rotation[4];
+    boxes.clear();
+    try
+    {
+        AnnotParser parser(buffer.data(), buffer.data() + buffer.size());
+        parser.parse(lidar_location, lidar_rotation, boxes);
+    }
+    catch (const AnnotError &e)
+    {
+        long line = 1 + std::count(static_cast<const char *>(buffer.data()), e.position, '\n');
+        std::cout << annot_file << "(" << line << "): " << e.message << std::endl;
+        return false;
+    }
+
+    Eigen::Vector3f lidar_0_trans(lidar_location[0], lidar_location[1], lidar_location[2]);
+    Eigen::Quaternionf lidar_0_quat(lidar_rotation[0], lidar_rotation[1], lidar_rotation[2], lidar_rotation[3]);
+    Eigen::Quaternionf lidar_0_quat_inv = lidar_0_quat.inverse();
+    if (pose != nullptr)
+    {
+        pose->valid = true;
+        pose->translation = lidar_0_trans;
+        pose->rotation = lidar_0_quat.normalized();
+    }
+
+    bboxes.reserve(bboxes.size() + boxes.size());
+    for (size_t count = 0; count < boxes.size(); ++count)
+    {
+        const RawBBox &box = boxes[count];
+        Eigen::Vector3f bbox_center(box.origin[0], box.origin[1], box.origin[2]);
+        Eigen::Vector3f bbox_center_lidar_coord = lidar_0_quat_inv * (bbox_center - lidar_0_trans);
+        Eigen::Quaternionf bbox_rot(box.rotation[0], box.rotation[1], box.rotation[2], box.rotation[3]);
+        Eigen::Quaternionf bbox_rot_lidar_coord = lidar_0_quat_inv * bbox_rot;
+
+        // Extent is (x : width, y : depth, z : height).
+        float width = box.extent[0];
+        float height = box.extent[2];
+        float depth = box.extent[1];
+
+        std::string id = box.label + "_";
+        id += std::to_string(count);
+
+        bboxes.push_back(BBox3D{bbox_center_lidar_coord, bbox_rot_lidar_coord, width, height, depth, id});
+    }
+    return true;
+}
+
+std::string bbox_label(const std::string &id)
+{
+    size_t sep = id.find_last_of('_');
+    if (sep == std::string::npos || sep == 0 || sep + 1 == id.size())
+    {
+        return id;
+    }
+    for (size_t i = sep + 1; i < id.size(); ++i)
+    {
+        if (id[i] < '0' || id[i] > '9')
+        {
+            return id;
+        }
+    }
+    return id.substr(0, sep);
+}
+
+void write_annot(std::ostream &os, const std::vector<BBox3D> &bboxes)
+{
+    // Enough digits for the floats to read back identical.
+    std::streamsize precision = os.precision(9);
+    os << "{\n    \"Lidar\": {\n        \"lidar_0\": {\n"
+       << "            \"Location\": {\"x\": 0.0, \"y\": 0.0, \"z\": 0.0},\n"
+       << "            \"Rotation\": {\"w\": 1.0, \"x\": 0.0, \"y\": 0.0, \"z\": 0.0}\n"
+       << "        }\n    },\n    \"BoundingBox3D\": [";
+    for (size_t i = 0; i < bboxes.size(); ++i)
+    {
+        const BBox3D &bbox = bboxes[i];
+        os << (i ? ",\n" : "\n") << "        {\n            \"Label\": \"";
+        for (char c : bbox_label(bbox.id))
+        {
+            if (c == '"' || c == '\\')
+            {
+                os << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                os << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+            }
+            else
+            {
+                os << c;
+            }
+        }
+        // Extent is (x : width, y : depth, z : height), as load_annot reads it.
+        os << "\",\n"
+           << "            \"Origin\": {\"x\": " << bbox.translation.x() << ", \"y\": " << bbox.translation.y()
+           << ", \"z\": " << bbox.translation.z() << "},\n"
+           << "            \"Rotation\": {\"w\": " << bbox.rotation.w() << ", \"x\": " << bbox.rotation.x()
+           << ", \"y\": " << bbox.rotation.y() << ", \"z\": " << bbox.rotation.z() << "},\n"
+           << "            \"Extent\": {\"x\": " << bbox.width << ", \"y\": " << bbox.depth << ", \"z\": " << bbox.height
+           << "}\n        }";
+    }
+    os << "\n    ]\n}\n";
+    os.precision(precision);
+}
+
+void bbox_corners(const BBox3D &bbox, float *vertex)
+{
+    Eigen::Matrix3f rotation = bbox.rotation.toRotationMatrix();
+    Eigen::Vector3f half_x = rotation.col(0) * float(0.5 * bbox.width);
+    Eigen::Vector3f half_y = rotation.col(1) * float(0.5 * bbox.depth);
+    Eigen::Vector3f half_z = rotation.col(2) * float(0.5 * bbox.height);
+
+    for (int k = 0; k < 8; ++k)
+    {
+        Eigen::Vector3f corner = bbox.translation
+            + ((k & 1) ? half_x : -half_x)
+            + ((k & 2) ? half_y : -half_y)
+            + ((k & 4) ? half_z : -half_z);
+        vertex[3 * k] = corner.x();
+        vertex[3 * k + 1] = corner.y();
+        vertex[3 * k + 2] = corner.z();
+    }
+}
+
+void bbox_edges(size_t i, uint32_t *index)
+{
+    // Corner k is at (+-x, +-y, +-z) from the bit 0 / 1 / 2 of k : edges join the corners differing by one bit.
+    static const uint32_t edges[12][2] = {
+        {0, 1}, {2, 3}, {4, 5}, {6, 7},
+        {0, 2}, {1, 3}, {4, 6}, {5, 7},
+        {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+    for (int e = 0; e < 12; ++e)
+    {
+        index[2 * e] = uint32_t(i * 8) + edges[e][0];
+        index[2 * e + 1] = uint32_t(i * 8) + edges[e][1];
+    }
+}
+
+void build_bbox_wireframe(const std::vector<BBox3D> &bboxes, BBoxWireframe &wireframe)
+{
+    size_t n = bboxes.size();
+    wireframe.vertices.resize(n * 8 * 3);
+    // The topology only depends on the number of boxes.
+    if (wireframe.indices.size() != n * 12 * 2)
+    {
+        wireframe.indices.resize(n * 12 * 2);
+        for (size_t i = 0; i < n; ++i)
+        {
+            bbox_edges(i, wireframe.indices.data() + i * 12 * 2);
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        bbox_corners(bboxes[i], wireframe.vertices.data() + i * 8 * 3);
+    }
+}
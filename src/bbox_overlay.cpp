@@ -0,0 +1,134 @@
+#include "bbox_overlay.h"
+#include "pointcloud_processing.h"
+
+
+namespace
+{
+
+void label_orientation(const BBox3D &bbox, double angle[3])
+{
+    Eigen::Vector3f text_euler = bbox.rotation.toRotationMatrix().eulerAngles(0, 1, 2);
+    angle[0] = text_euler(0);
+    angle[1] = text_euler(1);
+    angle[2] = text_euler(2);
+}
+
+} // namespace
+
+
+BBoxOverlay::BBoxOverlay(pcl::visualization::PCLVisualizer &viewer, bool show_labels, const std::string &id)
+    : viewer(viewer),
+      id(id),
+      show_labels(show_labels)
+{
+    this->point_data = vtkSmartPointer<vtkFloatArray>::New();
+    this->point_data->SetNumberOfComponents(3);
+    this->points = vtkSmartPointer<vtkPoints>::New();
+    this->points->SetData(this->point_data);
+    this->lines = vtkSmartPointer<vtkCellArray>::New();
+    this->polydata = vtkSmartPointer<vtkPolyData>::New();
+    this->polydata->SetPoints(this->points);
+    this->polydata->SetLines(this->lines);
+
+    this->viewer.addModelFromPolyData(this->polydata, this->id);
+    this->viewer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1.0, 0.0, 0.0, this->id);
+    this->viewer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_LINE_WIDTH, 2, this->id);
+}
+
+const BBoxChanges &BBoxOverlay::update(const std::vector<BBox3D> &bboxes)
+{
+    vtkIdType previous_boxes = this->point_data->GetNumberOfTuples() / 8;
+    const BBoxChanges &changes = this->slots.update(bboxes);
+    vtkIdType n = vtkIdType(this->slots.size());
+
+    // Corners are written straight into the float array of the points, only for the slots that changed : the others
+    // keep theirs, and the actor is left in place.
+    this->point_data->SetNumberOfTuples(n * 8);
+    for (const std::vector<uint32_t> *rewritten : {&changes.added, &changes.updated, &changes.relocated})
+    {
+        for (uint32_t slot : *rewritten)
+        {
+            bbox_corners(this->slots.box(slot), this->point_data->GetPointer(vtkIdType(slot) * 8 * 3));
+        }
+    }
+    bool moved = !changes.added.empty() || !changes.updated.empty() || !changes.relocated.empty();
+    bool resized = n != previous_boxes;
+    if (moved || resized)
+    {
+        this->point_data->Modified();
+        this->points->Modified();
+    }
+
+    // The edges only depend on the number of boxes : appended when it grows, rebuilt when it shrinks.
+    if (resized)
+    {
+        if (n < previous_boxes)
+        {
+            this->lines->Reset();
+            previous_boxes = 0;
+        }
+        uint32_t index[12 * 2];
+        for (vtkIdType i = previous_boxes; i < n; ++i)
+        {
+            bbox_edges(size_t(i), index);
+            for (int e = 0; e < 12; ++e)
+            {
+                vtkIdType cell[2] = {vtkIdType(index[2 * e]), vtkIdType(index[2 * e + 1])};
+                this->lines->InsertNextCell(2, cell);
+            }
+        }
+        this->lines->Modified();
+    }
+    if (moved || resized)
+    {
+        this->polydata->Modified();
+    }
+
+    if (!this->show_labels)
+    {
+        return changes;
+    }
+    for (const std::string &key : changes.removed)
+    {
+        this->viewer.removeText3D(key + "_text");
+    }
+    for (uint32_t slot : changes.added)
+    {
+        this->add_label(slot);
+    }
+    for (uint32_t slot : changes.updated)
+    {
+        this->move_label(slot);
+    }
+    // Relocated boxes didn't move, their labels are found by key, not by slot.
+    return changes;
+}
+
+void BBoxOverlay::add_label(uint32_t slot)
+{
+    const BBox3D &bbox = this->slots.box(slot);
+    PointT trans(bbox.translation(0), bbox.translation(1), bbox.translation(2), 0, 0, 0);
+    double angle[3];
+    label_orientation(bbox, angle);
+    this->viewer.addText3D<PointT>(bbox.id, trans, angle, 1.0, 1.0, 1.0, 1.0, this->slots.key(slot) + "_text");
+}
+
+void BBoxOverlay::move_label(uint32_t slot)
+{
+    std::string label_id = this->slots.key(slot) + "_text";
+    pcl::visualization::ShapeActorMapPtr actors = this->viewer.getShapeActorMap();
+    auto it = actors->find(label_id);
+    vtkProp3D *actor = (it != actors->end()) ? vtkProp3D::SafeDownCast(it->second) : nullptr;
+    if (actor == nullptr)
+    {
+        this->viewer.removeText3D(label_id);
+        this->add_label(slot);
+        return;
+    }
+    const BBox3D &bbox = this->slots.box(slot);
+    double angle[3];
+    label_orientation(bbox, angle);
+    // As addText3D sets them.
+    actor->SetPosition(bbox.translation(0), bbox.translation(1), bbox.translation(2));
+    actor->SetOrientation(angle);
+}
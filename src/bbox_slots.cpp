@@ -0,0 +1,102 @@
+#include "bbox_slots.h"
+
+
+namespace
+{
+
+bool same_box(const BBox3D &a, const BBox3D &b)
+{
+    return a.translation == b.translation && a.rotation.coeffs() == b.rotation.coeffs() && a.width == b.width
+        && a.height == b.height && a.depth == b.depth;
+}
+
+} // namespace
+
+
+void BBoxChanges::clear()
+{
+    this->added.clear();
+    this->updated.clear();
+    this->relocated.clear();
+    this->removed.clear();
+    this->unchanged = 0;
+}
+
+const BBoxChanges &BBoxSlots::update(const std::vector<BBox3D> &bboxes)
+{
+    BBoxChanges &changes = this->last_changes;
+    changes.clear();
+    ++this->epoch;
+
+    // Match by id : boxes still shown are marked seen (and rewritten when they moved), new ones get a slot at the end.
+    for (const BBox3D &bbox : bboxes)
+    {
+        std::string key = bbox.id;
+        auto it = this->slot_of.find(key);
+        for (int rank = 2; it != this->slot_of.end() && this->slots[it->second].seen == this->epoch; ++rank)
+        {
+            key = bbox.id + "#" + std::to_string(rank);
+            it = this->slot_of.find(key);
+        }
+        if (it != this->slot_of.end())
+        {
+            Slot &slot = this->slots[it->second];
+            slot.seen = this->epoch;
+            if (!same_box(slot.box, bbox))
+            {
+                slot.box = bbox;
+                slot.updated = true;
+            }
+            continue;
+        }
+        Slot slot;
+        slot.box = bbox;
+        slot.key = key;
+        slot.seen = this->epoch;
+        slot.added = true;
+        this->slot_of[key] = uint32_t(this->slots.size());
+        this->slots.push_back(std::move(slot));
+    }
+
+    // Vanished boxes, from the end : each hole is filled with the last slot, which has been checked already.
+    for (size_t s = this->slots.size(); s-- > 0;)
+    {
+        if (this->slots[s].seen == this->epoch)
+        {
+            continue;
+        }
+        changes.removed.push_back(this->slots[s].key);
+        this->slot_of.erase(this->slots[s].key);
+        size_t last = this->slots.size() - 1;
+        if (s != last)
+        {
+            this->slots[s] = std::move(this->slots[last]);
+            this->slots[s].relocated = true;
+            this->slot_of[this->slots[s].key] = uint32_t(s);
+        }
+        this->slots.pop_back();
+    }
+
+    for (size_t s = 0; s < this->slots.size(); ++s)
+    {
+        Slot &slot = this->slots[s];
+        if (slot.added)
+        {
+            changes.added.push_back(uint32_t(s));
+        }
+        else if (slot.updated)
+        {
+            changes.updated.push_back(uint32_t(s));
+        }
+        else if (slot.relocated)
+        {
+            changes.relocated.push_back(uint32_t(s));
+        }
+        else
+        {
+            ++changes.unchanged;
+        }
+        slot.added = slot.updated = slot.relocated = false;
+    }
+    return changes;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+
+#include "cloud_pool.h"
+
+
+void CloudPool::Shared::release(PointCloudT *cloud, size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    // A fresh cloud (capacity 0) getting its first storage is already counted in n_allocations.
+    if (capacity > 0 && cloud->points.capacity() > capacity)
+    {
+        ++this->n_reallocations;
+    }
+    if (!this->alive || this->free_list.size() >= this->max_free)
+    {
+        delete cloud;
+        return;
+    }
+    // Keep the capacity of the point storage, drop everything else.
+    cloud->points.clear();
+    cloud->width = 0;
+    cloud->height = 1;
+    cloud->is_dense = true;
+    this->free_list.push_back(Buffer{cloud, cloud->points.capacity()});
+}
+
+CloudPool::CloudPool(size_t max_free) : shared(new Shared)
+{
+    this->shared->max_free = max_free;
+}
+
+CloudPool::~CloudPool()
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    this->shared->alive = false;
+    for (Buffer &buffer : this->shared->free_list)
+    {
+        delete buffer.cloud;
+    }
+    this->shared->free_list.clear();
+}
+
+PointCloudT::Ptr CloudPool::acquire()
+{
+    Buffer buffer{nullptr, 0};
+    {
+        std::lock_guard<std::mutex> lock(this->shared->mtx);
+        std::vector<Buffer> &free_list = this->shared->free_list;
+        if (!free_list.empty())
+        {
+            auto largest = std::max_element(free_list.begin(), free_list.end(), [](const Buffer &a, const Buffer &b) {
+                return a.capacity < b.capacity;
+            });
+            buffer = *largest;
+            *largest = free_list.back();
+            free_list.pop_back();
+            ++this->shared->n_recycled;
+        }
+        else
+        {
+            ++this->shared->n_allocations;
+        }
+    }
+    if (buffer.cloud == nullptr)
+    {
+        buffer.cloud = new PointCloudT;
+    }
+
+    std::shared_ptr<Shared> shared = this->shared;
+    size_t capacity = buffer.capacity;
+    return PointCloudT::Ptr(buffer.cloud, [shared, capacity](PointCloudT *cloud) {
+        shared->release(cloud, capacity);
+    });
+}
+
+size_t CloudPool::allocations() const
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    return this->shared->n_allocations;
+}
+
+size_t CloudPool::reallocations() const
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    return this->shared->n_reallocations;
+}
+
+size_t CloudPool::recycled() const
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    return this->shared->n_recycled;
+}
+
+size_t CloudPool::free_buffers() const
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    return this->shared->free_list.size();
+}
+
+void CloudPool::print_stats(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(this->shared->mtx);
+    os << "cloud pool : " << this->shared->n_allocations << " clouds allocated, "
+       << this->shared->n_reallocations << " point buffers grown, "
+       << this->shared->n_recycled << " recycled, "
+       << this->shared->free_list.size() << " free" << std::endl;
+}
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "compressed_cloud.h"
+#include "parallel.h"
+
+
+namespace
+{
+
+const size_t kMinChunk = 65536;
+// Largest level of a quantised value, the one above marks non-finite points.
+const float kMaxLevel = 65534.0f;
+const uint16_t kNonFiniteLevel = 0xffff;
+
+const char *kCodecNames[POINT_CODEC_COUNT] = {"none", "float", "quant16"};
+
+// Min/max of the finite points (and intensities) of the cloud, chunks of points on all cores.
+void finite_bounds(const PointCloudT &cloud, const std::vector<float> *intensity, Eigen::Vector3f &min, Eigen::Vector3f &max,
+                   float &value_min, float &value_max)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    size_t n = cloud.size();
+    size_t num_chunks = parallel_num_chunks(n, kMinChunk);
+    std::vector<Eigen::Vector3f> chunk_min(num_chunks, Eigen::Vector3f::Constant(inf));
+    std::vector<Eigen::Vector3f> chunk_max(num_chunks, Eigen::Vector3f::Constant(-inf));
+    std::vector<float> chunk_value_min(num_chunks, inf), chunk_value_max(num_chunks, -inf);
+
+    parallel_for(n, kMinChunk, [&](size_t begin, size_t end, size_t chunk) {
+        Eigen::Vector3f lo = chunk_min[chunk], hi = chunk_max[chunk];
+        float value_lo = inf, value_hi = -inf;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud.points[i];
+            if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+            {
+                Eigen::Vector3f v = p.getVector3fMap();
+                lo = lo.cwiseMin(v);
+                hi = hi.cwiseMax(v);
+            }
+            if (intensity != nullptr && std::isfinite((*intensity)[i]))
+            {
+                value_lo = std::min(value_lo, (*intensity)[i]);
+                value_hi = std::max(value_hi, (*intensity)[i]);
+            }
+        }
+        chunk_min[chunk] = lo;
+        chunk_max[chunk] = hi;
+        chunk_value_min[chunk] = value_lo;
+        chunk_value_max[chunk] = value_hi;
+    });
+
+    min = Eigen::Vector3f::Constant(inf);
+    max = Eigen::Vector3f::Constant(-inf);
+    value_min = inf;
+    value_max = -inf;
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        min = min.cwiseMin(chunk_min[c]);
+        max = max.cwiseMax(chunk_max[c]);
+        value_min = std::min(value_min, chunk_value_min[c]);
+        value_max = std::max(value_max, chunk_value_max[c]);
+    }
+}
+
+inline uint16_t quantize(float value, float origin, float inv_step)
+{
+    float level = (value - origin) * inv_step + 0.5f;
+    // Also catches NaN values.
+    if (!(level > 0.0f))
+    {
+        return 0;
+    }
+    return static_cast<uint16_t>(std::min(level, kMaxLevel));
+}
+
+} // namespace
+
+
+const char *point_codec_name(int codec)
+{
+    return (codec >= 0 && codec < POINT_CODEC_COUNT) ? kCodecNames[codec] : "unknown";
+}
+
+bool parse_point_codec(const std::string &name, PointCodec &codec)
+{
+    for (int c = 0; c < POINT_CODEC_COUNT; ++c)
+    {
+        if (name == kCodecNames[c])
+        {
+            codec = static_cast<PointCodec>(c);
+            return true;
+        }
+    }
+    return false;
+}
+
+CompressedCloud::CompressedCloud(const PointCloudT &cloud, const std::vector<float> &intensity, PointCodec codec)
+  : point_codec(codec == POINT_CODEC_QUANT16 ? POINT_CODEC_QUANT16 : POINT_CODEC_FLOAT),
+    num_points(cloud.size()),
+    width(cloud.width),
+    height(cloud.height),
+    dense(cloud.is_dense),
+    has_intensity(!intensity.empty() && intensity.size() == cloud.size())
+{
+    size_t n = this->num_points;
+
+    if (this->point_codec == POINT_CODEC_FLOAT)
+    {
+        this->xyz.resize(3 * n);
+        parallel_for(n, kMinChunk, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const PointT &p = cloud.points[i];
+                this->xyz[3 * i] = p.x;
+                this->xyz[3 * i + 1] = p.y;
+                this->xyz[3 * i + 2] = p.z;
+            }
+        });
+        if (this->has_intensity)
+        {
+            this->values = intensity;
+        }
+        return;
+    }
+
+    Eigen::Vector3f min, max;
+    float value_min, value_max;
+    finite_bounds(cloud, this->has_intensity ? &intensity : nullptr, min, max, value_min, value_max);
+    if ((min.array() <= max.array()).all())
+    {
+        this->origin = min;
+        this->step = (max - min) / kMaxLevel;
+    }
+    if (value_min <= value_max)
+    {
+        this->intensity_origin = value_min;
+        this->intensity_step = (value_max - value_min) / kMaxLevel;
+    }
+    // A flat axis has a step of 0 : every level is 0 and decodes to the origin.
+    Eigen::Vector3f inv_step;
+    for (int a = 0; a < 3; ++a)
+    {
+        inv_step(a) = this->step(a) > 0.0f ? 1.0f / this->step(a) : 0.0f;
+    }
+    float inv_value_step = this->intensity_step > 0.0f ? 1.0f / this->intensity_step : 0.0f;
+
+    this->xyz_levels.resize(3 * n);
+    if (this->has_intensity)
+    {
+        this->value_levels.resize(n);
+    }
+    parallel_for(n, kMinChunk, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud.points[i];
+            uint16_t *levels = this->xyz_levels.data() + 3 * i;
+            if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+            {
+                levels[0] = quantize(p.x, this->origin.x(), inv_step.x());
+                levels[1] = quantize(p.y, this->origin.y(), inv_step.y());
+                levels[2] = quantize(p.z, this->origin.z(), inv_step.z());
+            }
+            else
+            {
+                levels[0] = levels[1] = levels[2] = kNonFiniteLevel;
+            }
+        }
+        if (this->has_intensity)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                this->value_levels[i] = quantize(intensity[i], this->intensity_origin, inv_value_step);
+            }
+        }
+    });
+}
+
+size_t CompressedCloud::size_bytes() const
+{
+    return sizeof(CompressedCloud) + this->xyz.capacity() * sizeof(float) + this->values.capacity() * sizeof(float)
+        + this->xyz_levels.capacity() * sizeof(uint16_t) + this->value_levels.capacity() * sizeof(uint16_t);
+}
+
+Eigen::Vector3f CompressedCloud::max_error() const
+{
+    return (this->point_codec == POINT_CODEC_QUANT16) ? Eigen::Vector3f(0.5f * this->step) : Eigen::Vector3f::Zero();
+}
+
+void CompressedCloud::decode(PointCloudT &cloud, std::vector<float> &intensity) const
+{
+    size_t n = this->num_points;
+    cloud.resize(n);
+    cloud.width = this->width;
+    cloud.height = this->height;
+    cloud.is_dense = this->dense;
+    if (this->has_intensity)
+    {
+        intensity.resize(n);
+    }
+    else
+    {
+        intensity.clear();
+    }
+
+    const uint32_t default_rgba = PointT().rgba;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    parallel_for(n, kMinChunk, [&](size_t begin, size_t end, size_t) {
+        if (this->point_codec == POINT_CODEC_FLOAT)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                PointT &p = cloud.points[i];
+                p.x = this->xyz[3 * i];
+                p.y = this->xyz[3 * i + 1];
+                p.z = this->xyz[3 * i + 2];
+                p.data[3] = 1.0f;
+                p.rgba = default_rgba;
+            }
+            if (this->has_intensity)
+            {
+                std::copy(this->values.begin() + begin, this->values.begin() + end, intensity.begin() + begin);
+            }
+            return;
+        }
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            PointT &p = cloud.points[i];
+            const uint16_t *levels = this->xyz_levels.data() + 3 * i;
+            if (levels[0] == kNonFiniteLevel)
+            {
+                p.x = p.y = p.z = nan;
+            }
+            else
+            {
+                p.x = this->origin.x() + float(levels[0]) * this->step.x();
+                p.y = this->origin.y() + float(levels[1]) * this->step.y();
+                p.z = this->origin.z() + float(levels[2]) * this->step.z();
+            }
+            p.data[3] = 1.0f;
+            p.rgba = default_rgba;
+        }
+        if (this->has_intensity)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                intensity[i] = this->intensity_origin + float(this->value_levels[i]) * this->intensity_step;
+            }
+        }
+    });
+}
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "decimation.h"
+#include "parallel.h"
+
+
+namespace
+{
+
+// Clouds smaller than this are decimated on the calling thread.
+const size_t kDecimationChunkPoints = 1 << 16;
+// Hash buckets of the voxel grid, filled by one thread each. Fixed rather than one per chunk : the order the
+// voxels are walked in, and so the points stratified thinning keeps, doesn't depend on the number of cores.
+const size_t kVoxelBuckets = 64;
+
+// Voxel indices are packed as 3 x 21 bits into a 64-bit key.
+const int kVoxelKeyBits = 21;
+const int64_t kVoxelIndexMax = (int64_t(1) << kVoxelKeyBits) - 1;
+const uint64_t kInvalidKey = ~uint64_t(0);
+
+// A second grid is tried when the automatic voxel size leaves more voxels than this times the budget.
+const double kVoxelRetryRatio = 1.5;
+
+// splitmix64 finaliser.
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Uniform in [0, 1), reproducible from `i` alone.
+inline double unit_random(uint64_t i)
+{
+    return (mix64(i + 0x9e3779b97f4a7c15ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Random index in slice k of [0, n) cut into m slices (m <= n). Slices don't overlap, so the m indices are distinct.
+inline size_t stratified_index(size_t k, size_t n, size_t m)
+{
+    size_t begin = k * n / m;
+    size_t width = (k + 1) * n / m - begin;
+    return begin + std::min(width - 1, size_t(unit_random(k) * width));
+}
+
+inline bool is_finite(const PointT &p)
+{
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+// The cell hash picks the bucket from its high bits and the table slot from its low bits.
+inline size_t key_bucket(uint64_t key, size_t num_buckets)
+{
+    return (mix64(key) >> 40) % num_buckets;
+}
+
+struct Bounds
+{
+    float min[3];
+    float max[3];
+    size_t finite;
+};
+
+Bounds compute_bounds(const PointCloudT &cloud)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    size_t num_chunks = parallel_num_chunks(cloud.size(), kDecimationChunkPoints);
+    std::vector<Bounds> chunk_bounds(num_chunks, Bounds{{inf, inf, inf}, {-inf, -inf, -inf}, 0});
+    parallel_for(cloud.size(), kDecimationChunkPoints, [&](size_t begin, size_t end, size_t c) {
+        // Accumulated locally : the chunk results share cache lines.
+        Bounds b = chunk_bounds[c];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud[i];
+            if (!is_finite(p))
+            {
+                continue;
+            }
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                b.min[axis] = std::min(b.min[axis], p.data[axis]);
+                b.max[axis] = std::max(b.max[axis], p.data[axis]);
+            }
+            ++b.finite;
+        }
+        chunk_bounds[c] = b;
+    });
+
+    Bounds bounds = chunk_bounds[0];
+    for (size_t c = 1; c < num_chunks; ++c)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bounds.min[axis] = std::min(bounds.min[axis], chunk_bounds[c].min[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], chunk_bounds[c].max[axis]);
+        }
+        bounds.finite += chunk_bounds[c].finite;
+    }
+    return bounds;
+}
+
+// Running sums of the points of a voxel.
+struct VoxelCell
+{
+    float x, y, z, intensity;
+    uint32_t count;
+};
+
+// Open-addressing map from voxel key to the index of its cell, grown to stay at most half full.
+// Key and index share a slot, so that a lookup touches a single cache line.
+class VoxelTable
+{
+public:
+    // Empty the table, sized for `expected` keys. The storage is kept from one frame to the next.
+    void reset(size_t expected)
+    {
+        size_t capacity = 64;
+        while (capacity < 2 * expected)
+        {
+            capacity *= 2;
+        }
+        this->slots.assign(capacity, Slot{kInvalidKey, 0});
+        this->count = 0;
+    }
+
+    // Index of the cell of `key`, `next` when the key wasn't in the table yet.
+    uint32_t find_or_insert(uint64_t key, uint32_t next)
+    {
+        if (2 * (this->count + 1) > this->slots.size())
+        {
+            this->grow();
+        }
+        size_t mask = this->slots.size() - 1;
+        for (size_t i = mix64(key) & mask;; i = (i + 1) & mask)
+        {
+            Slot &slot = this->slots[i];
+            if (slot.key == key)
+            {
+                return slot.id;
+            }
+            if (slot.key == kInvalidKey)
+            {
+                slot.key = key;
+                slot.id = next;
+                ++this->count;
+                return next;
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key;
+        uint32_t id;
+    };
+
+    void grow()
+    {
+        std::vector<Slot> old_slots(2 * this->slots.size(), Slot{kInvalidKey, 0});
+        old_slots.swap(this->slots);
+        size_t mask = this->slots.size() - 1;
+        for (const Slot &slot : old_slots)
+        {
+            if (slot.key == kInvalidKey)
+            {
+                continue;
+            }
+            size_t i = mix64(slot.key) & mask;
+            while (this->slots[i].key != kInvalidKey)
+            {
+                i = (i + 1) & mask;
+            }
+            this->slots[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+};
+
+// Accumulates the points of `cloud` into the voxels of edge `voxel_size` with their min corner on the grid
+// starting at `origin`. The voxels are split by hash into kVoxelBuckets buckets, one table per bucket, so that
+// every bucket is filled by a single thread without locks. Returns the number of occupied voxels.
+size_t build_voxels(const PointCloudT &cloud, const float *intensity, const float origin[3], float voxel_size,
+                    std::vector<std::vector<VoxelCell>> &buckets)
+{
+    // Scratch buffers of the calling thread, reused from one frame to the next. Named through references so that
+    // the worker lambdas use these and not their own thread's instances.
+    thread_local std::vector<uint64_t> thread_keys;
+    thread_local std::vector<uint32_t> thread_order;
+    thread_local std::vector<VoxelTable> thread_tables;
+    std::vector<uint64_t> &keys = thread_keys;
+    std::vector<uint32_t> &order = thread_order;
+    std::vector<VoxelTable> &tables = thread_tables;
+
+    size_t n = cloud.size();
+    size_t num_chunks = parallel_num_chunks(n, kDecimationChunkPoints);
+    size_t num_buckets = kVoxelBuckets;
+    float inv_size = 1.0f / voxel_size;
+
+    // Pass 1 : voxel key of every point and number of points per (chunk, bucket).
+    keys.resize(n);
+    std::vector<size_t> offsets(num_chunks * num_buckets, 0);
+    parallel_for(n, kDecimationChunkPoints, [&](size_t begin, size_t end, size_t c) {
+        std::vector<size_t> counts(num_buckets, 0);
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud[i];
+            if (!is_finite(p))
+            {
+                keys[i] = kInvalidKey;
+                continue;
+            }
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                int64_t index = int64_t(std::floor((p.data[axis] - origin[axis]) * inv_size));
+                index = std::min(std::max(index, int64_t(0)), kVoxelIndexMax);
+                key |= uint64_t(index) << (axis * kVoxelKeyBits);
+            }
+            keys[i] = key;
+            ++counts[key_bucket(key, num_buckets)];
+        }
+        std::copy(counts.begin(), counts.end(), offsets.begin() + c * num_buckets);
+    });
+
+    // Bucket-major prefix sums : every chunk writes its points of a bucket to its own range.
+    std::vector<size_t> bucket_begin(num_buckets + 1, 0);
+    size_t total = 0;
+    for (size_t b = 0; b < num_buckets; ++b)
+    {
+        bucket_begin[b] = total;
+        for (size_t c = 0; c < num_chunks; ++c)
+        {
+            size_t count = offsets[c * num_buckets + b];
+            offsets[c * num_buckets + b] = total;
+            total += count;
+        }
+    }
+    bucket_begin[num_buckets] = total;
+
+    // Pass 2 : point indices grouped by bucket.
+    order.resize(total);
+    parallel_for(n, kDecimationChunkPoints, [&](size_t begin, size_t end, size_t c) {
+        std::vector<size_t> next(offsets.begin() + c * num_buckets, offsets.begin() + (c + 1) * num_buckets);
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (keys[i] != kInvalidKey)
+            {
+                order[next[key_bucket(keys[i], num_buckets)]++] = uint32_t(i);
+            }
+        }
+    });
+
+    // Pass 3 : one thread per bucket sums its points into their voxel.
+    buckets.resize(num_buckets);
+    tables.resize(num_buckets);
+    parallel_for(num_buckets, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t b = begin; b < end; ++b)
+        {
+            std::vector<VoxelCell> &cells = buckets[b];
+            cells.clear();
+            VoxelTable &table = tables[b];
+            table.reset((bucket_begin[b + 1] - bucket_begin[b]) / 2);
+            for (size_t k = bucket_begin[b]; k < bucket_begin[b + 1]; ++k)
+            {
+                uint32_t i = order[k];
+                uint32_t id = table.find_or_insert(keys[i], uint32_t(cells.size()));
+                if (id == cells.size())
+                {
+                    cells.push_back(VoxelCell{0.0f, 0.0f, 0.0f, 0.0f, 0});
+                }
+                VoxelCell &cell = cells[id];
+                const PointT &p = cloud[i];
+                cell.x += p.x;
+                cell.y += p.y;
+                cell.z += p.z;
+                cell.intensity += intensity ? intensity[i] : 0.0f;
+                ++cell.count;
+            }
+        }
+    });
+
+    size_t voxels = 0;
+    for (const std::vector<VoxelCell> &cells : buckets)
+    {
+        voxels += cells.size();
+    }
+    return voxels;
+}
+
+float decimate_voxel(const PointCloudT &input, const float *intensity, const DecimationConfig &config,
+                     PointCloudT &output, std::vector<float> &output_intensity)
+{
+    Bounds bounds = compute_bounds(input);
+    if (bounds.finite == 0)
+    {
+        output.clear();
+        output_intensity.clear();
+        return config.voxel_size;
+    }
+
+    // The grid has to hold the whole extent in 2^21 voxels per axis.
+    float extent[3];
+    float max_extent = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        extent[axis] = bounds.max[axis] - bounds.min[axis];
+        max_extent = std::max(max_extent, extent[axis]);
+    }
+    float min_size = max_extent / float(kVoxelIndexMax);
+
+    // Automatic size : a sweep is mostly a surface seen from above, so the budget is spread over the xy extent.
+    bool automatic = !(config.voxel_size > 0.0f);
+    float voxel_size = config.voxel_size;
+    if (automatic)
+    {
+        voxel_size = std::sqrt(extent[0] * extent[1] / float(config.max_points));
+    }
+    voxel_size = std::max(voxel_size, min_size);
+    if (!(voxel_size > 0.0f))
+    {
+        voxel_size = 1.0f;
+    }
+
+    thread_local std::vector<std::vector<VoxelCell>> thread_buckets;
+    std::vector<std::vector<VoxelCell>> &buckets = thread_buckets;
+    size_t voxels = build_voxels(input, intensity, bounds.min, voxel_size, buckets);
+    if (automatic && voxels > kVoxelRetryRatio * config.max_points)
+    {
+        // Scale the voxels up by the ratio still to remove. The cube root (volume-like occupancy) errs on the side of
+        // too many voxels, which the thinning below trims, rather than of too few.
+        voxel_size *= std::cbrt(float(voxels) / float(config.max_points));
+        voxels = build_voxels(input, intensity, bounds.min, voxel_size, buckets);
+    }
+
+    std::vector<size_t> bucket_begin(buckets.size() + 1, 0);
+    for (size_t b = 0; b < buckets.size(); ++b)
+    {
+        bucket_begin[b + 1] = bucket_begin[b] + buckets[b].size();
+    }
+
+    // Voxels over the budget are thinned the same way as the random method thins points.
+    size_t m = std::min(voxels, config.max_points);
+    output.resize(m);
+    output_intensity.resize(intensity ? m : 0);
+    parallel_for(m, kDecimationChunkPoints, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k)
+        {
+            size_t v = (voxels > m) ? stratified_index(k, voxels, m) : k;
+            size_t b = std::upper_bound(bucket_begin.begin(), bucket_begin.end(), v) - bucket_begin.begin() - 1;
+            const VoxelCell &cell = buckets[b][v - bucket_begin[b]];
+            float inv_count = 1.0f / float(cell.count);
+            PointT &p = output[k];
+            p.x = cell.x * inv_count;
+            p.y = cell.y * inv_count;
+            p.z = cell.z * inv_count;
+            if (intensity)
+            {
+                output_intensity[k] = cell.intensity * inv_count;
+            }
+        }
+    });
+    output.is_dense = true;
+    return voxel_size;
+}
+
+void decimate_random(const PointCloudT &input, const float *intensity, const DecimationConfig &config,
+                     PointCloudT &output, std::vector<float> &output_intensity)
+{
+    size_t n = input.size();
+    size_t m = config.max_points;
+    output.resize(m);
+    output_intensity.resize(intensity ? m : 0);
+    parallel_for(m, kDecimationChunkPoints, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k)
+        {
+            size_t i = stratified_index(k, n, m);
+            output[k] = input[i];
+            if (intensity)
+            {
+                output_intensity[k] = intensity[i];
+            }
+        }
+    });
+    output.is_dense = input.is_dense;
+}
+
+} // namespace
+
+
+float decimate_cloud(const PointCloudT &input, const std::vector<float> &intensity, const DecimationConfig &config,
+                     PointCloudT &output, std::vector<float> &output_intensity)
+{
+    const float *values = (intensity.size() == input.size()) ? intensity.data() : nullptr;
+    if (!decimation_needed(input.size(), config))
+    {
+        output = input;
+        output_intensity.clear();
+        if (values)
+        {
+            output_intensity = intensity;
+        }
+        return 0.0f;
+    }
+    if (config.method == DECIMATION_RANDOM)
+    {
+        decimate_random(input, values, config, output, output_intensity);
+        return 0.0f;
+    }
+    return decimate_voxel(input, values, config, output, output_intensity);
+}
@@ -0,0 +1,368 @@
+#include <cstring>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <pcl/PCLPointCloud2.h>
+#include <pcl/conversions.h>
+#include <pcl/io/pcd_io.h>
+
+#include "frame.h"
+#include "parallel.h"
+#include "pcd_reader.h"
+#include "spatial_index.h"
+#include "stage_profiler.h"
+
+
+std::string find_annot_file(const std::string &annot_path, const std::string &pcd_file_path)
+{
+    namespace bfs = boost::filesystem;
+
+    bfs::path bfs_annot_p(annot_path);
+
+    if (annot_path.empty() or !bfs::exists(bfs_annot_p))
+    {
+        return "";
+    }
+
+    if (bfs::is_directory(bfs_annot_p))
+    {
+        std::string file_name = bfs::path(pcd_file_path).stem().string();
+        return (bfs_annot_p / (file_name + ".json")).string();
+    }
+    else if (bfs_annot_p.extension().string() == ".json")
+    {
+        return annot_path;
+    }
+    return "";
+}
+
+bool load_frame_annot(const std::string &annot_path, const std::string &pcd_file_path, std::vector<BBox3D> &bboxes,
+                      LidarPose *pose)
+{
+    namespace bfs = boost::filesystem;
+
+    bboxes.clear();
+
+    if (annot_path.empty())
+    {
+        return true;
+    }
+    if (!bfs::exists(bfs::path(annot_path)))
+    {
+        std::cout << (boost::format("Warning : annotaion path '%1%' does not exist.") % annot_path).str() << std::endl;
+        return false;
+    }
+
+    std::string annot_file = find_annot_file(annot_path, pcd_file_path);
+    bool ret = false;
+    if (!annot_file.empty())
+    {
+        std::cout << "loading : " << annot_file << std::endl;
+        ret = load_annot(annot_file, bboxes, pose);
+    }
+
+    if (!ret)
+    {
+        std::cout << (boost::format("Warning : annotaion path '%1%' was skipped.") % annot_path).str() << std::endl;
+        std::cout << "check file format." << std::endl;
+    }
+    return ret;
+}
+
+size_t frame_size_bytes(const Frame &frame)
+{
+    size_t bytes = sizeof(Frame) + frame.pcd_file.capacity();
+    if (frame.cloud)
+    {
+        bytes += sizeof(PointCloudT) + frame.cloud->points.capacity() * sizeof(PointT);
+    }
+    if (frame.full_cloud)
+    {
+        bytes += sizeof(PointCloudT) + frame.full_cloud->points.capacity() * sizeof(PointT);
+    }
+    bytes += frame.intensity.capacity() * sizeof(float);
+    bytes += frame.full_intensity.capacity() * sizeof(float);
+    bytes += frame.bboxes.capacity() * sizeof(BBox3D);
+    for (const BBox3D &bbox : frame.bboxes)
+    {
+        bytes += bbox.id.capacity();
+    }
+    if (frame.spatial_index)
+    {
+        bytes += frame.spatial_index->size_bytes();
+    }
+    return bytes;
+}
+
+CompressedFramePtr compress_frame(const Frame &frame, PointCodec codec)
+{
+    ScopedStageTimer timer("frame.compress");
+    std::shared_ptr<CompressedFrame> compressed(new CompressedFrame);
+    compressed->index = frame.index;
+    compressed->pcd_file = frame.pcd_file;
+    compressed->bboxes = frame.bboxes;
+    compressed->pose = frame.pose;
+    compressed->filter = frame.filter;
+    compressed->load_ms = frame.load_ms;
+    compressed->filter_ms = frame.filter_ms;
+    compressed->decimate_ms = frame.decimate_ms;
+    compressed->color_ms = frame.color_ms;
+    if (frame.cloud)
+    {
+        compressed->cloud = CompressedCloud(*(frame.cloud), frame.intensity, codec);
+    }
+    if (frame.full_cloud)
+    {
+        compressed->full_cloud = CompressedCloud(*(frame.full_cloud), frame.full_intensity, codec);
+    }
+    compressed->frame_bytes = frame_size_bytes(frame);
+    return compressed;
+}
+
+FramePtr decompress_frame(const CompressedFrame &compressed, CloudPool *pool)
+{
+    ScopedStageTimer timer("frame.decompress");
+    FramePtr frame(new Frame);
+    frame->index = compressed.index;
+    frame->pcd_file = compressed.pcd_file;
+    frame->bboxes = compressed.bboxes;
+    frame->pose = compressed.pose;
+    frame->filter = compressed.filter;
+    frame->load_ms = compressed.load_ms;
+    frame->filter_ms = compressed.filter_ms;
+    frame->decimate_ms = compressed.decimate_ms;
+    frame->color_ms = compressed.color_ms;
+
+    frame->cloud = pool ? pool->acquire() : PointCloudT::Ptr(new PointCloudT);
+    compressed.cloud.decode(*(frame->cloud), frame->intensity);
+    frame->color_version = kColorVersionNone;
+
+    if (!compressed.full_cloud.empty())
+    {
+        frame->full_cloud = pool ? pool->acquire() : PointCloudT::Ptr(new PointCloudT);
+        compressed.full_cloud.decode(*(frame->full_cloud), frame->full_intensity);
+    }
+    frame->full_colored = false;
+    frame->full_color_version = 0;
+    return frame;
+}
+
+size_t compressed_frame_size_bytes(const CompressedFrame &frame)
+{
+    size_t bytes = sizeof(CompressedFrame) + frame.pcd_file.capacity() + frame.cloud.size_bytes() + frame.full_cloud.size_bytes();
+    bytes += frame.bboxes.capacity() * sizeof(BBox3D);
+    for (const BBox3D &bbox : frame.bboxes)
+    {
+        bytes += bbox.id.capacity();
+    }
+    return bytes;
+}
+
+namespace
+{
+
+template <typename T>
+void extract_field(const pcl::PCLPointCloud2 &blob, const pcl::PCLPointField &field, std::vector<float> &values)
+{
+    size_t n = size_t(blob.width) * blob.height;
+    values.resize(n);
+    const uint8_t *data = blob.data.data() + field.offset;
+    for (size_t i = 0; i < n; ++i)
+    {
+        T value;
+        std::memcpy(&value, data + i * blob.point_step, sizeof(T));
+        values[i] = static_cast<float>(value);
+    }
+}
+
+void extract_intensity(const pcl::PCLPointCloud2 &blob, std::vector<float> &intensity)
+{
+    intensity.clear();
+    for (const pcl::PCLPointField &field : blob.fields)
+    {
+        if (field.name != "intensity")
+        {
+            continue;
+        }
+        switch (field.datatype)
+        {
+        case pcl::PCLPointField::FLOAT32:
+            extract_field<float>(blob, field, intensity);
+            break;
+        case pcl::PCLPointField::FLOAT64:
+            extract_field<double>(blob, field, intensity);
+            break;
+        case pcl::PCLPointField::UINT8:
+            extract_field<uint8_t>(blob, field, intensity);
+            break;
+        case pcl::PCLPointField::UINT16:
+            extract_field<uint16_t>(blob, field, intensity);
+            break;
+        case pcl::PCLPointField::UINT32:
+            extract_field<uint32_t>(blob, field, intensity);
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+}
+
+} // namespace
+
+bool load_frame_cloud(const std::string &pcd_file, PointCloudT &cloud, std::vector<float> &intensity)
+{
+    // Binary files (what the recorder writes) are read straight out of a mapping of the file.
+    if (read_pcd_mmap(pcd_file, cloud, intensity))
+    {
+        return true;
+    }
+
+    // Going through PCLPointCloud2 is what loadPCDFile does internally, it also gives access to the intensity field.
+    // The blob is kept per thread so that its data buffer is reused from one file to the next.
+    thread_local pcl::PCLPointCloud2 blob;
+    if (pcl::io::loadPCDFile(pcd_file, blob) != 0)
+    {
+        return false;
+    }
+    pcl::fromPCLPointCloud2(blob, cloud);
+    extract_intensity(blob, intensity);
+    return true;
+}
+
+FramePtr load_frame(const FrameSource &source, int index, const FramePipelineConfig &pipeline, CloudPool *pool)
+{
+    FramePtr frame(new Frame);
+    frame->index = index;
+    frame->pcd_file = source.name(index);
+    frame->cloud = pool ? pool->acquire() : PointCloudT::Ptr(new PointCloudT);
+    frame->full_colored = false;
+    frame->full_color_version = 0;
+    frame->filter_ms = 0.0;
+    frame->decimate_ms = 0.0;
+
+    ScopedStageTimer load_timer("frame.load_cloud");
+    if (!source.load_cloud(index, *(frame->cloud), frame->intensity))
+    {
+        return nullptr;
+    }
+    frame->load_ms = load_timer.stop();
+
+    // Before filtering, which may crop to the boxes.
+    ScopedStageTimer annot_timer("frame.annot");
+    source.load_bboxes(index, frame->bboxes, &frame->pose);
+    frame->filter.bboxes_dropped = filter_bboxes(frame->bboxes, pipeline.filter);
+    annot_timer.stop();
+
+    if (point_filter_enabled(pipeline.filter))
+    {
+        ScopedStageTimer filter_timer("frame.filter");
+        PointCloudT::Ptr filtered = pool ? pool->acquire() : PointCloudT::Ptr(new PointCloudT);
+        std::vector<float> filtered_intensity;
+        size_t bboxes_dropped = frame->filter.bboxes_dropped;
+        frame->filter = filter_cloud(*(frame->cloud), frame->intensity, frame->bboxes, pipeline.filter, *filtered,
+                                     filtered_intensity);
+        frame->filter.bboxes_dropped = bboxes_dropped;
+        frame->cloud = filtered;
+        frame->intensity.swap(filtered_intensity);
+        frame->filter_ms = filter_timer.stop();
+    }
+
+    if (decimation_needed(frame->cloud->size(), pipeline.decimation))
+    {
+        // The loaded points go to the reserve, the frame shows the decimated ones.
+        ScopedStageTimer decimate_timer("frame.decimate");
+        frame->full_cloud = frame->cloud;
+        frame->full_intensity.swap(frame->intensity);
+        frame->cloud = pool ? pool->acquire() : PointCloudT::Ptr(new PointCloudT);
+        decimate_cloud(*(frame->full_cloud), frame->full_intensity, pipeline.decimation, *(frame->cloud), frame->intensity);
+        frame->decimate_ms = decimate_timer.stop();
+    }
+
+    ScopedStageTimer color_timer("frame.color");
+    apply_color(frame->cloud, pipeline.color, &frame->intensity);
+    frame->color_version = pipeline.color_version;
+    frame->color_ms = color_timer.stop();
+
+    return frame;
+}
+
+void update_frame_color(Frame &frame, const FramePipelineConfig &pipeline)
+{
+    if (frame.color_version != pipeline.color_version)
+    {
+        apply_color(frame.cloud, pipeline.color, &frame.intensity);
+        frame.color_version = pipeline.color_version;
+    }
+}
+
+void update_full_color(Frame &frame, const FramePipelineConfig &pipeline)
+{
+    if (frame.full_cloud && (!frame.full_colored || frame.full_color_version != pipeline.color_version))
+    {
+        apply_color(frame.full_cloud, pipeline.color, &frame.full_intensity);
+        frame.full_colored = true;
+        frame.full_color_version = pipeline.color_version;
+    }
+}
+
+bool compute_sequence_color_range(const FrameSource &source, const ColorConfig &config, float &min, float &max,
+                                  const FilterConfig *filter)
+{
+    size_t n = source.size();
+    std::vector<float> frame_min(n), frame_max(n);
+    std::vector<char> frame_ok(n, 0);
+    bool filtered = filter != nullptr && point_filter_enabled(*filter);
+
+    parallel_for(n, 1, [&](size_t begin, size_t end, size_t) {
+        // A frame per thread keeps the cores busy : filtering and colouring run inline. The calling thread takes a
+        // chunk too, its own setting is restored after.
+        bool was_inline = parallel_for_inline();
+        parallel_for_inline() = true;
+        PointCloudT cloud, filtered_cloud;
+        std::vector<float> intensity, filtered_intensity;
+        std::vector<BBox3D> bboxes;
+        for (size_t i = begin; i < end; ++i)
+        {
+            try
+            {
+                if (!source.load_cloud(i, cloud, intensity))
+                {
+                    continue;
+                }
+                if (filtered)
+                {
+                    bboxes.clear();
+                    if (filter->crop_to_boxes)
+                    {
+                        source.load_bboxes(i, bboxes);
+                        filter_bboxes(bboxes, *filter);
+                    }
+                    filter_cloud(cloud, intensity, bboxes, *filter, filtered_cloud, filtered_intensity);
+                    cloud.swap(filtered_cloud);
+                    intensity.swap(filtered_intensity);
+                }
+                frame_ok[i] = color_value_range(cloud, config, &intensity, frame_min[i], frame_max[i]);
+            }
+            catch (const std::exception &e)
+            {
+                // Left out of the range, as a frame that can't be loaded.
+                std::cerr << "Error : reading " << source.name(i) << " for the colour range failed : " << e.what() << std::endl;
+            }
+        }
+        parallel_for_inline() = was_inline;
+    });
+
+    bool found = false;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!frame_ok[i])
+        {
+            continue;
+        }
+        min = found ? std::min(min, frame_min[i]) : frame_min[i];
+        max = found ? std::max(max, frame_max[i]) : frame_max[i];
+        found = true;
+    }
+    return found;
+}
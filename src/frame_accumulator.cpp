@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cmath>
+
+#include "frame_accumulator.h"
+#include "parallel.h"
+#include "stage_profiler.h"
+
+
+FrameAccumulator::FrameAccumulator(FrameProvider &provider, const AccumulationConfig &config)
+    : provider(provider),
+      settings(config),
+      merged(new PointCloudT)
+{
+    this->settings.frames = std::max(this->settings.frames, 1);
+    this->window.reserve(this->settings.frames);
+}
+
+int FrameAccumulator::advance(const FramePtr &frame)
+{
+    ScopedStageTimer timer("accumulate.advance");
+    int newest = frame->index;
+    int oldest = std::max(0, newest - this->settings.frames + 1);
+
+    std::vector<FramePtr> next;
+    next.reserve(this->settings.frames);
+    next.push_back(frame);
+    int fetched = 0;
+    for (int index = newest - 1; index >= oldest; --index)
+    {
+        auto kept = std::find_if(this->window.begin(), this->window.end(),
+                                 [index](const FramePtr &f) { return f->index == index; });
+        if (kept != this->window.end())
+        {
+            // Frames of the window may have been coloured before the colour config changed.
+            this->provider.update_color(**kept);
+            next.push_back(*kept);
+            ++this->n_reused;
+            continue;
+        }
+        FramePtr older = this->provider.get(index);
+        ++fetched;
+        if (older)
+        {
+            next.push_back(older);
+        }
+    }
+    if (fetched > 0)
+    {
+        // Fetching the older frames re-targeted prefetching around them.
+        this->provider.recenter(newest);
+    }
+    this->n_fetched += fetched;
+    this->window.swap(next);
+
+    this->merge();
+    return fetched;
+}
+
+void FrameAccumulator::recolor()
+{
+    for (const FramePtr &frame : this->window)
+    {
+        this->provider.update_color(*frame);
+    }
+    this->merge();
+}
+
+void FrameAccumulator::merge()
+{
+    ScopedStageTimer timer("accumulate.merge");
+
+    struct Sweep
+    {
+        const PointCloudT *cloud;
+        size_t offset;    // first point of the sweep in the merged cloud
+        size_t count;     // points taken from the sweep
+        bool transform;
+        Eigen::Matrix3f rotation;
+        Eigen::Vector3f translation;
+        bool faded;
+        uint8_t fade[256];  // colour channel -> channel blended towards white
+    };
+
+    size_t total = 0;
+    for (const FramePtr &frame : this->window)
+    {
+        total += frame->cloud->size();
+    }
+    size_t budget = (this->settings.max_points > 0) ? std::min(total, this->settings.max_points) : total;
+
+    const LidarPose &reference = this->window.front()->pose;
+    Eigen::Quaternionf reference_inv = reference.rotation.inverse();
+    int max_age = std::max(this->settings.frames - 1, 1);
+
+    std::vector<Sweep> sweeps(this->window.size());
+    size_t merged_points = 0;
+    this->n_without_pose = 0;
+    for (size_t age = 0; age < this->window.size(); ++age)
+    {
+        const Frame &frame = *(this->window[age]);
+        Sweep &sweep = sweeps[age];
+        sweep.cloud = frame.cloud.get();
+        sweep.offset = merged_points;
+        // Every sweep keeps the same share of its points, so that the overlay stays evenly dense.
+        sweep.count = (total > 0) ? size_t(double(frame.cloud->size()) * budget / total) : 0;
+        float fade = this->settings.fade * float(age) / max_age;
+        sweep.faded = fade > 0.0f;
+        for (int c = 0; c < 256; ++c)
+        {
+            sweep.fade[c] = uint8_t(c + std::lround((255 - c) * fade));
+        }
+        sweep.transform = false;
+        if (age > 0 && this->settings.use_pose)
+        {
+            if (reference.valid && frame.pose.valid)
+            {
+                // lidar frame of the sweep -> world -> lidar frame of the newest sweep.
+                sweep.transform = true;
+                sweep.rotation = (reference_inv * frame.pose.rotation).toRotationMatrix();
+                sweep.translation = reference_inv * (frame.pose.translation - reference.translation);
+            }
+            else
+            {
+                ++this->n_without_pose;
+            }
+        }
+        merged_points += sweep.count;
+    }
+
+    PointCloudT &output = *(this->merged);
+    output.resize(merged_points);
+    output.width = merged_points;
+    output.height = 1;
+    output.is_dense = std::all_of(this->window.begin(), this->window.end(), [](const FramePtr &f) { return bool(f->cloud->is_dense); });
+
+    parallel_for(merged_points, 65536, [&](size_t begin, size_t end, size_t) {
+        for (const Sweep &sweep : sweeps)
+        {
+            size_t first = std::max(begin, sweep.offset);
+            size_t last = std::min(end, sweep.offset + sweep.count);
+            size_t n = sweep.cloud->size();
+            for (size_t i = first; i < last; ++i)
+            {
+                // Even stride over the sweep, so that the scan structure is thinned uniformly.
+                size_t k = i - sweep.offset;
+                const PointT &p = sweep.cloud->points[(sweep.count < n) ? k * n / sweep.count : k];
+                PointT &q = output.points[i];
+                q = p;
+                if (sweep.transform)
+                {
+                    q.getVector3fMap() = sweep.rotation * p.getVector3fMap() + sweep.translation;
+                }
+                if (sweep.faded)
+                {
+                    q.r = sweep.fade[p.r];
+                    q.g = sweep.fade[p.g];
+                    q.b = sweep.fade[p.b];
+                }
+            }
+        }
+    });
+    this->last_merge_ms = timer.stop();
+}
+
+void FrameAccumulator::print_stats(std::ostream &os) const
+{
+    os << "accumulation : " << this->window.size() << " / " << this->settings.frames << " frames, "
+       << this->merged->size() << " points, " << this->n_fetched << " frames fetched, " << this->n_reused
+       << " reused, last merge " << this->last_merge_ms << " ms";
+    if (this->n_without_pose > 0)
+    {
+        os << ", " << this->n_without_pose << " frames without pose";
+    }
+    os << std::endl;
+}
@@ -0,0 +1,201 @@
+#include "frame_cache.h"
+
+#include "spatial_index.h"
+
+
+FrameCache::FrameCache(size_t budget_bytes, PointCodec codec, CloudPool *pool)
+  : budget_bytes(budget_bytes),
+    point_codec(codec),
+    pool(pool),
+    used_bytes(0),
+    used_frame_bytes(0),
+    n_hits(0),
+    n_misses(0),
+    n_evictions(0)
+{
+}
+
+FramePtr FrameCache::get(int pcd_id)
+{
+    CompressedFramePtr compressed;
+    std::shared_ptr<const FrameSpatialIndex> spatial_index;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+
+        auto it = this->entries.find(pcd_id);
+        if (it == this->entries.end())
+        {
+            ++this->n_misses;
+            return nullptr;
+        }
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        ++this->n_hits;
+        if (it->second->frame)
+        {
+            return it->second->frame;
+        }
+        compressed = it->second->compressed;
+        spatial_index = it->second->spatial_index;
+    }
+    // Decoded outside the lock, other threads keep using the cache meanwhile.
+    FramePtr frame = decompress_frame(*compressed, this->pool);
+    frame->spatial_index = spatial_index;
+    return frame;
+}
+
+bool FrameCache::contains(int pcd_id) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->entries.count(pcd_id) > 0;
+}
+
+void FrameCache::put(const FramePtr &frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+    Entry entry{frame->index, nullptr, nullptr, nullptr, 0, 0};
+    if (this->point_codec == POINT_CODEC_NONE)
+    {
+        entry.frame = frame;
+        entry.bytes = entry.frame_bytes = frame_size_bytes(*frame);
+    }
+    else
+    {
+        entry.compressed = compress_frame(*frame, this->point_codec);
+        entry.bytes = compressed_frame_size_bytes(*(entry.compressed));
+        entry.frame_bytes = entry.compressed->frame_bytes;
+    }
+    size_t bytes = entry.bytes;
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    auto it = this->entries.find(frame->index);
+    if (it != this->entries.end())
+    {
+        this->used_bytes -= it->second->bytes;
+        this->used_frame_bytes -= it->second->frame_bytes;
+        this->lru.erase(it->second);
+        this->entries.erase(it);
+    }
+    // A frame larger than the whole budget would only flush everything else.
+    if (bytes > this->budget_bytes)
+    {
+        return;
+    }
+
+    this->evict_to(this->budget_bytes - bytes);
+    this->lru.push_front(std::move(entry));
+    this->entries[frame->index] = this->lru.begin();
+    this->used_bytes += bytes;
+    this->used_frame_bytes += this->lru.front().frame_bytes;
+}
+
+void FrameCache::update_size(const FramePtr &frame)
+{
+    if (!frame)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    auto it = this->entries.find(frame->index);
+    if (it == this->entries.end())
+    {
+        return;
+    }
+    Entry &entry = *(it->second);
+    size_t bytes = entry.bytes;
+    size_t frame_bytes = entry.frame_bytes;
+    if (entry.frame)
+    {
+        if (entry.frame != frame)
+        {
+            return;
+        }
+        bytes = frame_bytes = frame_size_bytes(*frame);
+    }
+    else if (!entry.spatial_index && frame->spatial_index)
+    {
+        // Decoded frames are rebuilt from the entry on every hit : the index is only worth keeping here.
+        entry.spatial_index = frame->spatial_index;
+        bytes += entry.spatial_index->size_bytes();
+        frame_bytes += entry.spatial_index->size_bytes();
+    }
+    this->used_bytes = this->used_bytes - entry.bytes + bytes;
+    this->used_frame_bytes = this->used_frame_bytes - entry.frame_bytes + frame_bytes;
+    entry.bytes = bytes;
+    entry.frame_bytes = frame_bytes;
+    // Same policy as put() : a frame grown larger than the whole budget goes too.
+    this->evict_to(this->budget_bytes);
+}
+
+void FrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->lru.clear();
+    this->entries.clear();
+    this->used_bytes = 0;
+    this->used_frame_bytes = 0;
+}
+
+void FrameCache::evict_to(size_t target_bytes)
+{
+    while (this->used_bytes > target_bytes && !this->lru.empty())
+    {
+        const Entry &victim = this->lru.back();
+        this->used_bytes -= victim.bytes;
+        this->used_frame_bytes -= victim.frame_bytes;
+        this->entries.erase(victim.pcd_id);
+        this->lru.pop_back();
+        ++this->n_evictions;
+    }
+}
+
+size_t FrameCache::size_bytes() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->used_bytes;
+}
+
+size_t FrameCache::frame_bytes() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->used_frame_bytes;
+}
+
+size_t FrameCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->n_hits;
+}
+
+size_t FrameCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->n_misses;
+}
+
+size_t FrameCache::evictions() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->n_evictions;
+}
+
+void FrameCache::print_stats(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    double hit_rate = (this->n_hits + this->n_misses) > 0 ? 100.0 * this->n_hits / (this->n_hits + this->n_misses) : 0.0;
+    os << "cache : " << this->entries.size() << " frames, "
+       << this->used_bytes / (1024.0 * 1024.0) << " / " << this->budget_bytes / (1024.0 * 1024.0) << " MB, "
+       << "hits " << this->n_hits << ", misses " << this->n_misses << " (hit rate " << hit_rate << " %), "
+       << "evictions " << this->n_evictions;
+    if (this->point_codec != POINT_CODEC_NONE)
+    {
+        double ratio = this->used_bytes > 0 ? double(this->used_frame_bytes) / this->used_bytes : 0.0;
+        os << ", " << point_codec_name(this->point_codec) << " compression " << ratio << ":1";
+    }
+    os << std::endl;
+}
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <exception>
+
+#include "frame_prefetcher.h"
+
+
+FramePrefetcher::FramePrefetcher(
+    FrameSourcePtr source,
+    int ahead, int behind, int num_workers, const FrameCache *cache, CloudPool *pool
+) : source(source),
+    ahead(std::max(ahead, 0)),
+    behind(std::max(behind, 0)),
+    cache(cache),
+    pool(pool),
+    next_ticket(0),
+    stopping(false),
+    n_hits(0),
+    n_misses(0),
+    n_cancelled(0)
+{
+    int capacity = std::min<int>(1 + this->ahead + this->behind, this->source->size());
+    this->ring.resize(std::max(capacity, 1), Slot{-1, SLOT_EMPTY, 0, nullptr});
+
+    num_workers = std::max(num_workers, 1);
+    for (int i = 0; i < num_workers; ++i)
+    {
+        this->workers.emplace_back(&FramePrefetcher::worker_loop, this);
+    }
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->stopping = true;
+        this->queue.clear();
+    }
+    this->work_cv.notify_all();
+    this->ready_cv.notify_all();
+    for (std::thread &worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+FramePrefetcher::Slot *FramePrefetcher::find_slot(int pcd_id)
+{
+    for (Slot &slot : this->ring)
+    {
+        if (slot.state != SLOT_EMPTY && slot.index == pcd_id)
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void FramePrefetcher::release_slot(Slot &slot)
+{
+    if (slot.state == SLOT_QUEUED || slot.state == SLOT_LOADING)
+    {
+        ++this->n_cancelled;
+    }
+    slot.index = -1;
+    slot.state = SLOT_EMPTY;
+    slot.frame.reset();
+}
+
+FramePtr FramePrefetcher::get(int pcd_id)
+{
+    std::unique_lock<std::mutex> lock(this->mtx);
+
+    Slot *slot = this->find_slot(pcd_id);
+    if (slot != nullptr && slot->state == SLOT_LOADING)
+    {
+        // Already being decoded by a worker : waiting is cheaper than starting over.
+        unsigned long ticket = slot->ticket;
+        this->ready_cv.wait(lock, [&] {
+            return this->stopping || slot->ticket != ticket || slot->state != SLOT_LOADING;
+        });
+        if (slot->ticket != ticket)
+        {
+            slot = nullptr;
+        }
+    }
+
+    if (slot != nullptr && slot->state == SLOT_READY)
+    {
+        ++this->n_hits;
+        return slot->frame;
+    }
+
+    if (slot != nullptr && slot->state == SLOT_QUEUED)
+    {
+        // The caller loads it synchronously, drop it from the queue.
+        this->queue.erase(std::remove(this->queue.begin(), this->queue.end(), pcd_id), this->queue.end());
+        this->release_slot(*slot);
+    }
+    ++this->n_misses;
+    return nullptr;
+}
+
+FramePtr FramePrefetcher::peek(int pcd_id)
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    Slot *slot = this->find_slot(pcd_id);
+    if (slot == nullptr || slot->state != SLOT_READY)
+    {
+        return nullptr;
+    }
+    ++this->n_hits;
+    return slot->frame;
+}
+
+void FramePrefetcher::recenter(int pcd_id)
+{
+    int pcd_len = this->source->size();
+    if (pcd_len == 0)
+    {
+        return;
+    }
+
+    // Wanted frames, nearest first : current, +1, -1, +2, -2, ...
+    std::vector<int> wanted;
+    wanted.push_back(pcd_id);
+    for (int d = 1; d <= std::max(this->ahead, this->behind); ++d)
+    {
+        if (d <= this->ahead)
+        {
+            wanted.push_back((pcd_id + d) % pcd_len);
+        }
+        if (d <= this->behind)
+        {
+            wanted.push_back(((pcd_id - d) % pcd_len + pcd_len) % pcd_len);
+        }
+    }
+    std::vector<int> unique_wanted;
+    for (int id : wanted)
+    {
+        if (std::find(unique_wanted.begin(), unique_wanted.end(), id) == unique_wanted.end()
+            && unique_wanted.size() < this->ring.size())
+        {
+            unique_wanted.push_back(id);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+
+        for (Slot &slot : this->ring)
+        {
+            if (slot.state != SLOT_EMPTY
+                && std::find(unique_wanted.begin(), unique_wanted.end(), slot.index) == unique_wanted.end())
+            {
+                this->release_slot(slot);
+            }
+        }
+
+        this->queue.clear();
+        for (int id : unique_wanted)
+        {
+            Slot *slot = this->find_slot(id);
+            if (slot != nullptr)
+            {
+                if (slot->state == SLOT_QUEUED)
+                {
+                    this->queue.push_back(id);
+                }
+                continue;
+            }
+            // The current frame is shown by the caller already, only neighbours are loaded ahead.
+            if (id == pcd_id || (this->cache != nullptr && this->cache->contains(id)))
+            {
+                continue;
+            }
+            for (Slot &free_slot : this->ring)
+            {
+                if (free_slot.state == SLOT_EMPTY)
+                {
+                    free_slot.index = id;
+                    free_slot.state = SLOT_QUEUED;
+                    free_slot.ticket = ++this->next_ticket;
+                    this->queue.push_back(id);
+                    break;
+                }
+            }
+        }
+    }
+    this->work_cv.notify_all();
+}
+
+void FramePrefetcher::cancel()
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->queue.clear();
+    for (Slot &slot : this->ring)
+    {
+        this->release_slot(slot);
+    }
+}
+
+void FramePrefetcher::set_pipeline(const FramePipelineConfig &pipeline)
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->pipeline = pipeline;
+}
+
+void FramePrefetcher::print_stats(std::ostream &os) const
+{
+    size_t hits = this->n_hits, misses = this->n_misses;
+    double hit_rate = (hits + misses) > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+    os << "prefetch : hits " << hits << ", misses " << misses
+       << " (hit rate " << hit_rate << " %), cancelled " << this->n_cancelled << std::endl;
+}
+
+void FramePrefetcher::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(this->mtx);
+
+    while (true)
+    {
+        this->work_cv.wait(lock, [this] { return this->stopping || !this->queue.empty(); });
+        if (this->stopping)
+        {
+            return;
+        }
+
+        int pcd_id = this->queue.front();
+        this->queue.pop_front();
+
+        Slot *slot = this->find_slot(pcd_id);
+        if (slot == nullptr || slot->state != SLOT_QUEUED)
+        {
+            continue;
+        }
+        slot->state = SLOT_LOADING;
+        unsigned long ticket = slot->ticket;
+        FramePipelineConfig pipeline = this->pipeline;
+
+        lock.unlock();
+        FramePtr frame;
+        try
+        {
+            frame = load_frame(*(this->source), pcd_id, pipeline, this->pool);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error : prefetching " << this->source->name(pcd_id) << " failed : " << e.what() << std::endl;
+        }
+        lock.lock();
+
+        // The slot may have been recycled by recenter() while loading : discard the result then.
+        if (slot->ticket == ticket && slot->state == SLOT_LOADING)
+        {
+            slot->state = frame ? SLOT_READY : SLOT_FAILED;
+            slot->frame = frame;
+        }
+        this->ready_cv.notify_all();
+    }
+}
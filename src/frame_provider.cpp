@@ -0,0 +1,192 @@
+#include <algorithm>
+
+#include "frame_provider.h"
+#include "spatial_index.h"
+#include "stage_profiler.h"
+
+
+FrameProviderOptions sequential_provider_options(int threads, const FramePipelineConfig &pipeline)
+{
+    FrameProviderOptions options;
+    options.threads = std::max(threads, 1);
+    options.prefetch_ahead = 2 * options.threads;
+    options.prefetch_behind = 0;
+    options.cache_bytes = 0;
+    options.pipeline = pipeline;
+    return options;
+}
+
+FrameProvider::FrameProvider(FrameSourcePtr source, const FrameProviderOptions &options)
+  : source(source),
+    current_pipeline(options.pipeline)
+{
+    int ahead = std::max(options.prefetch_ahead, 0);
+    int behind = std::max(options.prefetch_behind, 0);
+    int threads = std::max(options.threads, 1);
+
+    // Enough free buffers for the frames dropped between two loads : prefetch ring, workers and the frame in use.
+    // Decimated frames hold two clouds, the decimated one and the full-resolution one.
+    size_t frame_buffers = ahead + behind + threads + 2;
+    if (options.pipeline.decimation.max_points > 0)
+    {
+        frame_buffers *= 2;
+    }
+    this->pool.reset(new CloudPool(frame_buffers));
+
+    if (this->source->size() <= 1)
+    {
+        return;
+    }
+    if (options.cache_bytes > 0)
+    {
+        this->cache.reset(new FrameCache(options.cache_bytes, options.cache_codec, this->pool.get()));
+    }
+    if (ahead + behind > 0)
+    {
+        this->prefetcher.reset(new FramePrefetcher(this->source, ahead, behind, threads, this->cache.get(), this->pool.get()));
+        this->prefetcher->set_pipeline(this->current_pipeline);
+    }
+}
+
+FramePtr FrameProvider::get(int index)
+{
+    FramePtr frame;
+    bool cached = false;
+    if (this->cache)
+    {
+        ScopedStageTimer timer("fetch.cache");
+        frame = this->cache->get(index);
+        cached = frame != nullptr;
+    }
+    if (!frame && this->prefetcher)
+    {
+        // Waits for the frame when a worker is loading it.
+        ScopedStageTimer timer("fetch.prefetch");
+        frame = this->prefetcher->get(index);
+    }
+    if (!frame)
+    {
+        ScopedStageTimer timer("fetch.load");
+        frame = load_frame(*(this->source), index, this->pipeline(), this->pool.get());
+    }
+    if (frame && !cached && this->cache)
+    {
+        this->cache->put(frame);
+    }
+    if (this->prefetcher)
+    {
+        // Start decoding the new neighbours while this frame is used.
+        this->prefetcher->recenter(index);
+    }
+    if (frame)
+    {
+        // Cached / prefetched frames may have been coloured before the colour config changed.
+        ScopedStageTimer timer("fetch.recolor");
+        this->update_color(*frame);
+    }
+    return frame;
+}
+
+FramePtr FrameProvider::try_get(int index)
+{
+    // Polled until the frame is ready : only lookups that find it are counted by the cache / prefetcher.
+    FramePtr frame;
+    if (this->cache && this->cache->contains(index))
+    {
+        frame = this->cache->get(index);
+    }
+    if (!frame && this->prefetcher)
+    {
+        frame = this->prefetcher->peek(index);
+        if (frame && this->cache)
+        {
+            this->cache->put(frame);
+        }
+    }
+    if (!frame)
+    {
+        return nullptr;
+    }
+    this->recenter(index);
+    ScopedStageTimer timer("fetch.recolor");
+    this->update_color(*frame);
+    return frame;
+}
+
+void FrameProvider::recenter(int index)
+{
+    if (this->prefetcher)
+    {
+        this->prefetcher->recenter(index);
+    }
+}
+
+std::shared_future<FramePtr> FrameProvider::get_async(int index)
+{
+    return std::async(std::launch::async, [this, index] { return this->get(index); }).share();
+}
+
+FramePipelineConfig FrameProvider::pipeline() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->current_pipeline;
+}
+
+void FrameProvider::set_color(const ColorConfig &color)
+{
+    FramePipelineConfig pipeline;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->current_pipeline.color = color;
+        ++this->current_pipeline.color_version;
+        pipeline = this->current_pipeline;
+    }
+    if (this->prefetcher)
+    {
+        this->prefetcher->set_pipeline(pipeline);
+    }
+}
+
+void FrameProvider::update_color(Frame &frame)
+{
+    FramePipelineConfig pipeline = this->pipeline();
+    std::lock_guard<std::mutex> lock(this->color_mtx);
+    update_frame_color(frame, pipeline);
+}
+
+void FrameProvider::update_full_color(Frame &frame)
+{
+    FramePipelineConfig pipeline = this->pipeline();
+    std::lock_guard<std::mutex> lock(this->color_mtx);
+    ::update_full_color(frame, pipeline);
+}
+
+std::shared_ptr<const FrameSpatialIndex> FrameProvider::spatial_index(const FramePtr &frame)
+{
+    bool built = frame->spatial_index != nullptr;
+    std::shared_ptr<const FrameSpatialIndex> index = frame_spatial_index(*frame);
+    if (!built && this->cache)
+    {
+        this->cache->update_size(frame);
+    }
+    return index;
+}
+
+bool FrameProvider::compute_color_range(const ColorConfig &color, float &min, float &max) const
+{
+    FramePipelineConfig pipeline = this->pipeline();
+    return compute_sequence_color_range(*(this->source), color, min, max, &pipeline.filter);
+}
+
+void FrameProvider::print_stats(std::ostream &os) const
+{
+    this->pool->print_stats(os);
+    if (this->cache)
+    {
+        this->cache->print_stats(os);
+    }
+    if (this->prefetcher)
+    {
+        this->prefetcher->print_stats(os);
+    }
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "frame.h"
+#include "frame_source.h"
+
+
+std::vector<std::string> find_pcd_files(const std::string &pcd_path)
+{
+    namespace bfs = boost::filesystem;
+
+    std::vector<std::string> pcd_files;
+    int file_check;
+    std::string file_ext;
+    bfs::path bfs_p(pcd_path);
+
+    if (pcd_path.empty() or !bfs::exists(bfs_p))
+    {
+        std::string message = (boost::format("An argument 'pcd_path : %1%' is empty or doesn't exist!") % pcd_path).str();
+        throw std::runtime_error(message);
+    }
+
+    if (bfs::is_directory(bfs_p))
+    {
+        // Names only, a directory of 50k frames would otherwise take one stat per file.
+        pcd_files = list_directory(pcd_path, ".pcd");
+        std::sort(pcd_files.begin(), pcd_files.end(), natural_less);
+    }
+    else
+    {
+        file_ext = bfs::extension(pcd_path);
+        file_check = (file_ext == ".pcd");
+        if (file_check)
+        {
+            std::cout << pcd_path << " is detected." << std::endl;
+            pcd_files.push_back(pcd_path);
+        }
+    }
+
+    return pcd_files;
+}
+
+PcdFileSource::PcdFileSource(const std::vector<std::string> &pcd_files, const std::string &annot_path)
+    : pcd_files(pcd_files),
+      annot_path(annot_path)
+{
+}
+
+PcdFileSource::PcdFileSource(const SequenceIndex &index, const std::string &annot_path)
+    : pcd_files(index.pcd_files),
+      annot_path(annot_path)
+{
+    if (index.annot_files.size() == index.pcd_files.size())
+    {
+        this->annot_files = std::make_shared<const std::vector<std::string>>(index.annot_files);
+    }
+}
+
+PcdFileSource::~PcdFileSource()
+{
+    if (this->indexer.joinable())
+    {
+        this->indexer.join();
+    }
+}
+
+void PcdFileSource::index_in_background(const std::string &pcd_dir, int64_t listed_mtime_ns)
+{
+    if (this->indexer.joinable())
+    {
+        return;
+    }
+    this->indexer = std::thread([this, pcd_dir, listed_mtime_ns] {
+        SequenceIndex index;
+        index.pcd_files = this->pcd_files;
+        try
+        {
+            index.annot_files = pair_annot_files(this->pcd_files, this->annot_path);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << "Warning : " << e.what() << ", annotations are looked up for each frame." << std::endl;
+            return;
+        }
+        std::atomic_store(&this->annot_files, std::make_shared<const std::vector<std::string>>(index.annot_files));
+        if (!pcd_dir.empty())
+        {
+            save_sequence_index(pcd_dir, this->annot_path, index, listed_mtime_ns);
+        }
+    });
+}
+
+bool PcdFileSource::annotations_paired() const
+{
+    return std::atomic_load(&this->annot_files) != nullptr;
+}
+
+bool PcdFileSource::load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const
+{
+    return load_frame_cloud(this->pcd_files[index], cloud, intensity);
+}
+
+bool PcdFileSource::load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose) const
+{
+    // load_annot leaves the pose as is without annotation file.
+    if (pose != nullptr)
+    {
+        *pose = LidarPose();
+    }
+    bboxes.clear();
+    // Until the annotations are paired in background, the file of the frame is looked up on its own. Either way a
+    // frame without one has no boxes, which isn't an error.
+    std::shared_ptr<const std::vector<std::string>> paired = std::atomic_load(&this->annot_files);
+    std::string annot_file = paired ? (*paired)[index] : find_annot_file(this->annot_path, this->pcd_files[index]);
+    return annot_file.empty() || load_annot(annot_file, bboxes, pose);
+}
+
+bool SeqFileSource::load_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const
+{
+    return this->file.read_cloud(index, cloud, intensity);
+}
+
+bool SeqFileSource::load_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose) const
+{
+    return this->file.read_bboxes(index, bboxes, pose);
+}
+
+FrameSourcePtr open_frame_source(const std::string &pcd_path, const std::string &annot_path)
+{
+    FrameSourcePtr source;
+    if (boost::filesystem::extension(pcd_path) == ".seq")
+    {
+        // Packed sequence : frames and annotations are read from the index of the single file.
+        source.reset(new SeqFileSource(pcd_path));
+        std::cout << pcd_path << " is detected (" << source->size() << " frames)." << std::endl;
+        if (!annot_path.empty())
+        {
+            std::cout << "Warning : annotations are read from the .seq file, 'annotation_path' is ignored." << std::endl;
+        }
+    }
+    else if (boost::filesystem::is_directory(pcd_path))
+    {
+        auto start = std::chrono::steady_clock::now();
+        SequenceIndex index;
+        if (load_sequence_index(pcd_path, annot_path, index))
+        {
+            source.reset(new PcdFileSource(index, annot_path));
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << index.pcd_files.size() << " pcd files in " << pcd_path << " (index cache read in " << elapsed << " ms)." << std::endl;
+        }
+        else
+        {
+            // Frames are shown as soon as the directory is listed, annotations are paired meanwhile.
+            int64_t mtime = path_mtime_ns(pcd_path);
+            std::shared_ptr<PcdFileSource> pcd_source(new PcdFileSource(find_pcd_files(pcd_path), annot_path));
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << pcd_source->size() << " pcd files detected in " << pcd_path << " (listed in " << elapsed << " ms)." << std::endl;
+            if (pcd_source->size() > 0)
+            {
+                pcd_source->index_in_background(pcd_path, mtime);
+            }
+            source = pcd_source;
+        }
+    }
+    else
+    {
+        source.reset(new PcdFileSource(find_pcd_files(pcd_path), annot_path));
+    }
+
+    if (source->size() == 0)
+    {
+        std::string message = (boost::format("Point cloud doesn't exist in given path '%1%'.") % pcd_path).str();
+        throw std::runtime_error(message);
+    }
+    return source;
+}
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include "live_feed.h"
+#include "mapped_file.h"
+#include "seq_file.h"
+
+
+namespace
+{
+
+// A viewer whose producer went quiet looks for a new one this often, and after this long without a frame.
+const int64_t kReconnectIntervalNs = 200 * 1000 * 1000;
+const int64_t kStaleNs = 1000 * 1000 * 1000;
+const size_t kSlotAlignment = 64;
+
+std::string shm_name(const std::string &name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+size_t align_up(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+
+LiveRing::LiveRing(const std::string &object_name, uint8_t *addr, size_t length, bool owner)
+    : object_name(object_name),
+      addr(addr),
+      length(length),
+      owner(owner)
+{
+}
+
+LiveRing::~LiveRing()
+{
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+    ::munmap(this->addr, this->length);
+    if (this->owner)
+    {
+        ::shm_unlink(this->object_name.c_str());
+    }
+#endif
+}
+
+std::unique_ptr<LiveRing> LiveRing::create(const std::string &name, size_t slot_bytes)
+{
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+    std::string object_name = shm_name(name);
+    slot_bytes = align_up(std::max(slot_bytes, sizeof(LiveFrameHeader)), kSlotAlignment);
+    size_t length = sizeof(LiveRingHeader) + kLiveSlots * slot_bytes;
+
+    // A viewer still mapping the previous object keeps it until it notices the new session.
+    ::shm_unlink(object_name.c_str());
+    int fd = ::shm_open(object_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error((boost::format("cannot create the live ring %1% : %2%") % object_name % std::strerror(errno)).str());
+    }
+    void *addr = MAP_FAILED;
+    if (::ftruncate(fd, off_t(length)) == 0)
+    {
+        addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        ::shm_unlink(object_name.c_str());
+        throw std::runtime_error((boost::format("cannot map the live ring %1% (%2% bytes) : %3%") % object_name % length
+                                  % std::strerror(error)).str());
+    }
+
+    LiveRingHeader *header = new (addr) LiveRingHeader;
+    header->version = kLiveVersion;
+    header->num_slots = kLiveSlots;
+    header->slot_bytes = slot_bytes;
+    header->session = std::random_device()() | (uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) << 32);
+    header->middle.store(1);
+    header->front.store(2);
+    header->closed.store(0);
+    header->reserved = 0;
+    header->published.store(0);
+    header->overwritten.store(0);
+    // The magic last : a viewer opening the object before it is set up doesn't take it for a ring.
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, kLiveMagic, sizeof(kLiveMagic));
+    return std::unique_ptr<LiveRing>(new LiveRing(object_name, static_cast<uint8_t *>(addr), length, true));
+#else
+    throw std::runtime_error((boost::format("cannot create the live ring %1% : no shared memory on this platform") % name).str());
+#endif
+}
+
+std::unique_ptr<LiveRing> LiveRing::open(const std::string &name)
+{
+#ifdef CLOUD_VIEWER_HAVE_MMAP
+    std::string object_name = shm_name(name);
+    int fd = ::shm_open(object_name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat st;
+    void *addr = MAP_FAILED;
+    size_t length = 0;
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(LiveRingHeader))
+    {
+        length = st.st_size;
+        addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    std::unique_ptr<LiveRing> ring(new LiveRing(object_name, static_cast<uint8_t *>(addr), length, false));
+    const LiveRingHeader &header = ring->header();
+    if (std::memcmp(header.magic, kLiveMagic, sizeof(kLiveMagic)) != 0 || header.version != kLiveVersion
+        || header.num_slots != kLiveSlots || header.slot_bytes < sizeof(LiveFrameHeader)
+        || sizeof(LiveRingHeader) + kLiveSlots * header.slot_bytes > length)
+    {
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ring;
+#else
+    return nullptr;
+#endif
+}
+
+size_t live_frame_bytes(size_t num_points, bool intensity, const std::vector<BBox3D> &bboxes, const std::string &name)
+{
+    return sizeof(LiveFrameHeader) + num_points * (sizeof(PointT) + (intensity ? sizeof(float) : 0))
+        + seq_bboxes_bytes(bboxes) + name.size();
+}
+
+LiveFrameWriter::LiveFrameWriter(const std::string &name, size_t slot_bytes)
+    : ring(LiveRing::create(name, slot_bytes)),
+      capacity(this->ring->header().slot_bytes)
+{
+}
+
+LiveFrameWriter::~LiveFrameWriter()
+{
+    this->ring->header().closed.store(1, std::memory_order_release);
+}
+
+bool LiveFrameWriter::publish(const PointCloudT &cloud, const std::vector<float> &intensity,
+                              const std::vector<BBox3D> &bboxes, const LidarPose &pose, const std::string &name,
+                              int64_t stamp_ns)
+{
+    size_t n = cloud.size();
+    bool has_intensity = !intensity.empty() && intensity.size() == n;
+    size_t bboxes_bytes = seq_bboxes_bytes(bboxes);
+    if (live_frame_bytes(n, has_intensity, bboxes, name) > this->capacity)
+    {
+        return false;
+    }
+
+    // The back slot is the producer's alone : written without any synchronisation.
+    uint8_t *data = this->ring->slot(this->back);
+    LiveFrameHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.sequence = ++this->sequence;
+    header.stamp_ns = stamp_ns;
+    header.num_points = n;
+    header.width = cloud.width;
+    header.height = cloud.height;
+    if (uint64_t(header.width) * header.height != n)
+    {
+        header.width = n;
+        header.height = 1;
+    }
+    header.flags = (cloud.is_dense ? kLiveFrameDense : 0) | (has_intensity ? kLiveFrameIntensity : 0)
+        | (pose.valid ? kLiveFramePose : 0);
+    header.num_bboxes = bboxes.size();
+    header.bboxes_bytes = bboxes_bytes;
+    header.name_length = name.size();
+    for (int k = 0; k < 3; ++k)
+    {
+        header.pose[k] = pose.translation(k);
+    }
+    header.pose[3] = pose.rotation.w();
+    header.pose[4] = pose.rotation.x();
+    header.pose[5] = pose.rotation.y();
+    header.pose[6] = pose.rotation.z();
+    std::memcpy(data, &header, sizeof(header));
+
+    size_t offset = sizeof(header);
+    std::memcpy(data + offset, cloud.points.data(), n * sizeof(PointT));
+    offset += n * sizeof(PointT);
+    if (has_intensity)
+    {
+        std::memcpy(data + offset, intensity.data(), n * sizeof(float));
+        offset += n * sizeof(float);
+    }
+    write_seq_bboxes(bboxes, data + offset);
+    offset += bboxes_bytes;
+    std::memcpy(data + offset, name.data(), name.size());
+
+    // Hand the slot over, and take back whichever the middle held : the consumer's previous one once it took the
+    // last frame, else the frame it never took.
+    LiveRingHeader &ring_header = this->ring->header();
+    uint32_t previous = ring_header.middle.exchange(this->back | kLiveFresh, std::memory_order_acq_rel);
+    if (previous & kLiveFresh)
+    {
+        ring_header.overwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+    this->back = previous & ~kLiveFresh;
+    ring_header.published.store(this->sequence, std::memory_order_relaxed);
+    return true;
+}
+
+uint64_t LiveFrameWriter::overwritten()
+{
+    return this->ring->header().overwritten.load(std::memory_order_relaxed);
+}
+
+int64_t live_clock_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+LiveFrameSource::LiveFrameSource(const std::string &name) : ring_name(name)
+{
+}
+
+std::string LiveFrameSource::name(int) const
+{
+    if (this->current == nullptr)
+    {
+        return "live:" + this->ring_name;
+    }
+    return std::string(reinterpret_cast<const char *>(this->current + this->name_offset()),
+                       this->current_header.name_length);
+}
+
+bool LiveFrameSource::load_cloud(int, PointCloudT &cloud, std::vector<float> &intensity) const
+{
+    if (this->current == nullptr)
+    {
+        return false;
+    }
+    const LiveFrameHeader &header = this->current_header;
+    size_t n = header.num_points;
+    const uint8_t *data = this->current + sizeof(LiveFrameHeader);
+    cloud.resize(n);
+    cloud.width = header.width;
+    cloud.height = header.height;
+    cloud.is_dense = (header.flags & kLiveFrameDense) != 0;
+    std::memcpy(static_cast<void *>(cloud.points.data()), data, n * sizeof(PointT));
+    if (header.flags & kLiveFrameIntensity)
+    {
+        intensity.resize(n);
+        std::memcpy(intensity.data(), data + n * sizeof(PointT), n * sizeof(float));
+    }
+    else
+    {
+        intensity.clear();
+    }
+    return true;
+}
+
+bool LiveFrameSource::load_bboxes(int, std::vector<BBox3D> &bboxes, LidarPose *pose) const
+{
+    bboxes.clear();
+    if (this->current == nullptr)
+    {
+        return true;
+    }
+    const LiveFrameHeader &header = this->current_header;
+    if (pose != nullptr)
+    {
+        *pose = LidarPose();
+        if (header.flags & kLiveFramePose)
+        {
+            pose->valid = true;
+            pose->translation = Eigen::Vector3f(header.pose[0], header.pose[1], header.pose[2]);
+            pose->rotation = Eigen::Quaternionf(header.pose[3], header.pose[4], header.pose[5], header.pose[6]);
+        }
+    }
+    const uint8_t *data = this->current + this->name_offset() - header.bboxes_bytes;
+    return read_seq_bboxes(data, header.bboxes_bytes, header.num_bboxes, bboxes);
+}
+
+size_t LiveFrameSource::name_offset() const
+{
+    const LiveFrameHeader &header = this->current_header;
+    size_t point_bytes = sizeof(PointT) + ((header.flags & kLiveFrameIntensity) ? sizeof(float) : 0);
+    return sizeof(LiveFrameHeader) + header.num_points * point_bytes + header.bboxes_bytes;
+}
+
+bool LiveFrameSource::reconnect()
+{
+    int64_t now = live_clock_ns();
+    if (this->last_reconnect_ns != 0 && now - this->last_reconnect_ns < kReconnectIntervalNs)
+    {
+        return false;
+    }
+    this->last_reconnect_ns = now;
+    std::unique_ptr<LiveRing> opened = LiveRing::open(this->ring_name);
+    if (!opened || (this->ring && opened->header().session == this->session))
+    {
+        return false;
+    }
+    // A new producer : the frame shown so far lives in the old mapping, which goes away.
+    this->ring = std::move(opened);
+    this->session = this->ring->header().session;
+    this->current = nullptr;
+    this->current_header = LiveFrameHeader{};
+    this->last_take_ns = now;
+    return true;
+}
+
+bool LiveFrameSource::take()
+{
+    int64_t now = live_clock_ns();
+    if (!this->ring || this->ring->header().closed.load(std::memory_order_relaxed) != 0
+        || now - this->last_take_ns > kStaleNs)
+    {
+        this->reconnect();
+    }
+    if (!this->ring)
+    {
+        return false;
+    }
+
+    LiveRingHeader &header = this->ring->header();
+    if (!(header.middle.load(std::memory_order_relaxed) & kLiveFresh))
+    {
+        return false;
+    }
+    // Swap the slot of the frame shown so far for the newest one : the producer writes the former next.
+    uint32_t front = header.front.load(std::memory_order_relaxed);
+    uint32_t previous = header.middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & ~kLiveFresh;
+    header.front.store(front, std::memory_order_relaxed);
+    this->last_take_ns = now;
+    if (front >= kLiveSlots)
+    {
+        this->current = nullptr;
+        return false;
+    }
+
+    // The producer is trusted with the layout, not with the sizes : a frame overflowing its slot is dropped.
+    const uint8_t *data = this->ring->slot(front);
+    LiveFrameHeader frame;
+    std::memcpy(&frame, data, sizeof(frame));
+    uint64_t point_bytes = sizeof(PointT) + ((frame.flags & kLiveFrameIntensity) ? sizeof(float) : 0);
+    uint64_t slot_bytes = header.slot_bytes;
+    if (frame.num_points > slot_bytes / point_bytes
+        || sizeof(LiveFrameHeader) + frame.num_points * point_bytes + uint64_t(frame.bboxes_bytes) + frame.name_length
+               > slot_bytes
+        || uint64_t(frame.width) * frame.height != frame.num_points)
+    {
+        this->current = nullptr;
+        return false;
+    }
+
+    if (this->current != nullptr && frame.sequence > this->current_header.sequence + 1)
+    {
+        this->n_skipped += frame.sequence - this->current_header.sequence - 1;
+    }
+    this->current = data;
+    this->current_header = frame;
+    ++this->n_taken;
+    this->taken_ms.add((now - frame.stamp_ns) / 1e6);
+    return true;
+}
+
+void LiveFrameSource::record_shown()
+{
+    if (this->current == nullptr)
+    {
+        return;
+    }
+    double ms = (live_clock_ns() - this->current_header.stamp_ns) / 1e6;
+    this->shown_ms.add(ms);
+    if (stage_profiler().enabled())
+    {
+        stage_profiler().record("live.latency", ms);
+    }
+}
+
+void LiveFrameSource::print_stats(std::ostream &os) const
+{
+    os << "live feed " << this->ring_name << " : " << this->n_taken << " frames taken, " << this->n_skipped
+       << " skipped, latency to take p50 " << this->taken_ms.percentile(0.5) << " ms / p95 "
+       << this->taken_ms.percentile(0.95) << " ms, to screen p50 " << this->shown_ms.percentile(0.5) << " ms / p95 "
+       << this->shown_ms.percentile(0.95) << " ms" << std::endl;
+}
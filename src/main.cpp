@@ -1,9 +1,292 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
+#include "batch_convert.h"
 #include "sequence_viewer.h"
+#include "stage_profiler.h"
+
+
+namespace
+{
+
+// "MIN:MAX"
+bool parse_min_max(const std::string &text, float &min, float &max)
+{
+    char separator;
+    std::istringstream stream(text);
+    return (stream >> min >> separator >> max) && separator == ':' && stream.peek() == EOF;
+}
+
+// "a,b,c", empty items skipped.
+std::vector<std::string> split_list(const std::string &text)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+// Options of the frame pipeline, shared by the viewer and convert : colour source / map, filters and decimation.
+boost::program_options::options_description pipeline_options(const char *max_points_help)
+{
+    namespace bops = boost::program_options;
+
+    bops::options_description description("frame pipeline");
+    description.add_options()
+        ("color_source,",
+        bops::value<std::string>()->default_value("z"),
+        "value the colormap is applied to : x, y, z, range or intensity")
+        ("color_mode,",
+        bops::value<int>()->default_value(4),
+        "colormap : 0 blue->red, 1 green->magenta, 2 white->red, 3 grey/red, 4 rainbow")
+        ("range,",
+        bops::value<std::string>(),
+        "keep the points at a distance from the sensor in 'MIN:MAX' metres (MAX 0 : no upper bound)")
+        ("height,",
+        bops::value<std::string>(),
+        "keep the points with z in 'MIN:MAX' metres")
+        ("crop_to_boxes,",
+        bops::value<float>(),
+        "keep only the points inside a bbox grown by this many metres on every side")
+        ("allow_labels,",
+        bops::value<std::string>(),
+        "comma-separated bbox labels (ids without their _<number>) to show, the others are hidden and ignored by --crop_to_boxes")
+        ("deny_labels,",
+        bops::value<std::string>(),
+        "comma-separated bbox labels to hide")
+        ("max_points,",
+        bops::value<int>()->default_value(0),
+        max_points_help)
+        ("decimate,",
+        bops::value<std::string>()->default_value("voxel"),
+        "decimation used by --max_points : 'voxel' (centroid per voxel) or 'random' (random subset)")
+        ("voxel_size,",
+        bops::value<float>()->default_value(0.0f),
+        "voxel edge in metres for --decimate voxel, 0 derives it from the extent of the frame and --max_points");
+    return description;
+}
+
+// The options of pipeline_options(), false after reporting the first invalid one.
+bool parse_color_options(const boost::program_options::variables_map &vm, ColorConfig &color)
+{
+    const std::vector<std::string> color_sources = {"x", "y", "z", "range", "intensity"};
+    auto source_it = std::find(color_sources.begin(), color_sources.end(), vm["color_source"].as<std::string>());
+    if (source_it == color_sources.end())
+    {
+        std::cerr << "An argument 'color_source : " << vm["color_source"].as<std::string>() << "' is invalid." << std::endl;
+        return false;
+    }
+    color.source = source_it - color_sources.begin();
+    color.color_mode = vm["color_mode"].as<int>();
+    if (color.color_mode < 0 || color.color_mode >= kColorModeCount)
+    {
+        std::cerr << "An argument 'color_mode : " << color.color_mode << "' is out of range." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool parse_filter_options(const boost::program_options::variables_map &vm, FilterConfig &filter)
+{
+    if (vm.count("range"))
+    {
+        if (!parse_min_max(vm["range"].as<std::string>(), filter.min_range, filter.max_range)
+            || filter.min_range < 0.0f || filter.max_range < 0.0f)
+        {
+            std::cerr << "An argument 'range : " << vm["range"].as<std::string>() << "' is invalid." << std::endl;
+            return false;
+        }
+    }
+    if (vm.count("height"))
+    {
+        filter.height_crop = true;
+        if (!parse_min_max(vm["height"].as<std::string>(), filter.min_z, filter.max_z))
+        {
+            std::cerr << "An argument 'height : " << vm["height"].as<std::string>() << "' is invalid." << std::endl;
+            return false;
+        }
+    }
+    if (vm.count("crop_to_boxes"))
+    {
+        filter.crop_to_boxes = true;
+        filter.box_padding = vm["crop_to_boxes"].as<float>();
+    }
+    if (vm.count("allow_labels"))
+    {
+        filter.allow_labels = split_list(vm["allow_labels"].as<std::string>());
+    }
+    if (vm.count("deny_labels"))
+    {
+        filter.deny_labels = split_list(vm["deny_labels"].as<std::string>());
+    }
+    return true;
+}
+
+bool parse_decimation_options(const boost::program_options::variables_map &vm, DecimationConfig &decimation)
+{
+    if (vm["max_points"].as<int>() < 0)
+    {
+        std::cerr << "An argument 'max_points : " << vm["max_points"].as<int>() << "' is out of range." << std::endl;
+        return false;
+    }
+    decimation.max_points = vm["max_points"].as<int>();
+    decimation.voxel_size = vm["voxel_size"].as<float>();
+    const std::vector<std::string> decimation_methods = {"voxel", "random"};
+    auto method_it = std::find(decimation_methods.begin(), decimation_methods.end(), vm["decimate"].as<std::string>());
+    if (method_it == decimation_methods.end())
+    {
+        std::cerr << "An argument 'decimate : " << vm["decimate"].as<std::string>() << "' is invalid." << std::endl;
+        return false;
+    }
+    decimation.method = method_it - decimation_methods.begin();
+    return true;
+}
+
+// `cloud_viewer convert` : the frame pipeline over a whole sequence, written as pcd files without opening a window.
+int convert_main(int argc, char *argv[])
+{
+    namespace bops = boost::program_options;
+
+    bops::options_description description("convert options");
+    description.add_options()
+        ("help,h", "show help")
+        ("pcd_path,",
+        bops::value<std::string>(),
+        "path to pcd file, directory in which pcd files exist, or .seq file")
+        ("annotation_path,",
+        bops::value<std::string>()->default_value(""),
+        "path to directory in which annotation files exist")
+        ("output,",
+        bops::value<std::string>(),
+        "directory the converted frames (<stem>.pcd) and their annotations (<stem>.json, boxes in the lidar frame) are written to")
+        ("format,",
+        bops::value<std::string>()->default_value("binary"),
+        "DATA of the written pcd files : 'binary' or 'binary_compressed'")
+        ("threads,",
+        bops::value<int>()->default_value(0),
+        "worker threads, 0 : one per core")
+        ("memory_mb,",
+        bops::value<int>()->default_value(512),
+        "memory budget in MB of the converted frames waiting to be written, workers wait beyond")
+        ("color_range,",
+        bops::value<std::string>()->default_value("frame"),
+        "colour range : 'frame' (min/max of each frame), 'global' (min/max over the whole sequence) or 'MIN:MAX'")
+        ("no_annotations,",
+        "don't write the annotation files")
+        ("profile,",
+        bops::value<std::string>(),
+        "time every stage, and write p50/p95/max per stage to this file on exit (.csv, else JSON)");
+    description.add(pipeline_options("point budget of the frames written, denser frames are decimated, 0 disables"));
+
+    bops::variables_map vm;
+    try
+    {
+        bops::store(bops::parse_command_line(argc, argv, description), vm);
+        bops::notify(vm);
+    }
+    catch (const bops::error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (vm.count("help") || !vm.count("pcd_path") || !vm.count("output"))
+    {
+        std::cout << "usage:\n"
+                  << "cloud_viewer convert --pcd_path [path/to/pcd_directory] --annotation_path [path/to/json_directory] --output [path/to/output_directory]" << std::endl;
+        std::cout << description << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    ConvertOptions options;
+    options.output_dir = vm["output"].as<std::string>();
+    if (!parse_pcd_data_format(vm["format"].as<std::string>(), options.format))
+    {
+        std::cerr << "An argument 'format : " << vm["format"].as<std::string>() << "' is invalid." << std::endl;
+        return 1;
+    }
+    options.threads = vm["threads"].as<int>();
+    if (options.threads < 0 || vm["memory_mb"].as<int>() <= 0)
+    {
+        std::cerr << "An argument 'threads : " << options.threads << "' or 'memory_mb : " << vm["memory_mb"].as<int>()
+                  << "' is out of range." << std::endl;
+        return 1;
+    }
+    options.max_pending_bytes = size_t(vm["memory_mb"].as<int>()) << 20;
+    options.write_annotations = vm.count("no_annotations") == 0;
+    FramePipelineConfig &pipeline = options.pipeline;
+    if (!parse_color_options(vm, pipeline.color) || !parse_filter_options(vm, pipeline.filter)
+        || !parse_decimation_options(vm, pipeline.decimation))
+    {
+        return 1;
+    }
+    std::string color_range = vm["color_range"].as<std::string>();
+    if (color_range != "frame" && color_range != "global")
+    {
+        if (!parse_min_max(color_range, pipeline.color.range_min, pipeline.color.range_max))
+        {
+            std::cerr << "An argument 'color_range : " << color_range << "' is invalid." << std::endl;
+            return 1;
+        }
+        pipeline.color.fixed_range = true;
+    }
+    stage_profiler().set_enabled(vm.count("profile") > 0);
+
+    try
+    {
+        FrameSourcePtr source = open_frame_source(vm["pcd_path"].as<std::string>(), vm["annotation_path"].as<std::string>());
+        if (color_range == "global")
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (compute_sequence_color_range(*source, pipeline.color, pipeline.color.range_min, pipeline.color.range_max,
+                                             &pipeline.filter))
+            {
+                pipeline.color.fixed_range = true;
+                std::cout << "global colour range [" << pipeline.color.range_min << ", " << pipeline.color.range_max
+                          << "] computed over " << source->size() << " frames in "
+                          << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+            }
+        }
+        std::cout << "converting " << source->size() << " frames to " << options.output_dir << " ("
+                  << pcd_data_format_name(options.format) << ")." << std::endl;
+        ConvertStats stats = convert_frames(*source, options, &std::cout);
+        stats.print(std::cout);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("profile"))
+    {
+        std::string profile_path = vm["profile"].as<std::string>();
+        if (stage_profiler().write(profile_path))
+        {
+            std::cout << "stage timings written to " << profile_path << std::endl;
+        }
+        else
+        {
+            std::cerr << "Error : cannot write stage timings to " << profile_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+} // namespace
 
 
 int main(int argc, char *argv[])
@@ -11,12 +294,20 @@ int main(int argc, char *argv[])
     namespace bops = boost::program_options;
     namespace bfs = boost::filesystem;
 
+    if (argc > 1 && std::string(argv[1]) == "convert")
+    {
+        return convert_main(argc - 1, argv + 1);
+    }
+
     bops::options_description description("options");
     description.add_options()
         ("help,h", "show help")
         ("pcd_path,",
         bops::value<std::string>(),
         "path to pcd file or directory in which pcd files exist")
+        ("live,",
+        bops::value<std::string>(),
+        "show the frames a live producer publishes to this shared memory ring (e.g. tools/live_replay), newest first, instead of --pcd_path")
         ("annotation_path,",
         bops::value<std::string>(),
         "path to directory in which annotation files exist")
@@ -25,7 +316,67 @@ int main(int argc, char *argv[])
         "path to camera pose parameters of view point")
         ("cameraparam_save_path,",
         bops::value<std::string>(),
-        "where to save camera pose parameters of view point, default : [current_directory]/cameraparam.cam");
+        "where to save camera pose parameters of view point, default : [current_directory]/cameraparam.cam")
+        ("prefetch,",
+        bops::value<int>()->default_value(2),
+        "number of frames decoded in background ahead of/behind the shown one, 0 disables prefetching")
+        ("prefetch_threads,",
+        bops::value<int>()->default_value(2),
+        "number of worker threads used for prefetching")
+        ("cache_mb,",
+        bops::value<int>()->default_value(512),
+        "memory budget in MB of the decoded frame cache, 0 disables caching")
+        ("cache_codec,",
+        bops::value<std::string>()->default_value("none"),
+        "keep cached frames compressed : 'none', 'float' (lossless xyz) or 'quant16' (16 bit xyz in the frame bounds)")
+        ("color_range,",
+        bops::value<std::string>()->default_value("frame"),
+        "colour range : 'frame' (min/max of each frame), 'global' (min/max over the whole sequence), 'robust' (1st - 99th percentile of the sequence, once summarised) or 'MIN:MAX'")
+        ("refine_ms,",
+        bops::value<int>()->default_value(500),
+        "show the full-resolution cloud of a decimated frame after this many ms without stepping, -1 never")
+        ("play,",
+        "start playing the sequence on startup (space toggles play/pause)")
+        ("fps,",
+        bops::value<double>()->default_value(10.0),
+        "target rate of playback in frames per second, frames that can't be decoded in time are skipped")
+        ("accumulate,",
+        bops::value<int>()->default_value(1),
+        "overlay the shown frame and the K - 1 frames before it, older ones faded, 1 disables")
+        ("accumulate_points,",
+        bops::value<int>()->default_value(2000000),
+        "cap on the points of the overlay of --accumulate, frames are thinned evenly to fit, 0 : no cap")
+        ("accumulate_pose,",
+        "transform the frames of --accumulate into the lidar frame of the shown one with the Lidar poses of their annotation files")
+        ("diff,",
+        bops::value<float>(),
+        "colour every point by its distance in metres to the nearest point of the previous frame, searched up to this distance (d toggles)")
+        ("diff_threshold,",
+        bops::value<float>()->default_value(0.0f),
+        "split the points of --diff into static (grey) and dynamic (red) at this distance in metres instead, 0 : colour by distance")
+        ("diff_pose,",
+        "compare with the previous frame through the Lidar poses of their annotation files, so that ego-motion isn't shown as change")
+        ("find,",
+        bops::value<std::string>(),
+        "frames v / V jump to, from the frame summaries : e.g. 'boxes>=20', 'car>5,zmax<10', 'max:points' (see README)")
+        ("summary_threads,",
+        bops::value<int>()->default_value(0),
+        "worker threads of the background summary pass, 0 : one less than the cores")
+        ("no_summary,",
+        "don't summarise the frames in background (no sidecar, no --find)")
+        ("no_bbox_labels,",
+        "don't draw the ids of the bboxes (one 3D text actor per bbox)")
+        ("profile,",
+        bops::value<std::string>(),
+        "time every stage of loading and stepping, and write p50/p95/max per stage to this file on exit (.csv, else JSON)")
+        ("export,",
+        bops::value<std::string>(),
+        "render every frame offscreen with the camera pose of --cameraparam_path and write the images to this directory, then exit")
+        ("export_format,",
+        bops::value<std::string>()->default_value("png"),
+        "format of --export : 'png' (numbered frame_XXXXXX.png) or 'raw' (single rgb24 stream frames.rgb)");
+    description.add(pipeline_options(
+        "point budget of the frames shown while stepping, denser frames are decimated and refined once stepping stops, 0 disables"));
 
     bops::variables_map vm;
     try
@@ -57,7 +408,7 @@ int main(int argc, char *argv[])
             return 1;
         }
     }
-    else
+    else if (!vm.count("live"))
     {
         std::cout << "usage:\n"
                   << argv[0] << "--pcd_path [path/to/pcd_file]" << std::endl;
@@ -107,8 +458,148 @@ int main(int argc, char *argv[])
         cameraparam_save_path = "camerapose.cam";
     }
 
-    SequenceViewer viewer(pcd_path, annot_path, cameraparam_path, cameraparam_save_path);
+    ViewerOptions options;
+    options.prefetch_window = vm["prefetch"].as<int>();
+    options.prefetch_threads = vm["prefetch_threads"].as<int>();
+    options.cache_mb = vm["cache_mb"].as<int>();
+    if (!parse_point_codec(vm["cache_codec"].as<std::string>(), options.cache_codec))
+    {
+        std::cerr << "An argument 'cache_codec : " << vm["cache_codec"].as<std::string>() << "' is invalid." << std::endl;
+        return 1;
+    }
+    options.offscreen = vm.count("export") > 0;
+    options.bbox_labels = vm.count("no_bbox_labels") == 0;
+    options.autoplay = vm.count("play") > 0;
+    options.play_fps = vm["fps"].as<double>();
+    options.accumulation.frames = vm["accumulate"].as<int>();
+    options.accumulation.use_pose = vm.count("accumulate_pose") > 0;
+    if (options.accumulation.frames < 1 || vm["accumulate_points"].as<int>() < 0)
+    {
+        std::cerr << "An argument 'accumulate : " << options.accumulation.frames << "' or 'accumulate_points : "
+                  << vm["accumulate_points"].as<int>() << "' is out of range." << std::endl;
+        return 1;
+    }
+    options.accumulation.max_points = vm["accumulate_points"].as<int>();
+    if (vm.count("diff"))
+    {
+        options.diff.enabled = true;
+        options.diff.max_distance = vm["diff"].as<float>();
+    }
+    options.diff.threshold = vm["diff_threshold"].as<float>();
+    options.diff.use_pose = vm.count("diff_pose") > 0;
+    // Neighbours are only searched up to max_distance : a threshold there or beyond can't split anything.
+    if (!(options.diff.max_distance > 0.0f) || options.diff.threshold < 0.0f
+        || options.diff.threshold >= options.diff.max_distance)
+    {
+        std::cerr << "An argument 'diff : " << options.diff.max_distance << "' or 'diff_threshold : " << options.diff.threshold
+                  << "' is out of range." << std::endl;
+        return 1;
+    }
+    if (options.diff.enabled && accumulation_enabled(options.accumulation))
+    {
+        std::cerr << "An argument 'diff' can't be combined with 'accumulate'." << std::endl;
+        return 1;
+    }
+    if (vm.count("live"))
+    {
+        options.live = vm["live"].as<std::string>();
+        if (options.live.empty())
+        {
+            std::cerr << "An argument 'live : " << options.live << "' is invalid." << std::endl;
+            return 1;
+        }
+        // Live frames arrive one at a time : nothing to compare with or accumulate, nothing to export.
+        if (options.diff.enabled || accumulation_enabled(options.accumulation) || options.offscreen)
+        {
+            std::cerr << "An argument 'live' can't be combined with 'diff', 'accumulate' or 'export'." << std::endl;
+            return 1;
+        }
+    }
+    options.summary = vm.count("no_summary") == 0;
+    options.summary_threads = vm["summary_threads"].as<int>();
+    if (options.summary_threads < 0)
+    {
+        std::cerr << "An argument 'summary_threads : " << options.summary_threads << "' is out of range." << std::endl;
+        return 1;
+    }
+    if (vm.count("find"))
+    {
+        options.find = vm["find"].as<std::string>();
+        try
+        {
+            SummaryQuery query(options.find);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << "An argument 'find : " << options.find << "' is invalid (" << e.what() << ")." << std::endl;
+            return 1;
+        }
+    }
+    if (options.play_fps <= 0)
+    {
+        std::cerr << "An argument 'fps : " << options.play_fps << "' is out of range." << std::endl;
+        return 1;
+    }
+
+    if (!parse_color_options(vm, options.color) || !parse_filter_options(vm, options.filter)
+        || !parse_decimation_options(vm, options.decimation))
+    {
+        return 1;
+    }
+    options.refine_delay_ms = vm["refine_ms"].as<int>();
+
+    std::string color_range = vm["color_range"].as<std::string>();
+    if (color_range == "global")
+    {
+        options.global_color_range = true;
+    }
+    else if (color_range == "robust")
+    {
+        options.robust_color_range = true;
+    }
+    else if (color_range != "frame")
+    {
+        float range_min, range_max;
+        if (!parse_min_max(color_range, range_min, range_max))
+        {
+            std::cerr << "An argument 'color_range : " << color_range << "' is invalid." << std::endl;
+            return 1;
+        }
+        options.color.fixed_range = true;
+        options.color.range_min = range_min;
+        options.color.range_max = range_max;
+    }
+    // The percentiles come from the summary pass, which only runs on the frames of an interactive, non-live session.
+    if (options.robust_color_range && (!options.summary || options.offscreen || !options.live.empty()))
+    {
+        std::cerr << "An argument 'color_range : robust' can't be combined with 'no_summary', 'export' or 'live'." << std::endl;
+        return 1;
+    }
+
+    stage_profiler().set_enabled(vm.count("profile") > 0);
+
+    SequenceViewer viewer(pcd_path, annot_path, cameraparam_path, cameraparam_save_path, options);
     int res;
-    res = viewer.run();
+    if (options.offscreen)
+    {
+        res = viewer.export_frames(vm["export"].as<std::string>(), vm["export_format"].as<std::string>());
+    }
+    else
+    {
+        res = viewer.run();
+    }
+
+    if (vm.count("profile"))
+    {
+        std::string profile_path = vm["profile"].as<std::string>();
+        if (stage_profiler().write(profile_path))
+        {
+            std::cout << "stage timings written to " << profile_path << std::endl;
+        }
+        else
+        {
+            std::cerr << "Error : cannot write stage timings to " << profile_path << std::endl;
+        }
+    }
     return res;
 }
\ No newline at end of file
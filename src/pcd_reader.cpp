@@ -0,0 +1,293 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "pcd_reader.h"
+
+
+namespace
+{
+
+// Points are copied by chunks of this size on parallel threads.
+const size_t kReadChunkPoints = 1 << 16;
+
+struct PcdField
+{
+    std::string name;
+    int size = 4;
+    char type = 'F';
+    int count = 1;
+    size_t offset = 0;
+};
+
+struct PcdHeader
+{
+    std::vector<PcdField> fields;
+    size_t width = 0;
+    size_t height = 1;
+    size_t points = 0;
+    size_t point_step = 0;
+    std::string data;
+    size_t data_offset = 0;  // first byte after the DATA line
+    float viewpoint[7] = {0, 0, 0, 1, 0, 0, 0};
+
+    const PcdField *find(const std::string &name) const
+    {
+        for (const PcdField &field : this->fields)
+        {
+            if (field.name == name)
+            {
+                return &field;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Parses the header lines up to and including DATA. SIZE / TYPE / COUNT default as in PCL when missing.
+bool parse_header(const MappedFile &file, PcdHeader &header)
+{
+    const char *begin = reinterpret_cast<const char *>(file.data());
+    const char *end = begin + file.size();
+    const char *line = begin;
+    while (line < end)
+    {
+        const char *eol = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (eol == nullptr)
+        {
+            return false;
+        }
+        std::istringstream is(std::string(line, eol));
+        line = eol + 1;
+
+        std::string key;
+        if (!(is >> key) || key[0] == '#')
+        {
+            continue;
+        }
+        if (key == "FIELDS" || key == "COLUMNS")
+        {
+            std::string name;
+            while (is >> name)
+            {
+                header.fields.push_back(PcdField());
+                header.fields.back().name = name;
+            }
+        }
+        else if (key == "SIZE" || key == "TYPE" || key == "COUNT")
+        {
+            for (PcdField &field : header.fields)
+            {
+                bool ok = (key == "SIZE") ? bool(is >> field.size) : (key == "TYPE") ? bool(is >> field.type) : bool(is >> field.count);
+                if (!ok)
+                {
+                    return false;
+                }
+            }
+        }
+        else if (key == "WIDTH")
+        {
+            is >> header.width;
+        }
+        else if (key == "HEIGHT")
+        {
+            is >> header.height;
+        }
+        else if (key == "POINTS")
+        {
+            is >> header.points;
+        }
+        else if (key == "VIEWPOINT")
+        {
+            for (float &v : header.viewpoint)
+            {
+                is >> v;
+            }
+        }
+        else if (key == "DATA")
+        {
+            is >> header.data;
+            header.data_offset = line - begin;
+            break;
+        }
+    }
+    if (header.data.empty() || header.fields.empty())
+    {
+        return false;
+    }
+
+    for (PcdField &field : header.fields)
+    {
+        if (field.size <= 0 || field.count <= 0)
+        {
+            return false;
+        }
+        field.offset = header.point_step;
+        header.point_step += size_t(field.size) * field.count;
+    }
+    // Untrusted sizes : WIDTH * HEIGHT must not wrap.
+    if (header.width != 0 && header.height > std::numeric_limits<size_t>::max() / header.width)
+    {
+        return false;
+    }
+    if (header.points == 0)
+    {
+        header.points = header.width * header.height;
+    }
+    return header.points == header.width * header.height;
+}
+
+bool is_float32(const PcdField *field)
+{
+    return field != nullptr && field->type == 'F' && field->size == 4 && field->count == 1;
+}
+
+template <typename T>
+void read_values(const uint8_t *data, size_t point_step, size_t offset, size_t begin, size_t end, float *values)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        T value;
+        std::memcpy(&value, data + i * point_step + offset, sizeof(T));
+        values[i] = static_cast<float>(value);
+    }
+}
+
+// Same intensity types as the PCL path of load_frame_cloud, other types are ignored.
+typedef void (*ReadValuesFn)(const uint8_t *, size_t, size_t, size_t, size_t, float *);
+
+ReadValuesFn intensity_reader(const PcdField *field)
+{
+    if (field == nullptr || field->count != 1)
+    {
+        return nullptr;
+    }
+    if (field->type == 'F')
+    {
+        return field->size == 4 ? read_values<float> : (field->size == 8 ? read_values<double> : nullptr);
+    }
+    if (field->type == 'U')
+    {
+        switch (field->size)
+        {
+        case 1:
+            return read_values<uint8_t>;
+        case 2:
+            return read_values<uint16_t>;
+        case 4:
+            return read_values<uint32_t>;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool read_pcd_mmap(const std::string &pcd_file, PointCloudT &cloud, std::vector<float> &intensity)
+{
+    MappedFile file(pcd_file);
+    if (file.data() == nullptr)
+    {
+        return false;
+    }
+
+    PcdHeader header;
+    if (!parse_header(file, header) || header.data != "binary")
+    {
+        return false;
+    }
+    const PcdField *x = header.find("x");
+    const PcdField *y = header.find("y");
+    const PcdField *z = header.find("z");
+    if (!is_float32(x) || !is_float32(y) || !is_float32(z))
+    {
+        return false;
+    }
+    const PcdField *rgb = header.find("rgb");
+    if (rgb == nullptr)
+    {
+        rgb = header.find("rgba");
+    }
+    if (rgb != nullptr && (rgb->size != 4 || rgb->count != 1))
+    {
+        rgb = nullptr;
+    }
+    const PcdField *intensity_field = header.find("intensity");
+    ReadValuesFn read_intensity = intensity_reader(intensity_field);
+
+    size_t n = header.points;
+    size_t step = header.point_step;
+    // The point count comes from the file : compared by division, so that a huge one can't wrap past the check.
+    if (step == 0 || header.data_offset > file.size() || n > (file.size() - header.data_offset) / step
+        || header.width * header.height != n)
+    {
+        return false;
+    }
+    const uint8_t *data = file.data() + header.data_offset;
+
+    cloud.resize(n);
+    cloud.width = header.width;
+    cloud.height = header.height;
+    cloud.sensor_origin_ = Eigen::Vector4f(header.viewpoint[0], header.viewpoint[1], header.viewpoint[2], 0.0f);
+    cloud.sensor_orientation_ = Eigen::Quaternionf(header.viewpoint[3], header.viewpoint[4], header.viewpoint[5], header.viewpoint[6]);
+    if (read_intensity != nullptr)
+    {
+        intensity.resize(n);
+    }
+    else
+    {
+        intensity.clear();
+    }
+
+    // x, y, z written by PCL are contiguous : a single 12-byte copy per point.
+    bool xyz_packed = (y->offset == x->offset + 4 && z->offset == x->offset + 8);
+    // Points without a colour field keep the default colour, as with PCL.
+    const uint32_t default_rgba = PointT().rgba;
+    PointT *points = cloud.points.data();
+    std::vector<char> chunk_dense(parallel_num_chunks(n, kReadChunkPoints), 1);
+    parallel_for(n, kReadChunkPoints, [&](size_t begin, size_t end, size_t c) {
+        bool dense = true;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint8_t *src = data + i * step;
+            PointT &p = points[i];
+            if (xyz_packed)
+            {
+                std::memcpy(p.data, src + x->offset, 3 * sizeof(float));
+            }
+            else
+            {
+                std::memcpy(&p.x, src + x->offset, sizeof(float));
+                std::memcpy(&p.y, src + y->offset, sizeof(float));
+                std::memcpy(&p.z, src + z->offset, sizeof(float));
+            }
+            p.data[3] = 1.0f;
+            if (rgb != nullptr)
+            {
+                std::memcpy(&p.rgba, src + rgb->offset, sizeof(uint32_t));
+            }
+            else
+            {
+                p.rgba = default_rgba;
+            }
+            dense = dense && std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+        }
+        chunk_dense[c] = dense;
+        if (read_intensity != nullptr)
+        {
+            read_intensity(data, step, intensity_field->offset, begin, end, intensity.data());
+        }
+    });
+
+    cloud.is_dense = true;
+    for (char dense : chunk_dense)
+    {
+        cloud.is_dense = cloud.is_dense && dense;
+    }
+    return true;
+}
+
@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <pcl/compression/lzf.h>
+
+#include "parallel.h"
+#include "pcd_writer.h"
+
+
+namespace
+{
+
+// Points are copied by chunks of this size on parallel threads.
+const size_t kWriteChunkPoints = 1 << 16;
+
+const char *kFormatNames[PCD_DATA_FORMAT_COUNT] = {"binary", "binary_compressed"};
+
+// Header up to and including the DATA line, with the fields written by encode_pcd.
+std::string pcd_header(const PointCloudT &cloud, bool has_intensity, PcdDataFormat format)
+{
+    size_t n = cloud.size();
+    bool organized = cloud.height > 1 && size_t(cloud.width) * cloud.height == n;
+    const Eigen::Vector4f &origin = cloud.sensor_origin_;
+    const Eigen::Quaternionf &orientation = cloud.sensor_orientation_;
+
+    std::ostringstream os;
+    os << "# .PCD v0.7 - Point Cloud Data file format\n"
+       << "VERSION 0.7\n"
+       << (has_intensity ? "FIELDS x y z rgb intensity\nSIZE 4 4 4 4 4\nTYPE F F F F F\nCOUNT 1 1 1 1 1\n"
+                         : "FIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F F\nCOUNT 1 1 1 1\n")
+       << "WIDTH " << (organized ? size_t(cloud.width) : n) << "\n"
+       << "HEIGHT " << (organized ? size_t(cloud.height) : 1) << "\n"
+       << "VIEWPOINT " << origin[0] << " " << origin[1] << " " << origin[2] << " " << orientation.w() << " "
+       << orientation.x() << " " << orientation.y() << " " << orientation.z() << "\n"
+       << "POINTS " << n << "\n"
+       << "DATA " << kFormatNames[format] << "\n";
+    return os.str();
+}
+
+} // namespace
+
+
+const char *pcd_data_format_name(int format)
+{
+    return (format >= 0 && format < PCD_DATA_FORMAT_COUNT) ? kFormatNames[format] : "unknown";
+}
+
+bool parse_pcd_data_format(const std::string &name, PcdDataFormat &format)
+{
+    for (int f = 0; f < PCD_DATA_FORMAT_COUNT; ++f)
+    {
+        if (name == kFormatNames[f])
+        {
+            format = static_cast<PcdDataFormat>(f);
+            return true;
+        }
+    }
+    return false;
+}
+
+void encode_pcd(const PointCloudT &cloud, const std::vector<float> &intensity, PcdDataFormat format, std::string &data)
+{
+    size_t n = cloud.size();
+    bool has_intensity = !intensity.empty() && intensity.size() == n;
+    size_t num_fields = has_intensity ? 5 : 4;
+    std::string header = pcd_header(cloud, has_intensity, format);
+    data.assign(header.data(), header.size());
+    size_t header_bytes = header.size();
+    const PointT *points = cloud.points.data();
+
+    if (format == PCD_DATA_BINARY)
+    {
+        size_t step = num_fields * sizeof(float);
+        data.resize(header_bytes + n * step);
+        char *out = &data[header_bytes];
+        parallel_for(n, kWriteChunkPoints, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                char *dst = out + i * step;
+                std::memcpy(dst, points[i].data, 3 * sizeof(float));
+                std::memcpy(dst + 12, &points[i].rgba, sizeof(uint32_t));
+                if (has_intensity)
+                {
+                    std::memcpy(dst + 16, &intensity[i], sizeof(float));
+                }
+            }
+        });
+        return;
+    }
+
+    // binary_compressed : all the x, then all the y... compressed as one block, behind its compressed and
+    // uncompressed sizes.
+    thread_local std::vector<char> fields;
+    size_t field_bytes = n * sizeof(float);
+    size_t raw_bytes = num_fields * field_bytes;
+    fields.resize(raw_bytes);
+    char *x = fields.data(), *y = x + field_bytes, *z = y + field_bytes, *rgb = z + field_bytes, *values = rgb + field_bytes;
+    parallel_for(n, kWriteChunkPoints, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            std::memcpy(x + i * sizeof(float), &points[i].x, sizeof(float));
+            std::memcpy(y + i * sizeof(float), &points[i].y, sizeof(float));
+            std::memcpy(z + i * sizeof(float), &points[i].z, sizeof(float));
+            std::memcpy(rgb + i * sizeof(float), &points[i].rgba, sizeof(uint32_t));
+        }
+    });
+    if (has_intensity)
+    {
+        std::memcpy(values, intensity.data(), field_bytes);
+    }
+
+    // LZF grows incompressible data by at most one byte in 32.
+    size_t bound = raw_bytes + raw_bytes / 16 + 64;
+    data.resize(header_bytes + 2 * sizeof(uint32_t) + bound);
+    char *out = &data[header_bytes];
+    uint32_t compressed_bytes = raw_bytes > 0
+        ? pcl::lzfCompress(fields.data(), uint32_t(raw_bytes), out + 2 * sizeof(uint32_t), uint32_t(bound))
+        : 0;
+    uint32_t uncompressed_bytes = uint32_t(raw_bytes);
+    std::memcpy(out, &compressed_bytes, sizeof(uint32_t));
+    std::memcpy(out + sizeof(uint32_t), &uncompressed_bytes, sizeof(uint32_t));
+    data.resize(header_bytes + 2 * sizeof(uint32_t) + compressed_bytes);
+}
+
+bool write_pcd(const std::string &pcd_file, const PointCloudT &cloud, const std::vector<float> &intensity,
+               PcdDataFormat format)
+{
+    thread_local std::string data;
+    encode_pcd(cloud, intensity, format, data);
+    std::ofstream os(pcd_file, std::ios::binary);
+    os.write(data.data(), data.size());
+    return bool(os);
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+
+#include "playback.h"
+
+
+PlaybackScheduler::PlaybackScheduler(FrameProvider &provider, double fps)
+  : provider(provider),
+    target_fps(std::max(fps, 0.1))
+{
+}
+
+void PlaybackScheduler::set_fps(double fps, Clock::time_point now)
+{
+    this->target_fps = std::max(fps, 0.1);
+    this->start_position = this->last_position;
+    this->start_time = now;
+}
+
+void PlaybackScheduler::play(int index, Clock::time_point now)
+{
+    this->is_playing = true;
+    this->play_time = now;
+    this->n_shown = 0;
+    this->n_dropped = 0;
+    this->n_stalls = 0;
+    this->lateness_ms = DurationHistogram();
+    this->seek(index, now);
+}
+
+void PlaybackScheduler::pause()
+{
+    this->is_playing = false;
+}
+
+void PlaybackScheduler::seek(int index, Clock::time_point now)
+{
+    this->start_position = this->last_position = index;
+    this->stalled_position = -1;
+    this->start_time = now;
+}
+
+PlaybackScheduler::Clock::time_point PlaybackScheduler::due(long position) const
+{
+    std::chrono::duration<double> offset((position - this->start_position) / this->target_fps);
+    return this->start_time + std::chrono::duration_cast<Clock::duration>(offset);
+}
+
+PlaybackScheduler::Clock::time_point PlaybackScheduler::next_due() const
+{
+    return this->due(this->last_position + 1);
+}
+
+int PlaybackScheduler::frame_index(long position) const
+{
+    return int(position % this->provider.size());
+}
+
+FramePtr PlaybackScheduler::tick(Clock::time_point now, int &index)
+{
+    if (!this->is_playing || now < this->next_due())
+    {
+        return nullptr;
+    }
+    // Newest due frame.
+    double elapsed = std::chrono::duration<double>(now - this->start_time).count();
+    long target = std::max(this->start_position + long(std::floor(elapsed * this->target_fps)), this->last_position + 1);
+
+    FramePtr frame;
+    if (!this->provider.prefetching())
+    {
+        frame = this->provider.get(this->frame_index(target));
+        if (frame)
+        {
+            this->show(target, now);
+            index = this->frame_index(target);
+        }
+        return frame;
+    }
+
+    // Newest due frame already decoded, each frame of the sequence looked up once at most.
+    long oldest = std::max(this->last_position + 1, target - this->provider.size() + 1);
+    for (long position = target; position >= oldest; --position)
+    {
+        frame = this->provider.try_get(this->frame_index(position));
+        if (frame)
+        {
+            this->show(position, now);
+            index = this->frame_index(position);
+            return frame;
+        }
+    }
+
+    if (target != this->stalled_position)
+    {
+        ++this->n_stalls;
+        this->stalled_position = target;
+        if (target > this->last_position + 1)
+        {
+            // More than a frame behind : decode where playback is rather than the frames it has passed.
+            this->provider.recenter(this->frame_index(target));
+        }
+    }
+    return nullptr;
+}
+
+void PlaybackScheduler::show(long position, Clock::time_point now)
+{
+    this->n_dropped += position - this->last_position - 1;
+    ++this->n_shown;
+    this->lateness_ms.add(std::chrono::duration<double, std::milli>(now - this->due(position)).count());
+    this->last_position = position;
+}
+
+double PlaybackScheduler::achieved_fps(Clock::time_point now) const
+{
+    double elapsed = std::chrono::duration<double>(now - this->play_time).count();
+    return elapsed > 0 ? this->n_shown / elapsed : 0.0;
+}
+
+void PlaybackScheduler::print_stats(std::ostream &os, Clock::time_point now) const
+{
+    os << "playback : " << this->achieved_fps(now) << " fps achieved / " << this->target_fps << " fps target, "
+       << this->n_shown << " frames shown, " << this->n_dropped << " dropped, " << this->n_stalls
+       << " stalls, lateness p50 " << this->lateness_ms.percentile(0.5) << " ms, p95 "
+       << this->lateness_ms.percentile(0.95) << " ms" << std::endl;
+}
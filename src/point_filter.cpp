@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CLOUD_VIEWER_HAVE_AVX2_KERNELS 1
+#endif
+
+#include "parallel.h"
+#include "point_filter.h"
+#include "spatial_index.h"
+
+
+namespace
+{
+
+// Clouds smaller than this are filtered on the calling thread.
+const size_t kFilterChunkPoints = 1 << 16;
+
+const char *kStageNames[FILTER_STAGE_COUNT] = {"range", "height", "boxes"};
+
+// Range and height bounds of a config, squared ranges so that no square root is taken per point.
+struct CropBounds
+{
+    bool range;
+    float min_range2;
+    float max_range2;
+    bool height;
+    float min_z;
+    float max_z;
+};
+
+CropBounds crop_bounds(const FilterConfig &config)
+{
+    CropBounds bounds;
+    bounds.range = config.min_range > 0.0f || config.max_range > 0.0f;
+    bounds.min_range2 = config.min_range * config.min_range;
+    bounds.max_range2 = config.max_range > 0.0f ? config.max_range * config.max_range : std::numeric_limits<float>::infinity();
+    bounds.height = config.height_crop;
+    bounds.min_z = config.min_z;
+    bounds.max_z = config.max_z;
+    return bounds;
+}
+
+// First stage the point fails (non-finite points fail every active stage), FILTER_STAGE_COUNT when it passes.
+inline uint8_t crop_verdict(const PointT &p, const CropBounds &bounds)
+{
+    if (bounds.range)
+    {
+        float range2 = p.x * p.x + p.y * p.y + p.z * p.z;
+        if (!(range2 >= bounds.min_range2 && range2 <= bounds.max_range2))
+        {
+            return FILTER_RANGE;
+        }
+    }
+    if (bounds.height && !(p.z >= bounds.min_z && p.z <= bounds.max_z))
+    {
+        return FILTER_HEIGHT;
+    }
+    return FILTER_STAGE_COUNT;
+}
+
+// Verdicts of the points in [begin, end), added to `counts` (one entry per verdict).
+void crop_scalar(const PointT *points, size_t begin, size_t end, const CropBounds &bounds, uint8_t *verdict, size_t *counts)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        verdict[i] = crop_verdict(points[i], bounds);
+        ++counts[verdict[i]];
+    }
+}
+
+#ifdef CLOUD_VIEWER_HAVE_AVX2_KERNELS
+
+bool cpu_has_avx2()
+{
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+// Verdicts of 4 points packed in bytes, from the bit masks of the points passing the range (bits 0-3) and height
+// (bits 4-7) tests.
+struct VerdictLut
+{
+    uint32_t verdicts[256];
+
+    VerdictLut()
+    {
+        for (int masks = 0; masks < 256; ++masks)
+        {
+            uint8_t lanes[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                bool range_ok = (masks >> k) & 1, height_ok = (masks >> (4 + k)) & 1;
+                lanes[k] = !range_ok ? FILTER_RANGE : (!height_ok ? FILTER_HEIGHT : FILTER_STAGE_COUNT);
+            }
+            std::memcpy(&this->verdicts[masks], lanes, 4);
+        }
+    }
+};
+
+__attribute__((target("avx2")))
+void crop_avx2(const PointT *points, size_t begin, size_t end, const CropBounds &bounds, uint8_t *verdict, size_t *counts)
+{
+    static const VerdictLut lut;
+
+    const __m128 min_range2 = _mm_set1_ps(bounds.min_range2);
+    const __m128 max_range2 = _mm_set1_ps(bounds.max_range2);
+    const __m128 min_z = _mm_set1_ps(bounds.min_z);
+    const __m128 max_z = _mm_set1_ps(bounds.max_z);
+    // Inactive stages pass every point, NaN included.
+    const __m128 range_off = bounds.range ? _mm_setzero_ps() : _mm_castsi128_ps(_mm_set1_epi32(-1));
+    const __m128 height_off = bounds.height ? _mm_setzero_ps() : _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    size_t range_dropped = 0, height_dropped = 0, passed = 0;
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        // x, y, z of the 4 points : their (x, y, z, pad) quads transposed.
+        __m128 x = _mm_load_ps(points[i].data);
+        __m128 y = _mm_load_ps(points[i + 1].data);
+        __m128 z = _mm_load_ps(points[i + 2].data);
+        __m128 w = _mm_load_ps(points[i + 3].data);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 range2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        // Ordered comparisons : NaN fails both, as in crop_verdict.
+        __m128 range_ok = _mm_or_ps(_mm_and_ps(_mm_cmpge_ps(range2, min_range2), _mm_cmple_ps(range2, max_range2)), range_off);
+        __m128 height_ok = _mm_or_ps(_mm_and_ps(_mm_cmpge_ps(z, min_z), _mm_cmple_ps(z, max_z)), height_off);
+        int range_mask = _mm_movemask_ps(range_ok);
+        int height_mask = _mm_movemask_ps(height_ok);
+        std::memcpy(verdict + i, &lut.verdicts[range_mask | (height_mask << 4)], 4);
+        range_dropped += 4 - __builtin_popcount(range_mask);
+        height_dropped += __builtin_popcount(range_mask & ~height_mask);
+        passed += __builtin_popcount(range_mask & height_mask);
+    }
+    counts[FILTER_RANGE] += range_dropped;
+    counts[FILTER_HEIGHT] += height_dropped;
+    counts[FILTER_STAGE_COUNT] += passed;
+    crop_scalar(points, i, end, bounds, verdict, counts);
+}
+
+#endif
+
+void crop_range(const PointT *points, size_t begin, size_t end, const CropBounds &bounds, uint8_t *verdict, size_t *counts)
+{
+#ifdef CLOUD_VIEWER_HAVE_AVX2_KERNELS
+    if (cpu_has_avx2())
+    {
+        crop_avx2(points, begin, end, bounds, verdict, counts);
+        return;
+    }
+#endif
+    crop_scalar(points, begin, end, bounds, verdict, counts);
+}
+
+// Cells of an xy grid overlapped by the axis-aligned bounds of the boxes : most points of a frame are far from
+// every box, and are rejected by one lookup before the BVH is walked.
+class BoxCoverage
+{
+public:
+    explicit BoxCoverage(const BoxBVH &bvh)
+    {
+        const int kMaxCells = 1024;
+        if (bvh.size() == 0)
+        {
+            return;
+        }
+        Eigen::Vector3f box_min, box_max;
+        bvh.bounds(0, this->min, this->max);
+        for (size_t b = 1; b < bvh.size(); ++b)
+        {
+            bvh.bounds(int(b), box_min, box_max);
+            this->min = this->min.cwiseMin(box_min);
+            this->max = this->max.cwiseMax(box_max);
+        }
+        Eigen::Vector2f extent = (this->max - this->min).head<2>();
+        this->inv_cell = 1.0f / std::max({extent.x() / kMaxCells, extent.y() / kMaxCells, 0.05f});
+        this->nx = std::min(int(extent.x() * this->inv_cell) + 1, kMaxCells + 1);
+        this->ny = std::min(int(extent.y() * this->inv_cell) + 1, kMaxCells + 1);
+        this->covered.assign(size_t(this->nx) * this->ny, 0);
+        for (size_t b = 0; b < bvh.size(); ++b)
+        {
+            bvh.bounds(int(b), box_min, box_max);
+            int x0 = this->cell_x(box_min.x()), x1 = this->cell_x(box_max.x());
+            int y0 = this->cell_y(box_min.y()), y1 = this->cell_y(box_max.y());
+            for (int y = y0; y <= y1; ++y)
+            {
+                std::fill(this->covered.begin() + size_t(y) * this->nx + x0, this->covered.begin() + size_t(y) * this->nx + x1 + 1, 1);
+            }
+        }
+    }
+
+    // false when no box can contain `p` (NaN included).
+    bool maybe_inside(const Eigen::Vector3f &p) const
+    {
+        if (!((p.array() >= this->min.array()).all() && (p.array() <= this->max.array()).all()))
+        {
+            return false;
+        }
+        return this->covered[size_t(this->cell_y(p.y())) * this->nx + this->cell_x(p.x())] != 0;
+    }
+
+private:
+    // Same computation for the box bounds and the points, so that a point on a box edge falls in a covered cell.
+    int cell_x(float x) const { return std::min(int((x - this->min.x()) * this->inv_cell), this->nx - 1); }
+    int cell_y(float y) const { return std::min(int((y - this->min.y()) * this->inv_cell), this->ny - 1); }
+
+    Eigen::Vector3f min = Eigen::Vector3f::Zero();
+    Eigen::Vector3f max = -Eigen::Vector3f::Ones();  // empty : nothing is inside
+    float inv_cell = 1.0f;
+    int nx = 0;
+    int ny = 0;
+    std::vector<uint8_t> covered;
+};
+
+} // namespace
+
+
+const char *filter_stage_name(int stage)
+{
+    return (stage >= 0 && stage < FILTER_STAGE_COUNT) ? kStageNames[stage] : "unknown";
+}
+
+bool point_filter_enabled(const FilterConfig &config)
+{
+    return config.min_range > 0.0f || config.max_range > 0.0f || config.height_crop || config.crop_to_boxes;
+}
+
+bool label_filter_enabled(const FilterConfig &config)
+{
+    return !config.allow_labels.empty() || !config.deny_labels.empty();
+}
+
+bool bbox_label_allowed(const std::string &id, const FilterConfig &config)
+{
+    std::string label = bbox_label(id);
+    auto matches = [&label](const std::string &allowed) { return label == allowed; };
+    if (!config.allow_labels.empty() && std::none_of(config.allow_labels.begin(), config.allow_labels.end(), matches))
+    {
+        return false;
+    }
+    return std::none_of(config.deny_labels.begin(), config.deny_labels.end(), matches);
+}
+
+size_t filter_bboxes(std::vector<BBox3D> &bboxes, const FilterConfig &config)
+{
+    if (!label_filter_enabled(config))
+    {
+        return 0;
+    }
+    size_t n = bboxes.size();
+    bboxes.erase(std::remove_if(bboxes.begin(), bboxes.end(),
+                                [&config](const BBox3D &bbox) { return !bbox_label_allowed(bbox.id, config); }),
+                 bboxes.end());
+    return n - bboxes.size();
+}
+
+size_t FilterStats::kept() const
+{
+    size_t dropped_total = 0;
+    for (int s = 0; s < FILTER_STAGE_COUNT; ++s)
+    {
+        dropped_total += this->dropped[s];
+    }
+    return this->input - dropped_total;
+}
+
+FilterStats filter_cloud(const PointCloudT &input, const std::vector<float> &intensity, const std::vector<BBox3D> &bboxes,
+                         const FilterConfig &config, PointCloudT &output, std::vector<float> &output_intensity)
+{
+    size_t n = input.size();
+    bool has_intensity = !intensity.empty() && intensity.size() == n;
+    CropBounds bounds = crop_bounds(config);
+
+    std::unique_ptr<BoxBVH> bvh;
+    std::unique_ptr<BoxCoverage> coverage;
+    if (config.crop_to_boxes)
+    {
+        std::vector<BBox3D> padded = bboxes;
+        for (BBox3D &bbox : padded)
+        {
+            bbox.width += 2.0 * config.box_padding;
+            bbox.depth += 2.0 * config.box_padding;
+            bbox.height += 2.0 * config.box_padding;
+        }
+        bvh.reset(new BoxBVH(padded));
+        coverage.reset(new BoxCoverage(*bvh));
+    }
+
+    // Pass 1 : verdict of every point and kept / dropped counts per chunk.
+    size_t num_chunks = parallel_num_chunks(n, kFilterChunkPoints);
+    std::vector<uint8_t> verdict(n);
+    std::vector<size_t> chunk_counts(num_chunks * (FILTER_STAGE_COUNT + 1), 0);
+    parallel_for(n, kFilterChunkPoints, [&](size_t begin, size_t end, size_t chunk) {
+        size_t *counts = chunk_counts.data() + chunk * (FILTER_STAGE_COUNT + 1);
+        crop_range(input.points.data(), begin, end, bounds, verdict.data(), counts);
+        if (!bvh)
+        {
+            return;
+        }
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (verdict[i] != FILTER_STAGE_COUNT)
+            {
+                continue;
+            }
+            Eigen::Vector3f p = input.points[i].getVector3fMap();
+            if (!coverage->maybe_inside(p) || !bvh->any_contains(p))
+            {
+                verdict[i] = FILTER_BOXES;
+                --counts[FILTER_STAGE_COUNT];
+                ++counts[FILTER_BOXES];
+            }
+        }
+    });
+
+    FilterStats stats;
+    stats.input = n;
+    std::vector<size_t> chunk_offset(num_chunks, 0);
+    size_t kept = 0;
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        const size_t *counts = chunk_counts.data() + c * (FILTER_STAGE_COUNT + 1);
+        for (int s = 0; s < FILTER_STAGE_COUNT; ++s)
+        {
+            stats.dropped[s] += counts[s];
+        }
+        chunk_offset[c] = kept;
+        kept += counts[FILTER_STAGE_COUNT];
+    }
+
+    // Pass 2 : every chunk copies its kept points from its offset, same chunks as pass 1.
+    output.resize(kept);
+    output.width = uint32_t(kept);
+    output.height = 1;
+    output.is_dense = input.is_dense;
+    if (has_intensity)
+    {
+        output_intensity.resize(kept);
+    }
+    else
+    {
+        output_intensity.clear();
+    }
+    parallel_for(n, kFilterChunkPoints, [&](size_t begin, size_t end, size_t chunk) {
+        // Every point up to the last kept one of the chunk is written at the next output slot, which only advances
+        // for kept points : no branch to mispredict, and the slots written stay within the chunk's own range.
+        size_t last = end;
+        while (last > begin && verdict[last - 1] != FILTER_STAGE_COUNT)
+        {
+            --last;
+        }
+        size_t j = chunk_offset[chunk];
+        for (size_t i = begin; i < last; ++i)
+        {
+            output.points[j] = input.points[i];
+            j += verdict[i] == FILTER_STAGE_COUNT;
+        }
+        if (has_intensity)
+        {
+            j = chunk_offset[chunk];
+            for (size_t i = begin; i < last; ++i)
+            {
+                output_intensity[j] = intensity[i];
+                j += verdict[i] == FILTER_STAGE_COUNT;
+            }
+        }
+    });
+    return stats;
+}
@@ -1,123 +1,391 @@
-#include "pointcloud_processing.h"
-
-
-void apply_color(PointCloudT::Ptr cloud)
-{
-    int filtering_axis_(2);
-    int color_mode_(4);
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
-    // Find the minimum and maximum values along the selected axis
-    double min, max;
-    // Set an initial value
-    switch (filtering_axis_)
-    {
-    case 0: // x
-        min = (*cloud)[0].x;
-        max = (*cloud)[0].x;
-        break;
-    case 1: // y
-        min = (*cloud)[0].y;
-        max = (*cloud)[0].y;
-        break;
-    default: // z
-        min = (*cloud)[0].z;
-        max = (*cloud)[0].z;
-        break;
-    }
-
-    // Search for the minimum/maximum
-    for (PointCloudT::iterator cloud_it = cloud->begin(); cloud_it != cloud->end(); ++cloud_it)
-    {
-        switch (filtering_axis_)
-        {
-        case 0: // x
-            if (min > cloud_it->x)
-                min = cloud_it->x;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CLOUD_VIEWER_HAVE_AVX2_KERNELS 1
+#endif
 
-            if (max < cloud_it->x)
-                max = cloud_it->x;
-            break;
-        case 1: // y
-            if (min > cloud_it->y)
-                min = cloud_it->y;
+#include "parallel.h"
+#include "pointcloud_processing.h"
 
-            if (max < cloud_it->y)
-                max = cloud_it->y;
-            break;
-        default: // z
-            if (min > cloud_it->z)
-                min = cloud_it->z;
 
-            if (max < cloud_it->z)
-                max = cloud_it->z;
-            break;
-        }
-    }
+namespace
+{
 
-    // Compute LUT scaling to fit the full histogram spectrum
-    double lut_scale = 255.0 / (max - min); // max is 255, min is 0
+// Clouds smaller than this are coloured on the calling thread.
+const size_t kColorChunkPoints = 1 << 17;
 
-    if (min == max)      // In case the cloud is flat on the chosen direction (x,y or z)
-        lut_scale = 1.0; // Avoid rounding error in boost
+// rgb packed as in PointXYZRGB::rgba (alpha excluded) for each of the 256 colormap levels.
+struct ColorLut
+{
+    uint32_t rgb[256];
+};
 
-    for (PointCloudT::iterator cloud_it = cloud->begin(); cloud_it != cloud->end(); ++cloud_it)
+ColorLut build_color_lut(int color_mode)
+{
+    ColorLut lut;
+    for (int value = 0; value < 256; ++value)
     {
-
-        int value;
-        switch (filtering_axis_)
-        {
-        case 0: // x
-            value = std::lround((cloud_it->x - min) * lut_scale);
-            break;
-        case 1: // y
-            value = std::lround((cloud_it->y - min) * lut_scale);
-            break;
-        default: // z
-            value = std::lround((cloud_it->z - min) * lut_scale);
-            break;
-        }
-
-        // Apply color to the cloud
-        switch (color_mode_)
+        int r, g, b;
+        switch (color_mode)
         {
         case 0:
             // Blue (= min) -> Red (= max)
-            cloud_it->r = value;
-            cloud_it->g = 0;
-            cloud_it->b = 255 - value;
+            r = value;
+            g = 0;
+            b = 255 - value;
             break;
         case 1:
             // Green (= min) -> Magenta (= max)
-            cloud_it->r = value;
-            cloud_it->g = 255 - value;
-            cloud_it->b = value;
+            r = value;
+            g = 255 - value;
+            b = value;
             break;
         case 2:
             // White (= min) -> Red (= max)
-            cloud_it->r = 255;
-            cloud_it->g = 255 - value;
-            cloud_it->b = 255 - value;
+            r = 255;
+            g = 255 - value;
+            b = 255 - value;
             break;
         case 3:
             // Grey (< 128) / Red (> 128)
             if (value > 128)
             {
-                cloud_it->r = 255;
-                cloud_it->g = 0;
-                cloud_it->b = 0;
+                r = 255;
+                g = 0;
+                b = 0;
             }
             else
             {
-                cloud_it->r = 128;
-                cloud_it->g = 128;
-                cloud_it->b = 128;
+                r = 128;
+                g = 128;
+                b = 128;
             }
             break;
         default:
             // Blue -> Green -> Red (~ rainbow)
-            cloud_it->r = value > 128 ? (value - 128) * 2 : 0;                 // r[128] = 0, r[255] = 255
-            cloud_it->g = value < 128 ? 2 * value : 255 - ((value - 128) * 2); // g[0] = 0, g[128] = 255, g[255] = 0
-            cloud_it->b = value < 128 ? 255 - (2 * value) : 0;                 // b[0] = 255, b[128] = 0
+            r = value > 128 ? (value - 128) * 2 : 0;                 // r[128] = 0, r[255] = 255
+            g = value < 128 ? 2 * value : 255 - ((value - 128) * 2); // g[0] = 0, g[128] = 255, g[255] = 0
+            b = value < 128 ? 255 - (2 * value) : 0;                 // b[0] = 255, b[128] = 0
         }
+        lut.rgb[value] = (uint32_t(uint8_t(r)) << 16) | (uint32_t(uint8_t(g)) << 8) | uint32_t(uint8_t(b));
     }
+    return lut;
+}
+
+const ColorLut &color_lut(int color_mode)
+{
+    static const ColorLut luts[5] = {
+        build_color_lut(0), build_color_lut(1), build_color_lut(2), build_color_lut(3), build_color_lut(4)};
+    return luts[(color_mode >= 0 && color_mode < 5) ? color_mode : 4];
+}
+
+inline void write_color(PointT &point, uint32_t rgb)
+{
+    point.rgba = (point.rgba & 0xff000000u) | rgb;
+}
+
+inline int clamp_level(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// (int)std::lround(t) without the libm call : round half away from zero, and 0 for NaN / values
+// outside the int range (lround returns LONG_MIN there, which truncates to 0).
+inline int round_level(double t)
+{
+    if (!(std::fabs(t) < 2147483648.0))
+    {
+        return 0;
+    }
+    long long value = static_cast<long long>(t);
+    double frac = t - static_cast<double>(value);
+    value += (frac >= 0.5) - (frac <= -0.5);
+    return static_cast<int>(value);
+}
+
+// Per-point value the colormap is applied to : one coordinate of the points (strided) ...
+struct AxisValues
+{
+    const PointT *points;
+    int axis;
+
+    float at(size_t i) const
+    {
+        return this->points[i].data[this->axis];
+    }
+};
+
+// ... or a separate contiguous array (range, intensity).
+struct ArrayValues
+{
+    const float *values;
+
+    float at(size_t i) const
+    {
+        return this->values[i];
+    }
+};
+
+// The min/max search keeps the first value on ties and ignores NaN (unless the first point is NaN),
+// exactly like the comparisons `if (min > v) min = v;` it replaces.
+template <typename Values>
+void minmax_scalar(const Values &values, size_t begin, size_t end, float &min, float &max)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        float v = values.at(i);
+        if (min > v)
+            min = v;
+        if (max < v)
+            max = v;
+    }
+}
+
+template <typename Values>
+void color_scalar(PointT *points, const Values &values, size_t begin, size_t end, double min, double lut_scale, const ColorLut &lut)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        int value = round_level((values.at(i) - min) * lut_scale);
+        write_color(points[i], lut.rgb[clamp_level(value)]);
+    }
+}
+
+#ifdef CLOUD_VIEWER_HAVE_AVX2_KERNELS
+
+bool cpu_has_avx2()
+{
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+// Values of `axis` of the 4 points starting at `i` : the 4 (x, y, z, pad) quads transposed.
+inline __m128 load4(const AxisValues &values, size_t i)
+{
+    const PointT *p = values.points + i;
+    __m128 a0 = _mm_load_ps(p[0].data);
+    __m128 a1 = _mm_load_ps(p[1].data);
+    __m128 a2 = _mm_load_ps(p[2].data);
+    __m128 a3 = _mm_load_ps(p[3].data);
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    return values.axis == 0 ? a0 : (values.axis == 1 ? a1 : a2);
+}
+
+inline __m128 load4(const ArrayValues &values, size_t i)
+{
+    return _mm_loadu_ps(values.values + i);
+}
+
+template <typename Values>
+__attribute__((target("avx2")))
+void minmax_avx2(const Values &values, size_t begin, size_t end, float &min, float &max)
+{
+    __m128 vmin = _mm_set1_ps(min);
+    __m128 vmax = _mm_set1_ps(max);
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 v = load4(values, i);
+        // (v < min) ? v : min and (v > max) ? v : max, NaN keeps the running value.
+        vmin = _mm_min_ps(v, vmin);
+        vmax = _mm_max_ps(v, vmax);
+    }
+
+    float lanes_min[4], lanes_max[4];
+    _mm_storeu_ps(lanes_min, vmin);
+    _mm_storeu_ps(lanes_max, vmax);
+    for (int k = 0; k < 4; ++k)
+    {
+        if (min > lanes_min[k])
+            min = lanes_min[k];
+        if (max < lanes_max[k])
+            max = lanes_max[k];
+    }
+    minmax_scalar(values, i, end, min, max);
+}
+
+template <typename Values>
+__attribute__((target("avx2")))
+void color_avx2(PointT *points, const Values &values, size_t begin, size_t end, double min, double lut_scale, const ColorLut &lut)
+{
+    const __m256d vmin = _mm256_set1_pd(min);
+    const __m256d vscale = _mm256_set1_pd(lut_scale);
+    const __m256d sign_mask = _mm256_set1_pd(-0.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d int_limit = _mm256_set1_pd(2147483648.0);
+    const __m128i level_min = _mm_setzero_si128();
+    const __m128i level_max = _mm_set1_epi32(255);
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 v = load4(values, i);
+        __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(v), vmin), vscale);
+
+        // std::lround : round half away from zero. t - trunc(t) is exact.
+        __m256d r = _mm256_round_pd(t, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d frac = _mm256_andnot_pd(sign_mask, _mm256_sub_pd(t, r));
+        __m256d away = _mm256_or_pd(_mm256_and_pd(t, sign_mask), one);
+        r = _mm256_add_pd(r, _mm256_and_pd(_mm256_cmp_pd(frac, half, _CMP_GE_OQ), away));
+        // NaN / out of int range give 0, as the truncated LONG_MIN of lround does.
+        r = _mm256_and_pd(r, _mm256_cmp_pd(_mm256_andnot_pd(sign_mask, r), int_limit, _CMP_LT_OQ));
+
+        __m128i level = _mm_min_epi32(_mm_max_epi32(_mm256_cvttpd_epi32(r), level_min), level_max);
+        write_color(points[i], lut.rgb[_mm_extract_epi32(level, 0)]);
+        write_color(points[i + 1], lut.rgb[_mm_extract_epi32(level, 1)]);
+        write_color(points[i + 2], lut.rgb[_mm_extract_epi32(level, 2)]);
+        write_color(points[i + 3], lut.rgb[_mm_extract_epi32(level, 3)]);
+    }
+    color_scalar(points, values, i, end, min, lut_scale, lut);
+}
+
+#endif
+
+template <typename Values>
+void minmax_range(const Values &values, size_t begin, size_t end, float &min, float &max)
+{
+#ifdef CLOUD_VIEWER_HAVE_AVX2_KERNELS
+    if (cpu_has_avx2())
+    {
+        minmax_avx2(values, begin, end, min, max);
+        return;
+    }
+#endif
+    minmax_scalar(values, begin, end, min, max);
+}
+
+template <typename Values>
+void color_range(PointT *points, const Values &values, size_t begin, size_t end, double min, double lut_scale, const ColorLut &lut)
+{
+#ifdef CLOUD_VIEWER_HAVE_AVX2_KERNELS
+    if (cpu_has_avx2())
+    {
+        color_avx2(points, values, begin, end, min, lut_scale, lut);
+        return;
+    }
+#endif
+    color_scalar(points, values, begin, end, min, lut_scale, lut);
+}
+
+// Min/max of the values, every chunk starts from the first value as the sequential search would.
+template <typename Values>
+void minmax_values(const Values &values, size_t n, float &min, float &max)
+{
+    size_t num_chunks = parallel_num_chunks(n, kColorChunkPoints);
+    std::vector<float> chunk_min(num_chunks, values.at(0));
+    std::vector<float> chunk_max(num_chunks, values.at(0));
+    parallel_for(n, kColorChunkPoints, [&](size_t begin, size_t end, size_t c) {
+        minmax_range(values, begin, end, chunk_min[c], chunk_max[c]);
+    });
+
+    min = chunk_min[0];
+    max = chunk_max[0];
+    for (size_t c = 1; c < num_chunks; ++c)
+    {
+        if (min > chunk_min[c])
+            min = chunk_min[c];
+        if (max < chunk_max[c])
+            max = chunk_max[c];
+    }
+}
+
+template <typename Values>
+void color_values(PointT *points, const Values &values, size_t n, double min, double max, int color_mode)
+{
+    // Compute LUT scaling to fit the full histogram spectrum
+    double lut_scale = 255.0 / (max - min); // max is 255, min is 0
+
+    if (min == max)      // In case the cloud is flat on the chosen direction (x,y or z)
+        lut_scale = 1.0; // Avoid rounding error in boost
+
+    const ColorLut &lut = color_lut(color_mode);
+    parallel_for(n, kColorChunkPoints, [&](size_t begin, size_t end, size_t) {
+        color_range(points, values, begin, end, min, lut_scale, lut);
+    });
+}
+
+void compute_ranges(const PointCloudT &cloud, std::vector<float> &ranges)
+{
+    ranges.resize(cloud.size());
+    parallel_for(cloud.size(), kColorChunkPoints, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud[i];
+            ranges[i] = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        }
+    });
+}
+
+// Calls f(values) with the accessor of the colour source of `config`.
+template <typename F>
+void with_color_values(const PointCloudT &cloud, const ColorConfig &config, const std::vector<float> *values, F &&f)
+{
+    if (config.source == COLOR_SOURCE_RANGE)
+    {
+        std::vector<float> ranges;
+        compute_ranges(cloud, ranges);
+        f(ArrayValues{ranges.data()});
+    }
+    else if (config.source == COLOR_SOURCE_INTENSITY && values != nullptr && values->size() == cloud.size())
+    {
+        f(ArrayValues{values->data()});
+    }
+    else
+    {
+        // Intensity missing from the frame falls back to z.
+        int axis = (config.source == COLOR_SOURCE_X || config.source == COLOR_SOURCE_Y) ? config.source : COLOR_SOURCE_Z;
+        f(AxisValues{cloud.points.data(), axis});
+    }
+}
+
+} // namespace
+
+
+bool color_value_range(const PointCloudT &cloud, const ColorConfig &config, const std::vector<float> *values, float &min, float &max)
+{
+    if (cloud.empty())
+    {
+        return false;
+    }
+    with_color_values(cloud, config, values, [&](const auto &v) {
+        minmax_values(v, cloud.size(), min, max);
+    });
+    return true;
+}
+
+void apply_color(PointCloudT::Ptr cloud, const ColorConfig &config, const std::vector<float> *values)
+{
+    if (cloud->empty())
+    {
+        return;
+    }
+
+    PointT *points = cloud->points.data();
+    size_t n = cloud->size();
+    with_color_values(*cloud, config, values, [&](const auto &v) {
+        float min = config.range_min, max = config.range_max;
+        if (!config.fixed_range)
+        {
+            minmax_values(v, n, min, max);
+        }
+        color_values(points, v, n, min, max, config.color_mode);
+    });
+}
+
+void apply_color(PointCloudT::Ptr cloud, int filtering_axis, int color_mode)
+{
+    ColorConfig config;
+    config.source = (filtering_axis == 0 || filtering_axis == 1) ? filtering_axis : COLOR_SOURCE_Z;
+    config.color_mode = color_mode;
+    apply_color(cloud, config);
+}
+
+void apply_color(PointCloudT::Ptr cloud)
+{
+    apply_color(cloud, ColorConfig());
 }
@@ -0,0 +1,306 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "frame_source.h"
+#include "seq_file.h"
+
+static_assert(sizeof(PointT) == 32, "the .seq point blocks store PointXYZRGB in memory layout");
+
+
+SeqFile::SeqFile(const std::string &path) : path(path), file(path, false)
+{
+    if (this->file.data() == nullptr)
+    {
+        std::string message = (boost::format("Error : cannot map sequence file %1%") % path).str();
+        throw std::runtime_error(message);
+    }
+
+    SeqFileHeader header{};
+    bool magic = this->file.size() >= sizeof(header);
+    if (magic)
+    {
+        std::memcpy(&header, this->file.data(), sizeof(header));
+        magic = std::memcmp(header.magic, kSeqMagic, sizeof(kSeqMagic)) == 0;
+    }
+    bool valid = magic && header.byte_order == kSeqByteOrder
+                 && (header.version == kSeqVersion || header.version == kSeqVersionNoPose)
+                 && header.index_offset <= this->file.size();
+    size_t entry_size = header.version == kSeqVersionNoPose ? kSeqFrameEntryV1Size : sizeof(SeqFrameEntry);
+    valid = valid && header.num_frames <= (this->file.size() - header.index_offset) / entry_size;
+    if (!valid)
+    {
+        std::string message = magic
+            ? (boost::format("Error : %1% is not a valid .seq file (version %2%).") % path % header.version).str()
+            : (boost::format("Error : %1% is not a .seq file.") % path).str();
+        throw std::runtime_error(message);
+    }
+
+    // Version 1 entries stop before the pose : the rest is left zeroed, without kSeqFramePose.
+    SeqFrameEntry zeroed;
+    std::memset(&zeroed, 0, sizeof(zeroed));
+    this->frames.assign(header.num_frames, zeroed);
+    for (size_t i = 0; i < this->frames.size(); ++i)
+    {
+        std::memcpy(&this->frames[i], this->file.data() + header.index_offset + i * entry_size, entry_size);
+        if (header.version == kSeqVersionNoPose)
+        {
+            this->frames[i].flags &= ~kSeqFramePose;
+        }
+    }
+
+    // Check every block once here, so that reads don't have to.
+    uint64_t file_size = this->file.size();
+    auto in_file = [file_size](uint64_t offset, uint64_t bytes) {
+        return offset <= file_size && bytes <= file_size - offset;
+    };
+    for (size_t i = 0; i < this->frames.size(); ++i)
+    {
+        const SeqFrameEntry &entry = this->frames[i];
+        bool ok = entry.num_points <= file_size / sizeof(PointT)
+                  && in_file(entry.points_offset, entry.num_points * sizeof(PointT))
+                  && (entry.intensity_offset == 0 || in_file(entry.intensity_offset, entry.num_points * sizeof(float)))
+                  && in_file(entry.bboxes_offset, uint64_t(entry.num_bboxes) * sizeof(SeqBBoxRecord))
+                  && in_file(entry.name_offset, entry.name_length)
+                  && uint64_t(entry.width) * entry.height == entry.num_points;
+        if (!ok)
+        {
+            std::string message = (boost::format("Error : %1% is corrupted (frame %2%).") % path % i).str();
+            throw std::runtime_error(message);
+        }
+    }
+}
+
+std::string SeqFile::name(int index) const
+{
+    const SeqFrameEntry &entry = this->frames[index];
+    return std::string(reinterpret_cast<const char *>(this->file.data() + entry.name_offset), entry.name_length);
+}
+
+bool SeqFile::read_cloud(int index, PointCloudT &cloud, std::vector<float> &intensity) const
+{
+    if (index < 0 || index >= this->size())
+    {
+        return false;
+    }
+    const SeqFrameEntry &entry = this->frames[index];
+    size_t n = entry.num_points;
+    this->file.will_need(entry.points_offset, n * sizeof(PointT));
+
+    cloud.resize(n);
+    cloud.width = entry.width;
+    cloud.height = entry.height;
+    std::memcpy(static_cast<void *>(cloud.points.data()), this->file.data() + entry.points_offset, n * sizeof(PointT));
+    cloud.is_dense = (entry.flags & kSeqFrameDense) != 0;
+
+    if (entry.intensity_offset != 0)
+    {
+        intensity.resize(n);
+        std::memcpy(intensity.data(), this->file.data() + entry.intensity_offset, n * sizeof(float));
+    }
+    else
+    {
+        intensity.clear();
+    }
+    return true;
+}
+
+size_t seq_bboxes_bytes(const std::vector<BBox3D> &bboxes)
+{
+    size_t bytes = bboxes.size() * sizeof(SeqBBoxRecord);
+    for (const BBox3D &bbox : bboxes)
+    {
+        bytes += bbox.id.size();
+    }
+    return bytes;
+}
+
+void write_seq_bboxes(const std::vector<BBox3D> &bboxes, uint8_t *data)
+{
+    for (const BBox3D &bbox : bboxes)
+    {
+        SeqBBoxRecord record;
+        std::memset(&record, 0, sizeof(record));
+        for (int k = 0; k < 3; ++k)
+        {
+            record.translation[k] = bbox.translation(k);
+        }
+        record.rotation[0] = bbox.rotation.w();
+        record.rotation[1] = bbox.rotation.x();
+        record.rotation[2] = bbox.rotation.y();
+        record.rotation[3] = bbox.rotation.z();
+        record.id_length = bbox.id.size();
+        record.width = bbox.width;
+        record.height = bbox.height;
+        record.depth = bbox.depth;
+        std::memcpy(data, &record, sizeof(record));
+        data += sizeof(record);
+        std::memcpy(data, bbox.id.data(), bbox.id.size());
+        data += bbox.id.size();
+    }
+}
+
+bool read_seq_bboxes(const uint8_t *data, size_t size, uint32_t count, std::vector<BBox3D> &bboxes)
+{
+    bboxes.clear();
+    bboxes.reserve(count);
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        SeqBBoxRecord record;
+        if (sizeof(record) > size - offset)
+        {
+            return false;
+        }
+        std::memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.id_length > size - offset)
+        {
+            return false;
+        }
+        std::string id(reinterpret_cast<const char *>(data + offset), record.id_length);
+        offset += record.id_length;
+
+        Eigen::Vector3f translation(record.translation[0], record.translation[1], record.translation[2]);
+        Eigen::Quaternionf rotation(record.rotation[0], record.rotation[1], record.rotation[2], record.rotation[3]);
+        bboxes.push_back(BBox3D{translation, rotation, record.width, record.height, record.depth, id});
+    }
+    return true;
+}
+
+bool SeqFile::read_bboxes(int index, std::vector<BBox3D> &bboxes, LidarPose *pose) const
+{
+    bboxes.clear();
+    if (pose != nullptr)
+    {
+        *pose = LidarPose();
+    }
+    if (index < 0 || index >= this->size())
+    {
+        return false;
+    }
+    const SeqFrameEntry &entry = this->frames[index];
+    if (pose != nullptr && (entry.flags & kSeqFramePose) != 0)
+    {
+        pose->valid = true;
+        pose->translation = Eigen::Vector3f(entry.pose[0], entry.pose[1], entry.pose[2]);
+        pose->rotation = Eigen::Quaternionf(entry.pose[3], entry.pose[4], entry.pose[5], entry.pose[6]);
+    }
+    return read_seq_bboxes(this->file.data() + entry.bboxes_offset, this->file.size() - entry.bboxes_offset,
+                           entry.num_bboxes, bboxes);
+}
+
+namespace
+{
+
+void write_padding(std::ofstream &os, size_t alignment)
+{
+    static const char zeros[kSeqBlockAlignment] = {};
+    size_t position = os.tellp();
+    size_t padding = (alignment - position % alignment) % alignment;
+    os.write(zeros, padding);
+}
+
+} // namespace
+
+int write_seq_file(const std::string &path, const FrameSource &source)
+{
+    namespace bfs = boost::filesystem;
+
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os)
+    {
+        std::string message = (boost::format("Error : cannot open %1% for writing") % path).str();
+        throw std::runtime_error(message);
+    }
+
+    SeqFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kSeqMagic, sizeof(kSeqMagic));
+    header.version = kSeqVersion;
+    header.byte_order = kSeqByteOrder;
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<SeqFrameEntry> frames;
+    PointCloudT cloud;
+    std::vector<float> intensity;
+    std::vector<BBox3D> bboxes;
+    LidarPose pose;
+    std::vector<uint8_t> bbox_bytes;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < source.size(); ++i)
+    {
+        if (!source.load_cloud(i, cloud, intensity))
+        {
+            std::cerr << "Warning : cannot load point cloud " << source.name(i) << ", skipped." << std::endl;
+            continue;
+        }
+        source.load_bboxes(i, bboxes, &pose);
+        // Only the file name is kept : the packed sequence doesn't depend on where the pcd files were.
+        std::string name = bfs::path(source.name(i)).filename().string();
+
+        SeqFrameEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.num_points = cloud.size();
+        entry.width = cloud.width;
+        entry.height = cloud.height;
+        entry.flags = (cloud.is_dense ? kSeqFrameDense : 0) | (pose.valid ? kSeqFramePose : 0);
+        for (int k = 0; k < 3; ++k)
+        {
+            entry.pose[k] = pose.translation(k);
+        }
+        entry.pose[3] = pose.rotation.w();
+        entry.pose[4] = pose.rotation.x();
+        entry.pose[5] = pose.rotation.y();
+        entry.pose[6] = pose.rotation.z();
+        if (uint64_t(entry.width) * entry.height != entry.num_points)
+        {
+            entry.width = cloud.size();
+            entry.height = 1;
+        }
+
+        write_padding(os, kSeqBlockAlignment);
+        entry.points_offset = os.tellp();
+        os.write(reinterpret_cast<const char *>(cloud.points.data()), cloud.size() * sizeof(PointT));
+        if (intensity.size() == cloud.size() && !intensity.empty())
+        {
+            entry.intensity_offset = os.tellp();
+            os.write(reinterpret_cast<const char *>(intensity.data()), intensity.size() * sizeof(float));
+        }
+
+        entry.bboxes_offset = os.tellp();
+        entry.num_bboxes = bboxes.size();
+        bbox_bytes.resize(seq_bboxes_bytes(bboxes));
+        write_seq_bboxes(bboxes, bbox_bytes.data());
+        os.write(reinterpret_cast<const char *>(bbox_bytes.data()), bbox_bytes.size());
+
+        entry.name_offset = os.tellp();
+        entry.name_length = name.size();
+        os.write(name.data(), name.size());
+        frames.push_back(entry);
+
+        std::cout << "packed " << name << " (" << cloud.size() << " points, " << bboxes.size() << " bboxes)" << std::endl;
+    }
+
+    write_padding(os, kSeqBlockAlignment);
+    header.num_frames = frames.size();
+    header.index_offset = os.tellp();
+    os.write(reinterpret_cast<const char *>(frames.data()), frames.size() * sizeof(SeqFrameEntry));
+    os.seekp(0);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os.close();
+    if (!os)
+    {
+        std::string message = (boost::format("Error : writing %1% failed") % path).str();
+        throw std::runtime_error(message);
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "packed " << frames.size() << " frames into " << path << " in " << elapsed << " s" << std::endl;
+    return frames.size();
+}
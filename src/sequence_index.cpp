@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/stat.h>
+#define CLOUD_VIEWER_HAVE_DIRENT 1
+#endif
+
+#include "sequence_index.h"
+
+
+namespace
+{
+
+const char *kIndexMagic = "cloud_viewer_index";
+const int kIndexVersion = 1;
+// The directory mtime is written last, in place, as a fixed-width field (see save_sequence_index).
+const int kMtimeWidth = 20;
+
+// Whether `a` and `b` name the same files, in any order.
+bool same_files(std::vector<std::string> a, std::vector<std::string> b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (std::vector<std::string> *files : {&a, &b})
+    {
+        for (std::string &file : *files)
+        {
+            file = boost::filesystem::path(file).filename().string();
+        }
+        std::sort(files->begin(), files->end());
+    }
+    return a == b;
+}
+
+} // namespace
+
+
+bool natural_less(const std::string &a, const std::string &b)
+{
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        if (std::isdigit(static_cast<unsigned char>(a[i])) && std::isdigit(static_cast<unsigned char>(b[j])))
+        {
+            size_t start_a = i, start_b = j;
+            while (i < a.size() && std::isdigit(static_cast<unsigned char>(a[i])))
+            {
+                ++i;
+            }
+            while (j < b.size() && std::isdigit(static_cast<unsigned char>(b[j])))
+            {
+                ++j;
+            }
+            // Value of the runs : the longer one without leading zeros is the larger, then digit by digit.
+            size_t digits_a = start_a, digits_b = start_b;
+            while (digits_a + 1 < i && a[digits_a] == '0')
+            {
+                ++digits_a;
+            }
+            while (digits_b + 1 < j && b[digits_b] == '0')
+            {
+                ++digits_b;
+            }
+            if (i - digits_a != j - digits_b)
+            {
+                return i - digits_a < j - digits_b;
+            }
+            int c = a.compare(digits_a, i - digits_a, b, digits_b, j - digits_b);
+            if (c != 0)
+            {
+                return c < 0;
+            }
+            if (i - start_a != j - start_b)
+            {
+                return i - start_a < j - start_b;
+            }
+        }
+        else
+        {
+            if (a[i] != b[j])
+            {
+                return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[j]);
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return i == a.size() && j < b.size();
+}
+
+std::vector<std::string> list_directory(const std::string &dir, const std::string &extension)
+{
+    namespace bfs = boost::filesystem;
+
+    std::vector<std::string> files;
+    auto matches = [&extension](const std::string &name) {
+        return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+    };
+
+#ifdef CLOUD_VIEWER_HAVE_DIRENT
+    // readdir() only : on network file systems every stat is a round trip, and the entry type usually comes
+    // with the name.
+    DIR *d = ::opendir(dir.c_str());
+    if (d == nullptr)
+    {
+        throw std::runtime_error((boost::format("cannot read directory '%1%'") % dir).str());
+    }
+    bfs::path dir_path(dir);
+    while (struct dirent *entry = ::readdir(d))
+    {
+        std::string name = entry->d_name;
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR)
+        {
+            continue;
+        }
+#endif
+        if (matches(name))
+        {
+            files.push_back((dir_path / name).string());
+        }
+    }
+    ::closedir(d);
+#else
+    boost::system::error_code ec;
+    for (bfs::directory_iterator itr(bfs::path(dir), ec), end_itr; !ec && itr != end_itr; itr.increment(ec))
+    {
+        if (matches(itr->path().filename().string()))
+        {
+            files.push_back(itr->path().string());
+        }
+    }
+    if (ec)
+    {
+        throw std::runtime_error((boost::format("cannot read directory '%1%'") % dir).str());
+    }
+#endif
+    return files;
+}
+
+std::vector<std::string> pair_annot_files(const std::vector<std::string> &pcd_files, const std::string &annot_path)
+{
+    namespace bfs = boost::filesystem;
+
+    std::vector<std::string> annot_files(pcd_files.size());
+    if (annot_path.empty() || !bfs::exists(bfs::path(annot_path)))
+    {
+        return annot_files;
+    }
+    if (!bfs::is_directory(bfs::path(annot_path)))
+    {
+        if (bfs::path(annot_path).extension().string() == ".json")
+        {
+            std::fill(annot_files.begin(), annot_files.end(), annot_path);
+        }
+        return annot_files;
+    }
+
+    std::unordered_map<std::string, std::string> by_stem;
+    for (std::string &file : list_directory(annot_path, ".json"))
+    {
+        std::string stem = bfs::path(file).stem().string();
+        by_stem.emplace(std::move(stem), std::move(file));
+    }
+    for (size_t i = 0; i < pcd_files.size(); ++i)
+    {
+        auto it = by_stem.find(bfs::path(pcd_files[i]).stem().string());
+        if (it != by_stem.end())
+        {
+            annot_files[i] = it->second;
+        }
+    }
+    return annot_files;
+}
+
+int64_t path_mtime_ns(const std::string &path)
+{
+#ifdef CLOUD_VIEWER_HAVE_DIRENT
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#else
+    boost::system::error_code ec;
+    std::time_t t = boost::filesystem::last_write_time(boost::filesystem::path(path), ec);
+    return ec ? 0 : int64_t(t) * 1000000000;
+#endif
+}
+
+std::string sequence_index_cache_path(const std::string &pcd_dir)
+{
+    return (boost::filesystem::path(pcd_dir) / ".cloud_viewer_index").string();
+}
+
+bool load_sequence_index(const std::string &pcd_dir, const std::string &annot_path, SequenceIndex &index)
+{
+    namespace bfs = boost::filesystem;
+
+    std::ifstream is(sequence_index_cache_path(pcd_dir), std::ios::binary);
+    if (!is)
+    {
+        return false;
+    }
+    std::string magic, key, cached_annot_path;
+    int version = 0;
+    long long pcd_mtime = 0, annot_mtime = 0;
+    size_t frames = 0;
+    if (!(is >> magic >> version) || magic != kIndexMagic || version != kIndexVersion
+        || !(is >> key >> pcd_mtime) || key != "pcd_mtime"
+        || !(is >> key >> annot_mtime) || key != "annot_mtime"
+        || !(is >> key) || key != "annot_path" || is.get() != ' ' || !std::getline(is, cached_annot_path)
+        || !(is >> key >> frames) || key != "frames" || is.get() != '\n')
+    {
+        return false;
+    }
+    // A directory mtime of 0 is what save_sequence_index leaves when the directory changed while it was listed.
+    if (pcd_mtime == 0 || pcd_mtime != path_mtime_ns(pcd_dir) || cached_annot_path != annot_path
+        || annot_mtime != path_mtime_ns(annot_path))
+    {
+        return false;
+    }
+
+    SequenceIndex cached;
+    cached.pcd_files.reserve(frames);
+    cached.annot_files.reserve(frames);
+    bfs::path dir_path(pcd_dir);
+    std::string line;
+    while (cached.pcd_files.size() < frames && std::getline(is, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            return false;
+        }
+        cached.pcd_files.push_back((dir_path / line.substr(0, tab)).string());
+        cached.annot_files.push_back(line.substr(tab + 1));
+    }
+    if (cached.pcd_files.size() != frames)
+    {
+        return false;
+    }
+    index = std::move(cached);
+    return true;
+}
+
+bool save_sequence_index(const std::string &pcd_dir, const std::string &annot_path, const SequenceIndex &index,
+                         int64_t listed_mtime_ns)
+{
+    namespace bfs = boost::filesystem;
+
+    std::string path = sequence_index_cache_path(pcd_dir);
+    bool existed = bfs::exists(bfs::path(path));
+    std::streamoff mtime_offset;
+    {
+        std::ofstream os(path, std::ios::binary | std::ios::trunc);
+        if (!os)
+        {
+            return false;
+        }
+        os << kIndexMagic << " " << kIndexVersion << "\n" << "pcd_mtime ";
+        mtime_offset = os.tellp();
+        os << std::string(kMtimeWidth, '0') << "\n"
+           << "annot_mtime " << path_mtime_ns(annot_path) << "\n"
+           << "annot_path " << annot_path << "\n"
+           << "frames " << index.pcd_files.size() << "\n";
+        for (size_t i = 0; i < index.pcd_files.size(); ++i)
+        {
+            os << bfs::path(index.pcd_files[i]).filename().string() << "\t"
+               << (i < index.annot_files.size() ? index.annot_files[i] : std::string()) << "\n";
+        }
+        if (!os)
+        {
+            return false;
+        }
+    }
+
+    // Creating the cache file is itself a change of the directory : its mtime is only known now, and is patched
+    // into the header in place (which doesn't touch the directory). When the file already existed, any change of
+    // the mtime since listing means frames were added or removed meanwhile. When it was just created, the mtime
+    // can't tell, so the directory is listed again after reading it : frames added or removed before match
+    // neither the listing nor the cache, after they change the mtime. The cache is left invalid in both cases.
+    int64_t mtime = path_mtime_ns(pcd_dir);
+    bool valid = mtime == listed_mtime_ns;
+    if (!existed && !valid)
+    {
+        valid = same_files(list_directory(pcd_dir, ".pcd"), index.pcd_files);
+    }
+    std::fstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!patch)
+    {
+        return false;
+    }
+    char field[kMtimeWidth + 1];
+    std::snprintf(field, sizeof(field), "%0*lld", kMtimeWidth, valid ? (long long)mtime : 0LL);
+    patch.seekp(mtime_offset);
+    patch.write(field, kMtimeWidth);
+    return bool(patch) && valid;
+}
+
+bool keep_sequence_index(const std::string &pcd_dir, int64_t created_after_mtime_ns)
+{
+    std::fstream patch(sequence_index_cache_path(pcd_dir), std::ios::binary | std::ios::in | std::ios::out);
+    std::string magic, key;
+    int version = 0;
+    long long pcd_mtime = 0;
+    if (!patch || !(patch >> magic >> version) || magic != kIndexMagic || version != kIndexVersion
+        || !(patch >> key) || key != "pcd_mtime" || patch.get() != ' ')
+    {
+        return false;
+    }
+    std::streamoff mtime_offset = patch.tellg();
+    if (!(patch >> pcd_mtime) || pcd_mtime == 0 || pcd_mtime != created_after_mtime_ns)
+    {
+        return false;
+    }
+    char field[kMtimeWidth + 1];
+    std::snprintf(field, sizeof(field), "%0*lld", kMtimeWidth, (long long)path_mtime_ns(pcd_dir));
+    patch.seekp(mtime_offset);
+    patch.write(field, kMtimeWidth);
+    return bool(patch);
+}
@@ -0,0 +1,822 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "sequence_index.h"
+#include "sequence_summary.h"
+
+
+namespace
+{
+
+// Sidecar layout (native byte order) :
+//   SummaryFileHeader            32 bytes
+//   records, appended as frames are summarised, in any order :
+//     uint32 payload bytes, uint32 FNV-1a of the payload
+//     SummaryRecord, then num_labels times (uint16 box count, uint16 length, label chars)
+const char kSummaryMagic[8] = {'P', 'C', 'S', 'U', 'M', 'R', 'Y', '\0'};
+const uint32_t kSummaryVersion = 1;
+
+struct SummaryFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bins;
+    uint64_t key;
+    uint64_t frames;
+};
+
+struct SummaryRecord
+{
+    uint32_t frame;
+    uint32_t flags;  // kSummaryLoaded | kSummaryIntensity
+    uint64_t points;
+    uint64_t finite_points;
+    float min[COLOR_SOURCE_COUNT];
+    float max[COLOR_SOURCE_COUNT];
+    float load_ms;
+    float annot_ms;
+    uint32_t boxes;
+    uint32_t num_labels;
+    uint16_t histogram[COLOR_SOURCE_COUNT][kSummaryBins];
+};
+
+const uint32_t kSummaryLoaded = 1;
+const uint32_t kSummaryIntensity = 2;
+
+static_assert(sizeof(SummaryFileHeader) == 32, "unexpected SummaryFileHeader padding");
+static_assert(sizeof(SummaryRecord) == 400, "unexpected SummaryRecord padding");
+
+// Records are written once this much is pending, and when the pass ends.
+const size_t kFlushBytes = 64 * 1024;
+// Bins of the sequence-wide histogram the frame histograms are merged into.
+const int kMergedBins = 4096;
+
+enum
+{
+    kQueryLess,
+    kQueryLessEqual,
+    kQueryGreater,
+    kQueryGreaterEqual,
+    kQueryEqual,
+    kQueryNotEqual,
+    kQueryMax,
+    kQueryMin
+};
+
+// Query fields of the min / max of each colour source, besides points, boxes and load_ms.
+const char *kMinFields[COLOR_SOURCE_COUNT] = {"xmin", "ymin", "zmin", "range_min", "imin"};
+const char *kMaxFields[COLOR_SOURCE_COUNT] = {"xmax", "ymax", "zmax", "range", "imax"};
+
+bool builtin_field(const std::string &field)
+{
+    return field == "points" || field == "boxes" || field == "load_ms"
+        || std::find(std::begin(kMinFields), std::end(kMinFields), field) != std::end(kMinFields)
+        || std::find(std::begin(kMaxFields), std::end(kMaxFields), field) != std::end(kMaxFields);
+}
+
+uint32_t fnv1a32(const uint8_t *data, size_t size)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+void fnv1a64(uint64_t &h, const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+std::string trim(const std::string &s)
+{
+    size_t begin = s.find_first_not_of(" \t");
+    size_t end = s.find_last_not_of(" \t");
+    return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+}
+
+// Workers give way to the viewer's own threads : the pass only uses idle cores.
+void lower_thread_priority()
+{
+#if defined(__linux__)
+    ::setpriority(PRIO_PROCESS, pid_t(::syscall(SYS_gettid)), 10);
+#endif
+}
+
+int64_t steady_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+
+SummaryQuery::SummaryQuery(const std::string &text) : query_text(text)
+{
+    size_t begin = 0;
+    while (begin <= text.size())
+    {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        std::string term = trim(text.substr(begin, end - begin));
+        begin = end + 1;
+
+        Condition condition{std::string(), kQueryEqual, 0.0};
+        if (term.compare(0, 4, "max:") == 0 || term.compare(0, 4, "min:") == 0)
+        {
+            condition.op = term[1] == 'a' ? kQueryMax : kQueryMin;
+            condition.field = trim(term.substr(4));
+        }
+        else
+        {
+            size_t op = term.find_first_of("<>=!");
+            if (op == std::string::npos)
+            {
+                throw std::runtime_error((boost::format("'%1%' : expected <field> <op> <value>") % term).str());
+            }
+            size_t op_end = (op + 1 < term.size() && term[op + 1] == '=') ? op + 2 : op + 1;
+            std::string op_text = term.substr(op, op_end - op);
+            const char *ops[] = {"<", "<=", ">", ">=", "=", "!="};
+            auto op_it = std::find(std::begin(ops), std::end(ops), op_text);
+            if (op_it == std::end(ops))
+            {
+                throw std::runtime_error((boost::format("'%1%' : unknown operator '%2%'") % term % op_text).str());
+            }
+            condition.op = int(op_it - std::begin(ops));
+            condition.field = trim(term.substr(0, op));
+            std::string value = trim(term.substr(op_end));
+            size_t parsed = 0;
+            try
+            {
+                condition.value = std::stod(value, &parsed);
+            }
+            catch (const std::logic_error &)
+            {
+                parsed = 0;
+            }
+            if (value.empty() || parsed != value.size())
+            {
+                throw std::runtime_error((boost::format("'%1%' : '%2%' isn't a number") % term % value).str());
+            }
+        }
+        if (condition.field.empty())
+        {
+            throw std::runtime_error((boost::format("'%1%' : missing field") % term).str());
+        }
+        this->conditions.push_back(condition);
+    }
+}
+
+SequenceSummary::SequenceSummary(FrameSourcePtr source, const std::string &sidecar_path)
+    : source(source),
+      path(sidecar_path),
+      key(sequence_key(*source)),
+      frames(source->size())
+{
+    this->load_sidecar();
+    for (int i = 0; i < this->size(); ++i)
+    {
+        if (!this->frames[i].done)
+        {
+            this->pending.push_back(i);
+        }
+    }
+    this->n_done = this->size() - int(this->pending.size());
+    this->n_resumed = this->n_done;
+}
+
+SequenceSummary::~SequenceSummary()
+{
+    this->stop();
+}
+
+uint64_t SequenceSummary::sequence_key(const FrameSource &source)
+{
+    uint64_t h = 14695981039346656037ull;
+    uint64_t n = source.size();
+    fnv1a64(h, &n, sizeof(n));
+    for (int i = 0; i < source.size(); ++i)
+    {
+        std::string name = boost::filesystem::path(source.name(i)).filename().string();
+        fnv1a64(h, name.data(), name.size() + 1);
+    }
+    return h;
+}
+
+std::string SequenceSummary::default_sidecar_path(const std::string &pcd_path)
+{
+    namespace bfs = boost::filesystem;
+    bfs::path p(pcd_path);
+    if (bfs::is_directory(p))
+    {
+        return (p / ".cloud_viewer_summary").string();
+    }
+    return (p.parent_path() / ("." + p.filename().string() + ".cloud_viewer_summary")).string();
+}
+
+void SequenceSummary::load_sidecar()
+{
+    if (this->path.empty())
+    {
+        return;
+    }
+    std::ifstream is(this->path, std::ios::binary);
+    if (!is)
+    {
+        return;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    SummaryFileHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kSummaryMagic, sizeof(kSummaryMagic)) != 0 || header.version != kSummaryVersion
+        || header.bins != uint32_t(kSummaryBins) || header.key != this->key || header.frames != this->frames.size())
+    {
+        // Another sequence or format : rewritten from scratch by the first flush.
+        return;
+    }
+
+    size_t offset = sizeof(header);
+    while (data.size() - offset >= 2 * sizeof(uint32_t))
+    {
+        uint32_t payload_bytes, checksum;
+        std::memcpy(&payload_bytes, data.data() + offset, sizeof(uint32_t));
+        std::memcpy(&checksum, data.data() + offset + sizeof(uint32_t), sizeof(uint32_t));
+        const uint8_t *payload = data.data() + offset + 2 * sizeof(uint32_t);
+        if (payload_bytes < sizeof(SummaryRecord) || payload_bytes > data.size() - offset - 2 * sizeof(uint32_t)
+            || fnv1a32(payload, payload_bytes) != checksum)
+        {
+            break;
+        }
+        SummaryRecord record;
+        std::memcpy(&record, payload, sizeof(record));
+        if (record.frame >= this->frames.size())
+        {
+            break;
+        }
+        FrameSummary summary;
+        summary.done = true;
+        summary.loaded = (record.flags & kSummaryLoaded) != 0;
+        summary.has_intensity = (record.flags & kSummaryIntensity) != 0;
+        summary.points = record.points;
+        summary.finite_points = record.finite_points;
+        std::memcpy(summary.min, record.min, sizeof(summary.min));
+        std::memcpy(summary.max, record.max, sizeof(summary.max));
+        std::memcpy(summary.histogram, record.histogram, sizeof(summary.histogram));
+        summary.boxes = record.boxes;
+        summary.load_ms = record.load_ms;
+        summary.annot_ms = record.annot_ms;
+        size_t label_offset = sizeof(record);
+        bool labels_ok = true;
+        for (uint32_t k = 0; k < record.num_labels && labels_ok; ++k)
+        {
+            uint16_t count, length;
+            labels_ok = payload_bytes - label_offset >= 2 * sizeof(uint16_t);
+            if (labels_ok)
+            {
+                std::memcpy(&count, payload + label_offset, sizeof(uint16_t));
+                std::memcpy(&length, payload + label_offset + sizeof(uint16_t), sizeof(uint16_t));
+                label_offset += 2 * sizeof(uint16_t);
+                labels_ok = payload_bytes - label_offset >= length;
+            }
+            if (labels_ok)
+            {
+                std::string label(reinterpret_cast<const char *>(payload + label_offset), length);
+                label_offset += length;
+                summary.labels.emplace_back(this->label_id(label), count);
+            }
+        }
+        if (!labels_ok)
+        {
+            break;
+        }
+        this->frames[record.frame] = std::move(summary);
+        offset += 2 * sizeof(uint32_t) + payload_bytes;
+    }
+    is.close();
+
+    // A record cut short by a crash is dropped, the next ones are appended after the last whole one.
+    boost::system::error_code ec;
+    if (offset < data.size())
+    {
+        boost::filesystem::resize_file(this->path, offset, ec);
+    }
+    if (!ec)
+    {
+        this->sidecar.open(this->path, std::ios::binary | std::ios::app);
+        this->sidecar_bytes = offset;
+    }
+}
+
+uint16_t SequenceSummary::label_id(const std::string &label)
+{
+    auto it = std::find(this->labels.begin(), this->labels.end(), label);
+    if (it != this->labels.end())
+    {
+        return uint16_t(it - this->labels.begin());
+    }
+    if (this->labels.size() >= std::numeric_limits<uint16_t>::max())
+    {
+        // Not a label set any more : everything beyond counts as the last one.
+        return uint16_t(this->labels.size() - 1);
+    }
+    this->labels.push_back(label);
+    return uint16_t(this->labels.size() - 1);
+}
+
+std::string SequenceSummary::label(uint16_t id) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->labels[id];
+}
+
+FrameSummary SequenceSummary::summary(int index) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->frames[index];
+}
+
+void SequenceSummary::start(int threads)
+{
+    if (!this->workers.empty() || this->next >= this->pending.size())
+    {
+        return;
+    }
+    this->stopping = false;
+    this->start_ns = steady_ns();
+    for (int t = 0; t < std::max(threads, 1); ++t)
+    {
+        this->workers.emplace_back([this] { this->work(); });
+    }
+}
+
+void SequenceSummary::stop()
+{
+    this->stopping = true;
+    for (std::thread &worker : this->workers)
+    {
+        worker.join();
+    }
+    this->workers.clear();
+}
+
+void SequenceSummary::work()
+{
+    lower_thread_priority();
+    PointCloudT cloud;
+    std::vector<float> intensity;
+    std::vector<BBox3D> bboxes;
+    std::string records;
+    while (!this->stopping)
+    {
+        size_t k = this->next.fetch_add(1);
+        if (k >= this->pending.size())
+        {
+            break;
+        }
+        int index = this->pending[k];
+        FrameSummary summary;
+        try
+        {
+            this->summarise(index, summary, cloud, intensity, bboxes);
+        }
+        catch (const std::exception &e)
+        {
+            // Recorded as a frame that couldn't be loaded, the pass goes on.
+            std::cerr << "Error : summarising " << this->source->name(index) << " failed : " << e.what() << std::endl;
+            summary = FrameSummary();
+            summary.done = true;
+            bboxes.clear();
+        }
+
+        // The record, labels by name : ids only hold within a run.
+        SummaryRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.frame = index;
+        record.flags = (summary.loaded ? kSummaryLoaded : 0) | (summary.has_intensity ? kSummaryIntensity : 0);
+        record.points = summary.points;
+        record.finite_points = summary.finite_points;
+        std::memcpy(record.min, summary.min, sizeof(record.min));
+        std::memcpy(record.max, summary.max, sizeof(record.max));
+        std::memcpy(record.histogram, summary.histogram, sizeof(record.histogram));
+        record.boxes = summary.boxes;
+        record.load_ms = summary.load_ms;
+        record.annot_ms = summary.annot_ms;
+
+        std::vector<std::pair<std::string, uint16_t>> counts;
+        for (const BBox3D &bbox : bboxes)
+        {
+            std::string label = bbox_label(bbox.id).substr(0, std::numeric_limits<uint16_t>::max());
+            auto it = std::find_if(counts.begin(), counts.end(), [&label](const auto &c) { return c.first == label; });
+            if (it == counts.end())
+            {
+                counts.emplace_back(label, 1);
+            }
+            else if (it->second < std::numeric_limits<uint16_t>::max())
+            {
+                ++it->second;
+            }
+        }
+        record.num_labels = counts.size();
+        std::string payload(reinterpret_cast<const char *>(&record), sizeof(record));
+        for (const auto &count : counts)
+        {
+            uint16_t fields[2] = {count.second, uint16_t(count.first.size())};
+            payload.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+            payload += count.first;
+        }
+        uint32_t framing[2] = {uint32_t(payload.size()), fnv1a32(reinterpret_cast<const uint8_t *>(payload.data()), payload.size())};
+        records.append(reinterpret_cast<const char *>(framing), sizeof(framing));
+        records += payload;
+
+        std::lock_guard<std::mutex> lock(this->mtx);
+        for (const auto &count : counts)
+        {
+            summary.labels.emplace_back(this->label_id(count.first), count.second);
+        }
+        this->frames[index] = std::move(summary);
+        int done = ++this->n_done;
+        if (done == this->size())
+        {
+            this->end_ns = steady_ns();
+        }
+        if (records.size() >= kFlushBytes || done == this->size() || this->stopping)
+        {
+            this->write_records(records);
+        }
+    }
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->write_records(records);
+}
+
+void SequenceSummary::write_records(std::string &records)
+{
+    if (records.empty() || this->path.empty() || this->sidecar_failed)
+    {
+        records.clear();
+        return;
+    }
+    if (!this->sidecar.is_open())
+    {
+        // No usable sidecar yet : start a new one. Creating it changes the mtime of its directory, which would
+        // invalidate the index cache of a pcd directory (see sequence_index.h) on every run while the pass isn't over.
+        namespace bfs = boost::filesystem;
+        std::string dir = bfs::path(this->path).parent_path().string();
+        bool existed = bfs::exists(bfs::path(this->path));
+        int64_t dir_mtime = path_mtime_ns(dir);
+        this->sidecar.open(this->path, std::ios::binary | std::ios::trunc);
+        if (!existed && this->sidecar.is_open())
+        {
+            keep_sequence_index(dir, dir_mtime);
+        }
+        SummaryFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kSummaryMagic, sizeof(kSummaryMagic));
+        header.version = kSummaryVersion;
+        header.bins = kSummaryBins;
+        header.key = this->key;
+        header.frames = this->frames.size();
+        this->sidecar.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        this->sidecar_bytes = sizeof(header);
+    }
+    this->sidecar.write(records.data(), records.size());
+    this->sidecar.flush();
+    if (!this->sidecar)
+    {
+        // Read-only directory : the summaries are kept in memory only.
+        std::cout << "Warning : cannot write the frame summaries to " << this->path << "." << std::endl;
+        this->sidecar_failed = true;
+    }
+    this->sidecar_bytes += records.size();
+    records.clear();
+}
+
+void SequenceSummary::summarise(int index, FrameSummary &summary, PointCloudT &cloud, std::vector<float> &intensity,
+                                std::vector<BBox3D> &bboxes)
+{
+    summary.done = true;
+    bboxes.clear();
+    auto start = std::chrono::steady_clock::now();
+    summary.loaded = this->source->load_cloud(index, cloud, intensity);
+    auto loaded = std::chrono::steady_clock::now();
+    summary.load_ms = std::chrono::duration<float, std::milli>(loaded - start).count();
+    if (!summary.loaded)
+    {
+        return;
+    }
+    this->source->load_bboxes(index, bboxes);
+    summary.annot_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - loaded).count();
+    summary.boxes = bboxes.size();
+
+    size_t n = cloud.size();
+    summary.points = n;
+    summary.has_intensity = !intensity.empty() && intensity.size() == n;
+    this->bytes_loaded += n * (sizeof(PointT) + (summary.has_intensity ? sizeof(float) : 0));
+
+    // Value of each colour source at point i, as apply_color takes them.
+    auto values = [&](size_t i, float v[COLOR_SOURCE_COUNT]) {
+        const PointT &p = cloud.points[i];
+        v[COLOR_SOURCE_X] = p.x;
+        v[COLOR_SOURCE_Y] = p.y;
+        v[COLOR_SOURCE_Z] = p.z;
+        v[COLOR_SOURCE_RANGE] = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        v[COLOR_SOURCE_INTENSITY] = summary.has_intensity ? intensity[i] : p.z;
+    };
+    auto finite = [](const float v[COLOR_SOURCE_COUNT]) {
+        for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+        {
+            if (!std::isfinite(v[s]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    float v[COLOR_SOURCE_COUNT];
+    std::fill(summary.min, summary.min + COLOR_SOURCE_COUNT, std::numeric_limits<float>::max());
+    std::fill(summary.max, summary.max + COLOR_SOURCE_COUNT, std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < n; ++i)
+    {
+        values(i, v);
+        if (!finite(v))
+        {
+            continue;
+        }
+        ++summary.finite_points;
+        for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+        {
+            summary.min[s] = std::min(summary.min[s], v[s]);
+            summary.max[s] = std::max(summary.max[s], v[s]);
+        }
+    }
+    if (summary.finite_points == 0)
+    {
+        std::fill(summary.min, summary.min + COLOR_SOURCE_COUNT, 0.0f);
+        std::fill(summary.max, summary.max + COLOR_SOURCE_COUNT, 0.0f);
+        return;
+    }
+
+    std::vector<uint32_t> counts(COLOR_SOURCE_COUNT * kSummaryBins, 0);
+    float scale[COLOR_SOURCE_COUNT];
+    for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+    {
+        float width = summary.max[s] - summary.min[s];
+        scale[s] = width > 0.0f ? kSummaryBins / width : 0.0f;
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        values(i, v);
+        if (!finite(v))
+        {
+            continue;
+        }
+        for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+        {
+            int bin = std::min(int((v[s] - summary.min[s]) * scale[s]), kSummaryBins - 1);
+            ++counts[s * kSummaryBins + bin];
+        }
+    }
+    for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+    {
+        for (int b = 0; b < kSummaryBins; ++b)
+        {
+            summary.histogram[s][b] = uint16_t(std::lround(double(counts[s * kSummaryBins + b]) * 65535.0 / summary.finite_points));
+        }
+    }
+}
+
+double SequenceSummary::value(const FrameSummary &summary, const std::string &field) const
+{
+    for (int s = 0; s < COLOR_SOURCE_COUNT; ++s)
+    {
+        if (field == kMinFields[s])
+        {
+            return summary.min[s];
+        }
+        if (field == kMaxFields[s])
+        {
+            return summary.max[s];
+        }
+    }
+    if (field == "points")
+    {
+        return double(summary.points);
+    }
+    if (field == "boxes")
+    {
+        return summary.boxes;
+    }
+    if (field == "load_ms")
+    {
+        return summary.load_ms;
+    }
+    // Anything else is a bbox label, counted 0 in the frames without any (see unknown_fields for typos).
+    for (const auto &count : summary.labels)
+    {
+        if (this->labels[count.first] == field)
+        {
+            return count.second;
+        }
+    }
+    return 0.0;
+}
+
+std::vector<std::string> SequenceSummary::unknown_fields(const SummaryQuery &query) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    std::vector<std::string> unknown;
+    for (const SummaryQuery::Condition &condition : query.conditions)
+    {
+        if (!builtin_field(condition.field)
+            && std::find(this->labels.begin(), this->labels.end(), condition.field) == this->labels.end()
+            && std::find(unknown.begin(), unknown.end(), condition.field) == unknown.end())
+        {
+            unknown.push_back(condition.field);
+        }
+    }
+    return unknown;
+}
+
+std::vector<std::string> SequenceSummary::seen_labels() const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    return this->labels;
+}
+
+std::vector<int> SequenceSummary::find(const SummaryQuery &query) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    // Extremes over the summarised frames first.
+    std::vector<double> extreme(query.conditions.size(), 0.0);
+    for (size_t c = 0; c < query.conditions.size(); ++c)
+    {
+        const SummaryQuery::Condition &condition = query.conditions[c];
+        if (condition.op != kQueryMax && condition.op != kQueryMin)
+        {
+            continue;
+        }
+        bool found = false;
+        for (const FrameSummary &summary : this->frames)
+        {
+            if (!summary.loaded)
+            {
+                continue;
+            }
+            double v = this->value(summary, condition.field);
+            extreme[c] = !found ? v : (condition.op == kQueryMax ? std::max(extreme[c], v) : std::min(extreme[c], v));
+            found = true;
+        }
+    }
+
+    std::vector<int> matches;
+    for (int i = 0; i < this->size(); ++i)
+    {
+        const FrameSummary &summary = this->frames[i];
+        if (!summary.loaded)
+        {
+            continue;
+        }
+        bool match = true;
+        for (size_t c = 0; c < query.conditions.size() && match; ++c)
+        {
+            const SummaryQuery::Condition &condition = query.conditions[c];
+            double v = this->value(summary, condition.field);
+            switch (condition.op)
+            {
+            case kQueryLess: match = v < condition.value; break;
+            case kQueryLessEqual: match = v <= condition.value; break;
+            case kQueryGreater: match = v > condition.value; break;
+            case kQueryGreaterEqual: match = v >= condition.value; break;
+            case kQueryEqual: match = v == condition.value; break;
+            case kQueryNotEqual: match = v != condition.value; break;
+            default: match = v == extreme[c]; break;
+            }
+        }
+        if (match)
+        {
+            matches.push_back(i);
+        }
+    }
+    return matches;
+}
+
+bool SequenceSummary::color_range(int source, double lower, double upper, float &min, float &max) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    bool found = false;
+    double total = 0.0;
+    for (const FrameSummary &summary : this->frames)
+    {
+        if (!summary.loaded || summary.finite_points == 0)
+        {
+            continue;
+        }
+        min = found ? std::min(min, summary.min[source]) : summary.min[source];
+        max = found ? std::max(max, summary.max[source]) : summary.max[source];
+        total += double(summary.finite_points);
+        found = true;
+    }
+    if (!found || (lower <= 0.0 && upper >= 1.0) || min == max)
+    {
+        return found;
+    }
+
+    // Every frame bin spread evenly over the merged bins it covers, weighted by the frame's points.
+    std::vector<double> merged(kMergedBins, 0.0);
+    double merged_scale = kMergedBins / (double(max) - double(min));
+    for (const FrameSummary &summary : this->frames)
+    {
+        if (!summary.loaded || summary.finite_points == 0)
+        {
+            continue;
+        }
+        double frame_min = summary.min[source];
+        double bin_width = (double(summary.max[source]) - frame_min) / kSummaryBins;
+        for (int b = 0; b < kSummaryBins; ++b)
+        {
+            double mass = summary.histogram[source][b] / 65535.0 * double(summary.finite_points);
+            if (mass <= 0.0)
+            {
+                continue;
+            }
+            int first = std::min(int((frame_min + b * bin_width - min) * merged_scale), kMergedBins - 1);
+            int last = std::min(int((frame_min + (b + 1) * bin_width - min) * merged_scale), kMergedBins - 1);
+            for (int m = first; m <= last; ++m)
+            {
+                merged[m] += mass / (last - first + 1);
+            }
+        }
+    }
+
+    double bin_width = (double(max) - double(min)) / kMergedBins;
+    double low_mass = lower * total, high_mass = upper * total, seen = 0.0;
+    float range_min = min, range_max = max;
+    bool low_found = false;
+    for (int m = 0; m < kMergedBins; ++m)
+    {
+        seen += merged[m];
+        if (!low_found && seen > low_mass)
+        {
+            range_min = float(min + m * bin_width);
+            low_found = true;
+        }
+        if (seen >= high_mass)
+        {
+            range_max = float(min + (m + 1) * bin_width);
+            break;
+        }
+    }
+    min = range_min;
+    max = std::max(range_max, range_min);
+    return true;
+}
+
+double SequenceSummary::elapsed_s() const
+{
+    if (this->start_ns == 0)
+    {
+        return 0.0;
+    }
+    int64_t end = this->end_ns.load();
+    return ((end != 0 ? end : steady_ns()) - this->start_ns) / 1e9;
+}
+
+void SequenceSummary::print_stats(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    double elapsed = this->elapsed_s();
+    int summarised = this->done() - this->n_resumed;
+    os << "frame summaries : " << this->done() << " / " << this->size() << " frames (" << this->n_resumed
+       << " read from " << (this->path.empty() ? "nowhere" : this->path) << ")";
+    if (summarised > 0 && elapsed > 0.0)
+    {
+        os << ", " << summarised << " summarised in " << elapsed << " s (" << summarised / elapsed << " frames/s, "
+           << this->bytes_loaded / elapsed / 1e6 << " MB/s)";
+    }
+    os << ", sidecar " << this->sidecar_bytes / 1024 << " KB" << std::endl;
+}
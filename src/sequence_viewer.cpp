@@ -1,20 +1,69 @@
 #include "sequence_viewer.h"
 #include "pointcloud_processing.h"
+#include "stage_profiler.h"
 
 SequenceViewer::SequenceViewer(
-    std::string pcd_path, std::string annot_path, std::string cameraparam_path, std::string cameraparam_save_path
+    std::string pcd_path, std::string annot_path, std::string cameraparam_path, std::string cameraparam_save_path,
+    const ViewerOptions &options
 ) : pcd_len(0),
     current_pcd_id(0),
     annot_path(annot_path),
-    cameraparam_save_path(cameraparam_save_path)
+    cameraparam_save_path(cameraparam_save_path),
+    options(options)
 {
-    load_pcd_files(pcd_path);
+    ScopedStageTimer init_timer("init.total");
+    {
+        ScopedStageTimer timer("init.open_source");
+        open_source(pcd_path);
+    }
+
+    if (this->options.global_color_range)
+    {
+        ScopedStageTimer timer("init.color_range");
+        this->compute_global_color_range();
+    }
 
-    cloud.reset(new PointCloudT);
-    load_point_cloud(pcd_files[current_pcd_id]);
-    apply_color(cloud);
+    ScopedStageTimer first_frame_timer("init.first_frame");
+    FramePtr frame = this->provider->get(current_pcd_id);
+    first_frame_timer.stop();
+    if (!frame)
+    {
+        std::string message = (boost::format("Error : cannot load point cloud %1%") % this->provider->name(current_pcd_id)).str();
+        throw std::runtime_error(message);
+    }
+    this->current_frame = frame;
+    this->last_step = std::chrono::steady_clock::now();
+    cloud = frame->cloud;
+    this->print_filter(*frame);
+    this->print_decimation(*frame);
+    if (accumulation_enabled(this->options.accumulation))
+    {
+        ScopedStageTimer timer("init.accumulate");
+        this->accumulator.reset(new FrameAccumulator(*(this->provider), this->options.accumulation));
+        int fetched = this->accumulator->advance(frame);
+        cloud = this->accumulator->cloud();
+        this->print_accumulation(fetched);
+    }
+    if (this->options.diff.enabled)
+    {
+        ScopedStageTimer timer("init.diff");
+        this->diff.reset(new TemporalDiff(*(this->provider), this->options.diff));
+        this->diff->advance(frame);
+        cloud = this->diff->cloud();
+        this->print_diff();
+    }
 
-    viewer.reset(new pcl::visualization::PCLVisualizer("3D Viewer"));
+    ScopedStageTimer viewer_timer("init.viewer");
+    if (this->options.offscreen)
+    {
+        // No interactor : frames are only rendered to images by export_frames().
+        viewer.reset(new pcl::visualization::PCLVisualizer("3D Viewer", false));
+        viewer->getRenderWindow()->SetOffScreenRendering(1);
+    }
+    else
+    {
+        viewer.reset(new pcl::visualization::PCLVisualizer("3D Viewer"));
+    }
     viewer->setBackgroundColor(1.0, 1.0, 1.0);
     viewer->addPointCloud<PointT>(cloud, "cloud");
     viewer->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 3, "cloud");
@@ -24,70 +73,101 @@ SequenceViewer::SequenceViewer(
         load_camerapose(cameraparam_path);
     }
 
-    load_annot_json(pcd_files[current_pcd_id]);
-    viewer->addText(pcd_files[current_pcd_id], 0, 0, 0, 0, 0, "file_name");
+    this->bbox_overlay.reset(new BBoxOverlay(*viewer, this->options.bbox_labels));
+    this->bboxes = frame->bboxes;
+    this->show_bboxes();
+    viewer->addText(frame->pcd_file, 0, 0, 0, 0, 0, "file_name");
+    viewer->addText("", 0, 15, 0, 0, 0, "pick_info");
+    viewer_timer.stop();
 
-    viewer->registerKeyboardCallback(keyboardEventOccurred, (void *)this);
-    viewer->registerPointPickingCallback(pointPickingEventOccured, (void*)this); 
-}
-
-void SequenceViewer::load_pcd_files(const std::string pcd_path)
-{
-    namespace bfs = boost::filesystem;
+    if (!this->options.offscreen)
+    {
+        viewer->registerKeyboardCallback(keyboardEventOccurred, (void *)this);
+        viewer->registerPointPickingCallback(pointPickingEventOccured, (void*)this); 
 
-    int file_check;
-    std::string file_ext;
-    bfs::path bfs_p(pcd_path);
+        this->playback.reset(new PlaybackScheduler(*(this->provider), this->options.play_fps));
+        if (this->options.autoplay)
+        {
+            this->toggle_playback();
+        }
+    }
 
-    if (pcd_path.empty() or !bfs::exists(bfs_p))
+    if (this->summary)
     {
-        std::string message = (boost::format("An argument 'pcd_path : %1%' is empty or doesn't exist!") % pcd_path).str();
-        throw std::runtime_error(message);
+        int threads = this->options.summary_threads > 0 ? this->options.summary_threads
+                                                        : int(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        this->summary->start(std::max(threads, 1));
+        this->report_summary_if_complete();
     }
+}
 
-    if (bfs::is_directory(bfs_p))
+void SequenceViewer::open_source(const std::string pcd_path)
+{
+    if (!this->options.live.empty())
     {
-        std::string pcd_file;
-        bfs::directory_iterator end_itr;
+        this->open_live_source();
+        return;
+    }
+    FrameSourcePtr source = open_frame_source(pcd_path, this->annot_path);
+    this->pcd_len = source->size();
 
-        for (bfs::directory_iterator itr(bfs_p); itr != end_itr; ++itr)
-        {
-            if (bfs::is_regular_file(itr->path()))
-            {
-                pcd_file = itr->path().string();
-                file_ext = bfs::extension(pcd_file);
-                file_check = (file_ext == ".pcd");
-                if (file_check)
-                {
-                    std::cout << pcd_file << " is detected." << std::endl;
-                    this->pcd_files.push_back(pcd_file);
-                }
-            }
-        }
-        std::sort(this->pcd_files.begin(), this->pcd_files.end());
+    FramePipelineConfig pipeline;
+    pipeline.color = this->options.color;
+    pipeline.filter = this->options.filter;
+    pipeline.decimation = this->options.decimation;
+    FrameProviderOptions provider_options;
+    if (this->options.offscreen)
+    {
+        // Export walks the sequence once in order : decode ahead only, a cache would never be hit.
+        provider_options = sequential_provider_options(this->options.prefetch_threads, pipeline);
+        provider_options.prefetch_ahead = std::max(this->options.prefetch_window, provider_options.prefetch_ahead);
     }
     else
     {
-        file_ext = bfs::extension(pcd_path);
-        file_check = (file_ext == ".pcd");
-        if (file_check)
-        {
-            std::cout << pcd_path << " is detected." << std::endl;
-            this->pcd_files.push_back(pcd_path);
-        }
+        provider_options.prefetch_ahead = this->options.prefetch_window;
+        provider_options.prefetch_behind = this->options.prefetch_window;
+        provider_options.threads = this->options.prefetch_threads;
+        provider_options.cache_bytes = size_t(std::max(this->options.cache_mb, 0)) * 1024 * 1024;
+        provider_options.cache_codec = this->options.cache_codec;
+        provider_options.pipeline = pipeline;
     }
+    this->provider.reset(new FrameProvider(source, provider_options));
 
-    this->pcd_len = this->pcd_files.size();
+    // The frames summarised by earlier runs are read now, the others once the viewer is up (export reads every
+    // frame anyway).
+    if (this->options.summary && !this->options.offscreen)
+    {
+        ScopedStageTimer timer("init.summary");
+        this->summary.reset(new SequenceSummary(source, SequenceSummary::default_sidecar_path(pcd_path)));
+    }
 }
 
-void SequenceViewer::load_point_cloud(const std::string pcd_file_path)
+void SequenceViewer::open_live_source()
 {
-    int load_status = pcl::io::loadPCDFile(pcd_file_path, *(this->cloud));
-    if (load_status != 0)
+    // The viewer starts on the first frame : wait for the producer.
+    this->live.reset(new LiveFrameSource(this->options.live));
+    bool waiting = false;
+    while (!this->live->take())
     {
-        std::string message = (boost::format("Error : cannot load point cloud %1%") % pcd_file_path).str();
-        throw std::runtime_error(message);
+        if (!waiting)
+        {
+            std::cout << "waiting for the live feed " << this->options.live << "..." << std::endl;
+            waiting = true;
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
     }
+    std::cout << "live feed " << this->options.live << " connected." << std::endl;
+    this->pcd_len = 1;
+
+    // Frame 0 is replaced by every take() : loaded on demand, never cached nor decoded ahead.
+    FrameProviderOptions provider_options;
+    provider_options.prefetch_ahead = 0;
+    provider_options.prefetch_behind = 0;
+    provider_options.cache_bytes = 0;
+    provider_options.pipeline.color = this->options.color;
+    provider_options.pipeline.filter = this->options.filter;
+    provider_options.pipeline.decimation = this->options.decimation;
+    this->provider.reset(new FrameProvider(this->live, provider_options));
 }
 
 void SequenceViewer::update_cloud(int pcd_id)
@@ -103,89 +183,604 @@ void SequenceViewer::update_cloud(int pcd_id)
             pcd_id = pcd_id % this->pcd_len;
         }
 
+        ScopedStageTimer step_timer("step.total");
         this->current_pcd_id = pcd_id;
-        std::string pcd_file = this->pcd_files[pcd_id];
+        std::string pcd_file = this->provider->name(pcd_id);
         std::cout << "toggle cloud shown to : " << pcd_file << std::endl;
 
-        int load_status(0);
-        PointCloudT::Ptr cloud_tmp(new PointCloudT);
-        load_status = pcl::io::loadPCDFile(pcd_file, *cloud_tmp);
-
-        if (load_status != 0)
+        FramePtr frame = this->fetch_frame(pcd_id);
+        if (!frame)
         {
             std::cerr << "Error : cannot load point cloud " << pcd_file << std::endl;
         }
         else
         {
-            apply_color(cloud_tmp);
-            pcl::copyPointCloud(*cloud_tmp, *(this->cloud));
-            this->viewer->updatePointCloud(this->cloud, "cloud");
-            this->viewer->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 3, "cloud");
-
-            // this->viewer->removeShape("center");
-            this->viewer->removeAllShapes();
-            this->load_annot_json(pcd_file);
-            this->viewer->addText(this->pcd_files[pcd_id], 0, 0, 0, 0, 0, "file_name");
+            this->show_frame(frame);
+            if (this->playback && this->playback->playing())
+            {
+                // Stepping while playing : playback carries on from the new frame.
+                this->playback->seek(pcd_id, this->last_step);
+            }
         }
     }
 }
 
-void SequenceViewer::load_annot_json(std::string pcd_file_path)
+FramePtr SequenceViewer::fetch_frame(int pcd_id)
 {
-    namespace bfs = boost::filesystem;
+    // Cache, prefetch ring or synchronous load, recoloured for the current colour config (see FrameProvider::get).
+    ScopedStageTimer fetch_timer("step.fetch");
+    return this->provider->get(pcd_id);
+}
+
+void SequenceViewer::show_frame(const FramePtr &frame)
+{
+    this->current_frame = frame;
+
+    // The frame's cloud is shown as is : no copy, the previous cloud goes back to the pool once nothing holds it.
+    // A decimated frame is shown at its reduced resolution until stepping stops (see refine_if_idle).
+    // When accumulating, the merged cloud of the window ending on the frame is shown instead, and with the
+    // temporal diff, a copy coloured by distance to the previous frame.
+    this->cloud = frame->cloud;
+    this->showing_full = false;
+    this->last_step = std::chrono::steady_clock::now();
+    int fetched = 0;
+    if (this->accumulator)
+    {
+        ScopedStageTimer timer("show.accumulate");
+        fetched = this->accumulator->advance(frame);
+        this->cloud = this->accumulator->cloud();
+    }
+    if (this->diff)
+    {
+        ScopedStageTimer timer("show.diff");
+        this->diff->advance(frame);
+        this->cloud = this->diff->cloud();
+    }
+    ScopedStageTimer upload_timer("show.upload");
+    this->viewer->updatePointCloud(this->cloud, "cloud");
+    this->viewer->setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 3, "cloud");
+    upload_timer.stop();
+    this->print_filter(*frame);
+    this->print_decimation(*frame);
+    this->print_accumulation(fetched);
+    this->print_diff();
+
+    // The bbox actor and the file name text are updated in place rather than removed and re-added.
+    ScopedStageTimer bboxes_timer("show.bboxes");
+    this->bboxes = frame->bboxes;
+    this->show_bboxes();
+    this->viewer->updateText(frame->pcd_file, 0, 0, 0, 0, 0, "file_name");
+    this->viewer->updateText("", 0, 15, 0, 0, 0, "pick_info");
+    bboxes_timer.stop();
+
+    if (stage_profiler().enabled() && !this->options.offscreen)
+    {
+        // The window is otherwise only redrawn by the next spinOnce, along with event handling.
+        // Export times its own render.
+        ScopedStageTimer timer("show.render");
+        this->viewer->getRenderWindow()->Render();
+    }
+}
+
+void SequenceViewer::show_full_resolution()
+{
+    if (this->showing_full || !this->current_frame->full_cloud || this->accumulator || this->diff)
+    {
+        return;
+    }
+    ScopedStageTimer refine_timer("refine.total");
+    this->provider->update_full_color(*(this->current_frame));
+    this->cloud = this->current_frame->full_cloud;
+    this->viewer->updatePointCloud(this->cloud, "cloud");
+    this->showing_full = true;
+    double elapsed = refine_timer.stop();
+    std::cout << "refined to full resolution : " << this->cloud->size() << " points (" << elapsed << " ms)" << std::endl;
+}
+
+bool SequenceViewer::refine_pending() const
+{
+    // The merged cloud of an accumulation window is built from the decimated clouds, it isn't refined, nor is
+    // the diff of the shown points.
+    return !this->showing_full && this->current_frame->full_cloud && this->options.refine_delay_ms >= 0 && !this->accumulator
+        && !this->diff;
+}
 
-    std::string annot_p = this->annot_path;
-    bfs::path bfs_annot_p (annot_p);
+void SequenceViewer::refine_if_idle()
+{
+    if (!this->refine_pending())
+    {
+        return;
+    }
+    if (std::chrono::steady_clock::now() - this->last_step >= std::chrono::milliseconds(this->options.refine_delay_ms))
+    {
+        this->show_full_resolution();
+    }
+}
+
+void SequenceViewer::toggle_playback()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (this->playback->playing())
+    {
+        this->playback->pause();
+        std::cout << "playback paused." << std::endl;
+        this->playback->print_stats(std::cout, now);
+    }
+    else if (this->pcd_len == 1)
+    {
+        std::cout << "The number of loaded .pcd files is 1. There is nothing to play." << std::endl;
+    }
+    else
+    {
+        this->playback->play(this->current_pcd_id, now);
+        std::cout << "playing at " << this->playback->fps() << " fps." << std::endl;
+    }
+}
 
-    this->bboxes.clear();
+void SequenceViewer::change_playback_rate(double factor)
+{
+    this->playback->set_fps(this->playback->fps() * factor, std::chrono::steady_clock::now());
+    std::cout << "playback rate : " << this->playback->fps() << " fps." << std::endl;
+}
 
-    if (!annot_p.empty())
+void SequenceViewer::play_if_due()
+{
+    if (!this->playback || !this->playback->playing())
     {
-        if (!bfs::exists(bfs_annot_p))
+        return;
+    }
+    int pcd_id;
+    FramePtr frame;
+    {
+        ScopedStageTimer timer("play.fetch");
+        frame = this->playback->tick(std::chrono::steady_clock::now(), pcd_id);
+    }
+    if (frame)
+    {
+        ScopedStageTimer timer("play.show");
+        this->current_pcd_id = pcd_id;
+        this->show_frame(frame);
+    }
+}
+
+void SequenceViewer::show_live_if_new()
+{
+    if (!this->live || !this->live->take())
+    {
+        return;
+    }
+    FramePtr frame;
+    {
+        ScopedStageTimer timer("live.fetch");
+        frame = this->provider->get(0);
+    }
+    if (frame)
+    {
+        ScopedStageTimer timer("live.show");
+        this->show_frame(frame);
+        this->live_drawn_pending = true;
+    }
+}
+
+int SequenceViewer::spin_timeout_ms() const
+{
+    // Events are handled as soon as they come in spinOnce(), the timeout only bounds how late the next due
+    // frame / the refinement can be.
+    auto now = std::chrono::steady_clock::now();
+    // A live feed is polled : this bounds the latency it adds.
+    auto wake = now + std::chrono::milliseconds(this->live ? 2 : 100);
+    if (this->playback && this->playback->playing())
+    {
+        wake = std::min(wake, this->playback->next_due());
+    }
+    else if (this->refine_pending())
+    {
+        wake = std::min(wake, this->last_step + std::chrono::milliseconds(this->options.refine_delay_ms));
+    }
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+    return int(std::max<long long>(timeout, 1));
+}
+
+void SequenceViewer::print_filter(const Frame &frame)
+{
+    if (frame.filter.input == 0 && frame.filter.bboxes_dropped == 0)
+    {
+        return;
+    }
+    const FilterStats &stats = frame.filter;
+    std::cout << "filtered";
+    if (stats.input > 0)
+    {
+        std::cout << " " << stats.input << " -> " << stats.kept() << " points (dropped";
+        for (int s = 0; s < FILTER_STAGE_COUNT; ++s)
         {
-            std::cout << (boost::format("Warning : annotaion path '%1%' does not exist.") % annot_p).str() << std::endl;
+            std::cout << " " << filter_stage_name(s) << " " << stats.dropped[s];
         }
-        else 
-        {
-            bool ret = false;
+        std::cout << ") in " << frame.filter_ms << " ms";
+    }
+    if (stats.bboxes_dropped > 0)
+    {
+        std::cout << ", " << stats.bboxes_dropped << " bboxes hidden by label";
+    }
+    std::cout << std::endl;
+}
 
-            if (bfs::is_directory(bfs_annot_p)) 
-            {
-                std::string file_name = bfs::path(pcd_file_path).stem().string();
-                std::string annot_file =  (bfs_annot_p / (file_name + ".json")).string();
-                std::cout << "loading : " << annot_file << std::endl;
+void SequenceViewer::print_decimation(const Frame &frame)
+{
+    if (!frame.full_cloud)
+    {
+        return;
+    }
+    size_t full_points = frame.full_cloud->size();
+    std::cout << "decimated " << full_points << " -> " << frame.cloud->size() << " points ("
+              << (full_points > 0 ? 100.0 * frame.cloud->size() / full_points : 0.0) << " %) : load " << frame.load_ms
+              << " ms, decimate " << frame.decimate_ms << " ms, colour " << frame.color_ms << " ms" << std::endl;
+}
 
-                ret = load_annot(annot_file, this->bboxes);
-            } 
-            else if (bfs_annot_p.extension().string() == ".json")
-            {
-                ret = load_annot(annot_p, this->bboxes);
-            }
+void SequenceViewer::print_accumulation(int fetched)
+{
+    if (!this->accumulator)
+    {
+        return;
+    }
+    std::cout << "accumulated " << this->accumulator->frames() << " frames (" << fetched << " fetched) : "
+              << this->cloud->size() << " points, merged in " << this->accumulator->merge_ms() << " ms" << std::endl;
+    if (this->accumulator->frames_without_pose() > 0)
+    {
+        std::cout << "Warning : " << this->accumulator->frames_without_pose()
+                  << " accumulated frames have no Lidar pose, overlaid without transformation." << std::endl;
+    }
+}
 
-            if (!ret)
-            {
-                std::cout << (boost::format("Warning : annotaion path '%1%' was skipped.") % annot_p).str() << std::endl;
-                std::cout << "check file format." << std::endl;
-            }
+void SequenceViewer::print_diff()
+{
+    if (!this->diff)
+    {
+        return;
+    }
+    if (!this->diff->compared())
+    {
+        std::cout << "temporal diff : no previous frame to compare " << this->current_frame->pcd_file << " with." << std::endl;
+        return;
+    }
+    const TemporalDiffConfig &config = this->diff->config();
+    std::cout << "diff against frame " << this->diff->previous_index() << " : " << this->diff->dynamic_points() << " / "
+              << this->cloud->size() << " points ";
+    if (config.threshold > 0.0f)
+    {
+        std::cout << "dynamic (> " << config.threshold << " m)";
+    }
+    else
+    {
+        std::cout << "without neighbour within " << config.max_distance << " m";
+    }
+    std::cout << ", mean distance " << this->diff->mean_distance() << " m, grid built in " << this->diff->build_ms()
+              << " ms, queried and coloured in " << this->diff->query_ms() << " ms" << std::endl;
+    if (config.use_pose && !this->diff->posed())
+    {
+        std::cout << "Warning : this frame or the previous one has no Lidar pose, compared without transformation." << std::endl;
+    }
+}
 
-            for (BBox3D bbox : this->bboxes) 
-            {
-                // if (bbox.id.find("person") != std::string::npos)
-                // {
-                //     std::cout << "load-bbox : " << bbox.id << std::endl;
-                //     showBBox3D(bbox);
-                // }
-                std::cout << "load-bbox : " << bbox.id << " : " << std::endl;
-                std::cout << "    (x, y, z) = (" << bbox.translation.x() << "," << bbox.translation.y() << "," << bbox.translation.z() << ")" << std::endl;
-                std::cout << "    (w, h, d) = (" << bbox.width << "," << bbox.height << "," << bbox.depth << ")" << std::endl;
-                std::cout << "    (w, x, y, z) = (" << bbox.rotation.w() << "," << bbox.rotation.x() << "," << bbox.rotation.y() << "," << bbox.rotation.z() << ")" << std::endl;
-                this->showBBox3D(bbox);
-                std::cout << "loaded" << std::endl;
-            }
+void SequenceViewer::compute_global_color_range()
+{
+    auto start = std::chrono::steady_clock::now();
+    ColorConfig color = this->provider->pipeline().color;
+    float min, max;
+    if (this->summary_color_range(color, 0.0, 1.0, min, max))
+    {
+        std::cout << "global colour range [" << min << ", " << max << "] read from the summaries of " << this->pcd_len
+                  << " frames" << std::endl;
+    }
+    else if (!this->provider->compute_color_range(color, min, max))
+    {
+        std::cout << "Warning : global colour range could not be computed, using per-frame range." << std::endl;
+        return;
+    }
+    else
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "global colour range [" << min << ", " << max << "] computed over " << this->pcd_len
+                  << " frames in " << elapsed << " s" << std::endl;
+    }
+
+    this->global_color_range_valid = true;
+    this->global_color_range_source = color.source;
+    this->global_color_min = min;
+    this->global_color_max = max;
+    color.fixed_range = true;
+    color.range_min = min;
+    color.range_max = max;
+    this->provider->set_color(color);
+}
+
+bool SequenceViewer::summary_color_range(const ColorConfig &color, double lower, double upper, float &min, float &max)
+{
+    // The summaries are of the frames as loaded : of no use once filters drop points.
+    if (!this->summary || !this->summary->complete() || point_filter_enabled(this->options.filter))
+    {
+        return false;
+    }
+    return this->summary->color_range(color.source, lower, upper, min, max);
+}
+
+void SequenceViewer::set_color_config(const ColorConfig &color)
+{
+    this->provider->set_color(color);
+
+    // Only the frame in memory is recoloured, the others are when they get fetched.
+    ScopedStageTimer recolor_timer("color.recolor");
+    this->provider->update_color(*(this->current_frame));
+    if (this->showing_full)
+    {
+        this->provider->update_full_color(*(this->current_frame));
+    }
+    if (this->accumulator)
+    {
+        this->accumulator->recolor();
+    }
+    if (this->diff)
+    {
+        this->diff->recolor();
+    }
+    this->viewer->updatePointCloud(this->cloud, "cloud");
+    double elapsed = recolor_timer.stop();
+
+    static const char *source_names[COLOR_SOURCE_COUNT] = {"x", "y", "z", "range", "intensity"};
+    std::cout << "colour : source " << source_names[color.source] << ", colormap " << color.color_mode << ", range ";
+    if (color.fixed_range)
+    {
+        std::cout << "fixed [" << color.range_min << ", " << color.range_max << "]";
+    }
+    else
+    {
+        std::cout << "per-frame";
+    }
+    std::cout << " (recoloured in " << elapsed << " ms)" << std::endl;
+    if (color.source == COLOR_SOURCE_INTENSITY && this->current_frame->intensity.empty())
+    {
+        std::cout << "Warning : " << this->current_frame->pcd_file << " has no intensity field, coloured along z." << std::endl;
+    }
+}
+
+void SequenceViewer::cycle_color_source()
+{
+    ColorConfig color = this->provider->pipeline().color;
+    color.source = (color.source + 1) % COLOR_SOURCE_COUNT;
+    if (color.fixed_range)
+    {
+        // A fixed range is only meaningful for the source it was computed on.
+        color.fixed_range = false;
+        std::cout << "colour source changed, back to per-frame range." << std::endl;
+    }
+    this->set_color_config(color);
+}
+
+void SequenceViewer::cycle_color_mode()
+{
+    ColorConfig color = this->provider->pipeline().color;
+    color.color_mode = (color.color_mode + 1) % kColorModeCount;
+    this->set_color_config(color);
+}
+
+void SequenceViewer::toggle_fixed_color_range()
+{
+    ColorConfig color = this->provider->pipeline().color;
+    if (color.fixed_range)
+    {
+        color.fixed_range = false;
+    }
+    else if (this->global_color_range_valid && this->global_color_range_source == color.source)
+    {
+        color.fixed_range = true;
+        color.range_min = this->global_color_min;
+        color.range_max = this->global_color_max;
+    }
+    else if (this->summary_color_range(color, 0.0, 1.0, color.range_min, color.range_max))
+    {
+        // The range of the whole sequence, once the summary pass is over.
+        color.fixed_range = true;
+    }
+    else
+    {
+        // Freeze the range of the frame currently shown (not of the merged cloud when accumulating).
+        const Frame &frame = *(this->current_frame);
+        const PointCloudT &frame_cloud = this->showing_full ? *(frame.full_cloud) : *(frame.cloud);
+        const std::vector<float> &intensity = this->showing_full ? frame.full_intensity : frame.intensity;
+        float min, max;
+        if (!color_value_range(frame_cloud, color, &intensity, min, max))
+        {
+            return;
+        }
+        color.fixed_range = true;
+        color.range_min = min;
+        color.range_max = max;
+    }
+    this->set_color_config(color);
+}
+
+void SequenceViewer::jump_to_match(int direction)
+{
+    if (!this->summary)
+    {
+        std::cout << "frame queries need the summary pass (disabled by --no_summary)." << std::endl;
+        return;
+    }
+    if (this->options.find.empty())
+    {
+        std::cout << "no frame query : give one with --find, e.g. --find 'boxes>=20' or --find max:points." << std::endl;
+        return;
+    }
+    SummaryQuery query(this->options.find);
+    // Before the pass is over, a field may still be the label of a frame not summarised yet.
+    std::vector<std::string> unknown = this->summary->unknown_fields(query);
+    if (!unknown.empty() && this->summary->complete())
+    {
+        std::cout << "unknown field '" << unknown.front() << "' in '" << this->options.find
+                  << "' : expected points, boxes, xmin, xmax, ymin, ymax, zmin, zmax, range, imin, imax, load_ms or a bbox label (";
+        std::vector<std::string> labels = this->summary->seen_labels();
+        for (size_t i = 0; i < labels.size(); ++i)
+        {
+            std::cout << (i > 0 ? ", " : "") << labels[i];
         }
+        std::cout << (labels.empty() ? "none in this sequence)." : ").") << std::endl;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> matches = this->summary->find(query);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::string scope = this->summary->complete()
+        ? std::string()
+        : (boost::format(" (%1% / %2% frames summarised so far%3%)") % this->summary->done() % this->summary->size()
+           % (unknown.empty() ? std::string() : ", '" + unknown.front() + "' isn't a field nor a label seen yet")).str();
+    if (matches.empty())
+    {
+        std::cout << "no frame matches '" << this->options.find << "'" << scope << "." << std::endl;
+        return;
+    }
+    // Next match after the shown frame (before it going back), wrapping around.
+    auto it = direction > 0 ? std::upper_bound(matches.begin(), matches.end(), this->current_pcd_id)
+                            : std::lower_bound(matches.begin(), matches.end(), this->current_pcd_id);
+    int target;
+    if (direction > 0)
+    {
+        target = it == matches.end() ? matches.front() : *it;
+    }
+    else
+    {
+        target = it == matches.begin() ? matches.back() : *(it - 1);
+    }
+    std::cout << matches.size() << " frames match '" << this->options.find << "'" << scope << " (queried in " << elapsed
+              << " ms), frame " << target << " : ";
+    FrameSummary summary = this->summary->summary(target);
+    std::cout << summary.points << " points, " << summary.boxes << " bboxes, z [" << summary.min[COLOR_SOURCE_Z] << ", "
+              << summary.max[COLOR_SOURCE_Z] << "]" << std::endl;
+    if (target != this->current_pcd_id)
+    {
+        this->update_cloud(target);
     }
 }
 
+void SequenceViewer::report_summary_if_complete()
+{
+    if (!this->summary || this->summary_reported || !this->summary->complete())
+    {
+        return;
+    }
+    this->summary_reported = true;
+    this->summary->print_stats(std::cout);
+    if (this->options.robust_color_range)
+    {
+        // Per-frame ranges until the pass is over.
+        ColorConfig color = this->provider->pipeline().color;
+        float min, max;
+        if (this->summary_color_range(color, 0.01, 0.99, min, max))
+        {
+            std::cout << "robust colour range [" << min << ", " << max << "] : 1st to 99th percentile of the points of "
+                      << this->pcd_len << " frames" << std::endl;
+            color.fixed_range = true;
+            color.range_min = min;
+            color.range_max = max;
+            this->set_color_config(color);
+        }
+        else
+        {
+            std::cout << "Warning : robust colour range could not be computed, using per-frame range." << std::endl;
+        }
+    }
+}
+
+void SequenceViewer::toggle_diff()
+{
+    if (this->accumulator)
+    {
+        std::cout << "temporal diff isn't available with --accumulate." << std::endl;
+        return;
+    }
+    if (this->diff)
+    {
+        this->diff.reset();
+        this->cloud = this->current_frame->cloud;
+        std::cout << "temporal diff off." << std::endl;
+    }
+    else
+    {
+        ScopedStageTimer timer("show.diff");
+        TemporalDiffConfig config = this->options.diff;
+        config.enabled = true;
+        this->diff.reset(new TemporalDiff(*(this->provider), config));
+        this->diff->advance(this->current_frame);
+        this->cloud = this->diff->cloud();
+        timer.stop();
+        this->print_diff();
+    }
+    this->showing_full = false;
+    this->last_step = std::chrono::steady_clock::now();
+    this->viewer->updatePointCloud(this->cloud, "cloud");
+}
+
+void SequenceViewer::show_bboxes()
+{
+    const BBoxChanges &changes = this->bbox_overlay->update(this->bboxes);
+    if (!this->bboxes.empty() || !changes.removed.empty())
+    {
+        // Boxes moved to the slot of a removed one are only rewritten, their labels aren't touched.
+        std::cout << "loaded " << this->bboxes.size() << " bboxes : " << changes.added.size() << " added, "
+                  << changes.updated.size() << " updated, " << changes.removed.size() << " removed, "
+                  << changes.unchanged + changes.relocated.size() << " unchanged" << std::endl;
+    }
+}
+
+void SequenceViewer::show_pick(float x, float y, float z)
+{
+    // Built on the first pick of the frame and kept with it and its cache entry.
+    std::shared_ptr<const FrameSpatialIndex> index;
+    {
+        ScopedStageTimer timer("pick.index");
+        index = this->provider->spatial_index(this->current_frame);
+    }
+    ScopedStageTimer query_timer("pick.query");
+    Eigen::Vector3f point(x, y, z);
+    int box = index->find_box(point);
+    size_t box_points = (box >= 0) ? index->count_points_in_box(box) : 0;
+    std::vector<std::pair<uint32_t, float>> nearest = index->nearest_points(point, 5, 1.0f);
+    double elapsed = query_timer.stop();
+
+    std::ostringstream text;
+    text << "(" << x << ", " << y << ", " << z << ")";
+    if (box >= 0)
+    {
+        text << " in " << this->current_frame->bboxes[box].id << " : " << box_points << " points";
+    }
+    std::cout << "picked " << text.str() << std::endl;
+    std::cout << "nearest points :";
+    for (const std::pair<uint32_t, float> &entry : nearest)
+    {
+        std::cout << " " << entry.first << " (" << entry.second << " m)";
+    }
+    std::cout << std::endl << "pick query : " << elapsed << " ms (index built in " << index->build_ms() << " ms)" << std::endl;
+    this->viewer->updateText(text.str(), 0, 15, 0, 0, 0, "pick_info");
+}
+
+void SequenceViewer::print_box_counts()
+{
+    const Frame &frame = *(this->current_frame);
+    if (frame.bboxes.empty())
+    {
+        std::cout << "no bbox in " << frame.pcd_file << std::endl;
+        return;
+    }
+    std::shared_ptr<const FrameSpatialIndex> index = this->provider->spatial_index(this->current_frame);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<size_t> counts = index->count_points_in_boxes();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        std::cout << frame.bboxes[i].id << " : " << counts[i] << " points" << std::endl;
+    }
+    std::cout << "points counted in " << counts.size() << " bboxes in " << elapsed << " ms" << std::endl;
+}
+
 void SequenceViewer::save_camerapose()
 {
     this->viewer->saveCameraParameters(this->cameraparam_save_path);
@@ -209,18 +804,159 @@ void SequenceViewer::save_screenshot()
     std::cout << "camera pose file was saved to 'screenshot_pcl_viewer.png'" << std::endl;
 }
 
-void SequenceViewer::showBBox3D(const BBox3D &bbox)
+void SequenceViewer::print_stats()
 {
-    this->viewer->addCube(bbox.translation, bbox.rotation, bbox.width, bbox.depth, bbox.height, bbox.id);
-    this->viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_REPRESENTATION, pcl::visualization::PCL_VISUALIZER_REPRESENTATION_WIREFRAME, bbox.id);
-    this->viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1.0, 0.0, 0.0, bbox.id);
-    this->viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_LINE_WIDTH, 2, bbox.id);
+    this->provider->print_stats(std::cout);
+    if (this->accumulator)
+    {
+        this->accumulator->print_stats(std::cout);
+    }
+    if (this->diff)
+    {
+        this->diff->print_stats(std::cout);
+    }
+    if (this->playback && this->playback->shown() > 0)
+    {
+        this->playback->print_stats(std::cout, std::chrono::steady_clock::now());
+    }
+    if (this->live)
+    {
+        this->live->print_stats(std::cout);
+    }
+    if (this->summary)
+    {
+        this->summary->print_stats(std::cout);
+    }
+}
+
+int SequenceViewer::export_frames(const std::string &output_dir, const std::string &format)
+{
+    namespace bfs = boost::filesystem;
+
+    if (pcd_len == 0)
+    {
+        std::cout << "Point cloud doesn't exist in given path." << std::endl;
+        return 1;
+    }
+    if (format != "png" && format != "raw")
+    {
+        std::cerr << "Error : unknown export format '" << format << "', expected 'png' or 'raw'." << std::endl;
+        return 1;
+    }
+    try
+    {
+        bfs::create_directories(bfs::path(output_dir));
+    }
+    catch (const bfs::filesystem_error &e)
+    {
+        std::cerr << "Error : cannot create export directory " << output_dir << " : " << e.what() << std::endl;
+        return 1;
+    }
+
+    vtkSmartPointer<vtkRenderWindow> render_window = this->viewer->getRenderWindow();
+    vtkSmartPointer<vtkWindowToImageFilter> window_to_image = vtkSmartPointer<vtkWindowToImageFilter>::New();
+    window_to_image->SetInput(render_window);
+    window_to_image->SetInputBufferTypeToRGB();
+    window_to_image->ReadFrontBufferOff();
+    vtkSmartPointer<vtkPNGWriter> png_writer = vtkSmartPointer<vtkPNGWriter>::New();
+    png_writer->SetInputConnection(window_to_image->GetOutputPort());
+
+    std::string raw_path = (bfs::path(output_dir) / "frames.rgb").string();
+    std::ofstream raw_stream;
+    if (format == "raw")
+    {
+        raw_stream.open(raw_path, std::ios::binary);
+        if (!raw_stream)
+        {
+            std::cerr << "Error : cannot open " << raw_path << " for writing." << std::endl;
+            return 1;
+        }
+    }
+
+    int width = 0, height = 0, exported = 0;
+    std::vector<unsigned char> row_flipped;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int pcd_id = 0; pcd_id < this->pcd_len; ++pcd_id)
+    {
+        // Frame 0 is already shown by the constructor.
+        if (pcd_id > 0)
+        {
+            FramePtr frame = this->fetch_frame(pcd_id);
+            if (!frame)
+            {
+                std::cerr << "Error : cannot load point cloud " << this->provider->name(pcd_id) << ", skipped." << std::endl;
+                continue;
+            }
+            this->current_pcd_id = pcd_id;
+            this->show_frame(frame);
+        }
+
+        ScopedStageTimer render_timer("export.render");
+        render_window->Render();
+        window_to_image->Modified();
+        window_to_image->Update();
+        render_timer.stop();
+
+        ScopedStageTimer write_timer("export.write");
+        if (format == "png")
+        {
+            std::string file_name = (boost::format("frame_%06d.png") % pcd_id).str();
+            std::string png_path = (bfs::path(output_dir) / file_name).string();
+            png_writer->SetFileName(png_path.c_str());
+            png_writer->Write();
+            if (png_writer->GetErrorCode() != vtkErrorCode::NoError)
+            {
+                std::cerr << "Error : cannot write " << png_path << " ("
+                          << vtkErrorCode::GetStringFromErrorCode(png_writer->GetErrorCode()) << "), export stopped after "
+                          << exported << " frames." << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            // VTK images start at the bottom row, raw video tools expect the top row first.
+            vtkImageData *image = window_to_image->GetOutput();
+            int *dims = image->GetDimensions();
+            width = dims[0];
+            height = dims[1];
+            size_t row_bytes = size_t(width) * 3;
+            const unsigned char *pixels = static_cast<const unsigned char *>(image->GetScalarPointer());
+            row_flipped.resize(row_bytes * height);
+            for (int y = 0; y < height; ++y)
+            {
+                std::copy(pixels + (height - 1 - y) * row_bytes, pixels + (height - y) * row_bytes, row_flipped.begin() + y * row_bytes);
+            }
+            raw_stream.write(reinterpret_cast<const char *>(row_flipped.data()), row_flipped.size());
+            if (!raw_stream)
+            {
+                std::cerr << "Error : cannot write to " << raw_path << ", export stopped after " << exported
+                          << " frames." << std::endl;
+                return 1;
+            }
+        }
+        ++exported;
+    }
+
+    if (raw_stream.is_open())
+    {
+        raw_stream.close();
+        if (!raw_stream)
+        {
+            std::cerr << "Error : cannot write to " << raw_path << "." << std::endl;
+            return 1;
+        }
+    }
 
-    std::string s = bbox.id + "_text";
-    PointT trans(bbox.translation(0), bbox.translation(1), bbox.translation(2), 0, 0, 0);
-    Eigen::Vector3f text_euler = bbox.rotation.toRotationMatrix().eulerAngles(0, 1, 2);
-    double angle[3] = {(double)text_euler(0), (double)text_euler(1), (double)text_euler(2)};
-    this->viewer->addText3D<PointT>(bbox.id, trans, angle, 1.0, 1.0, 1.0, 1.0, s);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "exported " << exported << " frames to " << output_dir << " in " << elapsed << " s ("
+              << (elapsed > 0 ? exported / elapsed : 0.0) << " fps)" << std::endl;
+    if (format == "raw")
+    {
+        std::cout << "raw stream : " << raw_path << " (rgb24, " << width << "x" << height << ")" << std::endl;
+    }
+    this->print_stats();
+    return 0;
 }
 
 int SequenceViewer::run()
@@ -232,9 +968,26 @@ int SequenceViewer::run()
     }
     while (!viewer->wasStopped())
     {
-        viewer->spinOnce(100);
-        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        int timeout_ms = this->spin_timeout_ms();
+        auto spin_start = std::chrono::steady_clock::now();
+        viewer->spinOnce(timeout_ms);
+        if (std::chrono::steady_clock::now() - spin_start < std::chrono::milliseconds(1))
+        {
+            // spinOnce() is throttled to the interactor's update rate and returns at once when called sooner.
+            boost::this_thread::sleep(boost::posix_time::milliseconds(std::min(timeout_ms, 5)));
+        }
+        if (this->live_drawn_pending)
+        {
+            // spinOnce() drew the live frame uploaded last.
+            this->live->record_shown();
+            this->live_drawn_pending = false;
+        }
+        this->show_live_if_new();
+        this->play_if_due();
+        this->refine_if_idle();
+        this->report_summary_if_complete();
     }
+    this->print_stats();
     return 0;
 }
 
@@ -261,6 +1014,51 @@ void keyboardEventOccurred(const pcl::visualization::KeyboardEvent &event, void
     {
         seq_viewer->save_screenshot();
     }
+    else if (event.getKeySym() == "a" && event.keyDown())
+    {
+        seq_viewer->cycle_color_source();
+    }
+    else if (event.getKeySym() == "y" && event.keyDown())
+    {
+        // Not m : unhandled keys go on to vtkInteractorStyle::OnChar, where m toggles the animation state.
+        seq_viewer->cycle_color_mode();
+    }
+    else if (event.getKeySym() == "n" && event.keyDown())
+    {
+        seq_viewer->toggle_fixed_color_range();
+    }
+    else if (event.getKeySym() == "d" && event.keyDown())
+    {
+        seq_viewer->toggle_diff();
+    }
+    else if (event.getKeySym() == "v" && event.keyDown())
+    {
+        seq_viewer->jump_to_match(1);
+    }
+    else if (event.getKeySym() == "V" && event.keyDown())
+    {
+        seq_viewer->jump_to_match(-1);
+    }
+    else if (event.getKeySym() == "k" && event.keyDown())
+    {
+        seq_viewer->print_stats();
+    }
+    else if (event.getKeySym() == "b" && event.keyDown())
+    {
+        seq_viewer->print_box_counts();
+    }
+    else if (event.getKeySym() == "space" && event.keyDown())
+    {
+        seq_viewer->toggle_playback();
+    }
+    else if (event.getKeySym() == "bracketright" && event.keyDown())
+    {
+        seq_viewer->change_playback_rate(2.0);
+    }
+    else if (event.getKeySym() == "bracketleft" && event.keyDown())
+    {
+        seq_viewer->change_playback_rate(0.5);
+    }
 }
 
 void pointPickingEventOccured(const pcl::visualization::PointPickingEvent& event, void *viewer_void)
@@ -270,5 +1068,5 @@ void pointPickingEventOccured(const pcl::visualization::PointPickingEvent& event
     float x,y,z;
     std::cout << event.getPointIndex() << std::endl;
     event.getPoint(x,y,z);
-    std::cout << "("<<x<<","<<y<<","<<z<<")" << std::endl; 
+    seq_viewer->show_pick(x, y, z);
 }
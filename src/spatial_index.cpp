@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+#include "frame.h"
+#include "parallel.h"
+#include "spatial_index.h"
+#include "stage_profiler.h"
+
+
+uint64_t PointGrid::key(int64_t x, int64_t y, int64_t z)
+{
+    // 21 bits per axis, offset so that negative voxels stay positive : +-2^20 voxels from the origin.
+    const int64_t offset = int64_t(1) << 20;
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    return (uint64_t(x + offset) & mask) | ((uint64_t(y + offset) & mask) << 21) | ((uint64_t(z + offset) & mask) << 42);
+}
+
+Eigen::Array3i PointGrid::cell_of(const Eigen::Vector3f &p) const
+{
+    return (p.array() / this->cell).floor().cast<int>();
+}
+
+PointGrid::PointGrid(const PointCloudT &cloud, float cell_size)
+    : cell(cell_size > 0.0f ? cell_size : FrameSpatialIndex::kDefaultCellSize),
+      min_cell(Eigen::Array3i::Zero()),
+      max_cell(Eigen::Array3i::Zero())
+{
+    size_t n = cloud.size();
+    std::vector<std::pair<uint64_t, uint32_t>> keyed(n);
+    std::vector<char> finite(n);
+    parallel_for(n, 65536, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud.points[i];
+            finite[i] = std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+            if (finite[i])
+            {
+                Eigen::Array3i c = this->cell_of(Eigen::Vector3f(p.x, p.y, p.z));
+                keyed[i] = {key(c(0), c(1), c(2)), uint32_t(i)};
+            }
+        }
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (finite[i])
+        {
+            keyed[kept++] = keyed[i];
+        }
+    }
+    keyed.resize(kept);
+    std::sort(keyed.begin(), keyed.end());
+
+    this->order.resize(kept);
+    this->xyz.resize(3 * kept);
+    this->runs.reserve(kept / 4 + 1);
+    Run *run = nullptr;
+    for (size_t i = 0; i < kept; ++i)
+    {
+        const PointT &p = cloud.points[keyed[i].second];
+        this->order[i] = keyed[i].second;
+        this->xyz[3 * i] = p.x;
+        this->xyz[3 * i + 1] = p.y;
+        this->xyz[3 * i + 2] = p.z;
+
+        Eigen::Array3i c = this->cell_of(Eigen::Vector3f(p.x, p.y, p.z));
+        if (i == 0)
+        {
+            this->min_cell = this->max_cell = c;
+        }
+        else
+        {
+            this->min_cell = this->min_cell.min(c);
+            this->max_cell = this->max_cell.max(c);
+        }
+        if (i == 0 || keyed[i].first != keyed[i - 1].first)
+        {
+            run = &(this->runs[keyed[i].first]);
+            run->begin = uint32_t(i);
+        }
+        run->end = uint32_t(i + 1);
+    }
+}
+
+size_t PointGrid::size_bytes() const
+{
+    // Node size of the hash map is an estimate : key, value and next pointer, plus one bucket pointer.
+    return this->order.capacity() * sizeof(uint32_t) + this->xyz.capacity() * sizeof(float)
+        + this->runs.size() * (sizeof(uint64_t) + sizeof(Run) + 2 * sizeof(void *));
+}
+
+void PointGrid::nearest(const Eigen::Vector3f &point, size_t k, float max_distance,
+                        std::vector<std::pair<uint32_t, float>> &result) const
+{
+    result.clear();
+    if (k == 0 || this->order.empty() || !point.allFinite())
+    {
+        return;
+    }
+    float max_squared = max_distance * max_distance;
+
+    // Grow a cube of voxels around the point until the k-th nearest candidate is closer than any point
+    // outside the cube could be.
+    for (int radius = 1;; ++radius)
+    {
+        // Every point within `reach` of the point is in a voxel overlapping the cube.
+        float reach = radius * this->cell;
+        Eigen::Vector3f extent = Eigen::Vector3f::Constant(reach);
+        result.clear();
+        this->for_each_candidate(point - extent, point + extent, [&](uint32_t index, const Eigen::Map<const Eigen::Vector3f> &p) {
+            float d = (p - point).squaredNorm();
+            if (d <= max_squared)
+            {
+                result.emplace_back(index, d);
+            }
+        });
+        bool enough = result.size() >= k;
+        if (enough)
+        {
+            std::nth_element(result.begin(), result.begin() + (k - 1), result.end(),
+                             [](const std::pair<uint32_t, float> &a, const std::pair<uint32_t, float> &b) { return a.second < b.second; });
+            enough = result[k - 1].second <= reach * reach;
+        }
+        bool whole_grid = (this->cell_of(point - extent) <= this->min_cell).all() && (this->cell_of(point + extent) >= this->max_cell).all();
+        if (enough || reach >= max_distance || whole_grid)
+        {
+            break;
+        }
+    }
+    std::sort(result.begin(), result.end(),
+              [](const std::pair<uint32_t, float> &a, const std::pair<uint32_t, float> &b) { return a.second < b.second; });
+    if (result.size() > k)
+    {
+        result.resize(k);
+    }
+}
+
+BoxBVH::BoxBVH(const std::vector<BBox3D> &bboxes)
+{
+    this->boxes.resize(bboxes.size());
+    for (size_t i = 0; i < bboxes.size(); ++i)
+    {
+        const BBox3D &bbox = bboxes[i];
+        Box &box = this->boxes[i];
+        box.rotation = bbox.rotation.toRotationMatrix();
+        box.center = bbox.translation;
+        box.half = Eigen::Vector3f(0.5f * bbox.width, 0.5f * bbox.depth, 0.5f * bbox.height);
+        Eigen::Vector3f reach = box.rotation.cwiseAbs() * box.half;
+        box.min = box.center - reach;
+        box.max = box.center + reach;
+    }
+    this->box_order.resize(this->boxes.size());
+    for (size_t i = 0; i < this->box_order.size(); ++i)
+    {
+        this->box_order[i] = int(i);
+    }
+    if (!this->boxes.empty())
+    {
+        this->nodes.reserve(2 * this->boxes.size());
+        this->build(0, int(this->boxes.size()));
+    }
+}
+
+int BoxBVH::build(int begin, int end)
+{
+    const int kLeafSize = 4;
+
+    int node_index = int(this->nodes.size());
+    this->nodes.push_back(Node());
+    Eigen::Vector3f min = this->boxes[this->box_order[begin]].min;
+    Eigen::Vector3f max = this->boxes[this->box_order[begin]].max;
+    for (int i = begin + 1; i < end; ++i)
+    {
+        min = min.cwiseMin(this->boxes[this->box_order[i]].min);
+        max = max.cwiseMax(this->boxes[this->box_order[i]].max);
+    }
+
+    Node node{min, max, -1, -1, begin, end};
+    if (end - begin > kLeafSize)
+    {
+        // Median split of the box centres along the longest axis.
+        int axis;
+        (max - min).maxCoeff(&axis);
+        int middle = begin + (end - begin) / 2;
+        std::nth_element(this->box_order.begin() + begin, this->box_order.begin() + middle, this->box_order.begin() + end,
+                         [&](int a, int b) { return this->boxes[a].center(axis) < this->boxes[b].center(axis); });
+        node.left = this->build(begin, middle);
+        node.right = this->build(middle, end);
+    }
+    this->nodes[node_index] = node;
+    return node_index;
+}
+
+size_t BoxBVH::size_bytes() const
+{
+    return this->boxes.capacity() * sizeof(Box) + this->box_order.capacity() * sizeof(int) + this->nodes.capacity() * sizeof(Node);
+}
+
+bool BoxBVH::contains(int index, const Eigen::Vector3f &point) const
+{
+    const Box &box = this->boxes[index];
+    Eigen::Vector3f local = box.rotation.transpose() * (point - box.center);
+    return (local.cwiseAbs().array() <= box.half.array()).all();
+}
+
+void BoxBVH::bounds(int index, Eigen::Vector3f &min, Eigen::Vector3f &max) const
+{
+    min = this->boxes[index].min;
+    max = this->boxes[index].max;
+}
+
+float BoxBVH::volume(int index) const
+{
+    return 8.0f * this->boxes[index].half.prod();
+}
+
+template <typename F>
+bool BoxBVH::visit_containing(const Eigen::Vector3f &point, F &&f) const
+{
+    if (this->nodes.empty())
+    {
+        return false;
+    }
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node &node = this->nodes[stack[--top]];
+        if ((point.array() < node.min.array()).any() || (point.array() > node.max.array()).any())
+        {
+            continue;
+        }
+        if (node.left < 0)
+        {
+            for (int i = node.begin; i < node.end; ++i)
+            {
+                if (this->contains(this->box_order[i], point) && f(this->box_order[i]))
+                {
+                    return true;
+                }
+            }
+            continue;
+        }
+        // Median splits keep the depth at log2(boxes), far below the stack size.
+        stack[top++] = node.left;
+        stack[top++] = node.right;
+    }
+    return false;
+}
+
+void BoxBVH::boxes_containing(const Eigen::Vector3f &point, std::vector<int> &result) const
+{
+    result.clear();
+    this->visit_containing(point, [&result](int box) {
+        result.push_back(box);
+        return false;
+    });
+}
+
+bool BoxBVH::any_contains(const Eigen::Vector3f &point) const
+{
+    return this->visit_containing(point, [](int) { return true; });
+}
+
+FrameSpatialIndex::FrameSpatialIndex(const PointCloudT &cloud, const std::vector<BBox3D> &bboxes, float cell_size)
+    : grid(cloud, cell_size),
+      bvh(bboxes)
+{
+}
+
+size_t FrameSpatialIndex::count_points_in_box(int box) const
+{
+    Eigen::Vector3f min, max;
+    this->bvh.bounds(box, min, max);
+    size_t count = 0;
+    this->grid.for_each_candidate(min, max, [&](uint32_t, const Eigen::Map<const Eigen::Vector3f> &p) {
+        count += this->bvh.contains(box, p);
+    });
+    return count;
+}
+
+std::vector<size_t> FrameSpatialIndex::count_points_in_boxes() const
+{
+    ScopedStageTimer timer("spatial.count_in_boxes");
+    std::vector<size_t> counts(this->bvh.size());
+    parallel_for(counts.size(), 8, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            counts[i] = this->count_points_in_box(int(i));
+        }
+    });
+    return counts;
+}
+
+int FrameSpatialIndex::find_box(const Eigen::Vector3f &point) const
+{
+    std::vector<int> found;
+    this->bvh.boxes_containing(point, found);
+    int best = -1;
+    for (int box : found)
+    {
+        if (best < 0 || this->bvh.volume(box) < this->bvh.volume(best) || (this->bvh.volume(box) == this->bvh.volume(best) && box < best))
+        {
+            best = box;
+        }
+    }
+    return best;
+}
+
+std::vector<std::pair<uint32_t, float>> FrameSpatialIndex::nearest_points(const Eigen::Vector3f &point, size_t k, float max_distance) const
+{
+    std::vector<std::pair<uint32_t, float>> result;
+    this->grid.nearest(point, k, max_distance, result);
+    for (std::pair<uint32_t, float> &entry : result)
+    {
+        entry.second = std::sqrt(entry.second);
+    }
+    return result;
+}
+
+std::shared_ptr<const FrameSpatialIndex> frame_spatial_index(Frame &frame)
+{
+    // Frames are shared between the viewer, the cache and the prefetch ring : one lock for all of them,
+    // indices are only built on user queries.
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!frame.spatial_index)
+    {
+        ScopedStageTimer timer("spatial.build");
+        const PointCloudT &cloud = frame.full_cloud ? *(frame.full_cloud) : *(frame.cloud);
+        std::shared_ptr<FrameSpatialIndex> index(new FrameSpatialIndex(cloud, frame.bboxes));
+        index->build_time_ms = timer.stop();
+        frame.spatial_index = index;
+    }
+    return frame.spatial_index;
+}
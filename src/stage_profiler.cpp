@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <thread>
+#include <boost/filesystem.hpp>
+
+#include "stage_profiler.h"
+
+
+void DurationHistogram::add(double ms)
+{
+    // Bucket 0 holds everything under 1 us, bucket i > 0 the durations under 2^(i / 8) us.
+    double us = ms * 1e3;
+    int bucket = 0;
+    if (us >= 1.0)
+    {
+        bucket = std::min(kBuckets - 1, 1 + int(std::floor(std::log2(us) * kBucketsPerOctave)));
+    }
+    ++this->buckets[bucket];
+    ++this->n;
+    this->sum += ms;
+    this->maximum = std::max(this->maximum, ms);
+}
+
+double DurationHistogram::percentile(double p) const
+{
+    if (this->n == 0)
+    {
+        return 0.0;
+    }
+    size_t rank = std::max<size_t>(1, size_t(std::ceil(p * this->n)));
+    size_t seen = 0;
+    for (int bucket = 0; bucket < kBuckets; ++bucket)
+    {
+        seen += this->buckets[bucket];
+        if (seen >= rank)
+        {
+            double upper_us = std::exp2(double(bucket) / kBucketsPerOctave);
+            return std::min(upper_us * 1e-3, this->maximum);
+        }
+    }
+    return this->maximum;
+}
+
+void StageProfiler::record(const char *stage, double ms)
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    auto it = this->stages.find(stage);
+    if (it == this->stages.end())
+    {
+        it = this->stages.emplace(stage, DurationHistogram()).first;
+    }
+    it->second.add(ms);
+}
+
+void StageProfiler::clear()
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->stages.clear();
+}
+
+void StageProfiler::write_json(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    os << "{\"threads\":" << std::thread::hardware_concurrency() << ",\"unit\":\"ms\",\"stages\":[";
+    bool first = true;
+    for (const auto &stage : this->stages)
+    {
+        const DurationHistogram &h = stage.second;
+        os << (first ? "" : ",") << "\n  {\"stage\":\"" << stage.first << "\",\"count\":" << h.count()
+           << ",\"mean\":" << h.mean() << ",\"p50\":" << h.percentile(0.5) << ",\"p95\":" << h.percentile(0.95)
+           << ",\"max\":" << h.max() << ",\"total\":" << h.total() << "}";
+        first = false;
+    }
+    os << "\n]}" << std::endl;
+}
+
+void StageProfiler::write_csv(std::ostream &os) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    os << "stage,count,mean_ms,p50_ms,p95_ms,max_ms,total_ms" << std::endl;
+    for (const auto &stage : this->stages)
+    {
+        const DurationHistogram &h = stage.second;
+        os << stage.first << "," << h.count() << "," << h.mean() << "," << h.percentile(0.5) << ","
+           << h.percentile(0.95) << "," << h.max() << "," << h.total() << std::endl;
+    }
+}
+
+bool StageProfiler::write(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    if (boost::filesystem::path(path).extension() == ".csv")
+    {
+        this->write_csv(file);
+    }
+    else
+    {
+        this->write_json(file);
+    }
+    return bool(file);
+}
+
+StageProfiler &stage_profiler()
+{
+    static StageProfiler profiler;
+    return profiler;
+}
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "parallel.h"
+#include "stage_profiler.h"
+#include "temporal_diff.h"
+
+
+namespace
+{
+
+// Nearest-neighbour queries cost much more than a copy, smaller chunks still pay for a thread.
+const size_t kMinQueryChunk = 16384;
+const size_t kMinBuildChunk = 65536;
+const uint32_t kNoBucket = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+
+NeighborGrid::NeighborGrid(const PointCloudT &cloud, float max_distance)
+    : radius(std::max(max_distance, 1e-4f)),
+      inv_cell(1.0f / this->radius)
+{
+    size_t n = cloud.size();
+    uint32_t num_buckets = 1;
+    while (num_buckets < n && num_buckets < (1u << 30))
+    {
+        num_buckets <<= 1;
+    }
+    this->mask = num_buckets - 1;
+
+    // Bucket of every point on all cores, then a counting sort : counts, prefix sums, scatter.
+    std::vector<uint32_t> ids(n);
+    parallel_for(n, kMinBuildChunk, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = cloud.points[i];
+            if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+            {
+                ids[i] = this->bucket(int64_t(std::floor(p.x * this->inv_cell)), int64_t(std::floor(p.y * this->inv_cell)),
+                                      int64_t(std::floor(p.z * this->inv_cell)));
+            }
+            else
+            {
+                ids[i] = kNoBucket;
+            }
+        }
+    });
+
+    this->bucket_start.assign(size_t(num_buckets) + 1, 0);
+    size_t finite = 0;
+    for (uint32_t id : ids)
+    {
+        if (id != kNoBucket)
+        {
+            ++this->bucket_start[id + 1];
+            ++finite;
+        }
+    }
+    this->occupied.assign((size_t(num_buckets) + 63) / 64, 0);
+    for (size_t b = 0; b < num_buckets; ++b)
+    {
+        if (this->bucket_start[b + 1] > 0)
+        {
+            this->occupied[b >> 6] |= uint64_t(1) << (b & 63);
+        }
+        this->bucket_start[b + 1] += this->bucket_start[b];
+    }
+    this->xyz.resize(finite);
+    std::vector<uint32_t> cursor(this->bucket_start.begin(), this->bucket_start.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (ids[i] != kNoBucket)
+        {
+            this->xyz[cursor[ids[i]]++] = cloud.points[i].getVector3fMap();
+        }
+    }
+}
+
+uint32_t NeighborGrid::bucket(int64_t ix, int64_t iy, int64_t iz) const
+{
+    uint64_t h = (uint64_t(ix) * 73856093ull) ^ (uint64_t(iy) * 19349663ull) ^ (uint64_t(iz) * 83492791ull);
+    // The xor of the three products leaves neighbouring cells in neighbouring buckets, mix before masking.
+    h *= 0x9e3779b97f4a7c15ull;
+    return uint32_t(h >> 32) & this->mask;
+}
+
+float NeighborGrid::nearest_distance(const Eigen::Vector3f &p) const
+{
+    Eigen::Vector3f scaled = p * this->inv_cell;
+    if (this->xyz.empty() || !scaled.allFinite())
+    {
+        return this->radius;
+    }
+    Eigen::Vector3f cell = scaled.array().floor();
+    int64_t ix = int64_t(cell.x()), iy = int64_t(cell.y()), iz = int64_t(cell.z());
+
+    // Squared distance from p to the cell before / the same / the cell after along each axis.
+    Eigen::Vector3f below = (scaled - cell) * this->radius;
+    Eigen::Vector3f above = Eigen::Vector3f::Constant(this->radius) - below;
+    float gap2[3][3];
+    for (int a = 0; a < 3; ++a)
+    {
+        gap2[a][0] = below(a) * below(a);
+        gap2[a][1] = 0.0f;
+        gap2[a][2] = above(a) * above(a);
+    }
+
+    float best2 = this->radius * this->radius;
+    auto scan = [&](uint32_t b) {
+        if (!(this->occupied[b >> 6] & (uint64_t(1) << (b & 63))))
+        {
+            return;
+        }
+        for (uint32_t k = this->bucket_start[b]; k < this->bucket_start[b + 1]; ++k)
+        {
+            best2 = std::min(best2, (this->xyz[k] - p).squaredNorm());
+        }
+    };
+
+    // Own cell first, the neighbours are then skipped as soon as they can't hold a closer point.
+    scan(this->bucket(ix, iy, iz));
+    for (int dz = 0; dz < 3; ++dz)
+    {
+        for (int dy = 0; dy < 3; ++dy)
+        {
+            for (int dx = 0; dx < 3; ++dx)
+            {
+                if ((dx == 1 && dy == 1 && dz == 1) || gap2[0][dx] + gap2[1][dy] + gap2[2][dz] >= best2)
+                {
+                    continue;
+                }
+                scan(this->bucket(ix + dx - 1, iy + dy - 1, iz + dz - 1));
+            }
+        }
+    }
+    return std::sqrt(best2);
+}
+
+size_t NeighborGrid::size_bytes() const
+{
+    return this->bucket_start.capacity() * sizeof(uint32_t) + this->occupied.capacity() * sizeof(uint64_t)
+        + this->xyz.capacity() * sizeof(Eigen::Vector3f);
+}
+
+TemporalDiff::TemporalDiff(FrameProvider &provider, const TemporalDiffConfig &config)
+    : provider(provider),
+      settings(config),
+      diffed(new PointCloudT)
+{
+}
+
+bool TemporalDiff::advance(const FramePtr &frame)
+{
+    ScopedStageTimer timer("diff.advance");
+    int previous = frame->index - 1;
+    this->last_build_ms = 0.0;
+    if (previous >= 0 && this->grid_index == previous)
+    {
+        ++this->n_reused;
+    }
+    else if (previous >= 0)
+    {
+        FramePtr source = (this->last && this->last->index == previous) ? this->last : FramePtr();
+        if (!source)
+        {
+            source = this->provider.get(previous);
+            ++this->n_fetched;
+            // Fetching the previous frame re-targeted prefetching around it.
+            this->provider.recenter(frame->index);
+        }
+        if (source)
+        {
+            ScopedStageTimer build_timer("diff.build");
+            // A decimated previous frame is searched at full resolution, its holes would read as change.
+            const PointCloudT &reference = source->full_cloud ? *(source->full_cloud) : *(source->cloud);
+            this->grid = NeighborGrid(reference, this->settings.max_distance);
+            this->grid_index = previous;
+            this->grid_pose = source->pose;
+            this->last_build_ms = build_timer.stop();
+            ++this->n_built;
+        }
+        else
+        {
+            this->grid = NeighborGrid();
+            this->grid_index = -1;
+        }
+    }
+    this->last = frame;
+    this->has_previous = previous >= 0 && this->grid_index == previous;
+
+    ScopedStageTimer query_timer("diff.query");
+    const PointCloudT &input = *(frame->cloud);
+    PointCloudT &output = *(this->diffed);
+    size_t n = input.size();
+    output.resize(n);
+    output.width = input.width;
+    output.height = input.height;
+    output.is_dense = input.is_dense;
+    this->distance.assign(n, 0.0f);
+    bool thresholded = this->settings.threshold > 0.0f;
+    this->classes.resize(thresholded ? n : 0);
+
+    // Points of the new frame -> world -> lidar frame of the previous one.
+    this->pose_applied = this->has_previous && this->settings.use_pose && frame->pose.valid && this->grid_pose.valid;
+    Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity();
+    Eigen::Vector3f translation = Eigen::Vector3f::Zero();
+    if (this->pose_applied)
+    {
+        Eigen::Quaternionf previous_inv = this->grid_pose.rotation.inverse();
+        rotation = (previous_inv * frame->pose.rotation).toRotationMatrix();
+        translation = previous_inv * (frame->pose.translation - this->grid_pose.translation);
+    }
+
+    size_t num_chunks = parallel_num_chunks(n, kMinQueryChunk);
+    std::vector<double> chunk_sum(num_chunks, 0.0);
+    std::vector<size_t> chunk_dynamic(num_chunks, 0);
+    float dynamic_above = thresholded ? this->settings.threshold : this->grid.max_distance();
+    parallel_for(n, kMinQueryChunk, [&](size_t begin, size_t end, size_t chunk) {
+        double sum = 0.0;
+        size_t dynamic = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointT &p = input.points[i];
+            output.points[i] = p;
+            if (!this->has_previous)
+            {
+                continue;
+            }
+            Eigen::Vector3f v = p.getVector3fMap();
+            float d = this->grid.nearest_distance(this->pose_applied ? Eigen::Vector3f(rotation * v + translation) : v);
+            this->distance[i] = d;
+            sum += d;
+            bool is_dynamic = thresholded ? d > dynamic_above : d >= dynamic_above;
+            dynamic += is_dynamic;
+            if (thresholded)
+            {
+                this->classes[i] = is_dynamic ? 1.0f : 0.0f;
+            }
+        }
+        chunk_sum[chunk] = sum;
+        chunk_dynamic[chunk] = dynamic;
+    });
+    double sum = 0.0;
+    this->n_dynamic = 0;
+    for (size_t c = 0; c < num_chunks; ++c)
+    {
+        sum += chunk_sum[c];
+        this->n_dynamic += chunk_dynamic[c];
+    }
+    this->mean = (this->has_previous && n > 0) ? float(sum / n) : 0.0f;
+
+    if (this->has_previous)
+    {
+        this->colorize();
+    }
+    this->last_query_ms = query_timer.stop();
+    return this->has_previous;
+}
+
+void TemporalDiff::recolor()
+{
+    if (this->has_previous)
+    {
+        this->colorize();
+        return;
+    }
+    if (this->last && this->last->cloud->size() == this->diffed->size())
+    {
+        // Nothing to compare with : the frame's own colours, refreshed by the provider.
+        this->provider.update_color(*(this->last));
+        for (size_t i = 0; i < this->diffed->size(); ++i)
+        {
+            this->diffed->points[i].rgba = this->last->cloud->points[i].rgba;
+        }
+    }
+}
+
+void TemporalDiff::colorize()
+{
+    ScopedStageTimer timer("diff.color");
+    ColorConfig color;
+    color.source = COLOR_SOURCE_INTENSITY;
+    color.fixed_range = true;
+    color.range_min = 0.0f;
+    if (this->settings.threshold > 0.0f)
+    {
+        // 0 : static -> grey, 1 : dynamic -> red.
+        color.color_mode = 3;
+        color.range_max = 1.0f;
+        apply_color(this->diffed, color, &(this->classes));
+    }
+    else
+    {
+        color.color_mode = this->provider.pipeline().color.color_mode;
+        color.range_max = this->grid.max_distance();
+        apply_color(this->diffed, color, &(this->distance));
+    }
+}
+
+void TemporalDiff::print_stats(std::ostream &os) const
+{
+    os << "temporal diff : " << this->n_built << " grids built, " << this->n_reused << " reused, " << this->n_fetched
+       << " previous frames fetched, last build " << this->last_build_ms << " ms, last query " << this->last_query_ms
+       << " ms, grid " << this->grid.size_bytes() / 1024 << " KB" << std::endl;
+}
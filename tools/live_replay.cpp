@@ -0,0 +1,144 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <boost/program_options.hpp>
+
+#include "frame_source.h"
+#include "live_feed.h"
+
+
+namespace
+{
+
+std::atomic<bool> interrupted(false);
+
+void on_interrupt(int)
+{
+    interrupted = true;
+}
+
+} // namespace
+
+
+// Publishes the frames of a directory of .pcd files (or a .seq file) to a live ring at a fixed rate, as a sensor
+// driver would : `cloud_viewer --live NAME` shows them as they come.
+int main(int argc, char *argv[])
+{
+    namespace bops = boost::program_options;
+
+    bops::options_description description("options");
+    description.add_options()
+        ("help,h", "show help")
+        ("pcd_path,",
+        bops::value<std::string>(),
+        "path to pcd file, directory in which pcd files exist, or .seq file")
+        ("annotation_path,",
+        bops::value<std::string>()->default_value(""),
+        "path to directory in which annotation files exist")
+        ("name,",
+        bops::value<std::string>()->default_value("cloud_viewer"),
+        "shared memory ring to publish to, as given to cloud_viewer --live")
+        ("fps,",
+        bops::value<double>()->default_value(10.0),
+        "frames published per second")
+        ("loop,",
+        "start over after the last frame until interrupted")
+        ("slot_mb,",
+        bops::value<int>()->default_value(64),
+        "size of a frame slot in MB, frames larger than this are skipped");
+
+    bops::variables_map vm;
+    try
+    {
+        bops::store(bops::parse_command_line(argc, argv, description), vm);
+        bops::notify(vm);
+    }
+    catch (const bops::error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help") || !vm.count("pcd_path"))
+    {
+        std::cout << "usage:\n"
+                  << argv[0] << " --pcd_path [path/to/pcd_directory] --annotation_path [path/to/json_directory] --fps 10" << std::endl;
+        std::cout << description << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+    double fps = vm["fps"].as<double>();
+    if (!(fps > 0.0))
+    {
+        std::cerr << "An argument 'fps : " << fps << "' is out of range." << std::endl;
+        return 1;
+    }
+    if (vm["slot_mb"].as<int>() <= 0)
+    {
+        std::cerr << "An argument 'slot_mb : " << vm["slot_mb"].as<int>() << "' is out of range." << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        FrameSourcePtr source = open_frame_source(vm["pcd_path"].as<std::string>(), vm["annotation_path"].as<std::string>());
+        if (source->size() == 0)
+        {
+            std::cerr << "Point cloud doesn't exist in given path." << std::endl;
+            return 1;
+        }
+        LiveFrameWriter writer(vm["name"].as<std::string>(), size_t(vm["slot_mb"].as<int>()) * 1024 * 1024);
+        std::signal(SIGINT, on_interrupt);
+        std::signal(SIGTERM, on_interrupt);
+        std::cout << "publishing " << source->size() << " frames to " << vm["name"].as<std::string>() << " at " << fps
+                  << " fps." << std::endl;
+
+        // Frames are due on a fixed schedule : a slow load delays one frame, not all the ones after it.
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+        auto start = std::chrono::steady_clock::now();
+        auto due = start;
+        PointCloudT cloud;
+        std::vector<float> intensity;
+        std::vector<BBox3D> bboxes;
+        LidarPose pose;
+        size_t skipped = 0;
+        bool loop = vm.count("loop") > 0;
+        do
+        {
+            for (int i = 0; i < source->size() && !interrupted; ++i)
+            {
+                std::this_thread::sleep_until(due);
+                due += period;
+                if (!source->load_cloud(i, cloud, intensity))
+                {
+                    std::cerr << "Warning : cannot load point cloud " << source->name(i) << ", skipped." << std::endl;
+                    ++skipped;
+                    continue;
+                }
+                source->load_bboxes(i, bboxes, &pose);
+                if (!writer.publish(cloud, intensity, bboxes, pose, source->name(i), live_clock_ns()))
+                {
+                    std::cerr << "Warning : " << source->name(i) << " doesn't fit in a " << writer.slot_bytes()
+                              << " bytes slot, skipped." << std::endl;
+                    ++skipped;
+                }
+            }
+        } while (loop && !interrupted);
+        // The last frame gets its period too, for the achieved rate.
+        std::this_thread::sleep_until(due);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "published " << writer.published() << " frames in " << elapsed << " s ("
+                  << (elapsed > 0 ? writer.published() / elapsed : 0.0) << " fps), " << writer.overwritten()
+                  << " overwritten before the viewer took them, " << skipped << " skipped." << std::endl;
+        return 0;
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
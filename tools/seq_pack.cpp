@@ -0,0 +1,64 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <boost/program_options.hpp>
+
+#include "frame_source.h"
+#include "seq_file.h"
+
+
+// Packs a directory of .pcd files (and their .json annotations) into a single .seq file for cloud_viewer.
+int main(int argc, char *argv[])
+{
+    namespace bops = boost::program_options;
+
+    bops::options_description description("options");
+    description.add_options()
+        ("help,h", "show help")
+        ("pcd_path,",
+        bops::value<std::string>(),
+        "path to pcd file or directory in which pcd files exist")
+        ("annotation_path,",
+        bops::value<std::string>()->default_value(""),
+        "path to directory in which annotation files exist")
+        ("output,o",
+        bops::value<std::string>(),
+        "packed sequence file to write, e.g. log.seq");
+
+    bops::variables_map vm;
+    try
+    {
+        bops::store(bops::parse_command_line(argc, argv, description), vm);
+        bops::notify(vm);
+    }
+    catch (const bops::error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help") || !vm.count("pcd_path") || !vm.count("output"))
+    {
+        std::cout << "usage:\n"
+                  << argv[0] << " --pcd_path [path/to/pcd_directory] --annotation_path [path/to/json_directory] --output log.seq" << std::endl;
+        std::cout << description << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    try
+    {
+        PcdFileSource source(find_pcd_files(vm["pcd_path"].as<std::string>()), vm["annotation_path"].as<std::string>());
+        if (source.size() == 0)
+        {
+            std::cerr << "Point cloud doesn't exist in given path." << std::endl;
+            return 1;
+        }
+        int packed = write_seq_file(vm["output"].as<std::string>(), source);
+        return packed == source.size() ? 0 : 1;
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}